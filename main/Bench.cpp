@@ -0,0 +1,119 @@
+#include "Bench.h"
+
+#if defined(__MANUVR_LINUX)
+  #include <time.h>
+#else
+  #include "sdkconfig.h"
+  #include "esp_timer.h"
+  #include <xtensa/hal.h>
+  #if defined(CONFIG_HEAP_TRACING_STANDALONE)
+    #include "esp_heap_trace.h"
+  #endif
+#endif
+
+static BenchPump         _pump          = nullptr;
+static BenchAllocCounter _alloc_counter = nullptr;
+static uint32_t          _alloc_mark    = 0;
+
+
+void bench_set_pump(BenchPump p) {                   _pump = p;            }
+void bench_set_alloc_counter(BenchAllocCounter c) {  _alloc_counter = c;   }
+bool bench_has_pump() {                              return (nullptr != _pump);   }
+
+void bench_pump() {
+  if (nullptr != _pump) _pump();
+}
+
+
+/*******************************************************************************
+* Platform primitives                                                          *
+*******************************************************************************/
+#if defined(__MANUVR_LINUX)
+
+uint64_t bench_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* No cycle counter that means the same thing on every host. */
+uint32_t bench_cycles() {   return 0;   }
+
+void bench_alloc_begin() {
+  if (nullptr != _alloc_counter) _alloc_mark = _alloc_counter();
+}
+
+int32_t bench_alloc_end(bool* floor) {
+  *floor = false;
+  return (nullptr != _alloc_counter) ? (int32_t) (_alloc_counter() - _alloc_mark) : -1;
+}
+
+#else
+
+uint64_t bench_ns() {       return (uint64_t) esp_timer_get_time() * 1000;   }
+uint32_t bench_cycles() {   return xthal_get_ccount();   }
+
+#if defined(CONFIG_HEAP_TRACING_STANDALONE)
+static heap_trace_record_t _heap_records[BENCH_HEAP_RECORDS];
+static bool _heap_trace_ready = false;
+
+void bench_alloc_begin() {
+  if (!_heap_trace_ready) {
+    _heap_trace_ready = (ESP_OK == heap_trace_init_standalone(_heap_records, BENCH_HEAP_RECORDS));
+  }
+  if (_heap_trace_ready) {
+    heap_trace_start(HEAP_TRACE_ALL);
+  }
+}
+
+int32_t bench_alloc_end(bool* floor) {
+  *floor = false;
+  if (!_heap_trace_ready) return -1;
+  heap_trace_stop();
+  const size_t n = heap_trace_get_count();
+  *floor = (BENCH_HEAP_RECORDS <= n);
+  return (int32_t) n;
+}
+
+#else
+
+void    bench_alloc_begin() {}
+int32_t bench_alloc_end(bool* floor) {
+  *floor = false;
+  return -1;
+}
+
+#endif  // CONFIG_HEAP_TRACING_STANDALONE
+#endif  // __MANUVR_LINUX
+
+
+/*******************************************************************************
+* Output                                                                       *
+*******************************************************************************/
+
+void bench_print_header(StringBuilder* output) {
+  output->concat("\tOperation                   Calls      ns/call  cycles/call  allocs/call\n");
+}
+
+
+void bench_print(StringBuilder* output, const char* name, BenchResult* r) {
+  if (0 == r->calls) {
+    output->concatf("\t%-24s  (skipped)\n", name);
+    return;
+  }
+  output->concatf("\t%-24s %7u %12u", name, r->calls, (uint32_t) (r->ns / r->calls));
+  if (0 < r->cycles) {
+    output->concatf(" %12u", (uint32_t) (r->cycles / r->calls));
+  }
+  else {
+    output->concat("            -");
+  }
+  if ((0 > r->allocs) || (0 == r->alloc_calls)) {
+    output->concat("            ?\n");
+  }
+  else {
+    output->concatf("  %s%9u.%02u\n", (r->alloc_floor ? ">=" : "  "),
+      r->allocs / r->alloc_calls, ((r->allocs % r->alloc_calls) * 100) / r->alloc_calls
+    );
+  }
+}
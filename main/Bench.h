@@ -0,0 +1,118 @@
+/*
+File:   Bench.h
+Author: J. Ian Lindsay
+Date:   2019.09.21
+
+Timing and allocation counts for single operations, as run by the
+  provisioner's 'Z' command and by the host benchmark (sim/main-bench.cpp).
+
+bench_run() calls an operation some number of times, and reports the mean
+  time per call in nanoseconds (and in CPU cycles, on the ESP32). Then it calls
+  it a few more times while counting heap allocations. Those calls are not
+  timed, as counting has a cost of its own.
+
+Allocations are counted by whatever the build provides:
+  ESP32: The heap tracer, if CONFIG_HEAP_TRACING_STANDALONE is set. Its
+         buffer holds BENCH_HEAP_RECORDS, so a count that fills it is a floor.
+  Host:  A counter registered with bench_set_alloc_counter(). The benchmark
+         build wraps malloc() to provide one.
+  Without either, allocations are reported as unknown.
+
+Some operations leave work on the I2C queue. Those are passed a pump, which
+  runs the kernel until the bus goes quiet. They are called no more than
+  BENCH_PUMPED_CALLS times. If there is no pump (as from the console, where
+  the kernel is busy running us), they are called only once.
+*/
+
+#ifndef __SX8634_BENCH_H__
+#define __SX8634_BENCH_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define BENCH_ITERATIONS        1000   // Default timed calls for each operation.
+#define BENCH_ALLOC_CALLS          4   // Calls made while counting allocations.
+#define BENCH_HEAP_RECORDS        64   // ESP32 heap trace depth.
+#define BENCH_STORAGE_WRITES      16   // Most writes made to flash-backed storage.
+#define BENCH_PUMPED_CALLS        16   // Most calls to an operation that needs the pump.
+
+typedef void     (*BenchPump)();
+typedef uint32_t (*BenchAllocCounter)();
+
+typedef struct {
+  uint32_t calls;
+  uint64_t ns;       // Total for the timed calls.
+  uint64_t cycles;   // Zero where there is no cycle counter.
+  uint32_t alloc_calls;
+  int32_t  allocs;        // Over alloc_calls calls. -1 if unknown.
+  bool     alloc_floor;   // Some count filled the trace buffer.
+} BenchResult;
+
+
+void bench_set_pump(BenchPump);
+void bench_set_alloc_counter(BenchAllocCounter);
+bool bench_has_pump();
+void bench_pump();
+
+uint64_t bench_ns();
+uint32_t bench_cycles();
+void     bench_alloc_begin();
+int32_t  bench_alloc_end(bool* floor);
+
+void bench_print_header(StringBuilder*);
+void bench_print(StringBuilder*, const char* name, BenchResult*);
+
+
+/*
+* @param pumped  The operation leaves work on the bus. Pump it between calls.
+*/
+template <typename F> void bench_run(BenchResult* r, uint32_t calls, bool pumped, F op) {
+  if (pumped && (1 < calls)) {
+    calls = bench_has_pump() ? ((BENCH_PUMPED_CALLS < calls) ? BENCH_PUMPED_CALLS : calls) : 1;
+  }
+  r->calls = calls;
+  const uint32_t c0 = bench_cycles();
+  uint64_t ns = 0;
+  uint32_t cycles = 0;
+  uint64_t t0 = bench_ns();
+  for (uint32_t i = 0; i < calls; i++) {
+    if (pumped) {
+      // Only the call is timed. Not the bus work it leaves behind.
+      const uint64_t t1 = bench_ns();
+      const uint32_t c1 = bench_cycles();
+      op();
+      ns     += bench_ns() - t1;
+      cycles += bench_cycles() - c1;
+      bench_pump();
+    }
+    else {
+      op();
+    }
+  }
+  if (!pumped) {
+    ns     = bench_ns() - t0;
+    cycles = bench_cycles() - c0;
+  }
+  r->ns     = ns;
+  r->cycles = cycles;
+
+  r->allocs      = 0;
+  r->alloc_floor = false;
+  r->alloc_calls = (calls < BENCH_ALLOC_CALLS) ? calls : BENCH_ALLOC_CALLS;
+  for (uint32_t i = 0; i < r->alloc_calls; i++) {
+    bool floor = false;
+    bench_alloc_begin();
+    op();
+    const int32_t n = bench_alloc_end(&floor);
+    if (0 > n) {
+      r->allocs = -1;
+      break;
+    }
+    r->allocs      += n;
+    r->alloc_floor |= floor;
+    if (pumped) bench_pump();
+  }
+}
+
+#endif  // __SX8634_BENCH_H__
@@ -0,0 +1,245 @@
+#include "BlobDirectory.h"
+#include "IoCore.h"
+#include <stdio.h>
+#include <string.h>
+
+
+BlobDirectory::BlobDirectory() {
+  memset(_records, 0, sizeof(_records));
+  _hdr.magic       = BLOB_DIR_MAGIC;
+  _hdr.version     = BLOB_DIR_VERSION;
+  _hdr.record_size = sizeof(BlobRecord);
+  _hdr.used        = 0;
+  _rebuild_index();
+}
+
+
+/*
+* CRC-8, polynomial 0x07.
+*/
+uint8_t BlobDirectory::crc8(const uint8_t* buf, uint16_t len) {
+  uint8_t crc = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+/*
+* FNV-1a
+*/
+uint32_t BlobDirectory::hashName(const char* name) {
+  uint32_t h = 2166136261UL;
+  for (uint8_t i = 0; (i < BLOB_DIR_NAME_LEN) && (0 != name[i]); i++) {
+    h = (h ^ (uint8_t) name[i]) * 16777619UL;
+  }
+  return h;
+}
+
+
+/*******************************************************************************
+* Index                                                                        *
+*******************************************************************************/
+
+/*
+* @return The record's position in the array, or -1 if there is no live record
+*   by that name.
+*/
+int BlobDirectory::_lookup(const char* name) {
+  uint32_t i = hashName(name) & (BLOB_DIR_HASH_SLOTS - 1);
+  while (BLOB_DIR_HASH_EMPTY != _hash[i]) {
+    const uint16_t rec = _hash[i];
+    if ((BLOB_DIR_HASH_DROPPED != rec) && (0 == strncmp(name, _records[rec].name, BLOB_DIR_NAME_LEN))) {
+      return rec;
+    }
+    i = (i + 1) & (BLOB_DIR_HASH_SLOTS - 1);
+  }
+  return -1;
+}
+
+
+/* Takes the first free bucket, which might be one that was dropped. */
+void BlobDirectory::_index(uint16_t rec) {
+  uint32_t i = hashName(_records[rec].name) & (BLOB_DIR_HASH_SLOTS - 1);
+  while ((BLOB_DIR_HASH_EMPTY != _hash[i]) && (BLOB_DIR_HASH_DROPPED != _hash[i])) {
+    i = (i + 1) & (BLOB_DIR_HASH_SLOTS - 1);
+  }
+  _hash[i] = rec;
+}
+
+
+void BlobDirectory::_rebuild_index() {
+  memset(_hash, 0xFF, sizeof(_hash));
+  _live = 0;
+  for (uint16_t i = 0; i < _hdr.used; i++) {
+    if (_records[i].flags & BLOB_DIR_REC_LIVE) {
+      _index(i);
+      _live++;
+    }
+  }
+}
+
+
+const BlobRecord* BlobDirectory::find(const char* name) {
+  const int rec = _lookup(name);
+  return (0 > rec) ? nullptr : &_records[rec];
+}
+
+
+/*******************************************************************************
+* Storage                                                                      *
+*******************************************************************************/
+
+/* Key must have room for 16 bytes. */
+void BlobDirectory::_record_key(char* key, uint16_t rec) {
+  snprintf(key, 16, BLOB_DIR_RECORD_KEY, rec);
+}
+
+
+/*
+* Reads the directory from storage. A missing or foreign directory leaves us
+*   with an empty one, which will replace it on the first save.
+*
+* @return 0 on success, -1 if there was no directory, -2 if it was unreadable.
+*/
+int8_t BlobDirectory::load(Storage* store) {
+  BlobDirHeader hdr;
+  _hdr.used = 0;
+  int rlen = io_core_read(store, BLOB_DIR_STORAGE_KEY, (uint8_t*) &hdr, sizeof(hdr), 0);
+  if ((int) sizeof(hdr) != rlen) {
+    _rebuild_index();
+    return -1;
+  }
+  if ((BLOB_DIR_MAGIC != hdr.magic) || (BLOB_DIR_VERSION != hdr.version) || (sizeof(BlobRecord) != hdr.record_size) || (BLOB_DIR_MAX_RECORDS < hdr.used)) {
+    _rebuild_index();
+    return -2;
+  }
+  char key[16];
+  for (uint16_t i = 0; i < hdr.used; i++) {
+    _record_key(key, i);
+    rlen = io_core_read(store, key, (uint8_t*) &_records[i], sizeof(BlobRecord), 0);
+    if ((int) sizeof(BlobRecord) != rlen) {
+      _rebuild_index();
+      return -2;
+    }
+  }
+  _hdr.used = hdr.used;
+  _rebuild_index();
+  return 0;
+}
+
+
+int8_t BlobDirectory::_write_header(Storage* store) {
+  const int wlen = io_core_write(store, BLOB_DIR_STORAGE_KEY, (uint8_t*) &_hdr, sizeof(_hdr), 0);
+  return (((int) sizeof(_hdr) == wlen) ? 0 : -1);
+}
+
+
+int8_t BlobDirectory::_write_records(Storage* store, uint16_t first, uint16_t n) {
+  char key[16];
+  for (uint16_t i = first; i < (first + n); i++) {
+    _record_key(key, i);
+    const int wlen = io_core_write(store, key, (uint8_t*) &_records[i], sizeof(BlobRecord), 0);
+    if ((int) sizeof(BlobRecord) != wlen) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/*
+* Squeezes dropped records out of the array, and writes the whole directory.
+*   Keys past the new end of the array are left as they are. Nothing reads
+*   them, and they are overwritten as the array grows back.
+*/
+int8_t BlobDirectory::_compact(Storage* store) {
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < _hdr.used; i++) {
+    if (_records[i].flags & BLOB_DIR_REC_LIVE) {
+      if (n != i) {
+        _records[n] = _records[i];
+      }
+      n++;
+    }
+  }
+  _hdr.used = n;
+  _rebuild_index();
+  if ((0 < n) && (0 != _write_records(store, 0, n))) {
+    return -1;
+  }
+  return _write_header(store);
+}
+
+
+/*
+* Records a blob that has just been stored. If the name is already known, its
+*   record is updated where it stands. Otherwise one is appended.
+*
+* @return 0 on success, -1 on bad name, -2 if the directory is full, -3 on
+*   storage failure.
+*/
+int8_t BlobDirectory::put(Storage* store, const char* name, const uint8_t* blob, uint16_t len) {
+  const size_t name_len = strlen(name);
+  if ((0 == name_len) || (BLOB_DIR_NAME_LEN <= name_len)) {
+    return -1;
+  }
+  int rec = _lookup(name);
+  if (0 > rec) {
+    if ((BLOB_DIR_MAX_RECORDS <= _hdr.used) && (BLOB_DIR_MAX_RECORDS > _live)) {
+      if (0 != _compact(store)) return -3;
+    }
+    if (BLOB_DIR_MAX_RECORDS <= _hdr.used) {
+      return -2;
+    }
+    rec = _hdr.used++;
+    memset(&_records[rec], 0, sizeof(BlobRecord));
+    memcpy(_records[rec].name, name, name_len);
+    _index(rec);
+    _live++;
+  }
+  BlobRecord* r = &_records[rec];
+  r->timestamp = epochTime();
+  r->len       = len;
+  r->crc       = crc8(blob, len);
+  r->flags     = BLOB_DIR_REC_LIVE;
+  if (0 != _write_records(store, rec, 1)) return -3;
+  return ((0 == _write_header(store)) ? 0 : -3);
+}
+
+
+/*
+* Marks a blob's record as dropped. The blob itself is the caller's to erase.
+*
+* @return 0 on success, -1 if there is no such blob, -3 on storage failure.
+*/
+int8_t BlobDirectory::drop(Storage* store, const char* name) {
+  uint32_t i = hashName(name) & (BLOB_DIR_HASH_SLOTS - 1);
+  while (BLOB_DIR_HASH_EMPTY != _hash[i]) {
+    const uint16_t rec = _hash[i];
+    if ((BLOB_DIR_HASH_DROPPED != rec) && (0 == strncmp(name, _records[rec].name, BLOB_DIR_NAME_LEN))) {
+      _hash[i] = BLOB_DIR_HASH_DROPPED;
+      _records[rec].flags &= ~BLOB_DIR_REC_LIVE;
+      _live--;
+      return ((0 == _write_records(store, rec, 1)) ? 0 : -3);
+    }
+    i = (i + 1) & (BLOB_DIR_HASH_SLOTS - 1);
+  }
+  return -1;
+}
+
+
+void BlobDirectory::printDirectory(StringBuilder* output) {
+  output->concatf("%u SPM blobs (%u of %u records used)%s\n", _live, _hdr.used, BLOB_DIR_MAX_RECORDS, PRINT_DIVIDER_1_STR);
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < _hdr.used; i++) {
+    const BlobRecord* r = &_records[i];
+    if (r->flags & BLOB_DIR_REC_LIVE) {
+      output->concatf("\t%3u: %-15s  %3u bytes  CRC 0x%02x  saved at %u\n", n++, r->name, r->len, r->crc, r->timestamp);
+    }
+  }
+}
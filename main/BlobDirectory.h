@@ -0,0 +1,98 @@
+/*
+File:   BlobDirectory.h
+Author: J. Ian Lindsay
+Date:   2019.09.08
+
+The index of SPM blobs kept in platform storage.
+
+The directory is a header followed by an array of fixed-size records. The
+  header is stored under its own key, and each record under a key of its own
+  that is derived from its position in the array, in the same form as they are
+  held in memory (see io_core_write() for why). Nothing is ever parsed. A new
+  record is written alone, followed by the header, so saving a blob costs the
+  same with three blobs in storage as it does with three hundred.
+
+Records are found by name through an open-addressed hash table that is built
+  when the directory is loaded. Dropped records are marked as such, and stay in
+  the array until it fills, at which point the directory is compacted and
+  written whole.
+
+The blobs themselves are stored under their own names, as they always were.
+  The record holds each blob's length, CRC, and when it was saved, so a blob
+  that was damaged in storage can be told apart from a good one. A blob saved
+  before there was a directory has no record, and is adopted when it is first
+  loaded by name.
+*/
+
+#ifndef __SX8634_BLOB_DIRECTORY_H__
+#define __SX8634_BLOB_DIRECTORY_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define BLOB_DIR_STORAGE_KEY   "blobdir"
+#define BLOB_DIR_RECORD_KEY    "blobdir.%u"  // Record keys. At most 11 characters.
+#define BLOB_DIR_MAGIC         0x44425853   // "SXBD", little-endian.
+#define BLOB_DIR_VERSION       2            // 1 kept the records at offsets under the header's key.
+#define BLOB_DIR_NAME_LEN      16           // Including the terminator.
+#define BLOB_DIR_MAX_RECORDS   384
+#define BLOB_DIR_HASH_SLOTS    1024         // Must be a power of two, and well over the record count.
+
+#define BLOB_DIR_HASH_EMPTY    0xFFFF
+#define BLOB_DIR_HASH_DROPPED  0xFFFE
+
+/* Record flags */
+#define BLOB_DIR_REC_LIVE      0x01
+
+
+typedef struct {
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  record_size;
+  uint16_t used;           // Records in the array, live or not.
+} BlobDirHeader;
+
+typedef struct {
+  char     name[BLOB_DIR_NAME_LEN];
+  uint32_t timestamp;      // Epoch seconds at save.
+  uint16_t len;
+  uint8_t  crc;            // CRC-8 of the blob.
+  uint8_t  flags;
+} BlobRecord;
+
+
+class BlobDirectory {
+  public:
+    BlobDirectory();
+
+    int8_t load(Storage*);
+    int8_t put(Storage*, const char* name, const uint8_t* blob, uint16_t len);
+    int8_t drop(Storage*, const char* name);
+    const BlobRecord* find(const char* name);
+
+    inline uint16_t count() {   return _live;   };
+
+    void printDirectory(StringBuilder*);
+
+    static uint8_t  crc8(const uint8_t*, uint16_t len);
+    static uint32_t hashName(const char*);
+
+
+  private:
+    BlobDirHeader _hdr;
+    uint16_t      _live = 0;
+    uint16_t      _hash[BLOB_DIR_HASH_SLOTS];
+    BlobRecord    _records[BLOB_DIR_MAX_RECORDS];
+
+    int    _lookup(const char* name);
+    void   _index(uint16_t rec);
+    void   _rebuild_index();
+    int8_t _compact(Storage*);
+    int8_t _write_header(Storage*);
+    int8_t _write_records(Storage*, uint16_t first, uint16_t n);
+
+    static void _record_key(char* key, uint16_t rec);
+};
+
+#endif  // __SX8634_BLOB_DIRECTORY_H__
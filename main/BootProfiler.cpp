@@ -0,0 +1,163 @@
+#include "BootProfiler.h"
+#include "SX8634Conf.h"
+
+static const char* const PHASE_STR[BOOT_PROF_PHASES] = {
+  "first INTB", "first ACK", "SPM read"
+};
+
+static const char* const CLASS_STR[2] = {
+  "Blank NVM (QSM)", "Provisioned NVM"
+};
+
+
+BootProfiler::BootProfiler() {
+  _boards[0] = 0;
+  _boards[1] = 0;
+}
+
+
+/*
+* The slot must be parked, and hold its bus. Results of any earlier profile are
+*   discarded.
+*/
+int8_t BootProfiler::start(ProvisionerSlot* slot, uint16_t cycles, bool by_reset) {
+  if (running() || (0 == cycles) || (SlotState::PARKED != slot->state()) || !slot->holdsBus()) {
+    return -1;
+  }
+  _slot     = slot;
+  _cycles   = cycles;
+  _by_reset = by_reset;
+  _done     = 0;
+  _timeouts = 0;
+  for (uint8_t c = 0; c < 2; c++) {
+    _boards[c] = 0;
+    for (uint8_t i = 0; i < BOOT_PROF_PHASES; i++) {
+      _hist[c][i].reset();
+    }
+  }
+  // Start from a board that is powered down (or has been idle for a moment).
+  _slot->power(by_reset);
+  _state    = BootProfState::DWELL;
+  _state_ms = millis();
+  return 0;
+}
+
+
+/*
+* Leaves the board powered, as it was found.
+*/
+void BootProfiler::stop() {
+  if (running()) {
+    if (!_by_reset && (BootProfState::DWELL == _state)) {
+      _slot->power(true);
+      _slot->bootBoard();
+    }
+    _state = BootProfState::IDLE;
+  }
+}
+
+
+/*
+* @return 1 if the profile just finished, 0 otherwise.
+*/
+int8_t BootProfiler::poll(uint32_t now) {
+  SX8634Jig* touch = &_slot->touch;
+  switch (_state) {
+    case BootProfState::DWELL:
+      if ((now - _state_ms) >= BOOT_PROF_DWELL_MS) {
+        _begin_cycle(now);
+      }
+      break;
+
+    case BootProfState::BOOTING:
+      if (touch->observed(SX8634_JIG_OBS_SPM_READ) && touch->mirrorValid()) {
+        _end_cycle(now);
+      }
+      else if ((now - _state_ms) >= BOOT_PROF_TIMEOUT_MS) {
+        _timeouts++;
+        _done++;
+        if (!_by_reset) {
+          _slot->power(false);
+        }
+        _state_ms = now;
+        _state = BootProfState::DWELL;
+      }
+      else if (!touch->observed(SX8634_JIG_OBS_ACK) && ((now - _ping_ms) >= BOOT_PROF_PING_MS)) {
+        _ping_ms = now;
+        touch->ping();
+      }
+      break;
+
+    default:
+      return 0;
+  }
+
+  if ((BootProfState::DWELL == _state) && (_done >= _cycles)) {
+    stop();
+    return 1;
+  }
+  return 0;
+}
+
+
+void BootProfiler::_begin_cycle(uint32_t now) {
+  SX8634Jig* touch = &_slot->touch;
+  touch->clearObservations();
+  touch->invalidateMirror();
+  latency_irq_take();   // A stale stamp would keep the ISR from noting this boot's edge.
+  _t0 = edge_clock_us();
+  if (!_by_reset) {
+    _slot->power(true);
+  }
+  _slot->bootBoard();
+  _state_ms = now;
+  _ping_ms  = now;
+  _state = BootProfState::BOOTING;
+}
+
+
+void BootProfiler::_end_cycle(uint32_t now) {
+  SX8634Jig* touch = &_slot->touch;
+  uint8_t cls;
+  if (touch->observed(SX8634_JIG_OBS_SPM_STAT)) {
+    cls = (touch->spmStat() & SX8634_SPM_STAT_NVM_VALID) ? BOOT_PROF_PROVISIONED : BOOT_PROF_BLANK;
+  }
+  else {
+    cls = (0 == SX8634Jig::compareApplicationBytes(touch->spmMirror(), SX8634_CONF_QSM)) ? BOOT_PROF_BLANK : BOOT_PROF_PROVISIONED;
+  }
+  const uint16_t flags[BOOT_PROF_PHASES] = {
+    SX8634_JIG_OBS_INTB, SX8634_JIG_OBS_ACK, SX8634_JIG_OBS_SPM_READ
+  };
+  for (uint8_t i = 0; i < BOOT_PROF_PHASES; i++) {
+    const uint64_t at = touch->observedAt(flags[i]);
+    if (at >= _t0) {
+      _hist[cls][i].add((uint32_t) (at - _t0));
+    }
+  }
+  _boards[cls]++;
+  _done++;
+  if (!_by_reset) {
+    _slot->power(false);
+  }
+  _state_ms = now;
+  _state = BootProfState::DWELL;
+}
+
+
+void BootProfiler::printResults(StringBuilder* output) {
+  output->concatf("Boot profile by %s: %u of %u cycles done, %u timed out.\n",
+    (_by_reset ? "reset" : "power"), _done, _cycles, _timeouts
+  );
+  for (uint8_t c = 0; c < 2; c++) {
+    if (0 == _boards[c]) continue;
+    output->concatf("%s, %u boots. Time from %s (us):\n", CLASS_STR[c], _boards[c], (_by_reset ? "reset" : "power"));
+    output->concat("\tPhase           Count      p50      p90      p99      max\n");
+    for (uint8_t i = 0; i < BOOT_PROF_PHASES; i++) {
+      LatencyHistogram* h = &_hist[c][i];
+      output->concatf("\t%-12s %8u %8u %8u %8u %8u\n",
+        PHASE_STR[i], h->count(), h->percentile(50), h->percentile(90),
+        h->percentile(99), h->max()
+      );
+    }
+  }
+}
@@ -0,0 +1,88 @@
+/*
+File:   BootProfiler.h
+Author: J. Ian Lindsay
+Date:   2019.09.15
+
+Measures how long an SX8634 takes to come up, over many cycles.
+
+Each cycle starts at the moment the board is powered (or reset, if asked), and
+  ends when the driver has read the whole SPM. Along the way, the jig notes
+  the first INTB edge, the first transfer that the board ACKs (it is pinged
+  until then), and the end of the SPM read. Each of those is put into a
+  histogram, as time since the start of the cycle.
+
+The INTB edge is the one LatencyProbe's ISR stamps, not the IrqSrc read that
+  follows it. Only the slot whose INTB is routed to the wake pin has an ISR,
+  so boards in other slots have no samples in that phase.
+
+Results are kept separately for boards with and without a valid NVM, as a
+  blank part loads its SPM from QSM. If the driver read SpmStat during boot,
+  its NvmValid bit decides. Otherwise, a board whose SPM matches QSM is taken
+  to be blank.
+
+This is what CONFIG_SX8634_CONFIG_ON_FAITH would save: the time between the
+  first ACK and the end of the SPM read.
+*/
+
+#ifndef __SX8634_BOOT_PROFILER_H__
+#define __SX8634_BOOT_PROFILER_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "ProvisionerSlot.h"
+#include "LatencyProbe.h"
+
+#define BOOT_PROF_TIMEOUT_MS   1500   // A cycle that takes longer is abandoned.
+#define BOOT_PROF_DWELL_MS      100   // Between cycles. With power removed, if cycling power.
+#define BOOT_PROF_SVC_MS          1   // Service period while profiling.
+#define BOOT_PROF_PING_MS         5   // Pings until the first ACK.
+
+#define BOOT_PROF_PHASE_IRQ       0
+#define BOOT_PROF_PHASE_ACK       1
+#define BOOT_PROF_PHASE_SPM       2
+#define BOOT_PROF_PHASES          3
+
+#define BOOT_PROF_BLANK           0   // Board classes
+#define BOOT_PROF_PROVISIONED     1
+
+#define SX8634_SPM_STAT_NVM_VALID 0x08
+
+
+enum class BootProfState : uint8_t {
+  IDLE,
+  DWELL,     // Between cycles.
+  BOOTING    // Waiting for the SPM read.
+};
+
+
+class BootProfiler {
+  public:
+    BootProfiler();
+
+    int8_t start(ProvisionerSlot*, uint16_t cycles, bool by_reset);
+    void   stop();
+    int8_t poll(uint32_t now);
+    inline bool running() {   return (BootProfState::IDLE != _state);   };
+
+    void printResults(StringBuilder*);
+
+
+  private:
+    ProvisionerSlot* _slot     = nullptr;
+    BootProfState    _state    = BootProfState::IDLE;
+    bool             _by_reset = false;
+    uint16_t         _cycles   = 0;
+    uint16_t         _done     = 0;
+    uint16_t         _timeouts = 0;
+    uint32_t         _state_ms = 0;
+    uint32_t         _ping_ms  = 0;
+    uint64_t         _t0       = 0;   // When power (or reset) was applied.
+    uint16_t         _boards[2];
+    LatencyHistogram _hist[2][BOOT_PROF_PHASES];
+
+    void _begin_cycle(uint32_t now);
+    void _end_cycle(uint32_t now);
+};
+
+#endif  // __SX8634_BOOT_PROFILER_H__
@@ -0,0 +1,202 @@
+#include "CapMonitor.h"
+#include "EventStream.h"
+#include "EdgeRing.h"
+#include <string.h>
+
+static const uint8_t FRAME_MARKER[3] = { 0xD9, 0xD9, 0xF7 };   // tag 55799
+
+
+CapMonitor::CapMonitor() {
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    _comp[i] = 0;
+    _reset(&_total[i]);
+    _reset(&_window[i]);
+    _reset(&_last[i]);
+  }
+}
+
+
+void CapMonitor::_reset(CapMonStats* s) {
+  memset(s, 0, sizeof(CapMonStats));
+  s->diff_min = 32767;
+  s->diff_max = -32768;
+}
+
+
+void CapMonitor::_tally(CapMonStats* s, uint16_t useful, uint16_t avg, int16_t diff) {
+  s->count++;
+  s->diff_sum   += diff;
+  s->diff_sumsq += (uint64_t) ((int32_t) diff * (int32_t) diff);
+  s->useful_sum += useful;
+  s->avg_sum    += avg;
+  if (diff < s->diff_min) s->diff_min = diff;
+  if (diff > s->diff_max) s->diff_max = diff;
+}
+
+
+int32_t CapMonitor::diffMean(const CapMonStats* s) {
+  if (0 == s->count) return 0;
+  const double mean = (double) s->diff_sum / s->count;
+  return (int32_t) ((0 > mean) ? (mean - 0.5) : (mean + 0.5));
+}
+
+
+/* Population variance. Done in double, as the square of the sum overflows. */
+uint32_t CapMonitor::diffVariance(const CapMonStats* s) {
+  if (0 == s->count) return 0;
+  const double mean = (double) s->diff_sum / s->count;
+  const double var  = ((double) s->diff_sumsq / s->count) - (mean * mean);
+  return (0 < var) ? (uint32_t) (var + 0.5) : 0;
+}
+
+
+/*
+* Forgets any earlier run.
+*
+* @param decimation  Full sweeps of all channels per window.
+*/
+int8_t CapMonitor::start(uint8_t slot, uint16_t decimation) {
+  if (_running) return -1;
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    _comp[i] = 0;
+    _reset(&_total[i]);
+    _reset(&_window[i]);
+    _reset(&_last[i]);
+  }
+  _slot          = slot;
+  _chan          = CAPMON_CHANNELS - 1;
+  _decimation    = (0 < decimation) ? decimation : CAPMON_DECIMATION;
+  _window_sweeps = 0;
+  _samples       = 0;
+  _faults        = 0;
+  _sweeps        = 0;
+  _windows       = 0;
+  _frames        = 0;
+  _frames_lost   = 0;
+  _frame_ready   = false;
+  _t_start       = edge_clock_us();
+  _t_last        = _t_start;
+  _running       = true;
+  return 0;
+}
+
+
+void CapMonitor::stop() {
+  _running = false;
+  poll();
+}
+
+
+/*
+* The console can't rewrite line endings while frames are on it.
+*/
+void CapMonitor::streaming(bool x) {
+  if (x == _streaming) return;
+  _streaming = x;
+  evstream_binary_mode(x);
+}
+
+
+uint8_t CapMonitor::nextChannel() {
+  _chan = (_chan + 1) % CAPMON_CHANNELS;
+  return _chan;
+}
+
+
+/*
+* @param regs  The eight bytes from CapSenseUsefulDataMsb onward.
+*/
+void CapMonitor::addSample(uint8_t chan, const uint8_t* regs) {
+  if (!_running || (CAPMON_CHANNELS <= chan)) return;
+  const uint16_t useful = ((uint16_t) regs[0] << 8) | regs[1];
+  const uint16_t avg    = ((uint16_t) regs[2] << 8) | regs[3];
+  const int16_t  diff   = (int16_t) (((uint16_t) regs[4] << 8) | regs[5]);
+  _comp[chan] = ((uint16_t) regs[6] << 8) | regs[7];
+  _tally(&_total[chan], useful, avg, diff);
+  _tally(&_window[chan], useful, avg, diff);
+  _samples++;
+  _t_last = edge_clock_us();
+
+  if ((CAPMON_CHANNELS - 1) == chan) {
+    _sweeps++;
+    if (++_window_sweeps >= _decimation) {
+      if (_streaming) {
+        if (_frame_ready) {
+          _frames_lost++;
+        }
+        else {
+          _build_frame();
+        }
+      }
+      memcpy(_last, _window, sizeof(_last));
+      for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+        _reset(&_window[i]);
+      }
+      _window_sweeps = 0;
+      _windows++;
+    }
+  }
+}
+
+
+/*
+* Samples arrive in the jig's bus callbacks. Frames are only built there, and
+*   are written from here.
+*/
+void CapMonitor::poll() {
+  if (_frame_ready) {
+    evstream_write(_frame, _frame_len);
+    _frames++;
+    _frame_ready = false;
+  }
+}
+
+
+void CapMonitor::_build_frame() {
+  uint16_t len = sizeof(FRAME_MARKER);
+  memcpy(_frame, FRAME_MARKER, len);
+  len += cbor_put_head(&_frame[len], CBOR_ARRAY, 4);
+  len += cbor_put_head(&_frame[len], CBOR_UINT, _t_last);
+  len += cbor_put_head(&_frame[len], CBOR_UINT, _slot);
+  len += cbor_put_head(&_frame[len], CBOR_UINT, _window_sweeps);
+  len += cbor_put_head(&_frame[len], CBOR_ARRAY, CAPMON_CHANNELS);
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    const CapMonStats* s = &_window[i];
+    len += cbor_put_head(&_frame[len], CBOR_ARRAY, 6);
+    len += cbor_put_int(&_frame[len], diffMean(s));
+    len += cbor_put_head(&_frame[len], CBOR_UINT, diffVariance(s));
+    len += cbor_put_int(&_frame[len], (0 < s->count) ? s->diff_min : 0);
+    len += cbor_put_int(&_frame[len], (0 < s->count) ? s->diff_max : 0);
+    len += cbor_put_head(&_frame[len], CBOR_UINT, (0 < s->count) ? (s->useful_sum / s->count) : 0);
+    len += cbor_put_head(&_frame[len], CBOR_UINT, (0 < s->count) ? (s->avg_sum / s->count) : 0);
+  }
+  _frame_len   = len;
+  _frame_ready = true;
+}
+
+
+void CapMonitor::printStats(StringBuilder* output) {
+  const uint64_t elapsed = _t_last - _t_start;
+  output->concatf("CapSense monitor on slot %u (%s): %u samples, %u sweeps, %u faults",
+    _slot, (_running ? "running" : "stopped"), _samples, _sweeps, _faults
+  );
+  if (0 < elapsed) {
+    output->concatf(", %u samples/s", (uint32_t) (((uint64_t) _samples * 1000000) / elapsed));
+  }
+  output->concatf("\n\t%u sweeps per window. ", _decimation);
+  if (_streaming) {
+    output->concatf("Streaming: %u frames sent, %u lost.\n", _frames, _frames_lost);
+  }
+  else {
+    output->concat("Not streaming.\n");
+  }
+  output->concat("\tChan    Count  Diff mean  Diff var  Diff min  Diff max   Useful  Average     Comp\n");
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    const CapMonStats* s = &_total[i];
+    if (0 == s->count) continue;
+    output->concatf("\t%4u %8u %10d %9u %9d %9d %8u %8u %8u\n",
+      i, s->count, diffMean(s), diffVariance(s), s->diff_min, s->diff_max,
+      (uint32_t) (s->useful_sum / s->count), (uint32_t) (s->avg_sum / s->count), _comp[i]
+    );
+  }
+}
@@ -0,0 +1,118 @@
+/*
+File:   CapMonitor.h
+Author: J. Ian Lindsay
+Date:   2019.09.18
+
+Statistics on the raw CapSense data behind the SX8634's touch decisions.
+
+The chip exposes one channel at a time through its diagnostic registers: write
+  the channel to CapSenseChanSelect, then read UsefulData, AverageData,
+  DiffData and Compensation (two bytes each, MSB first). SX8634Jig does that
+  for every channel in turn, as fast as the bus will take it, and hands each
+  sample to this class.
+
+Only one channel is ever in flight. The next is queued when the last comes
+  back, so the driver's own IRQ servicing never waits behind more than two
+  short transfers.
+
+For each channel, this keeps the count, mean, variance, min and max of
+  DiffData (the figure the chip compares against its thresholds), and the
+  means of UsefulData and AverageData. Once for the whole run, and once for
+  each window of some number of full sweeps. If streaming, each window is
+  sent as a CBOR frame (see EventStream.h) that can share the console with
+  log text:
+
+  tag 55799
+  array(4) [
+    uint   The edge-clock time at the end of the window (us).
+    uint   Slot.
+    uint   Sweeps in the window.
+    array(12), one per channel:
+      [diff mean, diff variance, diff min, diff max, useful mean, average mean]
+  ]
+
+  Event batches are indefinite-length arrays, and these are not. So a reader
+  can tell them apart. Means and variance are rounded to integers.
+*/
+
+#ifndef __SX8634_CAP_MONITOR_H__
+#define __SX8634_CAP_MONITOR_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define CAPMON_CHANNELS         12
+#define CAPMON_DECIMATION       16   // Default sweeps per window.
+#define CAPMON_FRAME_MAX       320
+
+typedef struct {
+  uint32_t count;
+  int16_t  diff_min;
+  int16_t  diff_max;
+  int64_t  diff_sum;
+  uint64_t diff_sumsq;
+  uint64_t useful_sum;
+  uint64_t avg_sum;
+} CapMonStats;
+
+
+class CapMonitor {
+  public:
+    CapMonitor();
+
+    int8_t start(uint8_t slot, uint16_t decimation);
+    void   stop();
+    inline bool    running() {     return _running;     };
+    inline uint8_t slot() {        return _slot;        };
+    void streaming(bool);
+    inline bool    streaming() {   return _streaming;   };
+    inline uint32_t sweeps() {     return _sweeps;      };
+    inline uint32_t windows() {    return _windows;     };
+
+    /* The whole run, and the last window to finish. */
+    inline const CapMonStats* total(uint8_t chan) {        return &_total[chan % CAPMON_CHANNELS];  };
+    inline const CapMonStats* lastWindow(uint8_t chan) {   return &_last[chan % CAPMON_CHANNELS];   };
+
+    /* From the jig, as samples come in. */
+    uint8_t nextChannel();
+    void    addSample(uint8_t chan, const uint8_t* regs);
+    inline void addFault() {   _faults++;   };
+
+    void poll();
+    void printStats(StringBuilder*);
+
+    static int32_t  diffMean(const CapMonStats*);
+    static uint32_t diffVariance(const CapMonStats*);
+
+
+  private:
+    bool        _running     = false;
+    bool        _streaming   = false;
+    bool        _frame_ready = false;   // A frame is waiting for poll().
+    uint8_t     _slot        = 0;
+    uint8_t     _chan        = CAPMON_CHANNELS - 1;   // The last channel requested.
+    uint16_t    _decimation  = CAPMON_DECIMATION;
+    uint16_t    _window_sweeps = 0;
+    uint16_t    _frame_len   = 0;
+    uint32_t    _samples     = 0;
+    uint32_t    _faults      = 0;
+    uint32_t    _sweeps      = 0;
+    uint32_t    _windows     = 0;
+    uint32_t    _frames      = 0;
+    uint32_t    _frames_lost = 0;   // Windows that ended before the last frame went out.
+    uint64_t    _t_start     = 0;
+    uint64_t    _t_last      = 0;
+    uint16_t    _comp[CAPMON_CHANNELS];   // Latest Compensation for each channel.
+    CapMonStats _total[CAPMON_CHANNELS];
+    CapMonStats _window[CAPMON_CHANNELS];
+    CapMonStats _last[CAPMON_CHANNELS];
+    uint8_t     _frame[CAPMON_FRAME_MAX];
+
+    void _build_frame();
+
+    static void  _reset(CapMonStats*);
+    static void  _tally(CapMonStats*, uint16_t useful, uint16_t avg, int16_t diff);
+};
+
+#endif  // __SX8634_CAP_MONITOR_H__
@@ -0,0 +1,315 @@
+#include "CapTuner.h"
+#include "SX8634Conf.h"
+#include <string.h>
+
+
+CapTuner::CapTuner() {
+  memset(_name, 0, sizeof(_name));
+  memset(_chosen, 0, sizeof(_chosen));
+  memset(_points, 0, sizeof(_points));
+}
+
+
+/*
+* The slot must be parked, hold its bus, and have a board whose SPM is known.
+*   The monitor must not be in use.
+*
+* @param margin_x10  The least acceptable signal-to-noise-peak, in tenths.
+* @return 0 on success, -1 if we can't start, -2 if no CAP channel is enabled.
+*/
+int8_t CapTuner::start(ProvisionerSlot* slot, CapMonitor* mon, const char* name, uint16_t margin_x10, uint8_t lowest, uint8_t highest) {
+  if (running() || mon->running() || (SlotState::PARKED != slot->state()) || !slot->holdsBus()) {
+    return -1;
+  }
+  if ((lowest > highest) || (CAP_TUNER_LEVELS <= highest) || (sizeof(_name) <= strlen(name))) {
+    return -1;
+  }
+  if (0 != slot->touch.copySPM(_base)) {
+    return -1;
+  }
+  _chans = 0;
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    const uint8_t mode = (_base[SX8634_SPM_CAP_MODE - (i >> 2)] >> ((i & 3) << 1)) & 0x03;
+    if (SX8634_CAP_MODE_DISABLED != mode) {
+      _chans |= (1 << i);
+    }
+  }
+  if (0 == _chans) {
+    return -2;
+  }
+  strncpy(_name, name, sizeof(_name) - 1);
+  _slot    = slot;
+  _monitor = mon;
+  _margin  = (0 < margin_x10) ? margin_x10 : CAP_TUNER_MARGIN_X10;
+  _lowest  = lowest;
+  _highest = highest;
+  _level   = lowest;
+  _short   = 0;
+  _done    = false;
+  memset(_points, 0, sizeof(_points));
+  memcpy(_result, _base, 128);
+  return _begin_level(millis());
+}
+
+
+/*
+* Abandons the sweep. The board keeps whatever level it was last given.
+*/
+void CapTuner::stop() {
+  if (running()) {
+    _monitor_stop();
+    _state = CapTunerState::IDLE;
+  }
+}
+
+
+/*
+* @return 1 if the sweep just finished, and result() holds the tuned image.
+*   -1 if it just failed. 0 otherwise.
+*/
+int8_t CapTuner::poll(uint32_t now, StringBuilder* output) {
+  SX8634Jig* touch = &_slot->touch;
+  switch (_state) {
+    case CapTunerState::LOADING:
+      if (!touch->deltaBusy()) {
+        if (touch->deltaFailed()) {
+          output->concatf("Tuning: failed to set sensitivity %u.\n", _level);
+          stop();
+          return -1;
+        }
+        _state    = CapTunerState::SETTLING;
+        _state_ms = now;
+      }
+      break;
+
+    case CapTunerState::SETTLING:
+      if ((now - _state_ms) >= CAP_TUNER_SETTLE_MS) {
+        _monitor_start(now);
+        _state = CapTunerState::QUIET;
+        output->concatf("Tuning: sensitivity %u. Hands off the board...\n", _level);
+      }
+      break;
+
+    case CapTunerState::QUIET:
+      if (_monitor->sweeps() >= CAP_TUNER_QUIET_SWEEPS) {
+        _take_noise();
+        _touched  = 0;
+        _released = 0;
+        _state    = CapTunerState::TOUCH;
+        _state_ms = now;
+        _progress = _monitor->windows();
+        output->concat("Tuning: touch each channel in turn, and let go.\n");
+      }
+      else if (_stalled(_monitor->sweeps(), now)) {
+        output->concat("Tuning: CapSense data stopped coming.\n");
+        stop();
+        return -1;
+      }
+      break;
+
+    case CapTunerState::TOUCH:
+      if (_progress != _monitor->windows()) {
+        _take_window();
+        _progress    = _monitor->windows();
+        _progress_ms = now;
+      }
+      else if (_stalled(_progress, now)) {
+        output->concat("Tuning: CapSense data stopped coming.\n");
+        stop();
+        return -1;
+      }
+      if ((_chans == _released) || ((now - _state_ms) >= CAP_TUNER_TOUCH_MS)) {
+        _monitor_stop();
+        if (_chans != _released) {
+          output->concatf("Tuning: channels 0x%03x weren't touched at sensitivity %u.\n", (_chans & ~_released), _level);
+        }
+        if (_level < _highest) {
+          _level++;
+          if (0 != _begin_level(now)) {
+            output->concat("Tuning: the delta writer refused the next level.\n");
+            return -1;
+          }
+        }
+        else {
+          _state = CapTunerState::IDLE;
+          _choose();
+          _done = true;
+          return 1;
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+  return 0;
+}
+
+
+/*
+* Sets every enabled channel to the current level, leaving the base thresholds.
+*/
+int8_t CapTuner::_begin_level(uint32_t now) {
+  uint8_t img[128];
+  memcpy(img, _base, 128);
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    if (_chans & (1 << i)) {
+      _set_sensitivity(img, i, _level);
+    }
+  }
+  if (0 > _slot->touch.loadSPMDelta(img)) {
+    _state = CapTunerState::IDLE;
+    return -1;
+  }
+  _state    = CapTunerState::LOADING;
+  _state_ms = now;
+  return 0;
+}
+
+
+void CapTuner::_monitor_start(uint32_t now) {
+  _monitor->start(_slot->index(), CAP_TUNER_WINDOW_SWEEPS);
+  _slot->touch.startMonitor(_monitor);
+  _progress    = 0;
+  _progress_ms = now;
+}
+
+
+void CapTuner::_monitor_stop() {
+  if (_monitor->running()) {
+    _slot->touch.stopMonitor();
+    _monitor->stop();
+  }
+}
+
+
+bool CapTuner::_stalled(uint32_t progress, uint32_t now) {
+  if (progress != _progress) {
+    _progress    = progress;
+    _progress_ms = now;
+    return false;
+  }
+  return ((now - _progress_ms) >= CAP_TUNER_STALL_MS);
+}
+
+
+void CapTuner::_take_noise() {
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    const CapMonStats* s = _monitor->total(i);
+    const int32_t lo = (0 < s->count) ? -((int32_t) s->diff_min) : 0;
+    const int32_t hi = (0 < s->count) ? s->diff_max : 0;
+    _points[_level][i].noise = (uint16_t) ((lo > hi) ? lo : hi);
+  }
+}
+
+
+/*
+* A channel is touched while its window mean is well clear of its noise. The
+*   highest such mean is its signal. It is done once it is let go.
+*/
+void CapTuner::_take_window() {
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    const uint16_t mask = (1 << i);
+    if (0 == (_chans & mask)) continue;
+    CapTunerPoint* pt = &_points[_level][i];
+    const int32_t mean  = CapMonitor::diffMean(_monitor->lastWindow(i));
+    const int32_t floor = ((2 * pt->noise) > CAP_TUNER_TOUCH_MIN) ? (2 * pt->noise) : CAP_TUNER_TOUCH_MIN;
+    if (mean > floor) {
+      _touched |= mask;
+      if (mean > pt->signal) {
+        pt->signal = (uint16_t) ((0xFFFF < mean) ? 0xFFFF : mean);
+      }
+    }
+    else if (_touched & mask) {
+      _touched  &= ~mask;
+      _released |= mask;
+    }
+  }
+}
+
+
+uint16_t CapTuner::_margin_x10(const CapTunerPoint* pt) {
+  const uint32_t noise = (0 < pt->noise) ? pt->noise : 1;
+  const uint32_t m = ((uint32_t) pt->signal * 10) / noise;
+  return (uint16_t) ((0xFFFF < m) ? 0xFFFF : m);
+}
+
+
+void CapTuner::_choose() {
+  memcpy(_result, _base, 128);
+  _short = 0;
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    _chosen[i] = _sensitivity(_base, i);
+    if (0 == (_chans & (1 << i))) continue;
+    int best = -1;
+    for (uint8_t l = _lowest; l <= _highest; l++) {
+      const CapTunerPoint* pt = &_points[l][i];
+      if (0 == pt->signal) continue;
+      if (_margin_x10(pt) >= _margin) {
+        best = l;
+        break;
+      }
+      if ((0 > best) || (_margin_x10(pt) > _margin_x10(&_points[best][i]))) {
+        best = l;
+      }
+    }
+    if (0 > best) continue;   // Never touched.
+    const CapTunerPoint* pt = &_points[best][i];
+    if (_margin_x10(pt) < _margin) {
+      _short |= (1 << i);
+    }
+    const uint32_t counts = pt->noise + ((pt->signal - pt->noise) / 2);
+    uint32_t thresh = (counts + CAP_TUNER_COUNTS_PER_STEP - 1) / CAP_TUNER_COUNTS_PER_STEP;
+    if (0 == thresh)   thresh = 1;
+    if (0xFF < thresh) thresh = 0xFF;
+    _chosen[i] = (uint8_t) best;
+    _set_sensitivity(_result, i, (uint8_t) best);
+    _result[SX8634_SPM_CAP_THRESH + i] = (uint8_t) thresh;
+  }
+}
+
+
+/* Even channels are in the high nibble. */
+uint8_t CapTuner::_sensitivity(const uint8_t* spm, uint8_t cap) {
+  const uint8_t b = spm[SX8634_SPM_CAP_SENS + (cap >> 1)];
+  return ((cap & 1) ? b : (b >> 4)) & 0x07;
+}
+
+
+void CapTuner::_set_sensitivity(uint8_t* spm, uint8_t cap, uint8_t s) {
+  uint8_t* b = &spm[SX8634_SPM_CAP_SENS + (cap >> 1)];
+  *b = (cap & 1) ? ((*b & 0xF0) | (s & 0x07)) : ((*b & 0x0F) | ((s & 0x07) << 4));
+}
+
+
+void CapTuner::printResults(StringBuilder* output) {
+  if (running()) {
+    output->concatf("Tuning \"%s\" on slot %u: sensitivity %u of %u-%u.\n", _name, _slot->index(), _level, _lowest, _highest);
+  }
+  if (!_done) {
+    if (!running()) output->concat("No tuning results.\n");
+    return;
+  }
+  output->concatf("Tuning \"%s\": margin %u.%u wanted. Signal/noise peak (x10) at each sensitivity:\n\tChan", _name, _margin / 10, _margin % 10);
+  for (uint8_t l = _lowest; l <= _highest; l++) {
+    output->concatf("  %5u", l);
+  }
+  output->concat("  |  Sens  Noise  Signal  Threshold\n");
+  for (uint8_t i = 0; i < CAPMON_CHANNELS; i++) {
+    if (0 == (_chans & (1 << i))) continue;
+    output->concatf("\t%4u", i);
+    for (uint8_t l = _lowest; l <= _highest; l++) {
+      if (0 < _points[l][i].signal) {
+        output->concatf("  %5u", _margin_x10(&_points[l][i]));
+      }
+      else {
+        output->concat("      -");
+      }
+    }
+    const CapTunerPoint* pt = &_points[_chosen[i]][i];
+    output->concatf("  |  %4u  %5u  %6u  %9u%s\n",
+      _chosen[i], pt->noise, pt->signal, _result[SX8634_SPM_CAP_THRESH + i],
+      (_short & (1 << i)) ? "  SHORT" : ((0 == pt->signal) ? "  (untouched)" : "")
+    );
+  }
+}
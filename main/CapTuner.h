@@ -0,0 +1,111 @@
+/*
+File:   CapTuner.h
+Author: J. Ian Lindsay
+Date:   2019.09.19
+
+Finds CapSense sensitivity and threshold settings for a touch board, and
+  hands back an SPM image that holds them.
+
+For each sensitivity level in the sweep, every enabled CAP channel is set to
+  that level, and the change is written with the jig's delta writer. Once the
+  chip has had time to settle, the CapSense monitor is run with hands off the
+  board. The largest DiffData seen on each channel is its noise peak. Then the
+  operator touches each channel in turn. The highest window mean of DiffData
+  while touched is the channel's signal.
+
+Once every level has been seen, each channel gets the lowest sensitivity
+  whose signal is at least (margin) times its noise peak. Lower sensitivity
+  is less prone to false touches from moisture and nearby hands, so there is
+  no reason to go higher than needed. A channel that never makes the margin
+  gets the level that came closest, and is called out. Its threshold is put
+  halfway between the noise peak and the signal at the chosen level.
+
+Channels that are disabled in the SPM are left alone, as is a channel that
+  was never touched. Nothing else in the image is changed.
+*/
+
+#ifndef __SX8634_CAP_TUNER_H__
+#define __SX8634_CAP_TUNER_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "ProvisionerSlot.h"
+#include "CapMonitor.h"
+
+#define CAP_TUNER_LEVELS             8   // Sensitivity is 0 through 7.
+#define CAP_TUNER_MARGIN_X10        80   // Default: the signal must be 8x the noise peak.
+#define CAP_TUNER_SETTLE_MS        500   // After an SPM change, before measuring.
+#define CAP_TUNER_QUIET_SWEEPS      32   // Sweeps of all channels, hands off.
+#define CAP_TUNER_WINDOW_SWEEPS      2   // Sweeps per window, while touching.
+#define CAP_TUNER_TOUCH_MS       20000   // Time given to touch every channel.
+#define CAP_TUNER_STALL_MS        2000   // No sweep in this long is a failure.
+#define CAP_TUNER_TOUCH_MIN         24   // The least DiffData that counts as a touch.
+#define CAP_TUNER_COUNTS_PER_STEP    4   // DiffData counts per step of CapThreshold.
+
+enum class CapTunerState : uint8_t {
+  IDLE,
+  LOADING,    // The delta writer is setting the next level.
+  SETTLING,   // Giving the chip time to recompensate.
+  QUIET,      // Measuring noise, hands off.
+  TOUCH       // Waiting for the operator to touch each channel.
+};
+
+typedef struct {
+  uint16_t noise;    // Peak DiffData with hands off.
+  uint16_t signal;   // Highest window mean while touched. Zero if never touched.
+} CapTunerPoint;
+
+
+class CapTuner {
+  public:
+    CapTuner();
+
+    int8_t start(ProvisionerSlot*, CapMonitor*, const char* name, uint16_t margin_x10, uint8_t lowest, uint8_t highest);
+    void   stop();
+    int8_t poll(uint32_t now, StringBuilder* output);
+    inline bool running() {   return (CapTunerState::IDLE != _state);   };
+
+    inline ProvisionerSlot* slot() {     return _slot;     };
+    inline const char*      name() {     return _name;     };
+    inline const uint8_t*   result() {   return (const uint8_t*) _result;   };
+
+    void printResults(StringBuilder*);
+
+
+  private:
+    ProvisionerSlot* _slot    = nullptr;
+    CapMonitor*      _monitor = nullptr;
+    CapTunerState    _state   = CapTunerState::IDLE;
+    bool             _done    = false;   // The last sweep finished, and _result holds its choice.
+    char             _name[16];
+    uint8_t          _lowest   = 0;
+    uint8_t          _highest  = CAP_TUNER_LEVELS - 1;
+    uint8_t          _level    = 0;
+    uint16_t         _margin   = CAP_TUNER_MARGIN_X10;
+    uint16_t         _chans    = 0;   // Bitmask of enabled CAP channels.
+    uint16_t         _touched  = 0;   // ...that are touched now.
+    uint16_t         _released = 0;   // ...that have been touched and let go.
+    uint16_t         _short    = 0;   // ...that never made the margin.
+    uint32_t         _state_ms = 0;
+    uint32_t         _progress = 0;   // Monitor windows or sweeps, as of _progress_ms.
+    uint32_t         _progress_ms = 0;
+    uint8_t          _chosen[CAPMON_CHANNELS];
+    CapTunerPoint    _points[CAP_TUNER_LEVELS][CAPMON_CHANNELS];
+    uint8_t          _base[128];      // The SPM as it was found.
+    uint8_t          _result[128];
+
+    int8_t _begin_level(uint32_t now);
+    void   _monitor_start(uint32_t now);
+    void   _monitor_stop();
+    bool   _stalled(uint32_t progress, uint32_t now);
+    void   _take_noise();
+    void   _take_window();
+    void   _choose();
+
+    static uint8_t _sensitivity(const uint8_t* spm, uint8_t cap);
+    static void    _set_sensitivity(uint8_t* spm, uint8_t cap, uint8_t s);
+    static uint16_t _margin_x10(const CapTunerPoint*);
+};
+
+#endif  // __SX8634_CAP_TUNER_H__
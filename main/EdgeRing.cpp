@@ -0,0 +1,91 @@
+#include "EdgeRing.h"
+
+#include <Platform/Platform.h>
+
+#if !defined(__MANUVR_LINUX)
+  #include "esp_timer.h"
+  #include "soc/soc.h"
+  #include "soc/gpio_reg.h"
+#endif
+
+
+EdgeRing::EdgeRing() {
+}
+
+
+/*
+* Called from ISRs. The record is filled before the new head is published.
+*/
+bool EDGE_RING_ISR_ATTR EdgeRing::push(uint8_t slot, uint8_t levels, uint8_t changed, uint64_t t_us) {
+  const uint32_t head = _head;
+  const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+  if (EDGE_RING_DEPTH <= (head - tail)) {
+    _dropped++;
+    return false;
+  }
+  GPIOEdge* e = &_ring[head & (EDGE_RING_DEPTH - 1)];
+  e->t_us    = t_us;
+  e->slot    = slot;
+  e->levels  = levels;
+  e->changed = changed;
+  __atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+  _pushed++;
+  return true;
+}
+
+
+/*
+* Copies out as many as max edges, oldest first, and frees their space.
+*/
+unsigned int EdgeRing::drain(GPIOEdge* buf, unsigned int max) {
+  const uint32_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+  uint32_t tail = _tail;
+  unsigned int n = 0;
+  while ((tail != head) && (n < max)) {
+    buf[n++] = _ring[tail & (EDGE_RING_DEPTH - 1)];
+    tail++;
+  }
+  __atomic_store_n(&_tail, tail, __ATOMIC_RELEASE);
+  return n;
+}
+
+
+/*
+* Throws away everything that is waiting. Consumer side only.
+*/
+void EdgeRing::discard() {
+  __atomic_store_n(&_tail, __atomic_load_n(&_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+
+unsigned int EdgeRing::count() {
+  return (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) - _tail);
+}
+
+
+#if defined(__MANUVR_LINUX)
+/* The host build's micros() may be running on simulated time. */
+uint64_t edge_clock_us() {   return (uint64_t) micros();   }
+
+/* There is no register to read. But nothing else runs while we do this. */
+uint64_t gpio_bank_read() {
+  uint64_t ret = 0;
+  for (uint8_t i = 0; i < 40; i++) {
+    if (0 < readPin(i)) {
+      ret |= ((uint64_t) 1 << i);
+    }
+  }
+  return ret;
+}
+#else
+uint64_t EDGE_RING_ISR_ATTR edge_clock_us() {
+  return (uint64_t) esp_timer_get_time();
+}
+
+/* GPIO0-31 are in one register, and GPIO32-39 in the low bits of another. */
+uint64_t EDGE_RING_ISR_ATTR gpio_bank_read() {
+  const uint32_t lo = REG_READ(GPIO_IN_REG);
+  const uint32_t hi = REG_READ(GPIO_IN1_REG) & 0xFF;
+  return (((uint64_t) hi) << 32) | lo;
+}
+#endif
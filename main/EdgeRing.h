@@ -0,0 +1,80 @@
+/*
+File:   EdgeRing.h
+Author: J. Ian Lindsay
+Date:   2019.09.06
+
+A lock-free ring of timestamped GPIO snapshots.
+
+Each record holds the levels of all eight of a slot's SX8634 GPIO lines, taken
+  from a single read of the platform's GPIO input register, and which of those
+  lines changed since the last record. Pins that toggle together arrive in the
+  same record, with the same timestamp.
+
+The platform GPIO ISRs are the only producer, and the main loop is the only
+  consumer. The producer only writes _head, and the consumer only writes _tail,
+  so neither side needs a lock. The ESP32 has two cores, so the indices are
+  published with release/acquire ordering to make sure a record's contents are
+  visible before the index that covers it.
+
+If the consumer falls behind, new edges are dropped (and counted) rather than
+  overwriting ones that haven't been read yet.
+
+Timestamps are 64-bit microseconds, and so won't wrap in the life of the jig.
+*/
+
+#ifndef __SX8634_EDGE_RING_H__
+#define __SX8634_EDGE_RING_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#if defined(__MANUVR_LINUX)
+  #define EDGE_RING_ISR_ATTR
+#else
+  #include "esp_attr.h"
+  #define EDGE_RING_ISR_ATTR IRAM_ATTR
+#endif
+
+#define EDGE_RING_DEPTH   256   // Must be a power of two.
+
+
+typedef struct {
+  uint64_t t_us;     // When the ISR ran.
+  uint8_t  slot;     // The provisioner slot whose GPIO this is.
+  uint8_t  levels;   // Bit n is the level of SX8634 GPIOn.
+  uint8_t  changed;  // Bit n is set if GPIOn changed since the last record.
+} GPIOEdge;
+
+
+class EdgeRing {
+  public:
+    EdgeRing();
+
+    /* Producer side (ISR). Returns false if the edge was dropped. */
+    bool push(uint8_t slot, uint8_t levels, uint8_t changed, uint64_t t_us);
+
+    /* Consumer side. Returns the number of edges copied into the buffer. */
+    unsigned int drain(GPIOEdge* buf, unsigned int max);
+    void discard();
+    unsigned int count();
+
+    inline uint32_t dropped() {   return _dropped;   };
+    inline uint32_t pushed() {    return _pushed;    };
+
+
+  private:
+    GPIOEdge          _ring[EDGE_RING_DEPTH];
+    volatile uint32_t _head    = 0;   // Written only by the producer.
+    volatile uint32_t _tail    = 0;   // Written only by the consumer.
+    volatile uint32_t _dropped = 0;   // Written only by the producer.
+    volatile uint32_t _pushed  = 0;   // Written only by the producer.
+};
+
+
+/* A 64-bit microsecond clock that is safe to read from an ISR. */
+uint64_t edge_clock_us();
+
+/* The levels of every platform GPIO (bit n is pin n), read at once. ISR-safe. */
+uint64_t gpio_bank_read();
+
+#endif  // __SX8634_EDGE_RING_H__
@@ -0,0 +1,165 @@
+#include "EventStream.h"
+#include "IoCore.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(__MANUVR_LINUX)
+  #include "esp_vfs_dev.h"
+#endif
+
+static const uint8_t BATCH_MARKER[3] = { 0xD9, 0xD9, 0xF7 };   // tag 55799
+
+
+EventStream::EventStream() {
+}
+
+
+/*
+* The console's output can't rewrite line endings while batches are on it, as
+*   that would corrupt them. Any batch underway goes out when streaming ends.
+*/
+void EventStream::enable(bool x) {
+  if (x == _enabled) return;
+  if (!x) {
+    flush();
+  }
+  _enabled = x;
+  evstream_binary_mode(x);
+}
+
+
+void EventStream::_head(uint8_t major, uint64_t val) {
+  _len += cbor_put_head(&_buf[_len], major, val);
+}
+
+
+void EventStream::add(uint8_t type, uint8_t slot, uint8_t arg, uint32_t value, uint64_t t_us) {
+  if (!_enabled) return;
+  if ((EVSTREAM_BUFFER_SIZE - EVSTREAM_MAX_RECORD) < _len) {
+    flush();
+  }
+  if (0 == _len) {
+    memcpy(_buf, BATCH_MARKER, sizeof(BATCH_MARKER));
+    _len = sizeof(BATCH_MARKER);
+    _buf[_len++] = CBOR_ARRAY | 31;   // Indefinite length.
+    _head(CBOR_UINT, t_us);
+    _t_first = t_us;
+    _t_last  = t_us;
+  }
+  _head(CBOR_ARRAY, 5);
+  _head(CBOR_UINT, (t_us > _t_last) ? (t_us - _t_last) : 0);
+  _head(CBOR_UINT, type);
+  _head(CBOR_UINT, slot);
+  _head(CBOR_UINT, arg);
+  _head(CBOR_UINT, value);
+  _t_last = t_us;
+  _events++;
+}
+
+
+/*
+* Called periodically. Sends the batch if its first event has waited too long.
+*/
+void EventStream::poll(uint64_t now_us) {
+  if ((0 < _len) && ((now_us - _t_first) >= EVSTREAM_FLUSH_US)) {
+    flush();
+  }
+}
+
+
+void EventStream::flush() {
+  if (0 == _len) return;
+  _buf[_len++] = CBOR_BREAK;
+  evstream_write(_buf, _len);
+  _bytes += _len;
+  _batches++;
+  _len = 0;
+}
+
+
+void EventStream::printStream(StringBuilder* output) {
+  output->concatf("Event stream %sabled: %u events in %u batches (%u bytes)\n",
+    (_enabled ? "en" : "dis"), _events, _batches, _bytes
+  );
+}
+
+
+uint8_t cbor_put_head(uint8_t* buf, uint8_t major, uint64_t val) {
+  uint8_t len = 0;
+  if (24 > val) {
+    buf[len++] = major | (uint8_t) val;
+  }
+  else if (0xFF >= val) {
+    buf[len++] = major | 24;
+    buf[len++] = (uint8_t) val;
+  }
+  else if (0xFFFF >= val) {
+    buf[len++] = major | 25;
+    buf[len++] = (uint8_t) (val >> 8);
+    buf[len++] = (uint8_t) val;
+  }
+  else if (0xFFFFFFFF >= val) {
+    buf[len++] = major | 26;
+    for (int8_t i = 3; i >= 0; i--) {
+      buf[len++] = (uint8_t) (val >> (i << 3));
+    }
+  }
+  else {
+    buf[len++] = major | 27;
+    for (int8_t i = 7; i >= 0; i--) {
+      buf[len++] = (uint8_t) (val >> (i << 3));
+    }
+  }
+  return len;
+}
+
+
+/* CBOR keeps the sign in the major type. -1 is encoded as 0. */
+uint8_t cbor_put_int(uint8_t* buf, int32_t val) {
+  if (0 <= val) {
+    return cbor_put_head(buf, CBOR_UINT, (uint64_t) val);
+  }
+  return cbor_put_head(buf, CBOR_NINT, (uint64_t) (-1 - (int64_t) val));
+}
+
+
+/*
+* With the cores split, frames go out through the I/O task, in order with the
+*   console text.
+*/
+void evstream_write(const uint8_t* buf, unsigned int len) {
+  io_core_emit(buf, len);
+}
+
+#if defined(__MANUVR_LINUX)
+static void _binary_line_endings(bool) {
+}
+#else
+/*
+* The UART VFS turns LF into CRLF by default. Anything already queued is
+*   written under the old setting before it changes.
+*/
+static void _binary_line_endings(bool x) {
+  io_core_flush();
+  esp_vfs_dev_uart_set_tx_line_endings(x ? ESP_LINE_ENDINGS_LF : ESP_LINE_ENDINGS_CRLF);
+}
+#endif
+
+static uint8_t _binary_users = 0;
+
+/*
+* The event stream and CapMonitor can both be streaming at once. So line endings
+*   go back to CRLF only once the last of them has let go.
+*/
+void evstream_binary_mode(bool x) {
+  if (x) {
+    if (0 == _binary_users++) {
+      _binary_line_endings(true);
+    }
+  }
+  else if (0 < _binary_users) {
+    if (0 == --_binary_users) {
+      _binary_line_endings(false);
+    }
+  }
+}
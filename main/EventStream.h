@@ -0,0 +1,99 @@
+/*
+File:   EventStream.h
+Author: J. Ian Lindsay
+Date:   2019.09.11
+
+Streams touch events to the host as batches of CBOR.
+
+Formatting every event as text and pushing it through the console can't keep up
+  with the slider. In streaming mode, SX8634BitDiddler hands events to this
+  class instead, and they are packed into a buffer that is written out in one
+  go when it fills, or when its oldest event has waited long enough.
+
+Each batch is self-delimiting, so it can share the console with ordinary log
+  text, and a reader that starts mid-stream can find the next one:
+
+  tag 55799 (0xD9 0xD9 0xF7, the CBOR "self-described" marker)
+  indefinite array [
+    uint   The edge-clock time of the batch's first event (us).
+    array  One per event: [dt, type, slot, arg, value]
+    ...
+  ]
+
+  dt is the time since the previous event in the batch (us). So the first is 0.
+
+tools/evstream_decode.py turns a captured stream back into events.
+
+The encoding is small enough that it is done here directly, rather than through
+  a general CBOR encoder.
+*/
+
+#ifndef __SX8634_EVENT_STREAM_H__
+#define __SX8634_EVENT_STREAM_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define EVSTREAM_BUFFER_SIZE   512
+#define EVSTREAM_MAX_RECORD     32   // The most that one event can take.
+#define EVSTREAM_FLUSH_US   20000    // The longest an event waits in the buffer.
+
+/* Event types, as they appear in the stream. */
+#define EVSTREAM_BUTTON_PRESS    0   // arg: button
+#define EVSTREAM_BUTTON_RELEASE  1   // arg: button
+#define EVSTREAM_SLIDER          2   // value: position
+#define EVSTREAM_GPI             3   // arg: pin, value: level
+#define EVSTREAM_LONG_PRESS      4   // Gestures, in the order of GestureEngine.h. arg: button, value: held (ms)
+#define EVSTREAM_DOUBLE_TAP      5   // arg: button, value: press to press (ms)
+#define EVSTREAM_CHORD           6   // value: mask of the buttons held
+#define EVSTREAM_SWIPE           7   // arg: 0 if the position rose, 1 if it fell. value: speed (units/s)
+
+
+class EventStream {
+  public:
+    EventStream();
+
+    void enable(bool);
+    inline bool enabled() {   return _enabled;   };
+
+    void add(uint8_t type, uint8_t slot, uint8_t arg, uint32_t value, uint64_t t_us);
+    void poll(uint64_t now_us);
+    void flush();
+
+    void printStream(StringBuilder*);
+
+
+  private:
+    bool     _enabled    = false;
+    uint16_t _len        = 0;
+    uint64_t _t_first    = 0;   // Time of the batch's first event.
+    uint64_t _t_last     = 0;   // Time of the batch's last event.
+    uint32_t _events     = 0;
+    uint32_t _batches    = 0;
+    uint32_t _bytes      = 0;
+    uint8_t  _buf[EVSTREAM_BUFFER_SIZE];
+
+    void _head(uint8_t major, uint64_t val);
+};
+
+/* CBOR major types */
+#define CBOR_UINT    0x00
+#define CBOR_NINT    0x20
+#define CBOR_ARRAY   0x80
+#define CBOR_TAG     0xC0
+#define CBOR_BREAK   0xFF
+
+/*
+* Writes a CBOR head (the major type and its argument, in the fewest bytes) at
+*   buf, which must have room for nine. Returns the length written.
+*/
+uint8_t cbor_put_head(uint8_t* buf, uint8_t major, uint64_t val);
+uint8_t cbor_put_int(uint8_t* buf, int32_t val);
+
+/* Writes raw bytes to the console's output. Through the I/O task, if it is running. */
+void evstream_write(const uint8_t* buf, unsigned int len);
+/* Takes (true) or gives back (false) binary mode on the console. Counted. */
+void evstream_binary_mode(bool);
+
+#endif  // __SX8634_EVENT_STREAM_H__
@@ -0,0 +1,180 @@
+/*
+File:   GestureEngine.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.24
+
+Gestures from button and slider events. See GestureEngine.h.
+*/
+
+#include "GestureEngine.h"
+#include <string.h>
+
+static const char* const GESTURE_NAMES[GESTURE_TYPES] = {
+  "LONG_PRESS", "DOUBLE_TAP", "CHORD", "SWIPE"
+};
+
+
+GestureEngine::GestureEngine() {
+  reset();
+}
+
+
+void GestureEngine::reset() {
+  _down        = 0;
+  _chorded     = 0;
+  _long        = 0;
+  _tap_button  = GESTURE_NO_BUTTON;
+  _swiping     = false;
+  _head        = 0;
+  _tail        = 0;
+  _dropped     = 0;
+  memset(_down_us, 0, sizeof(_down_us));
+  memset(_counts, 0, sizeof(_counts));
+}
+
+
+const char* GestureEngine::typeStr(uint8_t type) {
+  return (GESTURE_TYPES > type) ? GESTURE_NAMES[type] : "UNKNOWN";
+}
+
+
+void GestureEngine::_emit(uint8_t type, uint8_t button, uint16_t mask, int32_t value, int32_t velocity, uint64_t t_us) {
+  _counts[type]++;
+  if (GESTURE_QUEUE_DEPTH <= (uint8_t) (_head - _tail)) {
+    _dropped++;
+    return;
+  }
+  Gesture* g = &_queue[_head & (GESTURE_QUEUE_DEPTH - 1)];
+  g->t_us     = t_us;
+  g->value    = value;
+  g->velocity = velocity;
+  g->mask     = mask;
+  g->type     = type;
+  g->button   = button;
+  _head++;
+}
+
+
+bool GestureEngine::take(Gesture* g) {
+  if (_head == _tail) return false;
+  *g = _queue[_tail & (GESTURE_QUEUE_DEPTH - 1)];
+  _tail++;
+  return true;
+}
+
+
+void GestureEngine::press(uint8_t button, uint64_t t_us) {
+  if (GESTURE_BUTTONS <= button) return;
+  const uint16_t bit = (1 << button);
+  if (_down & bit) return;   // Already seen.
+  if (0 == _down) {
+    _set_since = t_us;
+  }
+  else if ((t_us - _set_since) <= ((uint64_t) GESTURE_CHORD_WINDOW_MS * 1000)) {
+    _chorded |= (_down | bit);
+    _emit(GESTURE_CHORD, GESTURE_NO_BUTTON, (_down | bit), 0, 0, t_us);
+  }
+  _down |= bit;
+  _long &= ~bit;
+  _down_us[button] = t_us;
+  if (_tap_button != button) {
+    _tap_button = GESTURE_NO_BUTTON;
+  }
+}
+
+
+void GestureEngine::release(uint8_t button, uint64_t t_us) {
+  if (GESTURE_BUTTONS <= button) return;
+  const uint16_t bit = (1 << button);
+  if (0 == (_down & bit)) return;
+  const uint64_t pressed = _down_us[button];
+  const uint32_t held_ms = (uint32_t) ((t_us - pressed) / 1000);
+  const bool chorded = (0 != (_chorded & bit));
+  const bool longed  = (0 != (_long & bit));
+  _down    &= ~bit;
+  _chorded &= ~bit;
+  _long    &= ~bit;
+  if (chorded || longed) {
+    _tap_button = GESTURE_NO_BUTTON;
+    return;
+  }
+  if (GESTURE_LONG_PRESS_MS <= held_ms) {
+    // poll() didn't get to it in time.
+    _emit(GESTURE_LONG_PRESS, button, bit, (int32_t) held_ms, 0, t_us);
+    _tap_button = GESTURE_NO_BUTTON;
+  }
+  else if (GESTURE_TAP_MAX_MS >= held_ms) {
+    if ((_tap_button == button) && ((pressed - _tap_release) <= ((uint64_t) GESTURE_DOUBLE_TAP_MS * 1000))) {
+      _emit(GESTURE_DOUBLE_TAP, button, bit, (int32_t) ((pressed - _tap_press) / 1000), 0, t_us);
+      _tap_button = GESTURE_NO_BUTTON;
+    }
+    else {
+      _tap_button  = button;
+      _tap_press   = pressed;
+      _tap_release = t_us;
+    }
+  }
+  else {
+    _tap_button = GESTURE_NO_BUTTON;
+  }
+}
+
+
+void GestureEngine::slider(uint16_t pos, uint64_t t_us) {
+  if (_swiping && ((t_us - _swipe_t1) >= ((uint64_t) GESTURE_SWIPE_GAP_MS * 1000))) {
+    _end_swipe(t_us);
+  }
+  if (!_swiping) {
+    _swiping    = true;
+    _swipe_pos0 = pos;
+    _swipe_t0   = t_us;
+  }
+  _swipe_pos1 = pos;
+  _swipe_t1   = t_us;
+}
+
+
+void GestureEngine::_end_swipe(uint64_t t_us) {
+  _swiping = false;
+  const int32_t travel  = (int32_t) _swipe_pos1 - (int32_t) _swipe_pos0;
+  const uint64_t dt_us  = _swipe_t1 - _swipe_t0;
+  const int32_t dist    = (0 > travel) ? -travel : travel;
+  if ((GESTURE_SWIPE_MIN_TRAVEL <= dist) && (0 < dt_us)) {
+    const int32_t velocity = (int32_t) (((int64_t) travel * 1000000) / (int64_t) dt_us);
+    _emit(GESTURE_SWIPE, GESTURE_NO_BUTTON, _down, travel, velocity, t_us);
+  }
+}
+
+
+/*
+* Call this periodically while pending().
+*/
+void GestureEngine::poll(uint64_t now_us) {
+  uint16_t waiting = _down & ~(_chorded | _long);
+  while (0 != waiting) {
+    const uint8_t b = (uint8_t) __builtin_ctz(waiting);
+    waiting &= (waiting - 1);
+    const uint32_t held_ms = (uint32_t) ((now_us - _down_us[b]) / 1000);
+    if (GESTURE_LONG_PRESS_MS <= held_ms) {
+      _long |= (1 << b);
+      _emit(GESTURE_LONG_PRESS, b, (1 << b), (int32_t) held_ms, 0, now_us);
+    }
+  }
+  if (_swiping && ((now_us - _swipe_t1) >= ((uint64_t) GESTURE_SWIPE_GAP_MS * 1000))) {
+    _end_swipe(now_us);
+  }
+}
+
+
+void GestureEngine::printStats(StringBuilder* output) {
+  output->concat("-- Gestures\n");
+  for (uint8_t i = 0; i < GESTURE_TYPES; i++) {
+    output->concatf("\t%-11s %u\n", GESTURE_NAMES[i], _counts[i]);
+  }
+  output->concatf("\tDropped:    %u\n", _dropped);
+  output->concatf("\tHeld:       0x%03x%s\n", _down, _swiping ? " (swipe open)" : "");
+  output->concatf("\tLong press %u ms, tap %u ms, double tap %u ms, chord %u ms, swipe %u units / %u ms gap\n",
+    GESTURE_LONG_PRESS_MS, GESTURE_TAP_MAX_MS, GESTURE_DOUBLE_TAP_MS, GESTURE_CHORD_WINDOW_MS,
+    GESTURE_SWIPE_MIN_TRAVEL, GESTURE_SWIPE_GAP_MS
+  );
+}
@@ -0,0 +1,106 @@
+/*
+File:   GestureEngine.h
+Author: J. Ian Lindsay
+Date:   2019.09.24
+
+Recognizes gestures in the SX8634's button and slider events, as they arrive.
+
+  Long press   A button held for GESTURE_LONG_PRESS_MS. Reported while it is
+               still held, as soon as the service timer sees it.
+  Double tap   Two taps (presses shorter than GESTURE_TAP_MAX_MS) of the same
+               button, the second pressed within GESTURE_DOUBLE_TAP_MS of the
+               first's release. Reported on the second release.
+  Chord        A button pressed within GESTURE_CHORD_WINDOW_MS of the first
+               button that is still down. Reported at once, with every button
+               that is down, and again for each button that joins it. Buttons
+               in a chord make no other gesture.
+  Swipe        Slider travel of at least GESTURE_SWIPE_MIN_TRAVEL, with its
+               velocity in slider units per second. The driver doesn't say
+               when the slider is let go, so a swipe ends when the slider has
+               been quiet for GESTURE_SWIPE_GAP_MS.
+
+All state is fixed in size, and each event is constant work. poll() looks at
+  no more than the twelve buttons. Gestures wait in a small ring until taken,
+  and any that don't fit are counted and lost.
+
+Times are edge-clock microseconds, as stamped in notify().
+*/
+
+#ifndef __SX8634_GESTURE_ENGINE_H__
+#define __SX8634_GESTURE_ENGINE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define GESTURE_BUTTONS              12
+#define GESTURE_QUEUE_DEPTH           8   // Must be a power of two.
+#define GESTURE_LONG_PRESS_MS       600
+#define GESTURE_TAP_MAX_MS          250
+#define GESTURE_DOUBLE_TAP_MS       300   // First release to second press.
+#define GESTURE_CHORD_WINDOW_MS      80
+#define GESTURE_SWIPE_GAP_MS        100
+#define GESTURE_SWIPE_MIN_TRAVEL     64
+
+/* Gesture types */
+#define GESTURE_LONG_PRESS            0   // button, value: held (ms)
+#define GESTURE_DOUBLE_TAP            1   // button, value: press to press (ms)
+#define GESTURE_CHORD                 2   // mask
+#define GESTURE_SWIPE                 3   // value: travel, velocity: units/s (both signed)
+#define GESTURE_TYPES                 4
+
+#define GESTURE_NO_BUTTON          0xFF
+
+typedef struct {
+  uint64_t t_us;       // When it was recognized.
+  int32_t  value;
+  int32_t  velocity;
+  uint16_t mask;       // Buttons that were down.
+  uint8_t  type;
+  uint8_t  button;
+} Gesture;
+
+
+class GestureEngine {
+  public:
+    GestureEngine();
+
+    void press(uint8_t button, uint64_t t_us);
+    void release(uint8_t button, uint64_t t_us);
+    void slider(uint16_t pos, uint64_t t_us);
+    void poll(uint64_t now_us);
+    bool take(Gesture*);
+    void reset();
+
+    /* Something is held, or a swipe is open. poll() has work to do. */
+    inline bool pending() {   return ((0 != _down) || _swiping);   };
+
+    void printStats(StringBuilder*);
+    static const char* typeStr(uint8_t);
+
+
+  private:
+    uint16_t _down      = 0;    // Buttons held.
+    uint16_t _chorded   = 0;    // Held buttons that are part of a chord.
+    uint16_t _long      = 0;    // Held buttons that have been reported as long presses.
+    uint64_t _set_since = 0;    // When the first of the held buttons went down.
+    uint64_t _down_us[GESTURE_BUTTONS];
+    uint8_t  _tap_button = GESTURE_NO_BUTTON;   // The last tap, if it could start a double.
+    uint64_t _tap_press  = 0;
+    uint64_t _tap_release = 0;
+    bool     _swiping    = false;
+    uint16_t _swipe_pos0 = 0;
+    uint16_t _swipe_pos1 = 0;
+    uint64_t _swipe_t0   = 0;
+    uint64_t _swipe_t1   = 0;
+    uint8_t  _head       = 0;
+    uint8_t  _tail       = 0;
+    uint32_t _dropped    = 0;
+    uint32_t _counts[GESTURE_TYPES];
+    Gesture  _queue[GESTURE_QUEUE_DEPTH];
+
+    void _emit(uint8_t type, uint8_t button, uint16_t mask, int32_t value, int32_t velocity, uint64_t t_us);
+    void _end_swipe(uint64_t t_us);
+};
+
+#endif  // __SX8634_GESTURE_ENGINE_H__
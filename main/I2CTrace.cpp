@@ -0,0 +1,179 @@
+#include "I2CTrace.h"
+#include "EdgeRing.h"
+#include "IoCore.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t TRACE_MAGIC[4] = { 'I', '2', 'C', 'T' };
+
+
+static void _put16(uint8_t* b, uint16_t v) {
+  b[0] = (uint8_t) v;
+  b[1] = (uint8_t) (v >> 8);
+}
+
+static void _put32(uint8_t* b, uint32_t v) {
+  _put16(b, (uint16_t) v);
+  _put16(b + 2, (uint16_t) (v >> 16));
+}
+
+static uint16_t _get16(const uint8_t* b) {
+  return (uint16_t) (b[0] | ((uint16_t) b[1] << 8));
+}
+
+static uint32_t _get32(const uint8_t* b) {
+  return (uint32_t) _get16(b) | ((uint32_t) _get16(b + 2) << 16);
+}
+
+
+I2CTrace::I2CTrace() {}
+
+I2CTrace::~I2CTrace() {
+  if (nullptr != _buf) {
+    free(_buf);
+  }
+}
+
+
+/*
+* Forgets any earlier trace. The buffer is only reallocated if its size changes.
+*
+* @return 0 on success, -1 if recording, -2 on a bad size or no memory.
+*/
+int8_t I2CTrace::start(uint8_t slot, uint32_t bytes) {
+  if (_recording) return -1;
+  if ((I2C_TRACE_HEADER_LEN + I2C_TRACE_RECORD_LEN > bytes) || (I2C_TRACE_MAX_BYTES < bytes)) {
+    return -2;
+  }
+  if (bytes != _size) {
+    if (nullptr != _buf) {
+      free(_buf);
+    }
+    _size = 0;
+    _buf  = (uint8_t*) malloc(bytes);
+    if (nullptr == _buf) return -2;
+    _size = bytes;
+  }
+  memset(_buf, 0, I2C_TRACE_HEADER_LEN);
+  memcpy(_buf, TRACE_MAGIC, 4);
+  _buf[4]    = I2C_TRACE_VERSION;
+  _buf[5]    = slot;
+  _len       = I2C_TRACE_HEADER_LEN;
+  _records   = 0;
+  _dropped   = 0;
+  _t_last    = edge_clock_us();
+  _recording = true;
+  return 0;
+}
+
+
+void I2CTrace::stop() {
+  _recording = false;
+}
+
+
+/*
+* Called from the jig's bus callback, once the transfer is complete.
+*/
+void I2CTrace::add(I2CBusOp* op, uint8_t flags) {
+  if (!_recording) return;
+  const bool rx = (BusOpcode::RX == op->get_opcode());
+  if (rx)                   flags |= I2C_TRACE_FLAG_RX;
+  if (0 <= op->sub_addr)    flags |= I2C_TRACE_FLAG_REG;
+  if (op->hasFault())       flags |= I2C_TRACE_FLAG_FAULT;
+  const uint16_t payload = (rx && op->hasFault()) ? 0 : op->buf_len;
+  if ((_size - _len) < (uint32_t) (I2C_TRACE_RECORD_LEN + payload)) {
+    // A smaller transfer later might fit, but a replay can't skip this one.
+    _dropped++;
+    _recording = false;
+    _put_header();
+    return;
+  }
+  const uint64_t now = edge_clock_us();
+  uint8_t* rec = &_buf[_len];
+  rec[0] = flags;
+  rec[1] = op->dev_addr;
+  rec[2] = (0 <= op->sub_addr) ? (uint8_t) op->sub_addr : 0;
+  rec[3] = (uint8_t) op->getFault();
+  _put16(&rec[4], op->buf_len);
+  _put32(&rec[6], (uint32_t) (now - _t_last));
+  if (0 < payload) {
+    memcpy(&rec[I2C_TRACE_RECORD_LEN], op->buf, payload);
+  }
+  _len    += I2C_TRACE_RECORD_LEN + payload;
+  _t_last  = now;
+  _records++;
+  _put_header();
+}
+
+
+void I2CTrace::_put_header() {
+  _put32(&_buf[8],  _records);
+  _put32(&_buf[12], _dropped);
+}
+
+
+int8_t I2CTrace::save(Storage* store) {
+  if ((nullptr == _buf) || (nullptr == store)) return -1;
+  const int wlen = io_core_write(store, I2C_TRACE_STORAGE_KEY, _buf, _len, 0);
+  return ((int) _len == wlen) ? 0 : -1;
+}
+
+
+void I2CTrace::printHex(StringBuilder* output) {
+  for (uint32_t i = 0; i < _len; i += I2C_TRACE_LINE_BYTES) {
+    output->concat(I2C_TRACE_LINE_TAG);
+    for (uint32_t n = i; (n < _len) && (n < (i + I2C_TRACE_LINE_BYTES)); n++) {
+      output->concatf("%02x", _buf[n]);
+    }
+    output->concat("\n");
+  }
+}
+
+
+void I2CTrace::printSummary(StringBuilder* output) {
+  if (nullptr == _buf) {
+    output->concat("No I2C trace.\n");
+    return;
+  }
+  output->concatf("I2C trace of slot %u (%s): %u records, %u of %u bytes used",
+    slot(), (_recording ? "recording" : "stopped"), _records, _len, _size
+  );
+  if (0 < _dropped) {
+    output->concat(", full");
+  }
+  output->concat(".\n");
+}
+
+
+/*
+* @return 0 if the buffer starts with a trace header we understand.
+*/
+int8_t I2CTrace::checkHeader(const uint8_t* buf, uint32_t len) {
+  if ((I2C_TRACE_HEADER_LEN > len) || (0 != memcmp(buf, TRACE_MAGIC, 4))) {
+    return -1;
+  }
+  return (I2C_TRACE_VERSION == buf[4]) ? 0 : -2;
+}
+
+
+/*
+* @return The offset of the record after this one, 0 at the end of the trace,
+*   or -1 if the record runs off the end of the buffer.
+*/
+int32_t I2CTrace::readRecord(const uint8_t* buf, uint32_t len, uint32_t offset, I2CTraceRecord* rec) {
+  if (offset >= len) return 0;
+  if ((len - offset) < I2C_TRACE_RECORD_LEN) return -1;
+  const uint8_t* b = &buf[offset];
+  rec->flags = b[0];
+  rec->addr  = b[1];
+  rec->reg   = b[2];
+  rec->fault = b[3];
+  rec->len   = _get16(&b[4]);
+  rec->dt_us = _get32(&b[6]);
+  const bool has_payload = !((rec->flags & I2C_TRACE_FLAG_RX) && (rec->flags & I2C_TRACE_FLAG_FAULT));
+  const uint32_t payload = has_payload ? rec->len : 0;
+  if ((len - offset - I2C_TRACE_RECORD_LEN) < payload) return -1;
+  rec->payload = (0 < payload) ? &b[I2C_TRACE_RECORD_LEN] : nullptr;
+  return (int32_t) (offset + I2C_TRACE_RECORD_LEN + payload);
+}
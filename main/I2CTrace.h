@@ -0,0 +1,115 @@
+/*
+File:   I2CTrace.h
+Author: J. Ian Lindsay
+Date:   2019.09.20
+
+A record of every I2C transfer between the bus and one slot's SX8634, kept so
+  that a board's session can be played back to the driver on a host (see
+  sim/TraceReplay.h).
+
+SX8634Jig hands each transfer to add() as it completes. Records are packed
+  into a fixed buffer, one after another. When it fills, recording stops
+  (rather than wrapping), as a replay has to start from the beginning. The
+  buffer can be saved to storage, or printed on the console as hex, on lines
+  that start with I2C_TRACE_LINE_TAG. The replay tool takes either.
+
+The format is little-endian:
+
+  Header (16 bytes)
+    char[4]   "I2CT"
+    uint8     Version (1)
+    uint8     Slot
+    uint16    Reserved
+    uint32    Records
+    uint32    Records that didn't fit. At most one, as recording stops there.
+
+  Record (10 bytes, then the payload)
+    uint8     Flags (I2C_TRACE_FLAG_*)
+    uint8     7-bit device address
+    uint8     Register (if I2C_TRACE_FLAG_REG)
+    uint8     XferFault, as a number. Zero for none.
+    uint16    Payload length, as the transfer had it.
+    uint32    Time since the previous record (us). For the first, since the
+                trace was started.
+    ...       The payload: what was written, or what was read. A read that
+                failed has none.
+
+Transfers that the jig made on its own (delta writes, CRC page reads, and
+  CapSense diagnostics) are flagged, so that a replay of the bare driver can
+  pass over them. So are reads of IrqSrc that answer INTB, so that the replay
+  can assert it at the right time.
+*/
+
+#ifndef __SX8634_I2C_TRACE_H__
+#define __SX8634_I2C_TRACE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+
+#define I2C_TRACE_VERSION          1
+#define I2C_TRACE_HEADER_LEN      16
+#define I2C_TRACE_RECORD_LEN      10   // Before its payload.
+#define I2C_TRACE_DEFAULT_BYTES 4096
+#define I2C_TRACE_MAX_BYTES    65536
+#define I2C_TRACE_STORAGE_KEY   "i2ctrace"
+#define I2C_TRACE_LINE_TAG      "I2CTRACE "
+#define I2C_TRACE_LINE_BYTES      32   // Bytes per console line.
+
+/* Record flags */
+#define I2C_TRACE_FLAG_RX       0x01   // A read. Otherwise, a write.
+#define I2C_TRACE_FLAG_REG      0x02   // Addressed to a register.
+#define I2C_TRACE_FLAG_FAULT    0x04   // The transfer failed.
+#define I2C_TRACE_FLAG_IRQ      0x08   // A read of IrqSrc that answered INTB.
+#define I2C_TRACE_FLAG_JIG      0x10   // The jig's own, not the driver's.
+
+/* A record, as read back out. */
+typedef struct {
+  uint8_t        flags;
+  uint8_t        addr;
+  uint8_t        reg;
+  uint8_t        fault;
+  uint16_t       len;
+  uint32_t       dt_us;
+  const uint8_t* payload;   // nullptr if there is none.
+} I2CTraceRecord;
+
+
+class I2CTrace {
+  public:
+    I2CTrace();
+    ~I2CTrace();
+
+    int8_t start(uint8_t slot, uint32_t bytes);
+    void   stop();
+    inline bool     recording() {   return _recording;   };
+    inline uint8_t  slot() {        return _buf[5];      };
+    inline uint32_t records() {     return _records;     };
+    inline uint32_t length() {      return _len;         };
+    inline const uint8_t* buffer() {   return (const uint8_t*) _buf;   };
+
+    void   add(I2CBusOp*, uint8_t flags);
+
+    int8_t save(Storage*);
+    void   printHex(StringBuilder*);
+    void   printSummary(StringBuilder*);
+
+    /* For readers of a finished trace. */
+    static int8_t  checkHeader(const uint8_t* buf, uint32_t len);
+    static int32_t readRecord(const uint8_t* buf, uint32_t len, uint32_t offset, I2CTraceRecord*);
+
+
+  private:
+    uint8_t* _buf       = nullptr;
+    uint32_t _size      = 0;
+    uint32_t _len       = 0;
+    uint32_t _records   = 0;
+    uint32_t _dropped   = 0;
+    uint64_t _t_last    = 0;
+    bool     _recording = false;
+
+    void _put_header();
+};
+
+#endif  // __SX8634_I2C_TRACE_H__
@@ -0,0 +1,371 @@
+#include "IoCore.h"
+#include "SpscQueue.h"
+#include "LogRing.h"
+#include "LoopWake.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__MANUVR_LINUX)
+  #include <pthread.h>
+  #include <unistd.h>
+  #include <fcntl.h>
+#else
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/task.h"
+#endif
+
+
+static SpscQueue<IoCoreLine, IO_CORE_LINE_DEPTH>      _lines;   // I/O task -> kernel task
+static SpscQueue<char, IO_CORE_TEXT_DEPTH>            _text;    // Kernel task -> I/O task
+static SpscQueue<IoCoreStoreJob, IO_CORE_STORE_DEPTH> _jobs;    // Kernel task -> I/O task
+
+static std::atomic<bool>     _running{false};
+static std::atomic<uint32_t> _text_written{0};   // Bytes of _text that reached stdout.
+
+/* Kept by the kernel task. */
+static uint32_t _lines_taken  = 0;
+static uint32_t _text_bytes   = 0;
+static uint32_t _text_stalls  = 0;
+static uint32_t _store_queued = 0;
+static uint32_t _store_stalls = 0;
+static uint32_t _store_nomem  = 0;
+static uint32_t _read_waits   = 0;
+
+/* Kept by the I/O task. */
+static uint32_t _lines_cut    = 0;
+static uint32_t _store_writes = 0;
+static uint32_t _store_failed = 0;
+
+/* Console input, as it is typed. Only the I/O task touches these. */
+static char     _line_buf[IO_CORE_LINE_MAX];
+static uint16_t _line_len = 0;
+
+
+/*******************************************************************************
+* Platform primitives                                                          *
+*******************************************************************************/
+#if defined(__MANUVR_LINUX)
+
+static pthread_t _io_thread;
+
+static void _io_nap() {       usleep(IO_CORE_POLL_MS * 1000);   }
+static void _io_notify() {}
+static void _kernel_yield() { usleep(1000);   }
+
+static int _console_getc() {
+  uint8_t c;
+  return (1 == read(STDIN_FILENO, &c, 1)) ? c : -1;
+}
+
+static void* _io_task(void*);
+
+/* Host builds have no cores to choose from. */
+static int8_t _spawn(int core) {
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+  return (0 == pthread_create(&_io_thread, nullptr, _io_task, nullptr)) ? 0 : -1;
+}
+
+#else
+
+static TaskHandle_t _io_handle = nullptr;
+
+static void _io_nap() {
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IO_CORE_POLL_MS));
+}
+
+static void _io_notify() {
+  if (nullptr != _io_handle) {
+    xTaskNotifyGive(_io_handle);
+  }
+}
+
+static void _kernel_yield() {
+  _io_notify();
+  vTaskDelay(1);
+}
+
+/* stdin on the UART doesn't block. It returns EOF when there is nothing. */
+static int _console_getc() {
+  const int c = fgetc(stdin);
+  return (EOF == c) ? -1 : c;
+}
+
+static void _io_task(void*);
+
+static int8_t _spawn(int core) {
+  const BaseType_t ret = xTaskCreatePinnedToCore(
+    _io_task, "_io", 8192, nullptr, (tskIDLE_PRIORITY + 1), &_io_handle, core
+  );
+  return (pdPASS == ret) ? 0 : -1;
+}
+
+#endif
+
+
+/*******************************************************************************
+* I/O task                                                                     *
+*******************************************************************************/
+
+/*
+* Assembles console input into lines. Empty lines are ignored, and anything
+*   past IO_CORE_LINE_MAX is cut.
+*
+* @return true if any input was read.
+*/
+static bool _service_console_in() {
+  bool read_any = false;
+  int c;
+  while (0 <= (c = _console_getc())) {
+    read_any = true;
+    if (('\n' == c) || ('\r' == c)) {
+      if (0 < _line_len) {
+        IoCoreLine* line = _lines.claim();
+        if (nullptr != line) {
+          memcpy(line->text, _line_buf, _line_len);
+          line->text[_line_len] = '\0';
+          _lines.publish();
+          loop_wake();
+        }
+        else {
+          _lines_cut++;   // The kernel task is behind. The line is lost.
+        }
+        _line_len = 0;
+      }
+    }
+    else if ((0x08 == c) || (0x7F == c)) {
+      if (0 < _line_len) _line_len--;
+    }
+    else if ((IO_CORE_LINE_MAX - 1) > _line_len) {
+      _line_buf[_line_len++] = (char) c;
+    }
+  }
+  return read_any;
+}
+
+
+/*
+* @return true if anything was written.
+*/
+static bool _service_console_out() {
+  char chunk[256];
+  unsigned int n = 0;
+  uint32_t len;
+  while (0 < (len = _text.read(chunk, sizeof(chunk)))) {
+    fwrite(chunk, 1, len, stdout);
+    n += len;
+  }
+  const unsigned int text_n = n;
+  n += log_ring_drain(LOG_RING_DRAIN_BATCH);
+  if (0 < n) {
+    fflush(stdout);
+  }
+  if (0 < text_n) {
+    _text_written.fetch_add(text_n, std::memory_order_release);
+  }
+  return (0 < n);
+}
+
+
+/*
+* One write per pass, so that console output isn't held up behind a long run
+*   of them.
+*
+* @return true if a write was done.
+*/
+static bool _service_storage() {
+  IoCoreStoreJob* job = _jobs.peek();
+  if (nullptr == job) return false;
+  const int wlen = job->store->persistentWrite(job->key, job->data, job->len, job->offset);
+  _store_writes++;
+  if ((int) job->len != wlen) {
+    _store_failed++;
+    printf("Deferred write of %u bytes to \"%s\" failed (%d).\n", (unsigned int) job->len, job->key, wlen);
+  }
+  free(job->data);
+  job->data = nullptr;
+  _jobs.release();
+  return true;
+}
+
+
+#if defined(__MANUVR_LINUX)
+static void* _io_task(void*) {
+#else
+static void _io_task(void*) {
+#endif
+  while (1) {
+    bool busy = _service_console_in();
+    busy |= _service_console_out();
+    busy |= _service_storage();
+    if (!busy) {
+      _io_nap();
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Kernel task                                                                  *
+*******************************************************************************/
+
+int8_t io_core_start(int core) {
+  if (_running.load()) return -1;
+  _running.store(true);
+  if (0 != _spawn(core)) {
+    _running.store(false);
+    return -1;
+  }
+  return 0;
+}
+
+
+bool io_core_running() {
+  return _running.load(std::memory_order_relaxed);
+}
+
+
+int io_core_take_line(char* buf, unsigned int len) {
+  IoCoreLine* line = _lines.peek();
+  if ((nullptr == line) || (0 == len)) return 0;
+  const unsigned int n = strnlen(line->text, len - 1);
+  memcpy(buf, line->text, n);
+  buf[n] = '\0';
+  _lines.release();
+  _lines_taken++;
+  return (int) n;
+}
+
+
+/*
+* If the queue can't hold it all, this waits for the I/O task to make room.
+*/
+static void _queue_text(const char* str, uint32_t len) {
+  uint32_t remaining = len;
+  _text_bytes += len;
+  remaining -= _text.write(str, remaining);
+  if (0 < remaining) {
+    _text_stalls++;
+    while (0 < remaining) {
+      _kernel_yield();
+      remaining -= _text.write(str + (len - remaining), remaining);
+    }
+  }
+  _io_notify();
+}
+
+
+void io_core_print(StringBuilder* output) {
+  if (0 < output->length()) {
+    _queue_text((const char*) output->string(), output->length());
+  }
+  output->clear();
+}
+
+
+/*
+* Binary output shares the text queue, so that a frame never lands in the
+*   middle of a line of text.
+*/
+void io_core_emit(const uint8_t* buf, unsigned int len) {
+  if (!io_core_running()) {
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    return;
+  }
+  if (0 < len) {
+    _queue_text((const char*) buf, len);
+  }
+}
+
+
+void io_core_flush() {
+  if (!io_core_running()) {
+    fflush(stdout);
+    return;
+  }
+  while (_text_bytes != _text_written.load(std::memory_order_acquire)) {
+    _kernel_yield();
+  }
+}
+
+
+/*
+* Returns len on success, as persistentWrite() does. Once the write is queued,
+*   it is taken to have succeeded. A write that later fails is reported by the
+*   I/O task.
+*
+* If there isn't heap for the copy, this waits for the queue to empty, and then
+*   does the write itself, so that writes still land in order.
+*/
+int io_core_write(Storage* store, const char* key, uint8_t* buf, unsigned int len, uint16_t offset) {
+  if (!io_core_running()) {
+    return store->persistentWrite(key, buf, len, offset);
+  }
+  if (IO_CORE_KEY_MAX <= strlen(key)) return -1;
+  uint8_t* copy = (uint8_t*) malloc((0 < len) ? len : 1);
+  if (nullptr == copy) {
+    _store_nomem++;
+    while (0 < _jobs.count()) {
+      _kernel_yield();
+    }
+    return store->persistentWrite(key, buf, len, offset);
+  }
+  memcpy(copy, buf, len);
+  IoCoreStoreJob* job;
+  while (nullptr == (job = _jobs.claim())) {
+    _store_stalls++;
+    _kernel_yield();
+  }
+  job->store  = store;
+  job->offset = offset;
+  job->len    = len;
+  job->data   = copy;
+  strncpy(job->key, key, IO_CORE_KEY_MAX);
+  _jobs.publish();
+  _store_queued++;
+  _io_notify();
+  return (int) len;
+}
+
+
+/*
+* Waits for any queued writes to the same key before reading it.
+*/
+int io_core_read(Storage* store, const char* key, uint8_t* buf, unsigned int len, uint16_t offset) {
+  if (io_core_running()) {
+    bool waited = false;
+    uint32_t i = 0;
+    IoCoreStoreJob* job;
+    while (nullptr != (job = _jobs.pending(i))) {
+      if (0 == strncmp(job->key, key, IO_CORE_KEY_MAX)) {
+        // The I/O task may be writing it now. Start over once it's gone.
+        waited = true;
+        _kernel_yield();
+        i = 0;
+      }
+      else {
+        i++;
+      }
+    }
+    if (waited) _read_waits++;
+  }
+  return store->persistentRead(key, buf, len, offset);
+}
+
+
+void io_core_print_stats(StringBuilder* output) {
+  if (!io_core_running()) {
+    output->concat("Cores are not split. Everything runs in the kernel task.\n");
+    return;
+  }
+  output->concatf("Console: %u lines in (%u lost), %u bytes out, %u waiting of %u. Output stalled %u times.\n",
+    _lines_taken, _lines_cut, _text_bytes, _text.count(), IO_CORE_TEXT_DEPTH, _text_stalls
+  );
+  output->concatf("Storage: %u writes queued, %u done, %u failed, %u waiting. Stalled %u times. %u reads waited.\n",
+    _store_queued, _store_writes, _store_failed, _jobs.count(), _store_stalls, _read_waits
+  );
+  if (0 < _store_nomem) {
+    output->concatf("Storage: %u writes were done in the kernel task for want of heap.\n", _store_nomem);
+  }
+}
@@ -0,0 +1,89 @@
+/*
+File:   IoCore.h
+Author: J. Ian Lindsay
+Date:   2019.09.17
+
+Splits the jig across the ESP32's two cores.
+
+Normally, one task runs everything: the kernel, I2C, the SX8634 drivers, the
+  console, and storage. A flash write (NVS erases a sector now and then) or a
+  long console dump holds up touch servicing for as long as it takes.
+
+With CONFIG_SX8634_PROV_DUAL_CORE, the kernel task (I2C, SX8634, and the
+  provisioner) is pinned to one core, and an I/O task is pinned to the other.
+  The I/O task owns the slow things...
+  1) Console input. Lines are read from stdin, and handed to the kernel task.
+  2) Console output. Text from the provisioner, event stream frames, and the
+       deferred log ring, are written by the I/O task.
+  3) Storage writes. Each is copied to the heap whole, queued, and written in
+       order, with one call to persistentWrite().
+
+Each direction is a lock-free single-producer, single-consumer queue (see
+  SpscQueue.h), so neither side ever waits on a lock held by the other. The
+  kernel task only waits if a queue is full. That is counted as a stall.
+
+A read of a storage key that has writes still in the queue waits for them,
+  so that the kernel task always reads what it last wrote.
+
+Until io_core_start() is called (and always, in host builds that don't call
+  it), every function here does its work right away, on the calling thread.
+*/
+
+#ifndef __SX8634_IO_CORE_H__
+#define __SX8634_IO_CORE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define IO_CORE_LINE_MAX          128   // Longest console line.
+#define IO_CORE_LINE_DEPTH          4   // Console lines waiting for the kernel task.
+#define IO_CORE_TEXT_DEPTH       8192   // Bytes of console output waiting for the I/O task.
+#define IO_CORE_STORE_DEPTH        16   // Storage writes waiting for the I/O task.
+#define IO_CORE_KEY_MAX            16   // NVS keys are at most 15 characters.
+#define IO_CORE_POLL_MS            10   // The I/O task's nap when it has nothing to do.
+
+typedef struct {
+  char text[IO_CORE_LINE_MAX];
+} IoCoreLine;
+
+typedef struct {
+  Storage* store;
+  char     key[IO_CORE_KEY_MAX];
+  uint16_t offset;
+  uint32_t len;
+  uint8_t* data;           // A heap copy. The I/O task frees it.
+} IoCoreStoreJob;
+
+
+/* Called once, from the kernel task. Returns 0 on success. */
+int8_t io_core_start(int core);
+bool   io_core_running();
+
+/* Kernel task */
+
+/* Takes one console line, if there is one. Returns its length, or 0. */
+int    io_core_take_line(char* buf, unsigned int len);
+
+/* Hands console output to the I/O task, and empties the given buffer. */
+void   io_core_print(StringBuilder*);
+
+/* Hands raw bytes for stdout to the I/O task, in order with the text. */
+void   io_core_emit(const uint8_t* buf, unsigned int len);
+
+/* Waits until everything handed to the I/O task for stdout has been written. */
+void   io_core_flush();
+
+/*
+* Stand-ins for Storage::persistentWrite() and persistentRead().
+* On the ESP32, Storage is NVS, which replaces a key's whole value on every
+*   write, whatever the offset. So every write must carry the key's entire
+*   value, from offset zero. Anything that changes part of a larger structure
+*   either rewrites it whole, or keeps the parts under keys of their own.
+*/
+int    io_core_write(Storage*, const char* key, uint8_t* buf, unsigned int len, uint16_t offset);
+int    io_core_read(Storage*, const char* key, uint8_t* buf, unsigned int len, uint16_t offset);
+
+void   io_core_print_stats(StringBuilder*);
+
+#endif  // __SX8634_IO_CORE_H__
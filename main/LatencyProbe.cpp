@@ -0,0 +1,156 @@
+#include "LatencyProbe.h"
+#include <string.h>
+
+/* Written by the ISR, and cleared by the consumer. */
+static volatile uint64_t LATENCY_IRQ_US = 0;
+
+static const char* const MSG_TYPE_STR[LATENCY_MSG_TYPES] = {
+  "Button", "Slider", "GPI"
+};
+
+static const char* const SPAN_STR[LATENCY_SPANS] = {
+  "IRQ->read", "read", "done->raise", "raise->notify", "total"
+};
+
+
+void EDGE_RING_ISR_ATTR latency_irq_isr() {
+  if (0 == LATENCY_IRQ_US) {
+    LATENCY_IRQ_US = edge_clock_us();
+  }
+}
+
+
+uint64_t latency_irq_take() {
+  const uint64_t ret = LATENCY_IRQ_US;
+  LATENCY_IRQ_US = 0;
+  return ret;
+}
+
+
+/*******************************************************************************
+* LatencyHistogram                                                             *
+*******************************************************************************/
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+
+void LatencyHistogram::reset() {
+  _count = 0;
+  _max   = 0;
+  memset(_buckets, 0, sizeof(_buckets));
+}
+
+
+/*
+* Exact below 8. After that, the top three bits of the value pick a bucket: the
+*   position of the highest bit gives the power of two, and the next two bits
+*   split it into quarters.
+*/
+uint8_t LatencyHistogram::bucketFor(uint32_t us) {
+  if (8 > us) {
+    return (uint8_t) us;
+  }
+  uint8_t msb = 31;
+  while (0 == (us & ((uint32_t) 1 << msb))) msb--;
+  const uint32_t b = 8 + ((msb - 3) << 2) + ((us >> (msb - 2)) & 0x03);
+  return (uint8_t) ((LATENCY_BUCKETS > b) ? b : (LATENCY_BUCKETS - 1));
+}
+
+
+/* The largest value that lands in the given bucket. */
+uint32_t LatencyHistogram::bucketTop(uint8_t bucket) {
+  if (8 > bucket) {
+    return bucket;
+  }
+  const uint8_t msb = 3 + ((bucket - 8) >> 2);
+  const uint8_t q   = (bucket - 8) & 0x03;
+  return ((uint32_t) (5 + q) << (msb - 2)) - 1;
+}
+
+
+void LatencyHistogram::add(uint32_t us) {
+  _buckets[bucketFor(us)]++;
+  _count++;
+  if (us > _max) _max = us;
+}
+
+
+/*
+* @return The top of the bucket holding the given percentile. Never more than
+*   the largest value seen.
+*/
+uint32_t LatencyHistogram::percentile(uint8_t pct) {
+  if (0 == _count) return 0;
+  const uint32_t rank = ((uint64_t) _count * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += _buckets[i];
+    if (seen >= rank) {
+      const uint32_t top = bucketTop(i);
+      return (top < _max) ? top : _max;
+    }
+  }
+  return _max;
+}
+
+
+/*******************************************************************************
+* LatencyProbe                                                                 *
+*******************************************************************************/
+
+LatencyProbe::LatencyProbe() {
+}
+
+
+/*
+* Takes the stamps of the IRQ that produced a message. Each message type takes
+*   a given set of stamps only once. Stamps that are out of order (or missing,
+*   for a message that didn't start with an IRQ) are counted, but not used.
+*/
+void LatencyProbe::record(uint8_t msg_type, LatencyStamps* s, uint64_t notify_us) {
+  if ((LATENCY_MSG_TYPES <= msg_type) || (s->recorded & (1 << msg_type))) {
+    return;
+  }
+  s->recorded |= (1 << msg_type);
+  const bool ordered = (0 < s->irq) && (s->irq <= s->read_start) &&
+    (s->read_start <= s->read_done) && (s->read_done <= s->raise) &&
+    (s->raise <= notify_us);
+  if (!ordered) {
+    _incomplete++;
+    return;
+  }
+  LatencyHistogram* h = _hist[msg_type];
+  h[LATENCY_SPAN_IRQ_READ].add((uint32_t) (s->read_start - s->irq));
+  h[LATENCY_SPAN_READ].add((uint32_t) (s->read_done - s->read_start));
+  h[LATENCY_SPAN_RAISE].add((uint32_t) (s->raise - s->read_done));
+  h[LATENCY_SPAN_NOTIFY].add((uint32_t) (notify_us - s->raise));
+  h[LATENCY_SPAN_TOTAL].add((uint32_t) (notify_us - s->irq));
+}
+
+
+void LatencyProbe::reset() {
+  _incomplete = 0;
+  for (uint8_t m = 0; m < LATENCY_MSG_TYPES; m++) {
+    for (uint8_t i = 0; i < LATENCY_SPANS; i++) {
+      _hist[m][i].reset();
+    }
+  }
+}
+
+
+void LatencyProbe::printHistograms(StringBuilder* output) {
+  output->concatf("Touch-to-notify latency (us). %u messages lacked stamps.\n", _incomplete);
+  output->concat("Message  Span            Count      p50      p99      max\n");
+  for (uint8_t m = 0; m < LATENCY_MSG_TYPES; m++) {
+    if (0 == _hist[m][LATENCY_SPAN_TOTAL].count()) continue;
+    for (uint8_t i = 0; i < LATENCY_SPANS; i++) {
+      LatencyHistogram* h = &_hist[m][i];
+      output->concatf("%-8s %-14s %6u %8u %8u %8u\n",
+        (0 == i) ? MSG_TYPE_STR[m] : "", SPAN_STR[i],
+        h->count(), h->percentile(50), h->percentile(99), h->max()
+      );
+    }
+  }
+}
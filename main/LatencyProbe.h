@@ -0,0 +1,103 @@
+/*
+File:   LatencyProbe.h
+Author: J. Ian Lindsay
+Date:   2019.09.10
+
+Measures how long a touch takes to become a message in SX8634BitDiddler.
+
+Five points are stamped for each message that the driver raises:
+  IRQ     The SX8634 asserted INTB (the jig routes it to the wake pin).
+  Read    The driver started reading IrqSrc in response.
+  Done    The I2C read that produced the message finished.
+  Raise   The driver's callback for that read returned. The driver raises its
+            messages from within the callback, so this bounds the raise.
+  Notify  notify() received the message.
+
+The intervals between them (and the whole span) are kept in fixed-bucket
+  histograms, one set for each message type. Buckets are log-linear: exact up
+  to 8us, and then four to each power of two. So a percentile is reported as
+  the top of the bucket it falls in, which is never more than 25% high.
+
+Stamps come from edge_clock_us(), which is safe to read in an ISR.
+*/
+
+#ifndef __SX8634_LATENCY_PROBE_H__
+#define __SX8634_LATENCY_PROBE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "EdgeRing.h"
+
+#define LATENCY_BUCKETS        96    // Tops out above 16 seconds.
+
+/* The message types that are measured. */
+#define LATENCY_MSG_BUTTON      0
+#define LATENCY_MSG_SLIDER      1
+#define LATENCY_MSG_GPI         2
+#define LATENCY_MSG_TYPES       3
+
+/* The intervals that are measured. */
+#define LATENCY_SPAN_IRQ_READ   0    // IRQ to read start.
+#define LATENCY_SPAN_READ       1    // Read start to read done.
+#define LATENCY_SPAN_RAISE      2    // Read done to raise.
+#define LATENCY_SPAN_NOTIFY     3    // Raise to notify.
+#define LATENCY_SPAN_TOTAL      4    // IRQ to notify.
+#define LATENCY_SPANS           5
+
+
+/* The stamps for one IRQ, as collected by a slot's SX8634Jig. */
+typedef struct {
+  uint64_t irq;
+  uint64_t read_start;
+  uint64_t read_done;
+  uint64_t raise;
+  uint8_t  recorded;    // Bit n is set once message type n has used them.
+} LatencyStamps;
+
+
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void     add(uint32_t us);
+    void     reset();
+    uint32_t percentile(uint8_t pct);
+
+    inline uint32_t count() {   return _count;   };
+    inline uint32_t max() {     return _max;     };
+
+    static uint8_t  bucketFor(uint32_t us);
+    static uint32_t bucketTop(uint8_t bucket);
+
+
+  private:
+    uint32_t _count = 0;
+    uint32_t _max   = 0;
+    uint32_t _buckets[LATENCY_BUCKETS];
+};
+
+
+class LatencyProbe {
+  public:
+    LatencyProbe();
+
+    void record(uint8_t msg_type, LatencyStamps*, uint64_t notify_us);
+    void reset();
+    void printHistograms(StringBuilder*);
+
+
+  private:
+    uint32_t         _incomplete = 0;   // Messages without a full set of stamps.
+    LatencyHistogram _hist[LATENCY_MSG_TYPES][LATENCY_SPANS];
+};
+
+
+/*
+* Called from the ISR on the line that INTB is routed to. The first IRQ after
+*   each take is kept.
+*/
+void     latency_irq_isr();
+uint64_t latency_irq_take();
+
+#endif  // __SX8634_LATENCY_PROBE_H__
@@ -0,0 +1,66 @@
+#include "LogRing.h"
+#include "SpscQueue.h"
+#include <stdio.h>
+
+static SpscQueue<LogRecord, LOG_RING_DEPTH> LOG_RING;
+static uint32_t  _logged    = 0;
+static uint32_t  _truncated = 0;
+static uint32_t  _highwater = 0;
+static std::atomic<uint32_t> _dropped{0};   // Counted by the producer, reported by the consumer.
+
+
+bool log_ring_put(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+  LogRecord* r = LOG_RING.claim();
+  if (nullptr == r) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  r->fmt     = fmt;
+  r->args[0] = a0;
+  r->args[1] = a1;
+  r->args[2] = a2;
+  r->args[3] = a3;
+  LOG_RING.publish();
+  _logged++;
+  const uint32_t used = LOG_RING.count();
+  if (used > _highwater) _highwater = used;
+  return true;
+}
+
+
+unsigned int log_ring_drain(unsigned int max) {
+  char line[LOG_RING_LINE_MAX];
+  unsigned int n = 0;
+  const LogRecord* r;
+  while ((n < max) && (nullptr != (r = LOG_RING.peek()))) {
+    int len = snprintf(line, sizeof(line), r->fmt, r->args[0], r->args[1], r->args[2], r->args[3]);
+    if ((int) sizeof(line) <= len) {
+      len = sizeof(line) - 1;
+      _truncated++;
+    }
+    if (0 < len) {
+      fwrite(line, 1, len, stdout);
+    }
+    LOG_RING.release();
+    n++;
+  }
+  if (LOG_RING.empty() && (0 < _dropped.load(std::memory_order_relaxed))) {
+    // The lost lines came after everything that was in the ring.
+    const uint32_t dropped = _dropped.exchange(0);
+    const int len = snprintf(line, sizeof(line), "(%u log lines dropped)\n", dropped);
+    fwrite(line, 1, len, stdout);
+    n++;
+  }
+  if (0 < n) {
+    fflush(stdout);
+  }
+  return n;
+}
+
+
+void log_ring_print(StringBuilder* output) {
+  output->concatf("Log ring: %u lines logged, %u waiting (most was %u of %u)\n",
+    _logged, LOG_RING.count(), _highwater, LOG_RING_DEPTH
+  );
+  output->concatf("\t%u truncated, %u dropped and not yet reported\n", _truncated, _dropped.load());
+}
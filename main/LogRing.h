@@ -0,0 +1,50 @@
+/*
+File:   LogRing.h
+Author: J. Ian Lindsay
+Date:   2019.09.12
+
+Deferred logging for the event path.
+
+Building a line in local_log and flushing it grows a heap-backed StringBuilder
+  and writes to the console, right there in the middle of handling a touch.
+  Instead, log_ring_put() copies a format string pointer and its arguments
+  into a preallocated ring, which costs the same every time and never touches
+  the heap. The main loop renders and writes the lines with log_ring_drain()
+  when the kernel is idle, before it waits.
+
+The format string must outlive the record (string literals do), and arguments
+  are 32-bit integers. So %u, %d, %x and %c are fine. %s is not. Lines are
+  rendered into a fixed buffer, and anything past LOG_RING_LINE_MAX is cut.
+
+If the ring is full, the new line is dropped and counted. Lines already in the
+  ring are never overwritten.
+
+The ring is filled by one thread, and drained by one thread. With the cores
+  split (see IoCore.h), those are different threads on different cores.
+*/
+
+#ifndef __SX8634_LOG_RING_H__
+#define __SX8634_LOG_RING_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define LOG_RING_DEPTH        64   // Must be a power of two.
+#define LOG_RING_LINE_MAX    128
+#define LOG_RING_DRAIN_BATCH   8   // Lines rendered per idle pass of the loop.
+
+typedef struct {
+  const char* fmt;
+  uint32_t    args[4];
+} LogRecord;
+
+
+bool log_ring_put(const char* fmt, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0);
+
+/* Renders and writes as many as max lines. Returns how many there were. */
+unsigned int log_ring_drain(unsigned int max);
+
+void log_ring_print(StringBuilder*);
+
+#endif  // __SX8634_LOG_RING_H__
@@ -0,0 +1,211 @@
+#include "LoopWake.h"
+#include <string.h>
+
+#if defined(__MANUVR_LINUX)
+  #include <pthread.h>
+  #include <time.h>
+  #include <unistd.h>
+#else
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/task.h"
+  #include "esp_attr.h"
+  #include "esp_timer.h"
+#endif
+
+
+static LoopWakeStats _stats;
+static bool          _event_driven = true;
+static uint32_t      _tick_ms      = 10;
+
+/* The first wakeup after each wait is stamped. Guarded per-platform, below. */
+static volatile bool     _wake_pending = false;
+static volatile uint32_t _wake_stamp   = 0;
+
+
+/*******************************************************************************
+* Platform primitives                                                          *
+*******************************************************************************/
+#if defined(__MANUVR_LINUX)
+
+static pthread_mutex_t _wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _wake_cond  = PTHREAD_COND_INITIALIZER;
+static bool            _notified   = false;
+
+static inline uint32_t _now_us() {   return micros();   }
+
+static void _post() {
+  pthread_mutex_lock(&_wake_mutex);
+  if (!_wake_pending) {
+    _wake_stamp   = _now_us();
+    _wake_pending = true;
+  }
+  _notified = true;
+  pthread_cond_signal(&_wake_cond);
+  pthread_mutex_unlock(&_wake_mutex);
+}
+
+void loop_wake_isr() {   _post();   }
+void loop_wake() {       _post();   }
+
+
+/*
+* Blocks for a wakeup or the tick. If a wakeup was stamped, its latency is
+*   written to *latency.
+*
+* @return true if there was a wakeup.
+*/
+static bool _wait(uint32_t* latency) {
+  bool woken = false;
+  if (_event_driven) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long) (_tick_ms % 1000) * 1000000L;
+    deadline.tv_sec  += (_tick_ms / 1000) + (deadline.tv_nsec / 1000000000L);
+    deadline.tv_nsec %= 1000000000L;
+    pthread_mutex_lock(&_wake_mutex);
+    while (!_notified) {
+      if (0 != pthread_cond_timedwait(&_wake_cond, &_wake_mutex, &deadline)) {
+        break;
+      }
+    }
+  }
+  else {
+    usleep(_tick_ms * 1000);
+    pthread_mutex_lock(&_wake_mutex);
+  }
+  woken = _notified;
+  _notified = false;
+  if (_wake_pending) {
+    *latency = _now_us() - _wake_stamp;
+    _wake_pending = false;
+  }
+  pthread_mutex_unlock(&_wake_mutex);
+  return woken;
+}
+
+
+void loop_wake_init(bool event_driven, uint32_t tick_ms) {
+  loop_wake_configure(event_driven, tick_ms);
+}
+
+#else   // FreeRTOS on the ESP32
+
+static TaskHandle_t _loop_task = nullptr;
+static portMUX_TYPE _wake_mux  = portMUX_INITIALIZER_UNLOCKED;
+
+/* esp_timer_get_time() is safe to call from an ISR. micros() may not be. */
+static inline uint32_t IRAM_ATTR _now_us() {   return (uint32_t) esp_timer_get_time();   }
+
+static inline void IRAM_ATTR _stamp() {
+  if (!_wake_pending) {
+    _wake_stamp   = _now_us();
+    _wake_pending = true;
+  }
+}
+
+
+void IRAM_ATTR loop_wake_isr() {
+  BaseType_t higher_prio_woken = pdFALSE;
+  portENTER_CRITICAL_ISR(&_wake_mux);
+  _stamp();
+  portEXIT_CRITICAL_ISR(&_wake_mux);
+  if (nullptr != _loop_task) {
+    vTaskNotifyGiveFromISR(_loop_task, &higher_prio_woken);
+    if (higher_prio_woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+
+void loop_wake() {
+  portENTER_CRITICAL(&_wake_mux);
+  _stamp();
+  portEXIT_CRITICAL(&_wake_mux);
+  if (nullptr != _loop_task) {
+    xTaskNotifyGive(_loop_task);
+  }
+}
+
+
+static bool _wait(uint32_t* latency) {
+  TickType_t ticks = pdMS_TO_TICKS(_tick_ms);
+  if (0 == ticks) ticks = 1;
+  bool woken = false;
+  if (_event_driven) {
+    woken = (0 < ulTaskNotifyTake(pdTRUE, ticks));
+  }
+  else {
+    vTaskDelay(ticks);
+    woken = (0 < ulTaskNotifyTake(pdTRUE, 0));   // Drain anything posted during the nap.
+  }
+  portENTER_CRITICAL(&_wake_mux);
+  if (_wake_pending) {
+    *latency = _now_us() - _wake_stamp;
+    _wake_pending = false;
+  }
+  portEXIT_CRITICAL(&_wake_mux);
+  return woken;
+}
+
+
+void loop_wake_init(bool event_driven, uint32_t tick_ms) {
+  _loop_task = xTaskGetCurrentTaskHandle();
+  loop_wake_configure(event_driven, tick_ms);
+}
+
+#endif  // Platform primitives
+
+
+
+/*******************************************************************************
+* Common                                                                       *
+*******************************************************************************/
+
+void loop_wake_configure(bool event_driven, uint32_t tick_ms) {
+  _event_driven = event_driven;
+  _tick_ms      = (0 < tick_ms) ? tick_ms : 1;
+  loop_wake_reset_stats();
+}
+
+bool     loop_wake_event_driven() {   return _event_driven;   }
+uint32_t loop_wake_tick_ms() {        return _tick_ms;        }
+
+
+bool loop_wake_wait() {
+  uint32_t latency = 0xFFFFFFFF;
+  bool woken = _wait(&latency);
+  _stats.waits++;
+  if (woken) {
+    _stats.wakes++;
+  }
+  else {
+    _stats.timeouts++;
+  }
+  if (0xFFFFFFFF != latency) {
+    if ((0 == _stats.samples) || (latency < _stats.lat_min)) _stats.lat_min = latency;
+    if (latency > _stats.lat_max) _stats.lat_max = latency;
+    _stats.lat_total += latency;
+    _stats.samples++;
+  }
+  return woken;
+}
+
+
+void loop_wake_reset_stats() {
+  memset((void*) &_stats, 0, sizeof(LoopWakeStats));
+}
+
+
+void loop_wake_print(StringBuilder* output) {
+  output->concatf("Loop wakeup (%s, %u ms tick)\n", _event_driven ? "event-driven" : "polled", _tick_ms);
+  output->concatf("\tWaits:        %u (%u woken, %u timed out)\n", _stats.waits, _stats.wakes, _stats.timeouts);
+  if (0 < _stats.samples) {
+    output->concatf("\tLatency (us): min %u / avg %u / max %u over %u wakeups\n",
+      _stats.lat_min,
+      (uint32_t) (_stats.lat_total / _stats.samples),
+      _stats.lat_max,
+      _stats.samples
+    );
+  }
+}
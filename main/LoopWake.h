@@ -0,0 +1,69 @@
+/*
+File:   LoopWake.h
+Author: J. Ian Lindsay
+Date:   2019.09.05
+
+Wakes the main loop as soon as there is something for it to do.
+
+Without this, the loop naps for a fixed tick whenever the kernel is idle, and
+  anything that arrives during the nap waits for the nap to end. Instead, the
+  loop blocks in loop_wake_wait(), and any ISR (or other thread) that has made
+  work for the kernel calls loop_wake_isr() (or loop_wake()) to end the wait
+  early. The fallback tick still bounds the wait, so that the scheduler and
+  anything that can't post a wakeup will be serviced.
+
+The first wakeup posted after each wait is timestamped, and the delay between
+  that stamp and the loop resuming is tallied. This is the IRQ-to-service
+  latency that the wakeup is meant to improve. Those numbers are collected the
+  same way when event-driven mode is disabled, so the two can be compared.
+
+LoopWake.cpp holds both implementations. The ESP32's uses a FreeRTOS task
+  notification. The host build's (under __MANUVR_LINUX, built from main/ by
+  sim/Makefile) uses a pthread condition variable.
+*/
+
+#ifndef __SX8634_LOOP_WAKE_H__
+#define __SX8634_LOOP_WAKE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+typedef struct {
+  uint32_t waits;      // Calls to loop_wake_wait().
+  uint32_t wakes;      // Waits that ended because of a wakeup.
+  uint32_t timeouts;   // Waits that ended because of the fallback tick.
+  uint32_t samples;    // Latency samples taken.
+  uint32_t lat_min;    // Shortest delay between a wakeup and service (us).
+  uint32_t lat_max;    // Longest delay between a wakeup and service (us).
+  uint64_t lat_total;  // Sum of all delays (us).
+} LoopWakeStats;
+
+
+/* Called once, from the thread that will be waiting. */
+void loop_wake_init(bool event_driven, uint32_t tick_ms);
+
+/*
+* If event_driven is false, loop_wake_wait() naps for the full tick (as the loop
+*   always did), but latency is still recorded. Resets the stats.
+*/
+void loop_wake_configure(bool event_driven, uint32_t tick_ms);
+bool     loop_wake_event_driven();
+uint32_t loop_wake_tick_ms();
+
+/* Post a wakeup. */
+void loop_wake_isr();   // From interrupt context.
+void loop_wake();       // From any other thread.
+
+/*
+* Called by the loop when the kernel is idle. Blocks until a wakeup is posted,
+*   or the tick elapses.
+*
+* @return true if a wakeup was pending when the wait ended.
+*/
+bool loop_wake_wait();
+
+void loop_wake_reset_stats();
+void loop_wake_print(StringBuilder*);
+
+#endif  // __SX8634_LOOP_WAKE_H__
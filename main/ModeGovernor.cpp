@@ -0,0 +1,200 @@
+/*
+File:   ModeGovernor.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.23
+
+Automatic ACTIVE/DOZE/SLEEP for an SX8634. See ModeGovernor.h.
+*/
+
+#include "ModeGovernor.h"
+#include "SX8634Conf.h"
+#include <string.h>
+
+static const char* const MODE_NAMES[MODE_GOV_MODES] = { "ACTIVE", "DOZE", "SLEEP" };
+static const SX8634OpMode OP_MODES[MODE_GOV_MODES] = {
+  SX8634OpMode::ACTIVE, SX8634OpMode::DOZE, SX8634OpMode::SLEEP
+};
+
+
+ModeGovernor::ModeGovernor() {
+  memset(_mode_ms, 0, sizeof(_mode_ms));
+  memset(_entries, 0, sizeof(_entries));
+  memset(_first_touches, 0, sizeof(_first_touches));
+  _scan_ms[0] = 0;
+  _scan_ms[1] = 0;
+}
+
+
+/*
+* The chip is put in ACTIVE to begin with, whatever it was in.
+*
+* @param budget_ms       The worst first-touch latency to allow. Zero for none.
+* @param doze_after_ms   Idle time before DOZE. Zero for the default.
+* @param sleep_after_ms  Idle time before SLEEP. Zero to never sleep.
+* @return 0 on success, -1 if the slot can't be had, -2 if its SPM can't be read
+*   or the driver won't change modes.
+*/
+int8_t ModeGovernor::start(ProvisionerSlot* slot, uint16_t budget_ms, uint32_t doze_after_ms, uint32_t sleep_after_ms, uint32_t now) {
+  if (running() || (SlotState::PARKED != slot->state()) || !slot->holdsBus()) {
+    return -1;
+  }
+  uint8_t spm[128];
+  if (0 != slot->touch.copySPM(spm)) {
+    return -2;
+  }
+  const uint8_t active = spm[SX8634_SPM_ACTIVE_SCAN];
+  const uint8_t doze   = spm[SX8634_SPM_DOZE_SCAN];
+  _scan_ms[MODE_GOV_ACTIVE] = ((0 < active) ? active : 1) * MODE_GOV_SCAN_UNIT_MS;
+  _scan_ms[MODE_GOV_DOZE]   = ((0 < doze)   ? doze   : 1) * MODE_GOV_SCAN_UNIT_MS;
+  _budget_ms   = budget_ms;
+  _doze_after  = (0 < doze_after_ms) ? doze_after_ms : MODE_GOV_DOZE_AFTER_MS;
+  _sleep_after = sleep_after_ms;
+  _set_fails   = 0;
+  memset(_mode_ms, 0, sizeof(_mode_ms));
+  memset(_entries, 0, sizeof(_entries));
+  memset(_first_touches, 0, sizeof(_first_touches));
+  _first[MODE_GOV_ACTIVE].reset();
+  _first[MODE_GOV_DOZE].reset();
+  _slot          = slot;
+  _last_activity = now;
+  _mode_since    = now;
+  _mode          = MODE_GOV_SLEEP;   // So that the change below is taken.
+  if (0 != _set_mode(MODE_GOV_ACTIVE, now)) {
+    _slot = nullptr;
+    return -2;
+  }
+  return 0;
+}
+
+
+/*
+* Leaves the chip in ACTIVE, and the stats as they were.
+*/
+void ModeGovernor::stop(uint32_t now) {
+  if (!running()) return;
+  if ((MODE_GOV_ACTIVE != _mode) && (SlotState::PARKED == _slot->state())) {
+    _set_mode(MODE_GOV_ACTIVE, now);
+  }
+  _mode_ms[_mode] += now - _mode_since;
+  _mode_since = now;
+  _slot = nullptr;
+}
+
+
+/*
+* @return 0 on success, -1 if the driver refused.
+*/
+int8_t ModeGovernor::_set_mode(uint8_t mode, uint32_t now) {
+  if (mode == _mode) return 0;
+  if (0 != _slot->touch.setMode(OP_MODES[mode])) {
+    _set_fails++;
+    return -1;
+  }
+  _mode_ms[_mode] += now - _mode_since;
+  _mode_since = now;
+  _mode       = mode;
+  _entries[mode]++;
+  return 0;
+}
+
+
+/*
+* The doze scan period, plus the worst IRQ-to-notify time for a first touch.
+*/
+uint32_t ModeGovernor::_doze_worst_ms() {
+  LatencyHistogram* h = (0 < _first[MODE_GOV_DOZE].count()) ? &_first[MODE_GOV_DOZE] : &_first[MODE_GOV_ACTIVE];
+  return _scan_ms[MODE_GOV_DOZE] + ((h->max() + 999) / 1000);
+}
+
+
+/*
+* Call this periodically.
+*
+* @return 1 if the mode changed, 0 if not, -1 if the governor gave up.
+*/
+int8_t ModeGovernor::poll(uint32_t now) {
+  if (!running()) return 0;
+  if (SlotState::PARKED != _slot->state()) {
+    // A run took the slot. It will set the mode as it likes.
+    _mode_ms[_mode] += now - _mode_since;
+    _mode_since = now;
+    _slot = nullptr;
+    return -1;
+  }
+  const uint32_t idle = now - _last_activity;
+  uint8_t want = MODE_GOV_ACTIVE;
+  if ((0 < _sleep_after) && (idle >= _sleep_after)) {
+    want = MODE_GOV_SLEEP;
+  }
+  else if ((idle >= _doze_after) && ((0 == _budget_ms) || (_doze_worst_ms() <= _budget_ms))) {
+    want = MODE_GOV_DOZE;
+  }
+  // Only activity brings the chip back up.
+  if ((want > _mode) && (0 == _set_mode(want, now))) {
+    return 1;
+  }
+  return 0;
+}
+
+
+/*
+* Called for every message from the chip that a person caused.
+*
+* @param touch   A press or a slider movement, as opposed to a release.
+* @param stamps  The latency stamps that went with the message, if any.
+*/
+void ModeGovernor::activity(uint32_t now, bool touch, const LatencyStamps* stamps, uint64_t notify_us) {
+  if (!running()) return;
+  if (touch && ((now - _last_activity) >= MODE_GOV_QUIET_MS)) {
+    _first_touches[_mode]++;
+    if ((MODE_GOV_SLEEP != _mode) && (nullptr != stamps) && (0 < stamps->irq) && (stamps->irq <= notify_us)) {
+      _first[_mode].add((uint32_t) (notify_us - stamps->irq));
+    }
+  }
+  _last_activity = now;
+  _set_mode(MODE_GOV_ACTIVE, now);
+}
+
+
+void ModeGovernor::printStats(StringBuilder* output, uint32_t now) {
+  output->concatf("-- Mode governor: %s", running() ? "running" : "stopped");
+  if (running()) {
+    output->concatf(" on slot %u, now %s (idle %u ms)", _slot->index(), MODE_NAMES[_mode], now - _last_activity);
+  }
+  output->concatf("\n\tBudget:       %u ms%s\n", _budget_ms, (0 == _budget_ms) ? " (none)" : "");
+  output->concatf("\tDOZE after:   %u ms\n", _doze_after);
+  if (0 < _sleep_after) {
+    output->concatf("\tSLEEP after:  %u ms\n", _sleep_after);
+  }
+  output->concatf("\tScan periods: %u ms active, %u ms doze\n", _scan_ms[MODE_GOV_ACTIVE], _scan_ms[MODE_GOV_DOZE]);
+  output->concatf("\tDOZE worst:   %u ms first-touch latency (%s budget)\n", _doze_worst_ms(),
+    ((0 == _budget_ms) || (_doze_worst_ms() <= _budget_ms)) ? "within" : "OVER"
+  );
+  if (0 < _set_fails) {
+    output->concatf("\tMode changes refused by the driver: %u\n", _set_fails);
+  }
+
+  uint32_t total = 0;
+  uint32_t ms[MODE_GOV_MODES];
+  for (uint8_t i = 0; i < MODE_GOV_MODES; i++) {
+    ms[i]  = _mode_ms[i] + ((running() && (i == _mode)) ? (now - _mode_since) : 0);
+    total += ms[i];
+  }
+  output->concat("\n\tMode    Entries  Time (ms)  Share  First touches  Scan wait avg/max (ms)  IRQ-notify p50/p99/max (us)\n");
+  for (uint8_t i = 0; i < MODE_GOV_MODES; i++) {
+    output->concatf("\t%-6s  %7u  %9u  %4u%%  %13u  ", MODE_NAMES[i], _entries[i], ms[i],
+      (0 < total) ? (uint32_t) (((uint64_t) ms[i] * 100) / total) : 0, _first_touches[i]
+    );
+    if (MODE_GOV_SLEEP == i) {
+      output->concat("(not scanning)\n");
+      continue;
+    }
+    output->concatf("%10u / %-9u  ", _scan_ms[i] / 2, _scan_ms[i]);
+    if (0 < _first[i].count()) {
+      output->concatf("%u / %u / %u\n", _first[i].percentile(50), _first[i].percentile(99), _first[i].max());
+    }
+    else {
+      output->concat("-\n");
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/*
+File:   ModeGovernor.h
+Author: J. Ian Lindsay
+Date:   2019.09.23
+
+Moves an SX8634 between ACTIVE, DOZE, and SLEEP on its own, as touch activity
+  comes and goes, and measures what that costs in touch latency.
+
+The chip is put in ACTIVE by any touch, and kept there until the board has
+  been left alone for a while. Then it is put in DOZE, if DOZE is within the
+  latency budget. After a longer while (if asked), it is put in SLEEP.
+
+A touch that lands on a chip in DOZE waits for the next doze scan to be seen,
+  and then for the jig to read it. So the worst first-touch latency in DOZE is
+  taken to be the doze scan period, plus the worst IRQ-to-notify time measured
+  for first touches. Until a first touch has been seen in DOZE, the worst seen
+  in ACTIVE stands in for the second part. If that sum is over the budget,
+  DOZE is not used. A budget of zero is no budget.
+
+A first touch is one that follows at least MODE_GOV_QUIET_MS without any
+  activity. Those are the ones whose latency a user notices. Their
+  IRQ-to-notify times are kept in a histogram for each mode. The part before
+  the IRQ can't be measured, so it is reported from the scan periods.
+
+A chip in SLEEP doesn't scan at all, so it never sees the touch that would
+  wake it. Something else must (stopping the governor puts it back in ACTIVE).
+  So SLEEP is only used if asked for, and is not subject to the budget.
+
+The driver's messages don't say which chip raised them, so every touch counts
+  as activity. The governor gives up if its slot is taken for a run.
+*/
+
+#ifndef __SX8634_MODE_GOVERNOR_H__
+#define __SX8634_MODE_GOVERNOR_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "ProvisionerSlot.h"
+#include "LatencyProbe.h"
+
+#define MODE_GOV_DOZE_AFTER_MS     3000   // Default: idle time before DOZE.
+#define MODE_GOV_QUIET_MS           500   // Idle time before a touch counts as a first touch.
+#define MODE_GOV_SCAN_UNIT_MS        15   // One step of Active/DozeScanPeriod.
+
+#define MODE_GOV_ACTIVE               0   // Indices for the per-mode stats.
+#define MODE_GOV_DOZE                 1
+#define MODE_GOV_SLEEP                2
+#define MODE_GOV_MODES                3
+
+
+class ModeGovernor {
+  public:
+    ModeGovernor();
+
+    int8_t start(ProvisionerSlot*, uint16_t budget_ms, uint32_t doze_after_ms, uint32_t sleep_after_ms, uint32_t now);
+    void   stop(uint32_t now);
+    int8_t poll(uint32_t now);
+    void   activity(uint32_t now, bool touch, const LatencyStamps*, uint64_t notify_us);
+    inline bool running() {   return (nullptr != _slot);   };
+    inline ProvisionerSlot* slot() {   return _slot;   };
+
+    void printStats(StringBuilder*, uint32_t now);
+
+
+  private:
+    ProvisionerSlot* _slot       = nullptr;
+    uint8_t          _mode       = MODE_GOV_ACTIVE;
+    uint16_t         _budget_ms  = 0;
+    uint32_t         _doze_after = 0;
+    uint32_t         _sleep_after = 0;
+    uint16_t         _scan_ms[2];              // Active and doze scan periods, from the SPM.
+    uint32_t         _last_activity = 0;
+    uint32_t         _mode_since    = 0;
+    uint32_t         _mode_ms[MODE_GOV_MODES];  // Time in each mode, before the current span.
+    uint32_t         _entries[MODE_GOV_MODES];
+    uint32_t         _set_fails  = 0;          // setMode() calls that didn't take.
+    uint32_t         _first_touches[MODE_GOV_MODES];
+    LatencyHistogram _first[2];                // IRQ to notify, for first touches in ACTIVE and DOZE.
+
+    int8_t   _set_mode(uint8_t mode, uint32_t now);
+    uint32_t _doze_worst_ms();
+};
+
+#endif  // __SX8634_MODE_GOVERNOR_H__
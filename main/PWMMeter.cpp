@@ -0,0 +1,195 @@
+#include "PWMMeter.h"
+#include "SX8634Conf.h"
+#include <string.h>
+
+
+PWMMeter::PWMMeter() {
+  memset(_pins, 0, sizeof(_pins));
+}
+
+
+/*
+* Begins a measurement window.
+*
+* @param slot      Only edges from this slot are counted.
+* @param levels    The pin levels at the start of the window.
+* @param window_ms The length of the window.
+* @param now_us    The start of the window, on the edge clock.
+*/
+void PWMMeter::start(uint8_t slot, uint8_t levels, uint32_t window_ms, uint64_t now_us) {
+  memset(_pins, 0, sizeof(_pins));
+  for (uint8_t i = 0; i < 8; i++) {
+    _pins[i].level    = (levels >> i) & 1;
+    _pins[i].duty_min = 1000;
+  }
+  _slot      = slot;
+  _t0        = now_us;
+  _t_end     = now_us;
+  _window_us = (uint64_t) window_ms * 1000;
+  _running   = true;
+}
+
+
+void PWMMeter::stop(uint64_t now_us) {
+  _t_end   = now_us;
+  _running = false;
+}
+
+
+void PWMMeter::feed(const GPIOEdge* e) {
+  if (!_running || (e->slot != _slot) || (e->t_us < _t0)) return;
+  for (uint8_t pin = 0; pin < 8; pin++) {
+    if (0 == (e->changed & (1 << pin))) continue;
+    PWMPinStats* p = &_pins[pin];
+    p->edges++;
+    p->level = (e->levels >> pin) & 1;
+    if (p->level) {
+      // A rise closes the cycle that began at the last rise.
+      if (p->rise_seen && p->fall_seen && (p->last_fall > p->last_rise)) {
+        _cycle(p, p->last_rise, p->last_fall, e->t_us);
+      }
+      p->last_rise = e->t_us;
+      p->rise_seen = true;
+    }
+    else {
+      p->last_fall = e->t_us;
+      p->fall_seen = true;
+    }
+  }
+}
+
+
+void PWMMeter::_cycle(PWMPinStats* p, uint64_t rise, uint64_t fall, uint64_t next_rise) {
+  const uint32_t period = (uint32_t) (next_rise - rise);
+  const uint32_t high   = (uint32_t) (fall - rise);
+  if (0 == period) return;
+  const uint16_t duty = (uint16_t) (((uint64_t) high * 1000) / period);
+
+  if (0 == p->cycles) {
+    p->duty_first = duty;
+    p->period_min = period;
+    p->period_max = period;
+  }
+  else {
+    const uint16_t delta = (duty > p->duty_last) ? (duty - p->duty_last) : (p->duty_last - duty);
+    if (PWM_METER_RAMP_TOL < delta) {
+      if (0 == p->ramp_start) p->ramp_start = rise;
+      p->ramp_end = next_rise;
+    }
+  }
+  if (period < p->period_min) p->period_min = period;
+  if (period > p->period_max) p->period_max = period;
+  if (duty < p->duty_min) p->duty_min = duty;
+  if (duty > p->duty_max) p->duty_max = duty;
+  p->duty_last     = duty;
+  p->period_total += period;
+  p->high_total   += high;
+  p->cycles++;
+
+  if (0 < _window_us) {
+    uint32_t b = (uint32_t) (((rise - _t0) * PWM_METER_BUCKETS) / _window_us);
+    if (PWM_METER_BUCKETS <= b) b = PWM_METER_BUCKETS - 1;
+    p->bucket_duty[b] += duty;
+    p->bucket_cycles[b]++;
+  }
+}
+
+
+/*
+* Average duty over all complete cycles. A pin that never cycled is at 0 or
+*   1000, according to its level.
+*/
+uint16_t PWMMeter::dutyPermille(uint8_t pin) {
+  PWMPinStats* p = &_pins[pin & 7];
+  if (0 == p->cycles) {
+    return (p->level ? 1000 : 0);
+  }
+  return (uint16_t) ((p->high_total * 1000) / p->period_total);
+}
+
+
+uint32_t PWMMeter::periodUs(uint8_t pin) {
+  PWMPinStats* p = &_pins[pin & 7];
+  return (0 < p->cycles) ? (uint32_t) (p->period_total / p->cycles) : 0;
+}
+
+
+uint32_t PWMMeter::rampUs(uint8_t pin) {
+  PWMPinStats* p = &_pins[pin & 7];
+  return (0 < p->ramp_start) ? (uint32_t) (p->ramp_end - p->ramp_start) : 0;
+}
+
+
+/*
+* How long the SPM says a fade between the OFF and ON intensities should take.
+*   Inc/DecTime are packed two pins to a byte, highest pins first.
+*/
+uint32_t PWMMeter::expectedRampUs(const uint8_t* spm, uint8_t pin, bool rising) {
+  pin &= 7;
+  const uint8_t reg    = (rising ? SX8634_SPM_GPIO_INC_TIME : SX8634_SPM_GPIO_DEC_TIME) + (3 - (pin >> 1));
+  const uint8_t nibble = (pin & 0x01) ? (spm[reg] >> 4) : (spm[reg] & 0x0F);
+  const uint8_t on     = spm[SX8634_SPM_GPIO_INTENS_ON + pin];
+  const uint8_t off    = spm[SX8634_SPM_GPIO_INTENS_OFF + pin];
+  const uint32_t delta = (on > off) ? (on - off) : (off - on);
+  return (delta * nibble * PWM_METER_FADE_UNIT_MS * 1000) / 256;
+}
+
+
+void PWMMeter::printResults(StringBuilder* output, const uint8_t* spm) {
+  const uint64_t span = (_running ? edge_clock_us() : _t_end) - _t0;
+  output->concatf("PWM measurement on slot %u over %u ms%s\n",
+    _slot, (uint32_t) (span / 1000), _running ? " (running)" : ""
+  );
+  output->concat("GPIO Edges Cycles   Hz  Duty (min-max)  Ramp ms");
+  if (nullptr != spm) {
+    output->concat(" | On   Off  Pol Auto  Inc/Dec ms");
+  }
+  output->concat("\n");
+
+  for (uint8_t i = 0; i < 8; i++) {
+    PWMPinStats* p = &_pins[i];
+    const uint32_t period = periodUs(i);
+    const uint16_t duty   = dutyPermille(i);
+    output->concatf("%u    %5u %6u %4u  %3u.%u%% ",
+      i, p->edges, p->cycles,
+      (0 < period) ? (1000000 / period) : 0,
+      duty / 10, duty % 10
+    );
+    if (0 < p->cycles) {
+      output->concatf("(%3u-%3u%%)  ", p->duty_min / 10, p->duty_max / 10);
+    }
+    else {
+      output->concatf("(steady %s) ", p->level ? "hi" : "lo");
+    }
+    output->concatf("%7u", rampUs(i) / 1000);
+    if (nullptr != spm) {
+      output->concatf(" | %3u%% %3u%%  %c   %c    %u/%u",
+        (spm[SX8634_SPM_GPIO_INTENS_ON + i] * 100) / 255,
+        (spm[SX8634_SPM_GPIO_INTENS_OFF + i] * 100) / 255,
+        (spm[SX8634_SPM_GPIO_POLARITY]  & (1 << i)) ? 'y' : 'n',
+        (spm[SX8634_SPM_GPIO_AUTOLIGHT] & (1 << i)) ? 'y' : 'n',
+        expectedRampUs(spm, i, true)  / 1000,
+        expectedRampUs(spm, i, false) / 1000
+      );
+    }
+    output->concat("\n");
+  }
+
+  output->concatf("\nFade profile (duty %% in %u buckets of %u ms)\n",
+    PWM_METER_BUCKETS, (uint32_t) (_window_us / PWM_METER_BUCKETS / 1000)
+  );
+  for (uint8_t i = 0; i < 8; i++) {
+    PWMPinStats* p = &_pins[i];
+    if (0 == p->cycles) continue;
+    output->concatf("%u   ", i);
+    for (uint8_t b = 0; b < PWM_METER_BUCKETS; b++) {
+      if (0 < p->bucket_cycles[b]) {
+        output->concatf(" %3u", (p->bucket_duty[b] / p->bucket_cycles[b]) / 10);
+      }
+      else {
+        output->concat("   -");
+      }
+    }
+    output->concat("\n");
+  }
+}
@@ -0,0 +1,86 @@
+/*
+File:   PWMMeter.h
+Author: J. Ian Lindsay
+Date:   2019.09.07
+
+Measures the PWM on a slot's SX8634 GPIO outputs from captured edges.
+
+Over a window, each pin's complete PWM cycles (rise to rise) are tallied for
+  period and duty. The window is also cut into buckets, and the average duty of
+  the cycles that began in each bucket gives the shape of any fade. A fade is
+  timed from the first cycle whose duty moved to the last one that did.
+
+Pins that don't toggle during the window are reported as steady at whatever
+  level they held.
+*/
+
+#ifndef __SX8634_PWM_METER_H__
+#define __SX8634_PWM_METER_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "EdgeRing.h"
+
+#define PWM_METER_BUCKETS        16   // Resolution of the fade profile.
+#define PWM_METER_RAMP_TOL        3   // Duty change (permille) that counts as movement.
+#define PWM_METER_FADE_UNIT_MS   64   // Full-scale fade time for each unit of Inc/DecTime.
+
+
+typedef struct {
+  uint64_t last_rise;
+  uint64_t last_fall;
+  uint64_t period_total;
+  uint64_t high_total;
+  uint64_t ramp_start;          // Start of the first cycle whose duty moved.
+  uint64_t ramp_end;            // End of the last cycle whose duty moved.
+  uint32_t cycles;
+  uint32_t edges;
+  uint32_t period_min;
+  uint32_t period_max;
+  uint16_t duty_min;            // Permille
+  uint16_t duty_max;            // Permille
+  uint16_t duty_first;          // Permille
+  uint16_t duty_last;           // Permille
+  uint32_t bucket_duty[PWM_METER_BUCKETS];
+  uint16_t bucket_cycles[PWM_METER_BUCKETS];
+  uint8_t  level;
+  bool     rise_seen;
+  bool     fall_seen;
+} PWMPinStats;
+
+
+class PWMMeter {
+  public:
+    PWMMeter();
+
+    void start(uint8_t slot, uint8_t levels, uint32_t window_ms, uint64_t now_us);
+    void feed(const GPIOEdge*);
+    void stop(uint64_t now_us);
+
+    inline bool    running() {           return _running;   };
+    inline uint8_t slot() {              return _slot;      };
+    inline bool    expired(uint64_t now_us) {   return (now_us >= (_t0 + _window_us));   };
+
+    /* Results */
+    inline uint32_t cycles(uint8_t pin) {    return _pins[pin & 7].cycles;   };
+    uint16_t dutyPermille(uint8_t pin);
+    uint32_t periodUs(uint8_t pin);
+    uint32_t rampUs(uint8_t pin);
+    static uint32_t expectedRampUs(const uint8_t* spm, uint8_t pin, bool rising);
+
+    void printResults(StringBuilder*, const uint8_t* spm);
+
+
+  private:
+    uint64_t    _t0         = 0;
+    uint64_t    _t_end      = 0;
+    uint64_t    _window_us  = 0;
+    uint8_t     _slot       = 0;
+    bool        _running    = false;
+    PWMPinStats _pins[8];
+
+    void _cycle(PWMPinStats*, uint64_t rise, uint64_t fall, uint64_t next_rise);
+};
+
+#endif  // __SX8634_PWM_METER_H__
@@ -0,0 +1,518 @@
+#include "ProvisionerSlot.h"
+#include "LogRing.h"
+#include <string.h>
+
+ProvisionerSlot* ProvisionerSlot::_bus_owner[SX8634PROV_MAX_BUSES] = { nullptr, nullptr };
+
+
+/*******************************************************************************
+*   ___ _              ___      _ _              _      _
+*  / __| |__ _ ______ | _ ) ___(_) |___ _ _ _ __| |__ _| |_ ___
+* | (__| / _` (_-<_-< | _ \/ _ \ | / -_) '_| '_ \ / _` |  _/ -_)
+*  \___|_\__,_/__/__/ |___/\___/_|_\___|_| | .__/_\__,_|\__\___|
+*                                          |_|
+* Constructors/destructors, class initialization functions and so-forth...
+*******************************************************************************/
+
+ProvisionerSlot::ProvisionerSlot(uint8_t idx, I2CAdapter* bus, uint8_t pwr_pin, const uint8_t* gpio_pins, const SX8634Opts* opts)
+    : touch(opts), _IDX(idx), _BUS_ID(bus->adapterNumber() % SX8634PROV_MAX_BUSES), _PWR_PIN(pwr_pin), _bus(bus) {
+  for (uint8_t i = 0; i < 8; i++) {
+    pf_pins[i] = (nullptr != gpio_pins) ? gpio_pins[i] : 255;
+    pin_transition_values[i] = 0;
+    pin_transition_times[i]  = 0;
+  }
+  memset(_stage_ms, 0, sizeof(_stage_ms));
+  gpioDefine(_PWR_PIN, GPIOMode::OUTPUT);
+  setPin(_PWR_PIN, false);
+}
+
+
+ProvisionerSlot::~ProvisionerSlot() {
+  releaseBus();
+}
+
+
+const char* ProvisionerSlot::stateStr(SlotState s) {
+  switch (s) {
+    case SlotState::PARKED:       return "PARKED";
+    case SlotState::SWAP:         return "SWAP";
+    case SlotState::WAIT_BUS:     return "WAIT_BUS";
+    case SlotState::POWER_UP:     return "POWER_UP";
+    case SlotState::READ_SPM:     return "READ_SPM";
+    case SlotState::LOAD:         return "LOAD";
+    case SlotState::BURN:         return "BURN";
+    case SlotState::POWER_CYCLE:  return "POWER_CYCLE";
+    case SlotState::VERIFY:       return "VERIFY";
+    case SlotState::GPIO_TEST:    return "GPIO_TEST";
+  }
+  return "UNKNOWN";
+}
+
+
+/*******************************************************************************
+* Bus and power                                                                *
+*******************************************************************************/
+
+/*
+* Boards on a shared bus have the same address. So a slot's driver is only
+*   attached to the bus while that slot holds it.
+*
+* @return 0 on success, -1 if another slot holds the bus.
+*/
+int8_t ProvisionerSlot::acquireBus() {
+  if (holdsBus()) return 0;
+  if (nullptr != _bus_owner[_BUS_ID]) return -1;
+  _bus_owner[_BUS_ID] = this;
+  if (!_slot_flag(SX8634PROV_SLOT_FLAG_ON_BUS)) {
+    _bus->addSlaveDevice((I2CDevice*) &touch);
+    _slot_set_flag(SX8634PROV_SLOT_FLAG_ON_BUS, true);
+  }
+  return 0;
+}
+
+
+/*
+* Powers the board down before giving up the bus.
+*/
+int8_t ProvisionerSlot::releaseBus() {
+  if (!holdsBus()) return -1;
+  power(false);
+  if (_slot_flag(SX8634PROV_SLOT_FLAG_ON_BUS)) {
+    _bus->removeSlaveDevice((I2CDevice*) &touch);
+    _slot_set_flag(SX8634PROV_SLOT_FLAG_ON_BUS, false);
+  }
+  _bus_owner[_BUS_ID] = nullptr;
+  return 0;
+}
+
+
+/*
+* Nothing gets powered without holding the bus.
+*/
+int8_t ProvisionerSlot::power(bool x) {
+  if (x && !holdsBus()) return -1;
+  setPin(_PWR_PIN, x);
+  if (!x) {
+    touch.invalidateMirror();
+  }
+  return 0;
+}
+
+
+/*
+* Restarts the driver against a freshly-powered board. The first time through,
+*   this is the driver's init(), which also sets up its reset and IRQ pins.
+*/
+int8_t ProvisionerSlot::bootBoard() {
+  if (!holdsBus()) return -1;
+  if (!_slot_flag(SX8634PROV_SLOT_FLAG_DRIVER_INIT)) {
+    _slot_set_flag(SX8634PROV_SLOT_FLAG_DRIVER_INIT, true);
+    return touch.init();
+  }
+  return touch.reset();
+}
+
+
+/*
+* With a cache, each board's full SPM read is checked against it, and added to
+*   it. The cache never stands in for the read. Passing nullptr stops this.
+*/
+void ProvisionerSlot::spmCache(SpmCache* cache) {
+  _cache = cache;
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_SPM_CACHE, (nullptr != cache));
+}
+
+
+/*******************************************************************************
+* Production runs                                                              *
+*******************************************************************************/
+
+/*
+* Begins a run. The slot assumes that a board is already in the socket.
+*
+* @param blob     A full 128-byte SPM image. Must outlive the run.
+* @param swap_ms  If non-zero, assume a fresh board this long after the last
+*                   one finishes. Otherwise, wait for boardLoaded().
+*/
+int8_t ProvisionerSlot::start(const uint8_t* blob, uint32_t swap_ms) {
+  if (nullptr == blob) return -1;
+  uint32_t now = millis();
+  _blob      = blob;
+  _swap_ms   = swap_ms;
+  _passed    = 0;
+  _failed    = 0;
+  _busy_ms   = 0;
+  _run_start = now;
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_AUTO_SWAP, (0 != swap_ms));
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_SINGLE, false);
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_LOADED, true);
+  _set_state(SlotState::SWAP, now);
+  return 0;
+}
+
+
+/*
+* Abandons whatever board is in progress and parks the slot.
+*/
+int8_t ProvisionerSlot::stop() {
+  if (SlotState::PARKED == _state) return -1;
+  _run_end = millis();
+  releaseBus();
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_LOADED, false);
+  _set_state(SlotState::PARKED, millis());
+  return 0;
+}
+
+
+/*
+* The operator has put a fresh board in the socket.
+*/
+int8_t ProvisionerSlot::boardLoaded() {
+  if (SlotState::PARKED == _state) return -1;
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_LOADED, true);
+  return 0;
+}
+
+
+/*
+* Time spent in each stage of a board's cycle is added up, as some stages are
+*   passed through more than once.
+*/
+void ProvisionerSlot::_set_state(SlotState s, uint32_t now) {
+  if (SlotState::WAIT_BUS < _state) {
+    const uint32_t total = _stage_ms[(uint8_t) _state] + (now - _stage_start);
+    _stage_ms[(uint8_t) _state] = (0xFFFF < total) ? 0xFFFF : (uint16_t) total;
+  }
+  _state       = s;
+  _stage_start = now;
+}
+
+
+void ProvisionerSlot::_finish_board(bool passed, uint32_t now) {
+  if (_slot_flag(SX8634PROV_SLOT_FLAG_SINGLE)) {
+    // Not part of a run. The board stays powered, and isn't counted.
+    _fail_stage = (uint8_t) _state;
+    _last_cycle_ms = now - _cycle_start;
+    _slot_set_flag(SX8634PROV_SLOT_FLAG_VERIFIED, passed);
+    _slot_set_flag(SX8634PROV_SLOT_FLAG_SINGLE, false);
+    _set_state(SlotState::PARKED, now);
+    return;
+  }
+  if (passed) {
+    _passed++;
+  }
+  else {
+    _failed++;
+    _fail_stage  = (uint8_t) _state;
+    _fail_detail = (SlotState::GPIO_TEST == _state) ? _gpio_pin : 0;
+  }
+  _last_cycle_ms = now - _cycle_start;
+  _busy_ms += _last_cycle_ms;
+  releaseBus();
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_LOADED, false);
+  _set_state(SlotState::SWAP, now);
+}
+
+
+/*
+* Advances this slot's board through its cycle. Never blocks.
+*
+* @return 1 if the slot changed state, 0 otherwise.
+*/
+int8_t ProvisionerSlot::poll(uint32_t now) {
+  const SlotState prior  = _state;
+  const uint32_t elapsed = now - _stage_start;
+
+  switch (_state) {
+    case SlotState::PARKED:
+      break;
+
+    case SlotState::SWAP:
+      if (_slot_flag(SX8634PROV_SLOT_FLAG_AUTO_SWAP) && (elapsed >= _swap_ms)) {
+        _slot_set_flag(SX8634PROV_SLOT_FLAG_LOADED, true);
+      }
+      if (_slot_flag(SX8634PROV_SLOT_FLAG_LOADED)) {
+        _set_state(SlotState::WAIT_BUS, now);
+      }
+      break;
+
+    case SlotState::WAIT_BUS:
+      if (0 == acquireBus()) {
+        _cycle_start = now;
+        _step_ms     = now;
+        _burns       = 0;
+        memset(_stage_ms, 0, sizeof(_stage_ms));
+        touch.clearObservations();
+        power(true);
+        bootBoard();
+        _set_state(SlotState::POWER_UP, now);
+      }
+      break;
+
+    case SlotState::POWER_UP:
+      // The driver's own traffic after reset usually gets an ACK first.
+      if (touch.observed(SX8634_JIG_OBS_ACK)) {
+        _set_state(SlotState::READ_SPM, now);
+      }
+      else if (elapsed >= SX8634PROV_PING_TIMEOUT_MS) {
+        _finish_board(false, now);
+      }
+      else if ((now - _step_ms) >= SX8634PROV_PING_PERIOD_MS) {
+        _step_ms = now;
+        touch.ping();
+      }
+      break;
+
+    case SlotState::READ_SPM:
+      if (touch.observed(SX8634_JIG_OBS_SPM_READ) && touch.mirrorValid()) {
+        // The driver might not have closed the gateway yet. If so, try again.
+        touch.clearObservations(SX8634_JIG_OBS_DELTA_DONE);
+        if (0 <= touch.loadSPMDelta(_blob)) {
+          if (spmCache()) {
+            _cache->record(touch.spmMirror());
+          }
+          touch.clearObservations(SX8634_JIG_OBS_SPM_READ);
+          _set_state(SlotState::LOAD, now);
+        }
+      }
+      else if (elapsed >= SX8634PROV_BOOT_TIMEOUT_MS) {
+        _finish_board(false, now);
+      }
+      break;
+
+    case SlotState::LOAD:
+      if (touch.observed(SX8634_JIG_OBS_DELTA_DONE)) {
+        _burn(now);
+      }
+      else if (touch.deltaFailed() || (elapsed >= SX8634PROV_LOAD_TIMEOUT_MS)) {
+        _finish_board(false, now);
+      }
+      break;
+
+    case SlotState::BURN:
+      if (touch.observed(SX8634_JIG_OBS_NVM_BURNED)) {
+        power(false);
+        _set_state(SlotState::POWER_CYCLE, now);
+      }
+      else if (elapsed >= SX8634PROV_BURN_TIMEOUT_MS) {
+        _finish_board(false, now);
+      }
+      break;
+
+    case SlotState::POWER_CYCLE:
+      if (elapsed >= SX8634PROV_POWER_OFF_MS) {
+        touch.clearObservations();
+        power(true);
+        bootBoard();
+        _set_state(SlotState::VERIFY, now);
+      }
+      break;
+
+    case SlotState::VERIFY:
+      if (touch.observed(SX8634_JIG_OBS_SPM_READ) && touch.mirrorValid()) {
+        if (!_check_readback()) {
+          if (SX8634PROV_BURN_ATTEMPTS > _burns) {
+            // The SPM holds whatever the NVM did. Load the blob and burn again.
+            _set_state(SlotState::READ_SPM, now);
+          }
+          else {
+            _finish_board(false, now);
+          }
+        }
+        else if (_slot_flag(SX8634PROV_SLOT_FLAG_SINGLE)) {
+          _finish_board(true, now);
+        }
+        else if (hasGPIO()) {
+          _gpio_pin   = 0;
+          _gpio_phase = 0;
+          _step_ms    = now - SX8634PROV_GPIO_SETTLE_MS;
+          _set_state(SlotState::GPIO_TEST, now);
+        }
+        else {
+          _finish_board(true, now);
+        }
+      }
+      else if (elapsed >= SX8634PROV_BOOT_TIMEOUT_MS) {
+        _finish_board(false, now);
+      }
+      break;
+
+    case SlotState::GPIO_TEST:
+      if ((now - _step_ms) >= SX8634PROV_GPIO_SETTLE_MS) {
+        const int8_t ret = _gpio_test(now);
+        if (0 != ret) {
+          _finish_board((0 < ret), now);
+        }
+      }
+      break;
+  }
+  return ((prior != _state) ? 1 : 0);
+}
+
+
+void ProvisionerSlot::_burn(uint32_t now) {
+  _burns++;
+  touch.clearObservations();
+  touch.burn_nvm();
+  _set_state(SlotState::BURN, now);
+}
+
+
+/*
+* The chip doesn't say when a burn didn't take (with its supply out of range,
+*   for instance). So after each burn, the board is power-cycled and the SPM it
+*   reloaded from NVM is compared against the blob.
+*
+* @return true if the application bytes all match.
+*/
+bool ProvisionerSlot::_check_readback() {
+  const uint8_t* spm = touch.spmMirror();
+  _crc_wanted = SX8634Jig::applicationCRC(_blob);
+  _crc_read   = SX8634Jig::applicationCRC(spm);
+  _diff_count = 0;
+  for (uint8_t i = 0; i < 128; i++) {
+    if (SX8634Jig::isApplicationAddr(i) && (spm[i] != _blob[i])) {
+      if (SX8634PROV_DIFF_MAX > _diff_count) {
+        _diff_addr[_diff_count] = i;
+        _diff_read[_diff_count] = spm[i];
+      }
+      _diff_count++;
+    }
+  }
+  if (0 < _diff_count) {
+    log_ring_put("Slot %u: burn %u read back %u wrong bytes. The first is at 0x%02x.\n",
+      _IDX, _burns, _diff_count, _diff_addr[0]
+    );
+  }
+  return (0 == _diff_count);
+}
+
+
+/*
+* Burns the SPM of the board that is powered in this slot, and verifies it as a
+*   run would, retrying as needed. The board must already hold the blob in its
+*   SPM. Progress is made by poll(), and the slot is parked again once done.
+*
+* @param blob  A full 128-byte SPM image. Must outlive the operation.
+* @return 0 on success, -1 if the slot is running or doesn't hold its bus.
+*/
+int8_t ProvisionerSlot::burnVerify(const uint8_t* blob) {
+  if ((SlotState::PARKED != _state) || !holdsBus() || (nullptr == blob)) {
+    return -1;
+  }
+  const uint32_t now = millis();
+  _blob        = blob;
+  _cycle_start = now;
+  _burns       = 0;
+  _diff_count  = 0;
+  memset(_stage_ms, 0, sizeof(_stage_ms));
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_SINGLE, true);
+  _slot_set_flag(SX8634PROV_SLOT_FLAG_VERIFIED, false);
+  _burn(now);
+  return 0;
+}
+
+
+void ProvisionerSlot::printBurnVerify(StringBuilder* output) {
+  const bool ok = _slot_flag(SX8634PROV_SLOT_FLAG_VERIFIED);
+  output->concatf("Slot %u: burn-verify %s after %u burn(s) (%u ms).",
+    _IDX, (ok ? "passed" : "FAILED"), _burns, _last_cycle_ms
+  );
+  if (!ok && (SlotState::VERIFY != (SlotState) _fail_stage)) {
+    output->concatf(" Gave up in %s.\n", stateStr((SlotState) _fail_stage));
+    return;
+  }
+  output->concatf(" Application CRC wanted 0x%02x, read 0x%02x.\n", _crc_wanted, _crc_read);
+  if (0 < _diff_count) {
+    output->concatf("\t%u bytes differ at the last readback:\n", _diff_count);
+    for (uint8_t i = 0; i < _diff_count; i++) {
+      if (SX8634PROV_DIFF_MAX <= i) {
+        output->concatf("\t... and %u more.\n", _diff_count - SX8634PROV_DIFF_MAX);
+        break;
+      }
+      output->concatf("\t0x%02x: wanted 0x%02x, read 0x%02x\n", _diff_addr[i], _blob[_diff_addr[i]], _diff_read[i]);
+    }
+  }
+}
+
+
+/*
+* Drives each pin that the blob made a GPO high and then low, and reads the
+*   platform pin that it is wired to after each. A pin passes if the two reads
+*   differ, so the GPO's polarity doesn't matter. Called once the last write
+*   has had time to settle.
+*
+* @return 1 if every GPO passed, -1 if one failed, or 0 if the test goes on.
+*/
+int8_t ProvisionerSlot::_gpio_test(uint32_t now) {
+  _step_ms = now;
+  switch (_gpio_phase) {
+    case 1:
+      _gpio_high = (0 != readPin(pf_pins[_gpio_pin]));
+      touch.setGPOValue(_gpio_pin, 0);
+      _gpio_phase = 2;
+      return 0;
+    case 2:
+      if (_gpio_high == (0 != readPin(pf_pins[_gpio_pin]))) {
+        return -1;
+      }
+      _gpio_pin++;
+      break;
+    default:
+      break;
+  }
+  while ((8 > _gpio_pin) && (GPIOMode::OUTPUT != touch.getGPIOMode(_gpio_pin))) {
+    _gpio_pin++;
+  }
+  if (8 <= _gpio_pin) {
+    return 1;
+  }
+  touch.setGPOValue(_gpio_pin, 255);
+  _gpio_phase = 1;
+  return 0;
+}
+
+
+/*
+* Counts every board that went through the slot, pass or fail, since the run
+*   started. Time spent waiting on the operator or the bus counts against it.
+*/
+uint32_t ProvisionerSlot::boardsPerHour() {
+  uint32_t run_ms = _run_ms();
+  if (0 == run_ms) return 0;
+  return (uint32_t) (((uint64_t) (_passed + _failed) * 3600000) / run_ms);
+}
+
+
+/*
+* The duration of the current run, or of the last one if the slot is parked.
+*/
+uint32_t ProvisionerSlot::_run_ms() {
+  return ((SlotState::PARKED == _state) ? _run_end : millis()) - _run_start;
+}
+
+
+void ProvisionerSlot::printSlot(StringBuilder* output) {
+  uint32_t run_ms = _run_ms();
+  uint32_t boards = _passed + _failed;
+  output->concatf("Slot %u (I2C%u, power on %u): %s%s\n",
+    _IDX, _BUS_ID, _PWR_PIN, stateStr(_state), holdsBus() ? " [bus]" : ""
+  );
+  if (0 < boards) {
+    output->concatf("\tPassed/Failed:   %u / %u\n", _passed, _failed);
+    if (0 < _failed) {
+      output->concatf("\tLast failure in: %s", stateStr((SlotState) _fail_stage));
+      if (SlotState::GPIO_TEST == (SlotState) _fail_stage) {
+        output->concatf(" (GPIO%u)", _fail_detail);
+      }
+      output->concat("\n");
+    }
+    output->concatf("\tLast cycle:      %u ms\n", _last_cycle_ms);
+    if (0 < run_ms) {
+      output->concatf("\tThroughput:      %u boards/hour (%u%% busy)\n",
+        boardsPerHour(),
+        (uint32_t) (((uint64_t) _busy_ms * 100) / run_ms)
+      );
+    }
+  }
+}
@@ -0,0 +1,165 @@
+/*
+File:   ProvisionerSlot.h
+Author: J. Ian Lindsay
+Date:   2019.09.04
+
+One socket on the provisioning jig: a power switch, an SX8634 on some I2C bus,
+  and (optionally) the platform pins that are wired to the board's GPIO.
+
+Slots that share an I2C bus necessarily share an address, so only one of them
+  may be powered at a time. A slot must hold its bus before it powers its board,
+  and releases it once the board is powered down. Slots on different buses run
+  concurrently. Slots on the same bus take turns, which hides board-swapping
+  time behind the other slot's work.
+*/
+
+#ifndef __SX8634_PROVISIONER_SLOT_H__
+#define __SX8634_PROVISIONER_SLOT_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "SX8634Jig.h"
+#include "SpmCache.h"
+
+#ifndef SX8634PROV_MAX_SLOTS
+  #define SX8634PROV_MAX_SLOTS           4
+#endif
+#define SX8634PROV_MAX_BUSES             2    // The ESP32 has two I2C controllers.
+
+/* Timeouts for each stage of a board cycle. */
+#define SX8634PROV_PING_TIMEOUT_MS     300    // Power-up until the board ACKs.
+#define SX8634PROV_PING_PERIOD_MS       50    // Pings while waiting for that.
+#define SX8634PROV_BOOT_TIMEOUT_MS    1000    // First ACK until SPM has been read.
+#define SX8634PROV_LOAD_TIMEOUT_MS     500    // SPM delta write until the last page is applied.
+#define SX8634PROV_BURN_TIMEOUT_MS    2000    // NVM burn until the chip acknowledges.
+#define SX8634PROV_POWER_OFF_MS        100    // Dwell with power removed.
+#define SX8634PROV_GPIO_SETTLE_MS       20    // GPO write until the platform pin is read.
+
+#define SX8634PROV_BURN_ATTEMPTS         3    // Burns of one board before giving up on it.
+#define SX8634PROV_DIFF_MAX              8    // Wrong bytes kept from a failed readback.
+
+/* Slot flags */
+#define SX8634PROV_SLOT_FLAG_GPIO_SAFETY  0x01  // Platform GPIO are inputs.
+#define SX8634PROV_SLOT_FLAG_ON_BUS       0x02  // The driver is attached to the bus.
+#define SX8634PROV_SLOT_FLAG_LOADED       0x04  // A board is waiting in the socket.
+#define SX8634PROV_SLOT_FLAG_AUTO_SWAP    0x08  // Assume a new board after a dwell.
+#define SX8634PROV_SLOT_FLAG_DRIVER_INIT  0x10  // The driver's init() has been run.
+#define SX8634PROV_SLOT_FLAG_SINGLE       0x20  // Burn-verifying one board, outside of a run.
+#define SX8634PROV_SLOT_FLAG_VERIFIED     0x40  // ...and it was read back correctly.
+#define SX8634PROV_SLOT_FLAG_SPM_CACHE    0x80  // Check each full SPM read against the cache.
+
+
+enum class SlotState : uint8_t {
+  PARKED,       // Not part of a run.
+  SWAP,         // Waiting for a board to be put in the socket.
+  WAIT_BUS,     // Has a board. Waiting for its turn on the bus.
+  POWER_UP,     // Powered and reset. Waiting for the board to ACK.
+  READ_SPM,     // Waiting for the driver to read the SPM.
+  LOAD,         // Writing the SPM pages that differ from the blob.
+  BURN,         // NVM burn in progress.
+  POWER_CYCLE,  // Power removed for a moment.
+  VERIFY,       // Powered back up. Waiting for the SPM readback.
+  GPIO_TEST     // Toggling each GPO, and reading it back on the platform pin.
+};
+
+/* The count of SlotStates. GPIO_TEST must stay the last of them. */
+#define SX8634PROV_STAGES               ((uint8_t) SlotState::GPIO_TEST + 1)
+
+
+class ProvisionerSlot {
+  public:
+    SX8634Jig touch;
+    uint8_t   pf_pins[8];                // Platform pins that match the SX8634 GPIO.
+    uint8_t   pin_transition_values[8];  // The last edge seen on each pin...
+    uint64_t  pin_transition_times[8];   // ...and when it happened.
+
+    ProvisionerSlot(uint8_t idx, I2CAdapter*, uint8_t pwr_pin, const uint8_t* gpio_pins, const SX8634Opts*);
+    ~ProvisionerSlot();
+
+    inline uint8_t   index() {      return _IDX;        };
+    inline uint8_t   busId() {      return _BUS_ID;     };
+    inline uint8_t   pwrPin() {     return _PWR_PIN;    };
+    inline SlotState state() {      return _state;      };
+    inline uint32_t  passed() {     return _passed;     };
+    inline uint32_t  failed() {     return _failed;     };
+    inline uint32_t  lastCycleMs() {  return _last_cycle_ms;  };
+    inline uint8_t   failStage() {    return _fail_stage;     };
+    inline uint8_t   failDetail() {   return _fail_detail;    };
+    inline const uint16_t* stageMs() {  return (const uint16_t*) _stage_ms;  };
+    uint32_t boardsPerHour();
+    inline bool gpioSafety() {      return _slot_flag(SX8634PROV_SLOT_FLAG_GPIO_SAFETY);  };
+    inline void gpioSafety(bool x) {       _slot_set_flag(SX8634PROV_SLOT_FLAG_GPIO_SAFETY, x);  };
+    inline bool spmCache() {        return _slot_flag(SX8634PROV_SLOT_FLAG_SPM_CACHE);  };
+    void        spmCache(SpmCache*);
+    inline bool hasGPIO() {         return (255 != pf_pins[0]);  };
+
+    int8_t power(bool);
+    int8_t bootBoard();
+    int8_t acquireBus();
+    int8_t releaseBus();
+    inline bool holdsBus() {        return (this == _bus_owner[_BUS_ID]);  };
+
+    /* Production runs */
+    int8_t start(const uint8_t* blob, uint32_t swap_ms);
+    int8_t stop();
+    int8_t boardLoaded();
+    int8_t poll(uint32_t now);
+
+    /* A single board, outside of a run */
+    int8_t burnVerify(const uint8_t* blob);
+    inline bool burnVerifyBusy() {  return _slot_flag(SX8634PROV_SLOT_FLAG_SINGLE);  };
+    void printBurnVerify(StringBuilder*);
+
+    void printSlot(StringBuilder*);
+    static const char* stateStr(SlotState);
+
+
+  private:
+    const uint8_t  _IDX;
+    const uint8_t  _BUS_ID;
+    const uint8_t  _PWR_PIN;
+    I2CAdapter*    _bus;
+    const uint8_t* _blob          = nullptr;   // The 128-byte SPM image to burn.
+    SpmCache*      _cache         = nullptr;
+    SlotState      _state         = SlotState::PARKED;
+    uint8_t        _flags         = 0;
+    uint8_t        _fail_stage    = 0;          // SlotState in which the last board failed.
+    uint8_t        _fail_detail   = 0;          // For GPIO_TEST, the pin that failed.
+    uint8_t        _gpio_pin      = 0;          // GPIO_TEST progress.
+    uint8_t        _gpio_phase    = 0;
+    bool           _gpio_high     = false;      // The platform pin with the GPO driven high.
+    uint32_t       _step_ms       = 0;          // Paces pings and GPIO_TEST within a stage.
+    uint16_t       _stage_ms[SX8634PROV_STAGES];   // Time in each stage of the last board.
+    uint8_t        _burns         = 0;          // NVM burns of the current board.
+    uint8_t        _crc_wanted    = 0;          // Application CRCs at the last readback.
+    uint8_t        _crc_read      = 0;
+    uint8_t        _diff_count    = 0;          // Wrong bytes at the last readback...
+    uint8_t        _diff_addr[SX8634PROV_DIFF_MAX];   // ...and the first few of them.
+    uint8_t        _diff_read[SX8634PROV_DIFF_MAX];
+    uint32_t       _swap_ms       = 0;          // Dwell before assuming a new board.
+    uint32_t       _stage_start   = 0;
+    uint32_t       _cycle_start   = 0;
+    uint32_t       _run_start     = 0;
+    uint32_t       _run_end       = 0;
+    uint32_t       _passed        = 0;
+    uint32_t       _failed        = 0;
+    uint32_t       _busy_ms       = 0;          // Total time spent cycling boards.
+    uint32_t       _last_cycle_ms = 0;
+
+    uint32_t _run_ms();
+    void _set_state(SlotState, uint32_t now);
+    void _finish_board(bool passed, uint32_t now);
+    int8_t _gpio_test(uint32_t now);
+    void   _burn(uint32_t now);
+    bool   _check_readback();
+
+    inline bool _slot_flag(uint8_t f) {   return (_flags & f);  };
+    inline void _slot_set_flag(uint8_t f, bool x) {
+      _flags = (x) ? (_flags | f) : (_flags & ~f);
+    };
+
+    static ProvisionerSlot* _bus_owner[SX8634PROV_MAX_BUSES];
+};
+
+#endif  // __SX8634_PROVISIONER_SLOT_H__
@@ -1,5 +1,10 @@
 #include "SX8634BitDiddler.h"
+#include "IoCore.h"
+#include "LoopWake.h"
+#include "LogRing.h"
+#include "SX8634Conf.h"
 #include <Drivers/SX8634/SX8634.h>
+#include <stdlib.h>
 
 
 /*******************************************************************************
@@ -12,63 +17,53 @@
 *
 * Static members and initializers should be located here.
 *******************************************************************************/
-static SX8634BitDiddler* INSTANCE = nullptr;
+/*
+* Only one slot at a time may have its platform GPIO in testing mode. The ISRs
+*   record pin transitions against that slot.
+*/
+static ProvisionerSlot* volatile GPIO_SLOT = nullptr;
+
+/* Every edge the ISRs see goes here, to be drained by the main loop. */
+static EdgeRing EDGE_RING;
 
-static uint8_t  pf_pins[8]; // The platform GPIO pins that match the SX8634 GPIO.
-static uint8_t  pin_transition_values[8];
-static uint32_t pin_transition_times[8];
+static const uint8_t MSG_ARGS_SX8634_BUTTON_MS[] = { (uint8_t) TCode::UINT8, (uint8_t) TCode::UINT32, 0 };
+static const uint8_t MSG_ARGS_SX8634_CHORD[]     = { (uint8_t) TCode::UINT16, 0 };
+static const uint8_t MSG_ARGS_SX8634_SWIPE[]     = { (uint8_t) TCode::INT32,  (uint8_t) TCode::INT32, 0 };
 
 const MessageTypeDef message_defs_list[] = {
-  {  MANUVR_MSG_SX8634_BD_SVC_REQ,    MSG_FLAG_EXPORTABLE,  "SX8634_BD_SVC_REQ",    ManuvrMsg::MSG_ARGS_NONE }  //
+  {  MANUVR_MSG_SX8634_BD_SVC_REQ,    MSG_FLAG_EXPORTABLE,  "SX8634_BD_SVC_REQ",    ManuvrMsg::MSG_ARGS_NONE },  //
+  {  MANUVR_MSG_SX8634_LONG_PRESS,    MSG_FLAG_EXPORTABLE,  "SX8634_LONG_PRESS",    MSG_ARGS_SX8634_BUTTON_MS },
+  {  MANUVR_MSG_SX8634_DOUBLE_TAP,    MSG_FLAG_EXPORTABLE,  "SX8634_DOUBLE_TAP",    MSG_ARGS_SX8634_BUTTON_MS },
+  {  MANUVR_MSG_SX8634_CHORD,         MSG_FLAG_EXPORTABLE,  "SX8634_CHORD",         MSG_ARGS_SX8634_CHORD     },
+  {  MANUVR_MSG_SX8634_SWIPE,         MSG_FLAG_EXPORTABLE,  "SX8634_SWIPE",         MSG_ARGS_SX8634_SWIPE     }
 };
 
 
-void sx_gpio_0_isr() {
-  uint8_t sxpin = 0;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_1_isr() {
-  uint8_t sxpin = 1;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_2_isr() {
-  uint8_t sxpin = 2;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_3_isr() {
-  uint8_t sxpin = 3;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_4_isr() {
-  uint8_t sxpin = 4;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_5_isr() {
-  uint8_t sxpin = 5;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
+/* The ISR's view of the GPIO. Written by the ISR once it is armed. */
+static volatile uint8_t GPIO_WATCHED = 0;   // SX8634 GPIO that have the ISR.
+static volatile uint8_t GPIO_LEVELS  = 0;   // The last snapshot.
 
-void sx_gpio_6_isr() {
-  uint8_t sxpin = 6;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
-}
-
-void sx_gpio_7_isr() {
-  uint8_t sxpin = 7;
-  pin_transition_times[sxpin]  = micros();
-  pin_transition_values[sxpin] = readPin(pf_pins[sxpin]) ? 1 : 0;
+/*
+* Every pin in testing mode shares this ISR. It doesn't matter which pin fired,
+*   since all eight are taken from one read of the input register, and stamped
+*   once. Pins that toggle together show up in the same record.
+*/
+void sx_gpio_isr() {
+  ProvisionerSlot* slot = GPIO_SLOT;
+  if (nullptr != slot) {
+    const uint64_t bank = gpio_bank_read();
+    const uint64_t now  = edge_clock_us();
+    uint8_t levels = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+      const uint8_t pfpin = slot->pf_pins[i];
+      if ((255 != pfpin) && ((bank >> pfpin) & 1)) {
+        levels |= (1 << i);
+      }
+    }
+    EDGE_RING.push(slot->index(), levels, ((levels ^ GPIO_LEVELS) & GPIO_WATCHED), now);
+    GPIO_LEVELS = levels;
+  }
+  loop_wake_isr();
 }
 
 
@@ -84,29 +79,23 @@ void sx_gpio_7_isr() {
 *******************************************************************************/
 
 /*
-* Constructor.
+* Constructor. The given board becomes slot 0, and is powered up, as the
+*   single-board jig always was.
 */
 SX8634BitDiddler::SX8634BitDiddler(I2CAdapter* i2c, uint8_t _pwr, uint8_t g0, uint8_t g1, uint8_t g2, uint8_t g3, uint8_t g4, uint8_t g5, uint8_t g6, uint8_t g7, const SX8634Opts* sx8634_o)
-    : EventReceiver("SX8634BitDiddler"), _PWR_PIN(_pwr), touch(sx8634_o) {
-  INSTANCE = this;
-  pf_pins[0] = g0;
-  pf_pins[1] = g1;
-  pf_pins[2] = g2;
-  pf_pins[3] = g3;
-  pf_pins[4] = g4;
-  pf_pins[5] = g5;
-  pf_pins[6] = g6;
-  pf_pins[7] = g7;
-  _platform_gpio_make_safe();
-  gpioDefine(_PWR_PIN, GPIOMode::OUTPUT);
-  setPin(_PWR_PIN, true);       // Turn on power to the touch board.
-  for (uint8_t i = 0; i < 8; i++) {
-    pin_transition_times[i] = 0;
+    : EventReceiver("SX8634BitDiddler") {
+  const uint8_t gpio_pins[8] = { g0, g1, g2, g3, g4, g5, g6, g7 };
+  for (uint8_t i = 0; i < SX8634PROV_MAX_SLOTS; i++) {
+    _slots[i] = nullptr;
   }
+  memset(_run_blob, 0, sizeof(_run_blob));
 
   int mes_count = sizeof(message_defs_list) / sizeof(MessageTypeDef);
   ManuvrMsg::registerMessages(message_defs_list, mes_count);
-  i2c->addSlaveDevice((I2CDevice*) &touch);
+
+  addSlot(i2c, _pwr, gpio_pins, sx8634_o);
+  _slots[0]->acquireBus();
+  _slots[0]->power(true);       // Turn on power to the touch board.
 }
 
 
@@ -114,6 +103,44 @@ SX8634BitDiddler::SX8634BitDiddler(I2CAdapter* i2c, uint8_t _pwr, uint8_t g0, ui
 * Destructor.
 */
 SX8634BitDiddler::~SX8634BitDiddler() {
+  if (nullptr != _capture) {
+    free(_capture);
+    _capture = nullptr;
+  }
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    delete _slots[i];
+    _slots[i] = nullptr;
+  }
+}
+
+
+/*
+* Adds another socket to the jig. Slots on the same bus must each have their
+*   own power, reset, and IRQ pins. gpio_pins may be nullptr if the slot has no
+*   platform GPIO wired to it.
+*
+* @return The index of the new slot, or -1 if there is no room for it.
+*/
+int8_t SX8634BitDiddler::addSlot(I2CAdapter* i2c, uint8_t pwr_pin, const uint8_t* gpio_pins, const SX8634Opts* sx8634_o) {
+  if (SX8634PROV_MAX_SLOTS <= _slot_count) return -1;
+  ProvisionerSlot* slot = new ProvisionerSlot(_slot_count, i2c, pwr_pin, gpio_pins, sx8634_o);
+  _slots[_slot_count] = slot;
+  _platform_gpio_make_safe(slot);
+  return _slot_count++;
+}
+
+
+/*
+* With the cores split, console output is written by the I/O task, so that a
+*   long dump doesn't hold up touch servicing.
+*/
+void SX8634BitDiddler::_flush_log() {
+  if (io_core_running()) {
+    io_core_print(&local_log);
+  }
+  else {
+    flushLocalLog();
+  }
 }
 
 
@@ -122,14 +149,28 @@ SX8634BitDiddler::~SX8634BitDiddler() {
 * Touch
 *******************************************************************************/
 
-int8_t SX8634BitDiddler::_platform_gpio_reconfigure() {
-  local_log.concat("Putting platform GPIO into testing mode.\n");
-
-  _gpio_safety(false);
+int8_t SX8634BitDiddler::_platform_gpio_reconfigure(ProvisionerSlot* slot) {
+  if (!slot->hasGPIO()) {
+    local_log.concatf("Slot %u has no platform GPIO.\n", slot->index());
+    _flush_log();
+    return -1;
+  }
+  if ((nullptr != GPIO_SLOT) && (slot != GPIO_SLOT)) {
+    _platform_gpio_make_safe(GPIO_SLOT);
+  }
+  local_log.concatf("Putting platform GPIO for slot %u into testing mode.\n", slot->index());
+
+  SX8634Jig* touch = &slot->touch;
+  uint8_t* pf_pins = slot->pf_pins;
+  slot->gpioSafety(false);
+  GPIO_WATCHED = 0;
+  GPIO_LEVELS  = 0;
+  GPIO_SLOT    = slot;
+  _msg_service_request.enableSchedule(true);   // Keeps the edge ring drained.
   for (uint8_t i = 0; i < 8; i++) {
     bool using_isr = false;
     GPIOMode pptm;
-    switch (touch.getGPIOMode(i)) {
+    switch (touch->getGPIOMode(i)) {
       case GPIOMode::ANALOG_OUT:
       case GPIOMode::OUTPUT:
         pptm = GPIOMode::INPUT;
@@ -148,7 +189,7 @@ int8_t SX8634BitDiddler::_platform_gpio_reconfigure() {
     }
     local_log.concatf("SX8634 pin %u has mode: %s.  Setting platform pin %u to mode: %s\n",
       i,
-      Platform::getPinModeStr(touch.getGPIOMode(i)),
+      Platform::getPinModeStr(touch->getGPIOMode(i)),
       pf_pins[i],
       Platform::getPinModeStr(pptm)
     );
@@ -158,36 +199,35 @@ int8_t SX8634BitDiddler::_platform_gpio_reconfigure() {
       }
       gpioDefine(pf_pins[i], pptm);
       if (using_isr) {
-        switch (i) {
-          case 0:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_0_isr);  break;
-          case 1:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_1_isr);  break;
-          case 2:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_2_isr);  break;
-          case 3:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_3_isr);  break;
-          case 4:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_4_isr);  break;
-          case 5:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_5_isr);  break;
-          case 6:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_6_isr);  break;
-          case 7:  setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_7_isr);  break;
+        if (readPin(pf_pins[i]) > 0) {
+          GPIO_LEVELS = GPIO_LEVELS | (1 << i);   // Baseline, before the ISR is armed.
         }
+        GPIO_WATCHED = GPIO_WATCHED | (1 << i);
+        setPinFxn(pf_pins[i], CHANGE_PULL_UP, sx_gpio_isr);
       }
     }
   }
-  flushLocalLog();
+  _flush_log();
   return 0;
 }
 
 
 
-int8_t SX8634BitDiddler::_platform_gpio_make_safe() {
-  local_log.concat("Putting platform GPIO into INPUT_PULLUP mode.\n");
+int8_t SX8634BitDiddler::_platform_gpio_make_safe(ProvisionerSlot* slot) {
+  local_log.concatf("Putting platform GPIO for slot %u into INPUT_PULLUP mode.\n", slot->index());
 
   for (uint8_t i = 0; i < 8; i++) {
-    if (255 != pf_pins[i]) {
-      gpioDefine(pf_pins[i], GPIOMode::INPUT_PULLUP);
-      unsetPinIRQ(pf_pins[i]);
+    if (255 != slot->pf_pins[i]) {
+      gpioDefine(slot->pf_pins[i], GPIOMode::INPUT_PULLUP);
+      unsetPinIRQ(slot->pf_pins[i]);
     }
   }
-  _gpio_safety(true);
-  flushLocalLog();
+  if (slot == GPIO_SLOT) {
+    GPIO_SLOT    = nullptr;
+    GPIO_WATCHED = 0;
+  }
+  slot->gpioSafety(true);
+  _flush_log();
   return 0;
 }
 
@@ -195,6 +235,623 @@ int8_t SX8634BitDiddler::_platform_gpio_make_safe() {
 
 
 
+/*******************************************************************************
+* Production runs
+*******************************************************************************/
+
+/*
+* Every slot gets the same blob. Each slot cycles boards on its own, and the
+*   slots sharing a bus take turns holding it. So while one board is burning
+*   NVM, another is being verified on the other bus, and a third is being
+*   swapped by the operator.
+*/
+int8_t SX8634BitDiddler::_run_start(const char* name, uint32_t swap_ms) {
+  if (0 != _load_blob_by_name(name, _run_blob)) {
+    return -1;
+  }
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    if (!_slots[i]->gpioSafety()) {
+      _platform_gpio_make_safe(_slots[i]);
+    }
+    _slots[i]->releaseBus();
+    _slots[i]->start(_run_blob, swap_ms);
+  }
+  _msg_service_request.enableSchedule(true);
+  local_log.concatf("Started a run of \"%s\" on %u slots.\n", name, _slot_count);
+  return 0;
+}
+
+
+int8_t SX8634BitDiddler::_run_stop() {
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    _slots[i]->stop();
+  }
+  _msg_service_request.enableSchedule(false);
+  printSlots(&local_log);
+  return 0;
+}
+
+
+/*
+* Called periodically while any slot is running, or an SPM delta write is
+*   underway.
+*/
+int8_t SX8634BitDiddler::_service_slots() {
+  const uint32_t now = millis();
+  bool running = false;
+  _script_service(now);   // First, so that the slots see anything it started.
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    ProvisionerSlot* slot = _slots[i];
+    slot->touch.pollDelta(now);
+    running |= slot->touch.deltaBusy();
+    const uint32_t passed = slot->passed();
+    const uint32_t boards = passed + slot->failed();
+    if (0 != slot->poll(now)) {
+      if (boards != (slot->passed() + slot->failed())) {
+        Storage* store = _storage();
+        if (nullptr != store) {
+          _yield.add(store, slot, (passed != slot->passed()));
+        }
+        log_ring_put(
+          (passed != slot->passed()) ? "Slot %u: board %u passed (%u ms).\n" : "Slot %u: board %u FAILED (%u ms).\n",
+          i, boards + 1, slot->lastCycleMs()
+        );
+      }
+    }
+    running |= (SlotState::PARKED != slot->state());
+  }
+  running |= _evstream.enabled();   // Batches are sent on a timer.
+  if (_capmon.running()) {
+    _capmon.poll();
+    _slots[_capmon.slot()]->touch.pollMonitor();
+    running = true;
+  }
+  running |= _script.running();
+  if (_tuner.running()) {
+    if (1 == _tuner.poll(now, &local_log)) {
+      uint8_t buf[128];
+      memcpy(buf, _tuner.result(), 128);
+      _tuner.printResults(&local_log);
+      if (0 == _save_blob_by_name(_tuner.name(), buf)) {
+        local_log.concatf("Saved tuned SPM as \"%s\".\n", _tuner.name());
+      }
+      ProvisionerSlot* slot = _tuner.slot();
+      if (0 <= slot->touch.loadSPMDelta(buf)) {
+        _delta_slot = slot->index();
+      }
+      _print_app_config(buf);
+    }
+    running |= _tuner.running();
+  }
+  running |= _gestures_pending();   // Long presses and swipe ends are found on the timer.
+  if (_governor.running()) {
+    const uint8_t idx = _governor.slot()->index();
+    if (0 > _governor.poll(now)) {
+      local_log.concatf("Mode governor stopped: slot %u was taken for a run.\n", idx);
+    }
+    running |= _governor.running();
+  }
+  if (_bootprof.running()) {
+    if (1 == _bootprof.poll(now)) {
+      _bootprof.printResults(&local_log);
+      _msg_service_request.alterSchedulePeriod(SX8634PROV_SVC_PERIOD_MS);
+    }
+    running |= _bootprof.running();
+  }
+  if ((_delta_slot < _slot_count) && !_slots[_delta_slot]->touch.deltaBusy()) {
+    local_log.concatf("Slot %u: ", _delta_slot);
+    _slots[_delta_slot]->touch.printDelta(&local_log);
+    _delta_slot = SX8634PROV_MAX_SLOTS;
+  }
+  if ((_verify_slot < _slot_count) && !_slots[_verify_slot]->burnVerifyBusy()) {
+    _slots[_verify_slot]->printBurnVerify(&local_log);
+    _verify_slot = SX8634PROV_MAX_SLOTS;
+  }
+  if (!running && (nullptr == GPIO_SLOT)) {
+    _msg_service_request.enableSchedule(false);
+  }
+  _flush_log();
+  return 0;
+}
+
+
+/*******************************************************************************
+* Benchmarks                                                                   *
+*******************************************************************************/
+
+/*
+* Times the data paths that a station cycle goes through, on the selected slot.
+*   A scratch blob is saved, loaded, and dropped. Unless storage was replaced
+*   by useStorage(), it is backed by flash, and is written no more than
+*   BENCH_STORAGE_WRITES times. load_spm_from_buffer() writes the board's own
+*   SPM back to it, and is only run if asked.
+*/
+void SX8634BitDiddler::runBenchmarks(StringBuilder* output, uint32_t calls, bool with_board) {
+  ProvisionerSlot* slot = _slot();
+  SX8634Jig* touch = &slot->touch;
+  Storage* store   = _storage();
+  BenchResult r;
+  uint8_t spm[128];
+  uint8_t buf[128];
+  if (0 != touch->copySPM(spm)) {
+    memcpy(spm, SX8634_CONF_QSM, 128);
+  }
+  const uint32_t store_calls = ((nullptr == store) || ((nullptr == _store) && (BENCH_STORAGE_WRITES < calls))) ? BENCH_STORAGE_WRITES : calls;
+
+  output->concatf("Benchmarks on slot %u (%s storage):\n", slot->index(), ((nullptr != _store) ? "replaced" : "platform"));
+  bench_print_header(output);
+
+  bench_run(&r, calls, false, [&]() {
+    memcpy(buf, spm, 128);
+    SX8634::render_stripped_spm(buf);
+  });
+  bench_print(output, "render_stripped_spm()", &r);
+
+  bench_run(&r, calls, false, [&]() {   touch->copy_spm_to_buffer(buf);   });
+  bench_print(output, "copy_spm_to_buffer()", &r);
+
+  bench_run(&r, ((with_board && slot->holdsBus()) ? calls : 0), true, [&]() {
+    touch->load_spm_from_buffer(spm);
+  });
+  bench_print(output, "load_spm_from_buffer()", &r);
+
+  bench_run(&r, ((nullptr != store) ? store_calls : 0), false, [&]() {
+    _save_blob_by_name(SX8634PROV_BENCH_BLOB, spm);
+  });
+  bench_print(output, "_save_blob_by_name()", &r);
+
+  bench_run(&r, ((nullptr != store) ? calls : 0), false, [&]() {
+    _load_blob_by_name(SX8634PROV_BENCH_BLOB, buf);
+  });
+  bench_print(output, "_load_blob_by_name()", &r);
+
+  bench_run(&r, ((nullptr != store) ? calls : 0), false, [&]() {   _blob_dir.load(store);   });
+  bench_print(output, "BlobDirectory::load()", &r);
+
+  // What the console does to a line before consoleCmdProc(), and what
+  //   _console_exec() does with the tokens.
+  bench_run(&r, calls, false, [&]() {
+    StringBuilder line("u benchblob 80 0 7");
+    line.split(" ");
+    for (int i = 1; i < line.count(); i++) {
+      line.position_as_int(i);
+    }
+  });
+  bench_print(output, "console tokenizing", &r);
+
+  if (nullptr != store) {
+    _drop_blob_by_name(SX8634PROV_BENCH_BLOB);
+  }
+  if (!bench_has_pump() && with_board) {
+    output->concat("\tSPM writes are called once from the console. The host benchmark repeats them.\n");
+  }
+}
+
+
+/*******************************************************************************
+* Scripts                                                                      *
+*******************************************************************************/
+
+/*
+* Runs script steps until one of them has to wait, or the script ends. Commands
+*   act on the selected slot, as they would from the console.
+*/
+int8_t SX8634BitDiddler::_script_service(uint32_t now) {
+  while (_script.running()) {
+    if (ScriptWait::NONE != _script.waitFor()) {
+      const int8_t ret = _script_wait_check(now);
+      if (0 == ret) {
+        break;   // Still waiting.
+      }
+      _script.stepDone((0 < ret) ? 0 : -1, &local_log, now);
+    }
+    else if (_script.nextStep(&local_log, now)) {
+      if (ScriptWait::NONE == _script.waitFor()) {
+        StringBuilder line(_script.step());
+        line.split(" ");
+        _slot()->touch.clearObservations();
+        const int8_t ret = _console_exec(&line);
+        _script.stepDone(ret, &local_log, millis());
+      }
+      else {
+        _script_ping_ms = 0;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+* @return 1 if the condition was met, 0 if we should keep waiting, or -1 if
+*   the wait failed.
+*/
+int8_t SX8634BitDiddler::_script_wait_check(uint32_t now) {
+  SX8634Jig* touch = &_slot()->touch;
+  const uint32_t elapsed = now - _script.stepStart();
+  bool met = false;
+  switch (_script.waitFor()) {
+    case ScriptWait::PING:
+      met = touch->observed(SX8634_JIG_OBS_ACK);
+      if (!met && _slot()->holdsBus() && ((0 == _script_ping_ms) || ((now - _script_ping_ms) >= SCRIPT_PING_PERIOD_MS))) {
+        _script_ping_ms = now;
+        touch->ping();
+      }
+      break;
+    case ScriptWait::SPM:
+      met = touch->observed(SX8634_JIG_OBS_SPM_READ) && touch->mirrorValid();
+      break;
+    case ScriptWait::DELTA:
+      met = touch->observed(SX8634_JIG_OBS_DELTA_DONE);
+      if (!met && !touch->deltaBusy()) {
+        return -1;   // It failed, or there was never one to wait for.
+      }
+      break;
+    case ScriptWait::NVM:
+      met = touch->observed(SX8634_JIG_OBS_NVM_BURNED);
+      break;
+    case ScriptWait::IRQ:
+      met = touch->observed(SX8634_JIG_OBS_IRQ);
+      break;
+    case ScriptWait::DELAY:
+      return (elapsed >= _script.waitArg()) ? 1 : 0;
+    default:
+      return -1;
+  }
+  if (met) {
+    return 1;
+  }
+  return (elapsed >= _script.waitArg()) ? -1 : 0;
+}
+
+
+/*
+* The console split the steps on spaces. They are joined back together here.
+*/
+int8_t SX8634BitDiddler::_script_save(StringBuilder* input) {
+  Storage* store = _storage();
+  if (nullptr == store) {
+    local_log.concat("No storage available.\n");
+    return -1;
+  }
+  StringBuilder text;
+  for (int i = 2; i < input->count(); i++) {
+    if (2 < i) text.concat(' ');
+    text.concat(input->position(i));
+  }
+  const char* name = input->position(1);
+  const int8_t ret = _script.put(store, name, (const char*) text.string());
+  switch (ret) {
+    case 0:
+      local_log.concatf("Saved script \"%s\".\n", name);
+      break;
+    case -1:
+      local_log.concatf("Script names must be shorter than %u characters, and scripts shorter than %u.\n", SCRIPT_NAME_LEN, SCRIPT_TEXT_LEN);
+      break;
+    case -2:
+      local_log.concatf("There is no room for another script. The limit is %u.\n", SCRIPT_MAX_SCRIPTS);
+      break;
+    default:
+      local_log.concat("Tried to write the script table and failed.\n");
+      break;
+  }
+  return ret;
+}
+
+
+/*
+* Takes edges out of the ring in batches. Each slot keeps the last edge seen on
+*   each of its pins, and a running capture keeps all of them.
+*
+* @return 1 if there were edges, 0 otherwise.
+*/
+int8_t SX8634BitDiddler::_drain_edges() {
+  GPIOEdge batch[SX8634PROV_EDGE_BATCH];
+  unsigned int n = 0;
+  int8_t ret = 0;
+  while (0 < (n = EDGE_RING.drain(batch, SX8634PROV_EDGE_BATCH))) {
+    for (unsigned int i = 0; i < n; i++) {
+      const GPIOEdge* e = &batch[i];
+      if (_slot_count > e->slot) {
+        ProvisionerSlot* slot = _slots[e->slot];
+        for (uint8_t pin = 0; pin < 8; pin++) {
+          if (e->changed & (1 << pin)) {
+            slot->pin_transition_values[pin] = (e->levels >> pin) & 1;
+            slot->pin_transition_times[pin]  = e->t_us;
+          }
+        }
+      }
+      _pwm.feed(e);
+      if (_capture_len < _capture_max) {
+        _capture[_capture_len++] = *e;
+      }
+      else if (0 < _capture_max) {
+        _capture_lost++;
+      }
+    }
+    ret = 1;
+  }
+  return ret;
+}
+
+
+/*
+* Starts keeping every edge that comes out of the ring. Anything captured
+*   before is discarded.
+*/
+int8_t SX8634BitDiddler::_capture_start(uint16_t depth) {
+  _drain_edges();
+  _capture_max  = 0;
+  _capture_len  = 0;
+  _capture_lost = 0;
+  if (nullptr != _capture) {
+    free(_capture);
+  }
+  _capture = (GPIOEdge*) malloc(depth * sizeof(GPIOEdge));
+  if (nullptr == _capture) {
+    return -1;
+  }
+  _capture_max = depth;
+  return 0;
+}
+
+
+/*
+* Stops the capture, but keeps what was captured.
+*/
+int8_t SX8634BitDiddler::_capture_stop() {
+  _drain_edges();
+  _capture_max = 0;
+  return 0;
+}
+
+
+/*
+* Measures PWM on the GPIO of whichever slot is in testing mode. The results
+*   are printed when the window closes.
+*/
+int8_t SX8634BitDiddler::_pwm_start(uint32_t window_ms) {
+  ProvisionerSlot* slot = GPIO_SLOT;
+  if (nullptr == slot) {
+    return -1;
+  }
+  _drain_edges();
+  _pwm.start(slot->index(), GPIO_LEVELS, window_ms, edge_clock_us());
+  return 0;
+}
+
+
+/*
+* Prints the measurements beside the SPM values that ought to have produced
+*   them.
+*/
+void SX8634BitDiddler::_pwm_report() {
+  uint8_t buf[128];
+  bool have_spm = false;
+  if (_pwm.slot() < _slot_count) {
+    have_spm = (0 == _slots[_pwm.slot()]->touch.copySPM(buf));
+  }
+  _pwm.printResults(&local_log, have_spm ? buf : nullptr);
+}
+
+
+/*
+* The driver's messages don't say which chip raised them. Whichever slot
+*   serviced an IRQ most recently, and hasn't already been counted for this
+*   type of message, is taken to be the source.
+*
+* @return The stamps that were recorded, or nullptr if none fit.
+*/
+LatencyStamps* SX8634BitDiddler::_latency_record(uint8_t msg_type, uint64_t notify_us) {
+  LatencyStamps* best = nullptr;
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    LatencyStamps* s = _slots[i]->touch.latencyStamps();
+    if ((0 == (s->recorded & (1 << msg_type))) && (0 < s->raise) && (s->raise <= notify_us)) {
+      if ((nullptr == best) || (s->raise > best->raise)) {
+        best = s;
+      }
+    }
+  }
+  if (nullptr != best) {
+    _latency.record(msg_type, best, notify_us);
+  }
+  return best;
+}
+
+
+/*
+* Raises a message for each gesture that any slot's engine has recognized, and
+*   keeps the service timer going while they have more to look for.
+*/
+void SX8634BitDiddler::_raise_gestures() {
+  Gesture g;
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    while (_gestures[i].take(&g)) {
+      ManuvrMsg* msg = nullptr;
+      uint8_t  arg   = g.button;
+      uint32_t value = (uint32_t) g.value;
+      switch (g.type) {
+        case GESTURE_LONG_PRESS:
+          msg = Kernel::returnEvent(MANUVR_MSG_SX8634_LONG_PRESS, (EventReceiver*) this);
+          msg->addArg(g.button);
+          msg->addArg((uint32_t) g.value);
+          break;
+        case GESTURE_DOUBLE_TAP:
+          msg = Kernel::returnEvent(MANUVR_MSG_SX8634_DOUBLE_TAP, (EventReceiver*) this);
+          msg->addArg(g.button);
+          msg->addArg((uint32_t) g.value);
+          break;
+        case GESTURE_CHORD:
+          msg = Kernel::returnEvent(MANUVR_MSG_SX8634_CHORD, (EventReceiver*) this);
+          msg->addArg(g.mask);
+          arg   = 0;
+          value = g.mask;
+          break;
+        case GESTURE_SWIPE:
+          msg = Kernel::returnEvent(MANUVR_MSG_SX8634_SWIPE, (EventReceiver*) this);
+          msg->addArg((int32_t) g.value);
+          msg->addArg((int32_t) g.velocity);
+          // The stream carries no signs. Direction goes in the arg.
+          arg   = (0 > g.value) ? 1 : 0;
+          value = (uint32_t) ((0 > g.velocity) ? -g.velocity : g.velocity);
+          break;
+        default:
+          continue;
+      }
+      raiseEvent(msg);
+      if (_evstream.enabled()) {
+        _evstream.add(EVSTREAM_LONG_PRESS + g.type, i, arg, value, g.t_us);
+      }
+      else {
+        switch (g.type) {
+          case GESTURE_LONG_PRESS:
+            log_ring_put("Slot %u: long press %u (%u ms)\n", i, g.button, value);
+            break;
+          case GESTURE_DOUBLE_TAP:
+            log_ring_put("Slot %u: double tap %u (%u ms)\n", i, g.button, value);
+            break;
+          case GESTURE_CHORD:
+            log_ring_put("Slot %u: chord 0x%03x\n", i, g.mask);
+            break;
+          case GESTURE_SWIPE:
+            log_ring_put("Slot %u: swipe %d at %d/s\n", i, (int32_t) g.value, (int32_t) g.velocity);
+            break;
+        }
+      }
+    }
+  }
+  if (_gestures_pending()) {
+    _msg_service_request.enableSchedule(true);
+  }
+}
+
+
+bool SX8634BitDiddler::_gestures_pending() {
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    if (_gestures[i].pending()) return true;
+  }
+  return false;
+}
+
+
+/*
+* The slot whose chip raised the message. The driver names itself as the
+*   message's originator. A message without one is taken to be from the
+*   selected slot.
+*/
+uint8_t SX8634BitDiddler::_event_slot(ManuvrMsg* msg) {
+  const void* origin = (const void*) msg->getOriginator();
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    if ((const void*) &_slots[i]->touch == origin) {
+      return i;
+    }
+  }
+  return _selected;
+}
+
+
+void SX8634BitDiddler::_print_capture(StringBuilder* output, bool list_edges) {
+  output->concatf("Edge capture: %u snapshots (%s), %u lost\n",
+    _capture_len, (0 < _capture_max) ? "running" : "stopped", _capture_lost
+  );
+  output->concatf("Edge ring: %u pushed, %u dropped, %u waiting\n",
+    EDGE_RING.pushed(), EDGE_RING.dropped(), EDGE_RING.count()
+  );
+  if (0 == _capture_len) return;
+  const uint64_t t0 = _capture[0].t_us;
+  uint32_t coincident = 0;   // Snapshots in which more than one pin changed.
+  uint32_t spurious   = 0;   // Snapshots in which nothing changed.
+  uint8_t  active     = 0;   // Pins that changed at all.
+
+  if (list_edges) {
+    output->concat("\n  #  Slot Levels Changed  Time (us)\n");
+  }
+  for (uint16_t i = 0; i < _capture_len; i++) {
+    const GPIOEdge* e = &_capture[i];
+    const uint8_t c = e->changed;
+    if (0 == c) {
+      spurious++;
+    }
+    else if (0 != (c & (c - 1))) {
+      coincident++;
+    }
+    active |= c;
+    if (list_edges) {
+      output->concatf("%5u  %u    0x%02x   0x%02x     %u\n",
+        i, e->slot, e->levels, c, (uint32_t) (e->t_us - t0)
+      );
+    }
+  }
+  output->concatf("\n%u snapshots had coincident edges. %u had none.\n", coincident, spurious);
+  if (0 == active) return;
+
+  /* Skew is measured against the lowest-numbered pin that moved. */
+  uint8_t ref = 0;
+  while (0 == (active & (1 << ref))) ref++;
+
+  output->concatf("\nGPIO Edges  High (us)  Low (us)  Duty  Period (us)  Skew vs GPIO%u (avg/max us)\n", ref);
+  for (uint8_t pin = 0; pin < 8; pin++) {
+    if (0 == (active & (1 << pin))) continue;
+    const uint8_t mask = (1 << pin);
+    uint32_t edges = 0;
+    uint32_t rises = 0;
+    uint32_t skews = 0;
+    uint64_t high_us    = 0;
+    uint64_t low_us     = 0;
+    uint64_t skew_total = 0;
+    uint64_t skew_max   = 0;
+    uint64_t first_rise = 0;
+    uint64_t last_rise  = 0;
+    uint64_t ref_t      = 0;
+    bool     ref_seen   = false;
+    const GPIOEdge* prev = nullptr;
+    for (uint16_t i = 0; i < _capture_len; i++) {
+      const GPIOEdge* e = &_capture[i];
+      if (e->changed & (1 << ref)) {
+        ref_t    = e->t_us;
+        ref_seen = true;
+      }
+      if (0 == (e->changed & mask)) continue;
+      edges++;
+      const bool level = (e->levels & mask);
+      if (nullptr != prev) {
+        if (prev->levels & mask) {
+          high_us += (e->t_us - prev->t_us);
+        }
+        else {
+          low_us  += (e->t_us - prev->t_us);
+        }
+      }
+      if (level) {
+        if (0 == rises++) first_rise = e->t_us;
+        last_rise = e->t_us;
+      }
+      if (ref_seen && (pin != ref)) {
+        const uint64_t skew = e->t_us - ref_t;
+        skew_total += skew;
+        if (skew > skew_max) skew_max = skew;
+        skews++;
+      }
+      prev = e;
+    }
+    const uint64_t total = high_us + low_us;
+    output->concatf("%u    %5u  %9u  %8u  %3u%%  %11u  ",
+      pin, edges, (uint32_t) high_us, (uint32_t) low_us,
+      (0 < total) ? (uint32_t) ((high_us * 100) / total) : 0,
+      (1 < rises) ? (uint32_t) ((last_rise - first_rise) / (rises - 1)) : 0
+    );
+    if (0 < skews) {
+      output->concatf("%u / %u\n", (uint32_t) (skew_total / skews), (uint32_t) skew_max);
+    }
+    else {
+      output->concat("-\n");
+    }
+  }
+}
+
+
+
+
 /*******************************************************************************
 * ######## ##     ## ######## ##    ## ########  ######
 * ##       ##     ## ##       ###   ##    ##    ##    ##
@@ -215,7 +872,32 @@ int8_t SX8634BitDiddler::_platform_gpio_make_safe() {
 */
 int8_t SX8634BitDiddler::attached() {
   if (EventReceiver::attached()) {
-    touch.init();
+    Storage* store = _storage();
+    if ((nullptr != store) && (-2 == _blob_dir.load(store))) {
+      local_log.concat("SPM blob directory is unreadable. Starting a new one.\n");
+      _flush_log();
+    }
+    if (nullptr != store) {
+      _script.load(store);
+      if (-2 == _yield.load(store)) {
+        local_log.concat("Yield log is unreadable. Starting a new one.\n");
+        _flush_log();
+      }
+      _spm_cache.load(store);
+    }
+    for (uint8_t i = 0; i < _slot_count; i++) {
+      if (_slots[i]->holdsBus()) {
+        _slots[i]->bootBoard();
+      }
+    }
+    _msg_service_request.repurpose(MANUVR_MSG_SX8634_BD_SVC_REQ, (EventReceiver*) this);
+    _msg_service_request.incRefs();
+    _msg_service_request.specific_target = (EventReceiver*) this;
+    _msg_service_request.alterSchedulePeriod(SX8634PROV_SVC_PERIOD_MS);
+    _msg_service_request.alterScheduleRecurrence(-1);
+    _msg_service_request.autoClear(false);
+    _msg_service_request.enableSchedule(false);
+    platform.kernel()->addSchedule(&_msg_service_request);
     return 1;
   }
   return 0;
@@ -253,63 +935,79 @@ int8_t SX8634BitDiddler::callback_proc(ManuvrMsg* event) {
 
 
 int8_t SX8634BitDiddler::notify(ManuvrMsg* active_event) {
+  const uint64_t notify_us = edge_clock_us();
   int8_t return_value = 0;
   uint8_t val0 = 0;
 
   switch (active_event->eventCode()) {
     case MANUVR_MSG_SX8634_BD_SVC_REQ:
+      for (uint8_t i = 0; i < _slot_count; i++) {
+        _gestures[i].poll(notify_us);
+      }
+      _evstream.poll(notify_us);
+      _drain_edges();
+      if (_pwm.running() && _pwm.expired(edge_clock_us())) {
+        _pwm.stop(edge_clock_us());
+        _pwm_report();
+      }
+      _service_slots();
       return_value++;
       break;
 
     case MANUVR_MSG_USER_BUTTON_PRESS:
+      _governor.activity(millis(), true, _latency_record(LATENCY_MSG_BUTTON, notify_us), notify_us);
       if (0 == active_event->getArgAs(&val0)) {
-        local_log.concatf("Button press %u\n", val0);
-        switch (val0) {
-          case 0:
-            break;
-          case 1:
-            break;
-          case 2:
-            break;
-          case 3:
-            break;
-          case 4:
-            break;
-          case 5:
-            break;
-          case 6:
-            break;
-          case 7:
-            break;
-          case 8:
-            break;
-          case 9:
-            break;
-          case 10:
-            break;
-          case 11:
-            break;
+        if (_evstream.enabled()) {
+          _evstream.add(EVSTREAM_BUTTON_PRESS, _event_slot(active_event), val0, 0, notify_us);
         }
+        else {
+          log_ring_put("Button press %u\n", val0);
+        }
+        _gestures[_event_slot(active_event)].press(val0, notify_us);
       }
       return_value++;
       break;
 
     case MANUVR_MSG_USER_BUTTON_RELEASE:
+      _governor.activity(millis(), false, nullptr, notify_us);
       if (0 == active_event->getArgAs(&val0)) {
-        local_log.concatf("Button release %u\n", val0);
+        if (_evstream.enabled()) {
+          _evstream.add(EVSTREAM_BUTTON_RELEASE, _event_slot(active_event), val0, 0, notify_us);
+        }
+        else {
+          log_ring_put("Button release %u\n", val0);
+        }
+        _gestures[_event_slot(active_event)].release(val0, notify_us);
       }
       return_value++;
       break;
 
     case MANUVR_MSG_GPI_CHANGE:
+      _latency_record(LATENCY_MSG_GPI, notify_us);
       if (0 == active_event->getArgAs(&val0)) {
-        local_log.concatf("GPI%u is now state %u\n", val0, touch.getGPIOValue(val0));
+        ProvisionerSlot* src = _slots[_event_slot(active_event)];
+        if (_evstream.enabled()) {
+          _evstream.add(EVSTREAM_GPI, src->index(), val0, src->touch.getGPIOValue(val0), notify_us);
+        }
+        else {
+          log_ring_put("GPI%u is now state %u\n", val0, src->touch.getGPIOValue(val0));
+        }
       }
       return_value++;
       break;
 
     case MANUVR_MSG_USER_SLIDER_VALUE:
-      local_log.concatf("Slider: %u\n", touch.sliderValue());
+      _governor.activity(millis(), true, _latency_record(LATENCY_MSG_SLIDER, notify_us), notify_us);
+      {
+        ProvisionerSlot* src = _slots[_event_slot(active_event)];
+        if (_evstream.enabled()) {
+          _evstream.add(EVSTREAM_SLIDER, src->index(), 0, src->touch.sliderValue(), notify_us);
+        }
+        else {
+          log_ring_put("Slider: %u\n", src->touch.sliderValue());
+        }
+        _gestures[src->index()].slider(src->touch.sliderValue(), notify_us);
+      }
       return_value++;
       break;
 
@@ -318,7 +1016,8 @@ int8_t SX8634BitDiddler::notify(ManuvrMsg* active_event) {
       break;
   }
 
-  flushLocalLog();
+  _raise_gestures();
+  _flush_log();
   return return_value;
 }
 
@@ -328,25 +1027,42 @@ int8_t SX8634BitDiddler::notify(ManuvrMsg* active_event) {
 */
 void SX8634BitDiddler::printDebug(StringBuilder* output) {
   EventReceiver::printDebug(output);
+  printSlots(output);
   printPins(output);
 }
 
 
+void SX8634BitDiddler::printSlots(StringBuilder* output) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < _slot_count; i++) {
+    output->concat((i == _selected) ? "*" : " ");
+    _slots[i]->printSlot(output);
+    total += _slots[i]->boardsPerHour();
+  }
+  if (0 < total) {
+    output->concatf("Jig throughput: %u boards/hour\n", total);
+  }
+}
+
+
 void SX8634BitDiddler::printPins(StringBuilder* output) {
-  local_log.concat("SX8634BitDiddler platform pin assignments\n");
-  local_log.concatf("GPIO safety:    %c\n", _gpio_safety() ? 'y':'n');
+  ProvisionerSlot* slot = _slot();
+  uint8_t* pf_pins = slot->pf_pins;
+  local_log.concatf("SX8634BitDiddler platform pin assignments for slot %u\n", slot->index());
+  local_log.concatf("GPIO safety:    %c\n", slot->gpioSafety() ? 'y':'n');
+  _drain_edges();
   local_log.concat("\nSX  PF   Val real micros\n-----------------------------------------\n");
   for (uint8_t i = 0; i < 8; i++) {
     local_log.concatf(
-      "%u:  %u   %u    %u   %u\n",
+      "%u:  %u   %u    %u   %llu\n",
       i,
       pf_pins[i],
-      pin_transition_values[i],
-      readPin(i)? 1:0,
-      pin_transition_times[i]
+      slot->pin_transition_values[i],
+      readPin(pf_pins[i])? 1:0,
+      (unsigned long long) slot->pin_transition_times[i]
     );
   }
-  flushLocalLog();
+  _flush_log();
 }
 
 
@@ -362,23 +1078,53 @@ static const ConsoleCommand console_cmds[] = {
   { "i 2",  "SX8634 GPIO listing" },
   { "i 3",  "SX8634 SPM" },
   { "i 4",  "Platform GPIO listing" },
+  { "i 5",  "Main loop wakeup latency" },
+  { "i 6",  "Deferred log ring" },
+  { "i 7",  "Queues between the cores, if split" },
+  { "E",    "Start capturing platform GPIO edges (optional depth)" },
+  { "e",    "Stop edge capture and summarize. \"e 1\" also lists the snapshots" },
+  { "f",    "Measure PWM on the platform GPIO (optional window in ms)" },
+  { "w",    "Main loop wakeup: <0: polled, 1: event-driven> [fallback tick ms]" },
+  { "H/h",  "Print/Clear touch-to-notify latency histograms" },
+  { "b",    "Touch events as a CBOR stream: <0: text, 1: CBOR>" },
+  { "s",    "List slots, or select the slot that other commands act upon" },
+  { "M",    "Provision boards in every slot with a stored blob (optional swap time in ms)" },
+  { "m",    "Stop provisioning" },
+  { "n",    "A new board has been put in the given (or selected) slot" },
+  { "y/Y",  "Print/Clear the yield log: throughput, stage times, failures by stage" },
   { "X/x",  "Enable/Disable power to the connected touch board" },
   { "t",    "Touch board info" },
   { "t 1",  "Set SX8634 to ACTIVE" },
   { "t 2",  "Set SX8634 to DOZE" },
   { "t 3",  "Set SX8634 to SLEEP" },
   { "t 4",  "Ping SX8634" },
+  { "v",    "Automatic ACTIVE/DOZE/SLEEP: v <latency budget ms (0: none)> [DOZE after ms] [SLEEP after ms]. No argument for stats" },
+  { "V",    "Stop the mode governor, leaving the chip ACTIVE" },
+  { "q",    "Gesture counts. \"q 0\" clears them" },
   { "R",    "Reset SX8634" },
+  { "a",    "CapSense monitor on the selected slot: a <sweeps per window>. \"a 0\" stops. No argument for stats" },
+  { "A",    "Stream CapSense monitor windows as CBOR: <0: off, 1: on>" },
+  { "u",    "Tune sensitivity and thresholds: u <blob name> [margin x10] [lowest] [highest]. No argument for results" },
+  { "U",    "Abort tuning" },
+  { "j",    "Trace I2C on the selected slot from a reset: j <bytes (1 for default)> [0 to skip the reset]. \"j 0\" stops" },
+  { "J",    "Print the I2C trace as hex. \"J 1\" saves it to storage" },
+  { "Z",    "Benchmark the provisioner's data paths: Z [calls] [1 to include SPM writes to the selected board]" },
+  { "Q",    "SPM cache for runs: Q <0: off, 1: on, 2: clear>. No argument for stats" },
+  { "T",    "Time <n> boots: T <n> [1 to reset instead of power-cycle]. \"T 0\" stops" },
   { "G/g",  "Reconfigure/Safety the platform GPIO pins" },
   { "O/o",  "Set/Clear GPIO pin on touch board" },
   { "P/p",  "Set/Clear the value of a platform GPO pin" },
   { "S",    "Save current SPM to local storage" },
   { "d",    "Dump given SPM blob to console" },
   { "D",    "Drop given SPM blob from local storage" },
-  { "L",    "Load stored SPM blob to SPM" },
+  { "L",    "Load stored SPM blob to SPM (changed pages only)" },
   { "l",    "List stored SPM blobs" },
   { "c",    "Print an application config blob from the current SPM" },
-  { "B",    "Burn current SPM to SX8634 NVM" }
+  { "B",    "Burn current SPM to SX8634 NVM. \"B 1\" also power-cycles and verifies, with retries" },
+  { "K",    "List scripts, print one, or save one: K <name> <step; step; ...>" },
+  { "k",    "Drop given script" },
+  { "r",    "Run given script on the selected slot. With no name, abort the running one" },
+  { "W",    "(In scripts) Wait for: ping, spm, delta, nvm, irq [timeout ms], or ms <delay>" }
 };
 
 
@@ -389,6 +1135,15 @@ uint SX8634BitDiddler::consoleGetCmds(ConsoleCommand** ptr) {
 
 
 void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
+  _console_exec(input);
+}
+
+
+/*
+* Runs one console command, and returns zero if it succeeded. Scripts use the
+*   return value to decide whether to go on.
+*/
+int8_t SX8634BitDiddler::_console_exec(StringBuilder* input) {
   const char* str = (char *) input->position(0);
   char c          = *str;
   bool arg0_given = false;
@@ -415,21 +1170,39 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
     arg2_given = true;
   }
 
+  ProvisionerSlot* slot = _slot();
+  SX8634Jig* touch = &slot->touch;
+  if ((nullptr != strchr("tRBOoSLc", c)) && !slot->holdsBus()) {
+    // The driver can't reach a board that doesn't hold its bus.
+    local_log.concatf("Slot %u does not hold its bus. Power it up with 'X'.\n", slot->index());
+    _flush_log();
+    return -1;
+  }
+
   switch (c) {
     case 'i':   // Debug prints.
       switch (arg0) {
         case 1:
-          touch.printOverview(&local_log);
+          touch->printOverview(&local_log);
           break;
         case 2:
-          touch.printGPIO(&local_log);
+          touch->printGPIO(&local_log);
           break;
         case 3:
-          touch.printSPMShadow(&local_log);
+          touch->printSPMShadow(&local_log);
           break;
         case 4:
           printPins(&local_log);
           break;
+        case 5:
+          loop_wake_print(&local_log);
+          break;
+        case 6:
+          log_ring_print(&local_log);
+          break;
+        case 7:
+          io_core_print_stats(&local_log);
+          break;
         default:
           printDebug(&local_log);
           break;
@@ -437,10 +1210,145 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
       break;
 
     /* Jig control options */
+    case 's':   // Slot selection
+      if (arg0_given) {
+        if ((0 <= arg0) && (_slot_count > arg0)) {
+          _selected = arg0;
+          local_log.concatf("Selected slot %u.\n", _selected);
+        }
+        else {
+          local_log.concatf("There are %u slots.\n", _slot_count);
+          ret = -1;
+        }
+      }
+      else {
+        printSlots(&local_log);
+      }
+      break;
+
+    case 'M':   // Start a production run.
+      if (arg0_given) {
+        ret = _run_start(input->position(1), (arg1_given && (0 < arg1)) ? arg1 : 0);
+        if (0 != ret) {
+          local_log.concatf("Failed to start run (%d).\n", ret);
+        }
+      }
+      else {
+        local_log.concatf("Usage: %c <blob name> [swap ms]\n", c);
+        ret = -1;
+      }
+      break;
+
+    case 'm':   // Stop a production run.
+      _run_stop();
+      break;
+
+    case 'y':   // Yield and throughput report.
+      _yield.printReport(&local_log);
+      break;
+    case 'Y':   // Clear the yield log.
+      {
+        Storage* store = _storage();
+        ret = (nullptr != store) ? _yield.clear(store) : -1;
+        local_log.concat((0 == ret) ? "Yield log cleared.\n" : "Failed to clear the yield log.\n");
+      }
+      break;
+
+    case 'n':   // The operator put a new board in a slot.
+      if (arg0_given && ((0 > arg0) || (_slot_count <= arg0))) {
+        local_log.concatf("There are %u slots.\n", _slot_count);
+        ret = -1;
+      }
+      else {
+        uint8_t idx = arg0_given ? arg0 : _selected;
+        ret = _slots[idx]->boardLoaded();
+        local_log.concatf("Slot %u %s.\n", idx, (0 == ret) ? "loaded" : "is not running");
+      }
+      break;
+
+    case 'E':   // Start an edge capture.
+      ret = _capture_start((arg0_given && (0 < arg0)) ? arg0 : SX8634PROV_CAPTURE_DEPTH);
+      if (0 == ret) {
+        local_log.concatf("Capturing up to %u edges.\n", _capture_max);
+        if (nullptr == GPIO_SLOT) {
+          local_log.concat("No slot has its platform GPIO in testing mode. Use 'G'.\n");
+        }
+      }
+      else {
+        local_log.concat("Failed to allocate the capture.\n");
+      }
+      break;
+
+    case 'e':   // Stop an edge capture and report.
+      _capture_stop();
+      _print_capture(&local_log, (1 == arg0));
+      break;
+
+    case 'f':   // PWM measurement.
+      if (_pwm.running()) {
+        _pwm.printResults(&local_log, nullptr);
+      }
+      else if (0 == _pwm_start((arg0_given && (0 < arg0)) ? arg0 : SX8634PROV_PWM_WINDOW_MS)) {
+        local_log.concat("Measuring PWM...\n");
+      }
+      else {
+        local_log.concat("No slot has its platform GPIO in testing mode. Use 'G'.\n");
+        ret = -1;
+      }
+      break;
+
+    case 'w':   // Main loop wakeup mode.
+      if (arg0_given) {
+        loop_wake_configure((0 != arg0), (arg1_given && (0 < arg1)) ? arg1 : loop_wake_tick_ms());
+      }
+      loop_wake_print(&local_log);
+      break;
+
+    case 'b':   // Binary event stream.
+      if (arg0_given) {
+        _evstream.enable(0 != arg0);
+        if (_evstream.enabled()) {
+          _msg_service_request.enableSchedule(true);
+        }
+      }
+      _evstream.printStream(&local_log);
+      break;
+
+    case 'H':   // Touch-to-notify latency.
+      _latency.printHistograms(&local_log);
+      break;
+    case 'h':
+      _latency.reset();
+      local_log.concat("Latency histograms cleared.\n");
+      break;
+
     case 'X':   // Power control
     case 'x':   // Power control
-      setPin(_PWR_PIN, 'X' == c);
-      local_log.concatf("Power %sabled.\n", (('X' == c) ? "En" : "Dis"));
+      if ('X' == c) {
+        ret = slot->acquireBus();
+        if (0 == ret) {
+          slot->power(true);
+          ret = slot->bootBoard();
+          if (0 == ret) {
+            local_log.concatf("Slot %u power Enabled.\n", slot->index());
+          }
+          else {
+            local_log.concatf("Slot %u powered, but the driver failed to start (%d).\n", slot->index(), ret);
+          }
+        }
+        else {
+          local_log.concatf("Another slot holds I2C%u.\n", slot->busId());
+        }
+      }
+      else {
+        ret = slot->releaseBus();
+        if (0 == ret) {
+          local_log.concatf("Slot %u power Disabled.\n", slot->index());
+        }
+        else {
+          local_log.concatf("Slot %u doesn't hold I2C%u.\n", slot->index(), slot->busId());
+        }
+      }
       break;
 
     /* SX8634 control options */
@@ -451,19 +1359,20 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
         if (arg1_given && (0 <= arg1) & (8 > arg1)) {
           pinval = arg1;
         }
-        ret = touch.setGPOValue(arg0, pinval);
+        ret = touch->setGPOValue(arg0, pinval);
         local_log.concatf("touch.setGPOValue(%u, %u) returns %d\n", arg0, pinval, ret);
       }
       else {
         local_log.concatf("Usage: %c <SX8634 pin>", c);
+        ret = -1;
       }
       break;
 
     case 'P':   // Set platform GPO pin
     case 'p':   // Clear platform GPO pin
       if (arg0_given && (0 <= arg0) & (8 > arg0)) {
-        uint8_t pfpin = pf_pins[arg0];
-        switch (touch.getGPIOMode(arg0)) {
+        uint8_t pfpin = slot->pf_pins[arg0];
+        switch (touch->getGPIOMode(arg0)) {
           case GPIOMode::INPUT:
           case GPIOMode::INPUT_PULLUP:
           case GPIOMode::INPUT_PULLDOWN:
@@ -474,35 +1383,41 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
           case GPIOMode::ANALOG_OUT:
           default:
             local_log.concatf("Platform pin %u is an input.\n", pfpin);
+            ret = -1;
             break;
         }
       }
       else {
         local_log.concatf("Usage: %c <SX8634 pin> <desired value>", c);
+        ret = -1;
       }
       break;
 
 
     case 't':   // Touch
+      if ((1 <= arg0) && (3 >= arg0) && _governor.running()) {
+        _governor.stop(millis());
+        local_log.concat("Mode governor stopped.\n");
+      }
       switch (arg0) {
         case 1:
-          ret = touch.setMode(SX8634OpMode::ACTIVE);
+          ret = touch->setMode(SX8634OpMode::ACTIVE);
           local_log.concat("touch.setMode(ACTIVE)");
           break;
         case 2:
-          ret = touch.setMode(SX8634OpMode::DOZE);
+          ret = touch->setMode(SX8634OpMode::DOZE);
           local_log.concat("touch.setMode(DOZE)");
           break;
         case 3:
-          ret = touch.setMode(SX8634OpMode::SLEEP);
+          ret = touch->setMode(SX8634OpMode::SLEEP);
           local_log.concat("touch.setMode(SLEEP)");
           break;
         case 4:
-          ret = touch.ping();
+          ret = touch->ping();
           local_log.concat("touch.ping()");
           break;
         default:
-          touch.printDebug(&local_log);
+          touch->printDebug(&local_log);
           break;
       }
       if (0 != ret) {
@@ -513,20 +1428,247 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
       }
       break;
 
+    case 'v':   // Mode governor.
+      if (!arg0_given) {
+        _governor.printStats(&local_log, millis());
+      }
+      else if ((0 <= arg0) && (0xFFFF >= arg0) && (0 <= arg1) && (0 <= arg2)) {
+        ret = _governor.start(slot, (uint16_t) arg0, (uint32_t) arg1, (uint32_t) arg2, millis());
+        switch (ret) {
+          case 0:
+            local_log.concatf("Governing the mode of slot %u.\n", slot->index());
+            _msg_service_request.enableSchedule(true);
+            break;
+          case -2:
+            local_log.concat("Couldn't read the SPM, or set the mode.\n");
+            break;
+          default:
+            local_log.concat("The slot must be parked and powered, and not already governed.\n");
+            break;
+        }
+      }
+      else {
+        local_log.concatf("Usage: %c <latency budget ms> [DOZE after ms] [SLEEP after ms]\n", c);
+        ret = -1;
+      }
+      break;
+    case 'V':   // Stop the mode governor.
+      if (_governor.running()) {
+        _governor.stop(millis());
+        _governor.printStats(&local_log, millis());
+      }
+      break;
+
+    case 'q':   // Gestures.
+      for (uint8_t i = 0; i < _slot_count; i++) {
+        if (arg0_given && (0 == arg0)) {
+          _gestures[i].reset();
+        }
+        local_log.concatf("Slot %u ", i);
+        _gestures[i].printStats(&local_log);
+      }
+      break;
+
+    case 'a':   // CapSense diagnostics.
+      if (!arg0_given) {
+        _capmon.printStats(&local_log);
+      }
+      else if (0 < arg0) {
+        ret = _capmon.start(_selected, (uint16_t) arg0);
+        if (0 == ret) {
+          ret = touch->startMonitor(&_capmon);
+          if (0 != ret) {
+            _capmon.stop();
+          }
+        }
+        if (0 == ret) {
+          local_log.concatf("Monitoring CapSense on slot %u, %d sweeps per window.\n", _selected, arg0);
+          _msg_service_request.enableSchedule(true);
+        }
+        else {
+          local_log.concat("The monitor is already running.\n");
+        }
+      }
+      else if (_capmon.running() && !_tuner.running()) {
+        _slots[_capmon.slot()]->touch.stopMonitor();
+        _capmon.stop();
+        _capmon.printStats(&local_log);
+      }
+      break;
+    case 'A':   // CapSense monitor stream.
+      _capmon.streaming(1 == arg0);
+      if (!_capmon.streaming()) {
+        evstream_binary_mode(_evstream.enabled());
+      }
+      break;
+
+    case 'u':   // Tune sensitivity and thresholds.
+      if (!arg0_given) {
+        _tuner.printResults(&local_log);
+      }
+      else if ((4 > strlen(input->position(1))) || (15 < strlen(input->position(1)))) {
+        local_log.concat("blob name must be between 4 and 15 characters.\n");
+        ret = -1;
+      }
+      else {
+        const int lowest  = arg2_given ? arg2 : 0;
+        const int highest = (input->count() > 4) ? input->position_as_int(4) : (CAP_TUNER_LEVELS - 1);
+        ret = -1;
+        if ((0 <= arg1) && (0xFFFF >= arg1) && (0 <= lowest) && (lowest <= highest) && (CAP_TUNER_LEVELS > highest)) {
+          ret = _tuner.start(slot, &_capmon, input->position(1), (uint16_t) arg1, (uint8_t) lowest, (uint8_t) highest);
+        }
+        switch (ret) {
+          case 0:
+            local_log.concatf("Tuning slot %u, sensitivity %d through %d.\n", slot->index(), lowest, highest);
+            _msg_service_request.enableSchedule(true);
+            break;
+          case -2:
+            local_log.concat("No CAP channel is enabled in the SPM.\n");
+            break;
+          default:
+            local_log.concatf("Usage: %c <name> [margin x10] [lowest] [highest]\n", c);
+            local_log.concat("The slot must be parked and powered, and the CapSense monitor idle.\n");
+            break;
+        }
+      }
+      break;
+    case 'U':   // Abort tuning.
+      if (_tuner.running()) {
+        _tuner.stop();
+        local_log.concat("Tuning aborted.\n");
+      }
+      break;
+
+    case 'j':   // I2C trace capture.
+      if (!arg0_given) {
+        _trace.printSummary(&local_log);
+      }
+      else if (0 == arg0) {
+        if (_trace.recording()) {
+          _slots[_trace.slot()]->touch.traceTo(nullptr);
+          _trace.stop();
+        }
+        _trace.printSummary(&local_log);
+      }
+      else if (_trace.recording()) {
+        local_log.concat("Already tracing. Stop with \"j 0\" first.\n");
+        ret = -1;
+      }
+      else if (!slot->holdsBus()) {
+        local_log.concatf("Slot %u does not hold its bus. Power it up with 'X'.\n", slot->index());
+        ret = -1;
+      }
+      else {
+        ret = _trace.start(slot->index(), (1 == arg0) ? I2C_TRACE_DEFAULT_BYTES : (uint32_t) arg0);
+        if (0 == ret) {
+          touch->traceTo(&_trace);
+          local_log.concatf("Tracing I2C on slot %u.\n", slot->index());
+          if (!(arg1_given && (0 == arg1))) {
+            // From a reset, so that a replay starts where the driver does.
+            touch->reset();
+          }
+        }
+        else {
+          local_log.concatf("Couldn't start a trace of %d bytes (%d).\n", arg0, ret);
+        }
+      }
+      break;
+    case 'J':   // Dump or save the I2C trace.
+      if (_trace.recording()) {
+        local_log.concat("Stop the trace with \"j 0\" first.\n");
+        ret = -1;
+      }
+      else if (0 == _trace.records()) {
+        local_log.concat("The I2C trace is empty.\n");
+      }
+      else if (1 == arg0) {
+        ret = _trace.save(_storage());
+        local_log.concatf((0 == ret) ? "Saved the I2C trace as \"%s\".\n" : "Failed to save the I2C trace as \"%s\".\n", I2C_TRACE_STORAGE_KEY);
+      }
+      else {
+        _trace.printSummary(&local_log);
+        _flush_log();
+        _trace.printHex(&local_log);
+      }
+      break;
+
+    case 'Z':   // Benchmarks
+      runBenchmarks(&local_log, ((arg0_given && (0 < arg0)) ? (uint32_t) arg0 : BENCH_ITERATIONS), (arg1_given && (1 == arg1)));
+      break;
+
+    case 'Q':   // SPM cache.
+      if (!arg0_given) {
+        _spm_cache.printCache(&local_log);
+      }
+      else if (2 == arg0) {
+        ret = _spm_cache.clear();
+        local_log.concat((0 == ret) ? "SPM cache cleared.\n" : "Failed to clear the SPM cache.\n");
+      }
+      else if ((0 == arg0) || (1 == arg0)) {
+        for (uint8_t i = 0; i < _slot_count; i++) {
+          _slots[i]->spmCache((1 == arg0) ? &_spm_cache : nullptr);
+        }
+        local_log.concatf("SPM cache %sabled for all slots.\n", (1 == arg0) ? "en" : "dis");
+      }
+      else {
+        local_log.concatf("Usage: %c <0|1|2>\n", c);
+        ret = -1;
+      }
+      break;
+
+    case 'T':   // Boot timing characterization.
+      if (arg0_given && (0 < arg0)) {
+        ret = _bootprof.start(slot, arg0, (arg1_given && (1 == arg1)));
+        if (0 == ret) {
+          local_log.concatf("Profiling %d boots of slot %u.\n", arg0, slot->index());
+          _msg_service_request.alterSchedulePeriod(BOOT_PROF_SVC_MS);
+          _msg_service_request.enableSchedule(true);
+        }
+        else {
+          local_log.concat("The slot must be parked and powered, and not already profiling.\n");
+        }
+      }
+      else if (arg0_given && _bootprof.running()) {
+        _bootprof.stop();
+        _msg_service_request.alterSchedulePeriod(SX8634PROV_SVC_PERIOD_MS);
+        _bootprof.printResults(&local_log);
+      }
+      else {
+        _bootprof.printResults(&local_log);
+      }
+      break;
+
     case 'R':   // Reset the SX8634
-      ret = touch.reset();
+      ret = touch->reset();
       local_log.concat("touch.reset()");
       break;
 
     case 'B':   // Burn current config to NVM
-      ret = touch.burn_nvm();
-      local_log.concatf("burn_nvm() returns %d\n", ret);
+      if (1 == arg0) {
+        // Burn, power-cycle, and check that the SPM comes back the same.
+        ret = touch->copySPM(_verify_blob);
+        if (0 == ret) {
+          ret = slot->burnVerify(_verify_blob);
+        }
+        if (0 == ret) {
+          local_log.concatf("Burn-verifying slot %u (up to %u burns).\n", slot->index(), SX8634PROV_BURN_ATTEMPTS);
+          _verify_slot = _selected;
+          _msg_service_request.enableSchedule(true);
+        }
+        else {
+          local_log.concatf("Burn-verify failed to start (%d). Is a run underway?\n", ret);
+        }
+      }
+      else {
+        ret = touch->burn_nvm();
+        local_log.concatf("burn_nvm() returns %d\n", ret);
+      }
       break;
 
     /* Options involving platform GPIO */
     case 'G':   // Reconfigure all the platform GPIO pins.
     case 'g':   // Safety all the platform GPIO pins.
-      ret = ('G' == c) ? _platform_gpio_reconfigure() : _platform_gpio_make_safe();
+      ret = ('G' == c) ? _platform_gpio_reconfigure(slot) : _platform_gpio_make_safe(slot);
       local_log.concatf("Platform GPIO operation returns %d\n", ret);
       break;
 
@@ -537,14 +1679,17 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
         const char* name = input->position(1);
         uint8_t buf[128];
         memset(buf, 0, 128);
-        if (0 == touch.copy_spm_to_buffer(buf)) {
-          if (0 == _save_blob_by_name(name, buf)) {
+        ret = touch->copySPM(buf);
+        if (0 == ret) {
+          ret = _save_blob_by_name(name, buf);
+          if (0 == ret) {
             local_log.concatf("Saved SPM to blob \"%s\".\n", name);
           }
         }
       }
       else {
         local_log.concatf("Usage: %c <blob name>", c);
+        ret = -1;
       }
       break;
 
@@ -552,86 +1697,201 @@ void SX8634BitDiddler::consoleCmdProc(StringBuilder* input) {
       if (arg0_given) {
         const char* name = input->position(1);
         uint8_t buf[128];
-        if (0 == _load_blob_by_name(name, buf)) {
+        ret = _load_blob_by_name(name, buf);
+        if (0 == ret) {
           StringBuilder::printBuffer(&local_log, buf, 128, "");
           local_log.concat("\n\n");
         }
       }
       else {
         local_log.concatf("Usage: %c <blob name>", c);
+        ret = -1;
       }
       break;
 
     case 'D':  // Drop given SPM blob from local storage
       if (arg0_given) {
+        const char* name = input->position(1);
+        ret = _drop_blob_by_name(name);
+        if (0 == ret) {
+          local_log.concatf("Dropped SPM blob \"%s\".\n", name);
+        }
       }
       else {
         local_log.concatf("Usage: %c <blob name>", c);
+        ret = -1;
       }
       break;
 
-    case 'L':  // Load stored SPM blob to SPM
+    case 'L':  // Load stored SPM blob to SPM. Only changed pages, unless asked.
       if (arg0_given) {
         const char* name = input->position(1);
         uint8_t buf[128];
-        if (0 == _load_blob_by_name(name, buf)) {
-          if (0 == touch.load_spm_from_buffer(buf)) {
-            local_log.concatf("SPM loaded from stored blob \"%s\".", name);
+        ret = _load_blob_by_name(name, buf);
+        if (0 == ret) {
+          ret = touch->loadSPMDelta(buf, (arg1_given && (1 == arg1)));
+          if (0 < ret) {
+            local_log.concatf("Writing %d SPM pages from stored blob \"%s\".\n", ret, name);
+            _delta_slot = _selected;
+            _msg_service_request.enableSchedule(true);
+          }
+          else if (0 == ret) {
+            local_log.concatf("SPM already matches stored blob \"%s\".\n", name);
           }
+          else {
+            local_log.concatf("SPM delta write failed to start (%d).\n", ret);
+          }
+          ret = (0 < ret) ? 0 : ret;   // A page count is not a failure.
         }
       }
       else {
-        local_log.concatf("Usage: %c <blob name>", c);
+        local_log.concatf("Usage: %c <blob name> [1 to write every page]", c);
+        ret = -1;
       }
       break;
 
     case 'l':  // List stored SPM blobs
-      local_log.concatf("Existing SPM blobs:%s\n", PRINT_DIVIDER_1_STR);
-      for (uint8_t i = 0; i < _blob_index.count(); i++) {
-        local_log.concatf("\t %u: %s\n", i, _blob_index.position(i));
-      }
+      _blob_dir.printDirectory(&local_log);
       break;
 
     case 'c':  // Print an application config blob from the current SPM.
       {
         uint8_t buf[128];
         memset(buf, 0, 128);
-        if (0 == touch.copy_spm_to_buffer(buf)) {
-          if (0 == SX8634::render_stripped_spm(buf)) {
-            local_log.concatf("Application config blob:%s\n", PRINT_DIVIDER_1_STR);
-            StringBuilder::printBuffer(&local_log, buf, 97, "");
-            local_log.concat("\n\n");
+        ret = touch->copySPM(buf);
+        if (0 == ret) {
+          _print_app_config(buf);
+        }
+      }
+      break;
+
+    /* Scripts */
+    case 'K':  // List, print, or save scripts.
+      if (2 < input->count()) {
+        ret = _script_save(input);
+      }
+      else if (arg0_given) {
+        const char* text = _script.find(input->position(1));
+        if (nullptr != text) {
+          local_log.concatf("%s\n", text);
+        }
+        else {
+          local_log.concatf("There is no script \"%s\".\n", input->position(1));
+          ret = -1;
+        }
+      }
+      else {
+        _script.printScripts(&local_log);
+      }
+      break;
+
+    case 'k':  // Drop a script.
+      if (arg0_given) {
+        Storage* store = _storage();
+        ret = (nullptr != store) ? _script.drop(store, input->position(1)) : -3;
+        switch (ret) {
+          case 0:
+            local_log.concatf("Dropped script \"%s\".\n", input->position(1));
+            break;
+          case -1:
+            local_log.concatf("There is no script \"%s\".\n", input->position(1));
+            break;
+          default:
+            local_log.concat("Tried to write the script table and failed.\n");
+            break;
+        }
+      }
+      else {
+        local_log.concatf("Usage: %c <script name>", c);
+        ret = -1;
+      }
+      break;
+
+    case 'r':  // Run a script, or abort the one that is running.
+      if (arg0_given) {
+        for (uint8_t i = 0; i < _slot_count; i++) {
+          if (SlotState::PARKED != _slots[i]->state()) {
+            ret = -3;
           }
         }
+        if (0 == ret) {
+          ret = _script.start(input->position(1), millis());
+        }
+        switch (ret) {
+          case 0:
+            local_log.concatf("Running script \"%s\" on slot %u.\n", input->position(1), _selected);
+            _msg_service_request.enableSchedule(true);
+            break;
+          case -1:
+            _script.printStatus(&local_log);
+            break;
+          case -2:
+            local_log.concatf("There is no script \"%s\".\n", input->position(1));
+            break;
+          default:
+            local_log.concat("Scripts can't run during a production run.\n");
+            break;
+        }
+      }
+      else if (_script.running()) {
+        _script.stop(&local_log, millis());
+      }
+      else {
+        _script.printStatus(&local_log);
       }
       break;
 
+    case 'W':  // Waits are handled by the script runner.
+      local_log.concat("Waits only make sense in scripts.\n");
+      ret = -1;
+      break;
+
     default:
       break;
   }
-  flushLocalLog();
+  _flush_log();
+  return ret;
 }
 #endif  //MANUVR_CONSOLE_SUPPORT
 
 
 /*
 * buf is assumed to be 128-bytes long.
+* A blob that was saved before there was a directory has no record. If its key
+*   holds a whole blob, it is adopted into the directory as it stands.
 */
 int8_t SX8634BitDiddler::_load_blob_by_name(const char* name, uint8_t* buf) {
   int8_t ret = -3;
   int len = strlen(name);
   if ((3 < len) && (16 > len)) {
     ret++;
-    Storage* store = platform.fetchStorage("");
+    Storage* store = _storage();
     if (nullptr != store) {
       ret++;
-      int rlen = store->persistentRead(name, buf, 128, 0);
-
-      if (128 == rlen) {
-        ret++;
+      const BlobRecord* rec = _blob_dir.find(name);
+      if (nullptr == rec) {
+        if (128 != io_core_read(store, name, buf, 128, 0)) {
+          local_log.concatf("There is no SPM blob \"%s\".\n", name);
+        }
+        else if (0 != _blob_dir.put(store, name, buf, 128)) {
+          local_log.concatf("SPM blob \"%s\" has no directory record, and couldn't be given one.\n", name);
+        }
+        else {
+          local_log.concatf("SPM blob \"%s\" had no directory record. Adopted it.\n", name);
+          ret++;
+        }
       }
       else {
-        local_log.concatf("Trying to read SPM blob \"%s\" was the wrong size (%d).\n", name, rlen);
+        int rlen = io_core_read(store, name, buf, 128, 0);
+        if (128 != rlen) {
+          local_log.concatf("Trying to read SPM blob \"%s\" was the wrong size (%d).\n", name, rlen);
+        }
+        else if (rec->crc != BlobDirectory::crc8(buf, 128)) {
+          local_log.concatf("SPM blob \"%s\" fails its CRC.\n", name);
+        }
+        else {
+          ret++;
+        }
       }
     }
     else {
@@ -653,16 +1913,19 @@ int8_t SX8634BitDiddler::_save_blob_by_name(const char* name, uint8_t* buf) {
   int len = strlen(name);
   if ((3 < len) && (16 > len)) {
     ret++;
-    Storage* store = platform.fetchStorage("");
+    Storage* store = _storage();
     if (nullptr != store) {
       ret++;
-      int rwri = store->persistentWrite(name, buf, 128, 0);
+      int rwri = io_core_write(store, name, buf, 128, 0);
 
-      if (128 == rwri) {
-        ret++;
+      if (128 != rwri) {
+        local_log.concatf("Trying to write SPM blob \"%s\" was the wrong size (%d).\n", name, rwri);
+      }
+      else if (0 != _blob_dir.put(store, name, buf, 128)) {
+        local_log.concatf("SPM blob \"%s\" was written, but couldn't be added to the directory.\n", name);
       }
       else {
-        local_log.concatf("Trying to write SPM blob \"%s\" was the wrong size (%d).\n", name, rwri);
+        ret++;
       }
     }
     else {
@@ -677,56 +1940,51 @@ int8_t SX8634BitDiddler::_save_blob_by_name(const char* name, uint8_t* buf) {
 
 
 /*
-* buf is assumed to be 128-bytes long.
+* Prints the 97 application bytes of the given SPM image, as SX8634Opts takes
+*   them.
 */
-int8_t SX8634BitDiddler::_load_blob_directory() {
-  int8_t ret = -2;
-  Storage* store = platform.fetchStorage("");
-  if (nullptr != store) {
-    ret++;
-    uint8_t buf[1024];
-    memset(buf, 0, sizeof(buf));
-    int rlen = store->persistentRead("idx", buf, 128, 0);
-
-    if (0 < rlen) {
-      ret++;
-      _blob_index.clear();
-      _blob_index.concat(buf, rlen);
-      _blob_index.split("^!^");
-    }
-    else {
-      local_log.concat("Tried to read SPM blob index and failed.\n");
-    }
-  }
-  else {
-    local_log.concat("No storage available.\n");
+void SX8634BitDiddler::_print_app_config(const uint8_t* spm) {
+  uint8_t app[SX8634_CONF_APP_BYTES];
+  for (uint8_t i = 0; i < SX8634_CONF_APP_BYTES; i++) {
+    app[i] = spm[SX8634_CONF_APP_ADDRS.addr[i]];
   }
-  return ret;
+  local_log.concatf("Application config blob (CRC 0x%02x):%s\n", BlobDirectory::crc8(app, SX8634_CONF_APP_BYTES), PRINT_DIVIDER_1_STR);
+  StringBuilder::printBuffer(&local_log, app, SX8634_CONF_APP_BYTES, "");
+  local_log.concat("\n\n");
 }
 
 
-/*
-* buf is assumed to be 128-bytes long.
-*/
-int8_t SX8634BitDiddler::_save_blob_directory() {
+int8_t SX8634BitDiddler::_drop_blob_by_name(const char* name) {
   int8_t ret = -2;
-  Storage* store = platform.fetchStorage("");
+  Storage* store = _storage();
   if (nullptr != store) {
     ret++;
-    uint8_t buf[1024];
-    memset(buf, 0, sizeof(buf));
-    if (0 < _blob_index.count()) {
-      _blob_index.implode("^!^");
-    }
-    int wlen = _blob_index.length();
-    int rlen = store->persistentWrite("idx", buf, wlen, 0);
-    _blob_index.split("^!^");
-
-    if (rlen == wlen) {
-      ret++;
+    uint8_t nothing = 0;
+    int8_t dir_ret = _blob_dir.drop(store, name);
+    if (-1 == dir_ret) {
+      // Might be a blob from before the directory.
+      uint8_t buf[128];
+      if (128 == io_core_read(store, name, buf, 128, 0)) {
+        dir_ret = 0;
+      }
     }
-    else {
-      local_log.concat("Tried to write SPM blob index and failed.\n");
+    switch (dir_ret) {
+      case 0:
+        // Storage can't delete a key. Emptying it frees the space, and keeps
+        //   the blob from being adopted back into the directory.
+        if (0 == io_core_write(store, name, &nothing, 0, 0)) {
+          ret++;
+        }
+        else {
+          local_log.concatf("Dropped SPM blob \"%s\", but couldn't erase it.\n", name);
+        }
+        break;
+      case -1:
+        local_log.concatf("There is no SPM blob \"%s\".\n", name);
+        break;
+      default:
+        local_log.concat("Tried to write SPM blob directory and failed.\n");
+        break;
     }
   }
   else {
@@ -9,12 +9,36 @@
 #include <stdint.h>
 #include <Platform/Platform.h>
 #include <Drivers/SX8634/SX8634.h>
+#include "ProvisionerSlot.h"
+#include "EdgeRing.h"
+#include "PWMMeter.h"
+#include "BlobDirectory.h"
+#include "LatencyProbe.h"
+#include "EventStream.h"
+#include "ScriptRunner.h"
+#include "YieldLog.h"
+#include "BootProfiler.h"
+#include "SpmCache.h"
+#include "CapTuner.h"
+#include "ModeGovernor.h"
+#include "GestureEngine.h"
+#include "I2CTrace.h"
+#include "Bench.h"
 
 
 #define MANUVR_MSG_SX8634_BD_SVC_REQ  0x7C4F
 
-/* Class flags */
-#define SX8634PROV_FLAG_GPIO_SAFETY       0x01
+/* Gestures, as recognized by GestureEngine. */
+#define MANUVR_MSG_SX8634_LONG_PRESS  0x7C50   // Button, held (ms)
+#define MANUVR_MSG_SX8634_DOUBLE_TAP  0x7C51   // Button, press to press (ms)
+#define MANUVR_MSG_SX8634_CHORD       0x7C52   // Mask of the buttons held
+#define MANUVR_MSG_SX8634_SWIPE       0x7C53   // Travel, velocity (units/s)
+
+#define SX8634PROV_SVC_PERIOD_MS          10   // How often running slots are polled.
+#define SX8634PROV_EDGE_BATCH             16   // Edges taken from the ring at a time.
+#define SX8634PROV_CAPTURE_DEPTH         512   // Default length of an edge capture.
+#define SX8634PROV_PWM_WINDOW_MS        2000   // Default PWM measurement window.
+#define SX8634PROV_BENCH_BLOB    "benchblob"   // Scratch blob for benchmarks.
 
 
 #if !defined(MANUVR_CONSOLE_SUPPORT)
@@ -39,12 +63,22 @@ class SX8634BitDiddler : public EventReceiver, public ConsoleInterface {
     SX8634BitDiddler(I2CAdapter*, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, const SX8634Opts*);
     ~SX8634BitDiddler();
 
+    int8_t addSlot(I2CAdapter*, uint8_t pwr_pin, const uint8_t* gpio_pins, const SX8634Opts*);
+
     /* Overrides from EventReceiver */
     int8_t notify(ManuvrMsg*);
     int8_t callback_proc(ManuvrMsg*);
     void printDebug(StringBuilder*);
 
     void printPins(StringBuilder*);
+    void printSlots(StringBuilder*);
+    void runBenchmarks(StringBuilder*, uint32_t calls, bool with_board);
+
+    inline uint8_t slotCount() {   return _slot_count;   };
+    inline ProvisionerSlot* slot(uint8_t i) {   return (i < _slot_count) ? _slots[i] : nullptr;   };
+
+    /* Storage in place of the platform's. For benchmarks. */
+    inline void useStorage(Storage* s) {   _store = s;   };
 
     /* Overrides from ConsoleInterface */
     uint consoleGetCmds(ConsoleCommand**);
@@ -57,21 +91,68 @@ class SX8634BitDiddler : public EventReceiver, public ConsoleInterface {
 
 
   private:
-    const uint8_t _PWR_PIN;
-    StringBuilder _blob_index;
-    SX8634 touch;
-    ManuvrMsg _msg_service_request;
+    uint8_t          _slot_count = 0;
+    uint8_t          _selected   = 0;     // The slot that console commands act upon.
+    ProvisionerSlot* _slots[SX8634PROV_MAX_SLOTS];
+    uint8_t          _run_blob[128];      // The SPM image for production runs.
+    BlobDirectory    _blob_dir;
+    ManuvrMsg        _msg_service_request;
+    GPIOEdge*        _capture      = nullptr;   // Edges kept for later analysis.
+    uint16_t         _capture_len  = 0;
+    uint16_t         _capture_max  = 0;         // Zero when not capturing.
+    uint32_t         _capture_lost = 0;         // Edges that didn't fit.
+    PWMMeter         _pwm;
+    uint8_t          _delta_slot   = SX8634PROV_MAX_SLOTS;   // Reports on its SPM delta write.
+    uint8_t          _verify_slot  = SX8634PROV_MAX_SLOTS;   // Reports on its burn-verify.
+    uint8_t          _verify_blob[128];   // The SPM image that it should read back.
+    LatencyProbe     _latency;
+    YieldLog         _yield;
+    BootProfiler     _bootprof;
+    SpmCache         _spm_cache;
+    CapMonitor       _capmon;
+    CapTuner         _tuner;
+    ModeGovernor     _governor;
+    GestureEngine    _gestures[SX8634PROV_MAX_SLOTS];   // One per chip, so boards don't mix.
+    I2CTrace         _trace;
+    EventStream      _evstream;
+    ScriptRunner     _script;
+    uint32_t         _script_ping_ms = 0;   // When a script's wait last pinged.
+
+    Storage*         _store = nullptr;
+
+    inline ProvisionerSlot* _slot() {   return _slots[_selected];  };
+    uint8_t _event_slot(ManuvrMsg*);
+    inline Storage* _storage() {   return (nullptr != _store) ? _store : platform.fetchStorage("");  };
+    void _flush_log();
+
+    /* Production runs */
+    int8_t _run_start(const char* blob_name, uint32_t swap_ms);
+    int8_t _run_stop();
+    int8_t _service_slots();
+
+    /* Scripts */
+    int8_t _script_service(uint32_t now);
+    int8_t _script_wait_check(uint32_t now);
+    int8_t _script_save(StringBuilder* input);
+    int8_t _console_exec(StringBuilder* input);
 
     /* GPIO and automated testing functions */
-    int8_t _platform_gpio_reconfigure();
-    int8_t _platform_gpio_make_safe();
-    inline void _gpio_safety(bool x) {  _er_set_flag(SX8634PROV_FLAG_GPIO_SAFETY, x);   };
-    inline bool _gpio_safety() {        return _er_flag(SX8634PROV_FLAG_GPIO_SAFETY);   };
+    int8_t _platform_gpio_reconfigure(ProvisionerSlot*);
+    int8_t _platform_gpio_make_safe(ProvisionerSlot*);
+    int8_t _drain_edges();
+    int8_t _capture_start(uint16_t depth);
+    int8_t _capture_stop();
+    void   _print_capture(StringBuilder*, bool list_edges);
+    int8_t _pwm_start(uint32_t window_ms);
+    void   _pwm_report();
+    LatencyStamps* _latency_record(uint8_t msg_type, uint64_t notify_us);
+    void   _raise_gestures();
+    bool   _gestures_pending();
 
     int8_t _load_blob_by_name(const char*, uint8_t*);
     int8_t _save_blob_by_name(const char*, uint8_t*);
-    int8_t _load_blob_directory();
-    int8_t _save_blob_directory();
+    int8_t _drop_blob_by_name(const char*);
+    void   _print_app_config(const uint8_t*);
 };
 
 
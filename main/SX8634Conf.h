@@ -0,0 +1,291 @@
+/*
+File:   SX8634Conf.h
+Author: J. Ian Lindsay
+Date:   2019.09.09
+
+A compile-time builder for SX8634 configuration blobs.
+
+Starting from the Quick Start Memory, fields are set by name, and the result is
+  a 97-byte application blob (the form that SX8634Opts takes) that is built
+  entirely by the compiler. Nothing here runs on the target.
+
+  constexpr SX8634Conf MY_CONF = SX8634Conf()
+    .gpioMode(0, SX8634_GPIO_MODE_GPP)
+    .gpioIntensity(0, 0xFF, 0x00);
+  static_assert(0 == MY_CONF.faults(), "Bad SX8634 config.");
+  constexpr SX8634ConfBlob MY_BLOB = MY_CONF.blob();
+
+Setters have no access to reserved bytes. The only way to name an SPM address
+  directly is reg(), which refuses reserved addresses. A setter that is handed
+  a value that its field can't hold (or a reserved encoding) records a fault
+  instead of writing, and the static_assert turns that into a build failure.
+
+The chip computes SpmCrc itself, with an algorithm that the datasheet doesn't
+  give. So the blob carries the jig's own CRC-8 (polynomial 0x07, as kept by
+  BlobDirectory) over its 97 bytes, to identify a config. It is not SpmCrc.
+
+This is written to C++11's rules for constexpr, which is what the toolchain
+  gives us.
+*/
+
+#ifndef __SX8634_CONF_H__
+#define __SX8634_CONF_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#define SX8634_CONF_APP_BYTES     97
+
+/* CAP pin modes */
+#define SX8634_CAP_MODE_DISABLED  0
+#define SX8634_CAP_MODE_BUTTON    1
+#define SX8634_CAP_MODE_SLIDER    2
+
+/* GPIO modes */
+#define SX8634_GPIO_MODE_GPO      0
+#define SX8634_GPIO_MODE_GPP      1
+#define SX8634_GPIO_MODE_GPI      2
+
+/* GPI pulls */
+#define SX8634_GPIO_PULL_NONE     0
+#define SX8634_GPIO_PULL_UP       1
+#define SX8634_GPIO_PULL_DOWN     2
+
+/* GPI edges that assert INTB */
+#define SX8634_GPIO_IRQ_NONE      0
+#define SX8634_GPIO_IRQ_RISING    1
+#define SX8634_GPIO_IRQ_FALLING   2
+#define SX8634_GPIO_IRQ_BOTH      3
+
+/* SPM addresses of the fields that are also read or edited outside the builder. */
+#define SX8634_SPM_ACTIVE_SCAN     0x05  // Scan period in ACTIVE, in 15ms units.
+#define SX8634_SPM_DOZE_SCAN       0x06  // ...and in DOZE.
+#define SX8634_SPM_CAP_MODE        0x0C  // Four CAP pins per byte, 0-3 here, counting down.
+#define SX8634_SPM_CAP_SENS        0x0D  // Two CAP pins per byte. Even pins in the high nibble.
+#define SX8634_SPM_CAP_THRESH      0x13  // One byte per CAP pin.
+#define SX8634_SPM_GPIO_AUTOLIGHT  0x43  // One bit per GPIO.
+#define SX8634_SPM_GPIO_POLARITY   0x44  // One bit per GPIO.
+#define SX8634_SPM_GPIO_INTENS_ON  0x45  // One byte per GPIO...
+#define SX8634_SPM_GPIO_INTENS_OFF 0x4D  // ...and another.
+#define SX8634_SPM_GPIO_INC_TIME   0x59  // Two GPIO per byte, pins 6-7 first. Odd pins in the high nibble.
+#define SX8634_SPM_GPIO_DEC_TIME   0x5D  // The same.
+
+/* Faults recorded by the builder. */
+#define SX8634_CONF_FAULT_RESERVED  0x0001  // reg() was given a reserved address.
+#define SX8634_CONF_FAULT_INDEX     0x0002  // No such CAP pin, GPIO, or map entry.
+#define SX8634_CONF_FAULT_RANGE     0x0004  // The field can't hold the value.
+
+
+/*
+* The Quick Start Memory. This is what the SPM holds after boot if the NVM has
+*   never been (validly) burned. Taken from tables 12 and 13 of the datasheet.
+*   The first four bytes are marked as "0xxx" there. We fill them with zero.
+*/
+constexpr uint8_t SX8634_CONF_QSM[128] = {
+  0x00, 0x00, 0x11, 0x00, 0x2B, 0x02, 0x0D, 0x00,   // 0x00
+  0x00, 0x01, 0xAA, 0xA5, 0x55, 0x00, 0x00, 0x00,   // 0x08
+  0x00, 0x00, 0x00, 0xA0, 0xA0, 0xA0, 0xA0, 0xA0,   // 0x10
+  0xA0, 0xA0, 0xA0, 0xA0, 0xA0, 0xA0, 0xA0, 0x00,   // 0x18
+  0x00, 0x30, 0x50, 0x50, 0x01, 0x0A, 0x00, 0x00,   // 0x20
+  0x00, 0x03, 0xFF, 0x01, 0x80, 0x50, 0x50, 0x01,   // 0x28
+  0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE,   // 0x30
+  0x54, 0x32, 0x10, 0x00, 0x00, 0x00, 0x00, 0x02,   // 0x38
+  0x00, 0x00, 0x00, 0xFF, 0x00, 0xFF, 0xFF, 0xFF,   // 0x40
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00,   // 0x48
+  0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00,   // 0x50
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x44, 0x44, 0x44,   // 0x58
+  0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // 0x60
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50,   // 0x68
+  0x46, 0x10, 0x45, 0x02, 0xFF, 0xFF, 0xFF, 0xD5,   // 0x70
+  0x55, 0x55, 0x7F, 0x23, 0x22, 0x41, 0xFF, 0x6F    // 0x78
+};
+
+/*
+* Bitmap of SPM addresses that hold application data. Everything else is
+*   reserved (or the CRC), and must be left at its QSM value. This is the same
+*   split that SX8634::render_stripped_spm() makes, and it yields 97 bytes.
+*/
+constexpr uint8_t SX8634_CONF_APP_MAP[16] = {
+  0xf0, 0xfe, 0xff, 0xff, 0xfe, 0xfb, 0xf9, 0xff,
+  0xff, 0xff, 0xdf, 0xff, 0xff, 0x03, 0x01, 0x00
+};
+
+constexpr bool sx8634_is_app_addr(uint8_t addr) {
+  return ((addr < 128) && (SX8634_CONF_APP_MAP[addr >> 3] & (1 << (addr & 0x07))));
+}
+
+/* The SPM address of the nth application byte. */
+constexpr uint8_t sx8634_app_addr(uint8_t n, uint8_t addr = 0) {
+  return (127 < addr) ? 0xFF :
+    (!sx8634_is_app_addr(addr) ? sx8634_app_addr(n, addr + 1) :
+      ((0 == n) ? addr : sx8634_app_addr(n - 1, addr + 1)));
+}
+
+constexpr uint8_t sx8634_crc8_bits(uint8_t crc, uint8_t n = 8) {
+  return (0 == n) ? crc :
+    sx8634_crc8_bits(((crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1)), n - 1);
+}
+
+/* CRC-8, polynomial 0x07. Agrees with BlobDirectory::crc8(). */
+constexpr uint8_t sx8634_crc8(const uint8_t* buf, uint16_t len, uint8_t crc = 0) {
+  return (0 == len) ? crc : sx8634_crc8(buf + 1, len - 1, sx8634_crc8_bits(crc ^ *buf));
+}
+
+
+/* Index packs, since C++11 doesn't have std::index_sequence. */
+template <uint8_t... I> struct SX8634ConfSeq {};
+template <uint8_t N, uint8_t... I> struct SX8634ConfGen : SX8634ConfGen<N - 1, N - 1, I...> {};
+template <uint8_t... I> struct SX8634ConfGen<0, I...> {   typedef SX8634ConfSeq<I...> type;   };
+
+
+/* The SPM addresses of the 97 application bytes, in blob order. */
+struct SX8634ConfAddrs {
+  uint8_t addr[SX8634_CONF_APP_BYTES];
+};
+
+template <uint8_t... I>
+constexpr SX8634ConfAddrs sx8634_conf_addrs(SX8634ConfSeq<I...>) {
+  return SX8634ConfAddrs{ { sx8634_app_addr(I)... } };
+}
+
+constexpr SX8634ConfAddrs SX8634_CONF_APP_ADDRS = sx8634_conf_addrs(SX8634ConfGen<SX8634_CONF_APP_BYTES>::type());
+
+
+/* A finished application blob. */
+struct SX8634ConfBlob {
+  uint8_t bytes[SX8634_CONF_APP_BYTES];
+
+  constexpr uint8_t crc() const {   return sx8634_crc8(bytes, SX8634_CONF_APP_BYTES);   };
+};
+
+
+class SX8634Conf {
+  public:
+    constexpr SX8634Conf() : SX8634Conf(SX8634_CONF_QSM, SX8634ConfGen<128>::type()) {};
+
+    constexpr uint16_t faults() const {          return _faults;         };
+    constexpr uint8_t  at(uint8_t addr) const {  return spm[addr & 0x7F];  };
+
+    /* The 97-byte blob that SX8634Opts takes. */
+    constexpr SX8634ConfBlob blob() const {
+      return _blob(SX8634ConfGen<SX8634_CONF_APP_BYTES>::type());
+    };
+
+    /* General */
+    constexpr SX8634Conf i2cAddress(uint8_t a) const {
+      return _set(0x04, 0x7F, a, ((0x08 > a) || (0x77 < a)) ? SX8634_CONF_FAULT_RANGE : 0);
+    };
+    constexpr SX8634Conf activeScanPeriod(uint8_t x15ms) const {
+      return _set(SX8634_SPM_ACTIVE_SCAN, 0xFF, x15ms, (0 == x15ms) ? SX8634_CONF_FAULT_RANGE : 0);
+    };
+    constexpr SX8634Conf dozeScanPeriod(uint8_t x15ms) const {
+      return _set(SX8634_SPM_DOZE_SCAN, 0xFF, x15ms, (0 == x15ms) ? SX8634_CONF_FAULT_RANGE : 0);
+    };
+    constexpr SX8634Conf passiveTimer(uint8_t seconds) const {
+      return _set(0x07, 0xFF, seconds);
+    };
+
+    /* Capacitive sensors */
+    constexpr SX8634Conf capMode(uint8_t cap, uint8_t mode) const {
+      return _field2(cap, 12, SX8634_SPM_CAP_MODE - (cap >> 2), mode, 2);
+    };
+    constexpr SX8634Conf capSensitivity(uint8_t cap, uint8_t s) const {
+      return _nibble(cap, 12, SX8634_SPM_CAP_SENS + (cap >> 1), !(cap & 1), s, 7);
+    };
+    constexpr SX8634Conf capThreshold(uint8_t cap, uint8_t t) const {
+      return _set(SX8634_SPM_CAP_THRESH + cap, 0xFF, t, _index_fault(cap, 12));
+    };
+    constexpr SX8634Conf proximity(bool on) const {
+      return _set(0x70, 0xFF, (on ? 0x74 : 0x46));
+    };
+
+    /* Mapping */
+    constexpr SX8634Conf mapAutoLight(uint8_t n, uint8_t v) const {
+      return _set(0x37 + n, 0xFF, v, _index_fault(n, 4));
+    };
+    constexpr SX8634Conf mapAutoLightGroup(uint8_t grp, uint16_t caps) const {
+      return _set(0x3B + (grp << 1), 0xFF, (uint8_t) (caps >> 8), _index_fault(grp, 2))
+            ._set(0x3C + (grp << 1), 0xFF, (uint8_t) caps, _index_fault(grp, 2));
+    };
+
+    /* GPIO */
+    constexpr SX8634Conf gpioMode(uint8_t pin, uint8_t mode) const {
+      return _field2(pin, 8, 0x41 - (pin >> 2), mode, 2);
+    };
+    constexpr SX8634Conf gpioPowerUp(uint8_t pin, bool on) const {     return _bit(0x42, pin, on);   };
+    constexpr SX8634Conf gpioAutoLight(uint8_t pin, bool on) const {   return _bit(SX8634_SPM_GPIO_AUTOLIGHT, pin, on);   };
+    constexpr SX8634Conf gpioPolarity(uint8_t pin, bool inv) const {   return _bit(SX8634_SPM_GPIO_POLARITY, pin, inv);  };
+    constexpr SX8634Conf gpioLogFade(uint8_t pin, bool log) const {    return _bit(0x56, pin, log);  };
+    constexpr SX8634Conf gpioIntensity(uint8_t pin, uint8_t on, uint8_t off) const {
+      return _set(SX8634_SPM_GPIO_INTENS_ON + pin, 0xFF, on, _index_fault(pin, 8))._set(SX8634_SPM_GPIO_INTENS_OFF + pin, 0xFF, off, _index_fault(pin, 8));
+    };
+    constexpr SX8634Conf gpioFadeFactors(uint8_t inc, uint8_t dec) const {
+      return _set(0x57, 0xFF, inc)._set(0x58, 0xFF, dec);
+    };
+    /* Fade times are in units of 64ms (full scale). Zero fades instantly. */
+    constexpr SX8634Conf gpioFade(uint8_t pin, uint8_t inc, uint8_t dec) const {
+      return _nibble(pin, 8, SX8634_SPM_GPIO_INC_TIME + (3 - (pin >> 1)), (pin & 1), inc, 15)
+            ._nibble(pin, 8, SX8634_SPM_GPIO_DEC_TIME + (3 - (pin >> 1)), (pin & 1), dec, 15);
+    };
+    /* Off delays are in units of 200ms. */
+    constexpr SX8634Conf gpioOffDelay(uint8_t pin, uint8_t delay) const {
+      return _nibble(pin, 8, 0x61 + (3 - (pin >> 1)), (pin & 1), delay, 15);
+    };
+    constexpr SX8634Conf gpioPull(uint8_t pin, uint8_t pull) const {
+      return _field2(pin, 8, 0x66 - (pin >> 2), pull, 2);
+    };
+    constexpr SX8634Conf gpioInterrupt(uint8_t pin, uint8_t edge) const {
+      return _field2(pin, 8, 0x68 - (pin >> 2), edge, 3);
+    };
+    constexpr SX8634Conf gpioDebounce(uint8_t v) const {   return _set(0x69, 0xFF, v);   };
+
+    /* Any application byte, for fields without a setter. */
+    constexpr SX8634Conf reg(uint8_t addr, uint8_t v) const {
+      return _set(addr, 0xFF, v, sx8634_is_app_addr(addr) ? 0 : SX8634_CONF_FAULT_RESERVED);
+    };
+
+
+  private:
+    uint8_t  spm[128];
+    uint16_t _faults;
+
+    template <uint8_t... I>
+    constexpr SX8634Conf(const uint8_t* src, SX8634ConfSeq<I...>) : spm{ src[I]... }, _faults(0) {};
+
+    /* A copy of src, with the masked bits of one byte replaced. */
+    template <uint8_t... I>
+    constexpr SX8634Conf(const SX8634Conf& src, uint8_t addr, uint8_t mask, uint8_t val, uint16_t fault, SX8634ConfSeq<I...>) :
+      spm{ ((I == addr) ? (uint8_t) ((src.spm[I] & ~mask) | (val & mask)) : src.spm[I])... },
+      _faults(src._faults | fault) {};
+
+    template <uint8_t... I>
+    constexpr SX8634ConfBlob _blob(SX8634ConfSeq<I...>) const {
+      return SX8634ConfBlob{ { spm[SX8634_CONF_APP_ADDRS.addr[I]]... } };
+    };
+
+    /* A faulted write doesn't happen. */
+    constexpr SX8634Conf _set(uint8_t addr, uint8_t mask, uint8_t val, uint16_t fault = 0) const {
+      return SX8634Conf(*this, ((0 == fault) ? addr : 0xFF), mask, val, fault, SX8634ConfGen<128>::type());
+    };
+
+    static constexpr uint16_t _index_fault(uint8_t idx, uint8_t count) {
+      return (idx < count) ? 0 : SX8634_CONF_FAULT_INDEX;
+    };
+
+    constexpr SX8634Conf _bit(uint8_t addr, uint8_t pin, bool x) const {
+      return _set(addr, (1 << (pin & 7)), (x ? 0xFF : 0x00), _index_fault(pin, 8));
+    };
+
+    /* Four two-bit fields to a byte, highest index in the top bits. */
+    constexpr SX8634Conf _field2(uint8_t idx, uint8_t count, uint8_t addr, uint8_t v, uint8_t max) const {
+      return _set(addr, (0x03 << ((idx & 3) << 1)), (v << ((idx & 3) << 1)),
+        (_index_fault(idx, count) | ((v > max) ? SX8634_CONF_FAULT_RANGE : 0)));
+    };
+
+    constexpr SX8634Conf _nibble(uint8_t idx, uint8_t count, uint8_t addr, bool high, uint8_t v, uint8_t max) const {
+      return _set(addr, (high ? 0xF0 : 0x0F), (high ? (v << 4) : v),
+        (_index_fault(idx, count) | ((v > max) ? SX8634_CONF_FAULT_RANGE : 0)));
+    };
+};
+
+#endif  // __SX8634_CONF_H__
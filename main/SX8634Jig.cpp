@@ -0,0 +1,531 @@
+#include "SX8634Jig.h"
+#include "SX8634Conf.h"
+
+
+/*******************************************************************************
+*   ___ _              ___      _ _              _      _
+*  / __| |__ _ ______ | _ ) ___(_) |___ _ _ _ __| |__ _| |_ ___
+* | (__| / _` (_-<_-< | _ \/ _ \ | / -_) '_| '_ \ / _` |  _/ -_)
+*  \___|_\__,_/__/__/ |___/\___/_|_\___|_| | .__/_\__,_|\__\___|
+*                                          |_|
+* Constructors/destructors, class initialization functions and so-forth...
+*******************************************************************************/
+
+SX8634Jig::SX8634Jig(const SX8634Opts* opts) : SX8634(opts) {
+  memset(_spm_mirror, 0, sizeof(_spm_mirror));
+  memset(&_lat, 0, sizeof(_lat));
+  memset(_obs_at, 0, sizeof(_obs_at));
+}
+
+
+SX8634Jig::~SX8634Jig() {
+}
+
+
+bool SX8634Jig::isApplicationAddr(uint8_t addr) {
+  return sx8634_is_app_addr(addr);
+}
+
+
+/*
+* Compares two full (128-byte) SPM images, ignoring reserved bytes and the CRC.
+*
+* @return The number of application bytes that differ.
+*/
+int SX8634Jig::compareApplicationBytes(const uint8_t* a, const uint8_t* b) {
+  int ret = 0;
+  for (uint8_t i = 0; i < 128; i++) {
+    if (isApplicationAddr(i) && (a[i] != b[i])) {
+      ret++;
+    }
+  }
+  return ret;
+}
+
+
+/*
+* The CRC of a full SPM image's application bytes, in address order. This is
+*   the same CRC that an SX8634Conf blob reports, and that the 'c' command
+*   prints.
+*/
+uint8_t SX8634Jig::applicationCRC(const uint8_t* spm) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < SX8634_CONF_APP_BYTES; i++) {
+    crc = sx8634_crc8_bits(crc ^ spm[SX8634_CONF_APP_ADDRS.addr[i]]);
+  }
+  return crc;
+}
+
+
+void SX8634Jig::invalidateMirror() {
+  _pages_seen = 0;
+  _jig_set_flag(SX8634_JIG_FLAG_MIRROR_VALID, false);
+}
+
+
+/*
+* The driver's shadow doesn't see delta writes, but the mirror does. So the
+*   mirror is preferred whenever it is whole.
+*/
+int8_t SX8634Jig::copySPM(uint8_t* buf) {
+  if (mirrorValid()) {
+    memcpy(buf, _spm_mirror, 128);
+    return 0;
+  }
+  return copy_spm_to_buffer(buf);
+}
+
+
+/*******************************************************************************
+* Delta SPM writes                                                             *
+*******************************************************************************/
+
+/*
+* Writes only the SPM pages whose application bytes differ from the given blob.
+*   Reserved bytes in those pages are written back as the chip already has them.
+*
+* @param blob      A full (128-byte) SPM image.
+* @param all_pages Write every page, changed or not. For comparison.
+* @return The number of pages to be written, or...
+*   -1 if a delta write (or the driver's own SPM access) is underway.
+*   -2 if there is nothing to diff against.
+*/
+int8_t SX8634Jig::loadSPMDelta(const uint8_t* blob, bool all_pages) {
+  if (deltaBusy() || _jig_flag(SX8634_JIG_FLAG_SPM_OPEN | SX8634_JIG_FLAG_CRC_BUSY)) {
+    return -1;
+  }
+  if (0 != copySPM(_delta_target)) {
+    return -2;
+  }
+  _delta_pending = 0;
+  _delta_bytes   = 0;
+  for (uint8_t i = 0; i < 128; i++) {
+    if (isApplicationAddr(i) && (_delta_target[i] != blob[i])) {
+      _delta_target[i] = blob[i];
+      _delta_pending |= (1 << (i >> 3));
+      _delta_bytes++;
+    }
+  }
+  if (all_pages) {
+    _delta_pending = 0xFFFF;
+  }
+  _delta_pages = 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    if (_delta_pending & (1 << i)) _delta_pages++;
+  }
+  _delta_xfers = 0;
+  _delta_wire  = 0;
+  _delta_waits = 0;
+  _delta_start = millis();
+  _jig_set_flag(SX8634_JIG_FLAG_DELTA_ERROR, false);
+  _jig_set_flag(SX8634_JIG_FLAG_DELTA_BUSY, true);
+  _delta_next();
+  return (int8_t) _delta_pages;
+}
+
+
+/*
+* Moves things along if the chip isn't going to tell us that it applied a page,
+*   or if our own transfers went missing.
+*/
+void SX8634Jig::pollDelta(uint32_t now) {
+  if (!deltaBusy()) return;
+  const uint32_t elapsed = now - _delta_page_ms;
+  if (_jig_flag(SX8634_JIG_FLAG_DELTA_WAIT)) {
+    if (elapsed >= SX8634_JIG_DELTA_PAGE_MS) {
+      _delta_waits++;
+      _delta_next();
+    }
+  }
+  else if (elapsed >= SX8634_JIG_DELTA_STALL_MS) {
+    _delta_finish(true);
+  }
+}
+
+
+/*
+* Queues the datasheet's write sequence for the lowest pending page: open the
+*   gateway for writing at the page's base address, write the page, and close
+*   the gateway.
+*/
+void SX8634Jig::_delta_next() {
+  _jig_set_flag(SX8634_JIG_FLAG_DELTA_WAIT, false);
+  if (0 == _delta_pending) {
+    _delta_finish(false);
+    return;
+  }
+  uint8_t page = 0;
+  while (0 == (_delta_pending & (1 << page))) page++;
+  _delta_pending &= ~(1 << page);
+
+  const uint8_t base = page << 3;
+  _delta_open[0]  = 0x10;
+  _delta_open[1]  = base;
+  _delta_close[0] = 0x00;
+  memcpy(_delta_page, &_delta_target[base], 8);
+  _delta_page_ms  = millis();
+  writeX(SX8634_JIG_REG_SPM_CFG, 2, _delta_open);
+  writeX(0x00, 8, _delta_page);
+  writeX(SX8634_JIG_REG_SPM_CFG, 1, _delta_close);
+}
+
+
+void SX8634Jig::_delta_finish(bool failed) {
+  _delta_pending = 0;
+  _delta_ms = millis() - _delta_start;
+  _jig_set_flag(SX8634_JIG_FLAG_DELTA_WAIT | SX8634_JIG_FLAG_DELTA_BUSY, false);
+  _jig_set_flag(SX8634_JIG_FLAG_DELTA_ERROR, failed);
+  if (!failed) {
+    _observe(SX8634_JIG_OBS_DELTA_DONE);
+  }
+}
+
+
+bool SX8634Jig::_is_delta_op(I2CBusOp* op) {
+  return ((op->buf == _delta_open) || (op->buf == _delta_page) || (op->buf == _delta_close));
+}
+
+
+/*
+* Reads only the SPM page that holds SpmCrc. That is enough to tell (with the
+*   help of a cache of whole SPM images) whether the rest needs to be read.
+*   The driver never sees these transfers. When the page arrives,
+*   SX8634_JIG_OBS_CRC_PAGE is observed, and crcPage() holds it.
+*
+* @return 0 on success, -1 if the gateway is busy.
+*/
+int8_t SX8634Jig::readCRCPage() {
+  if (deltaBusy() || _jig_flag(SX8634_JIG_FLAG_SPM_OPEN | SX8634_JIG_FLAG_CRC_BUSY)) {
+    return -1;
+  }
+  _crc_open[0]  = 0x18;   // Open, for reading.
+  _crc_open[1]  = SX8634_JIG_SPM_CRC_PAGE;
+  _crc_close[0] = 0x00;
+  memset(_crc_page, 0, sizeof(_crc_page));
+  _jig_set_flag(SX8634_JIG_FLAG_CRC_BUSY, true);
+  writeX(SX8634_JIG_REG_SPM_CFG, 2, _crc_open);
+  readX(0x00, 8, _crc_page);
+  writeX(SX8634_JIG_REG_SPM_CFG, 1, _crc_close);
+  return 0;
+}
+
+
+/*
+* Takes a whole SPM image from somewhere other than the chip (a cache), as if it
+*   had just been read. The driver's own copy is not updated.
+*/
+int8_t SX8634Jig::loadMirror(const uint8_t* spm) {
+  if (_jig_flag(SX8634_JIG_FLAG_SPM_OPEN)) {
+    return -1;
+  }
+  memcpy(_spm_mirror, spm, 128);
+  _pages_seen = 0xFFFF;
+  _jig_set_flag(SX8634_JIG_FLAG_MIRROR_VALID, true);
+  _observe(SX8634_JIG_OBS_SPM_READ);
+  return 0;
+}
+
+
+bool SX8634Jig::_is_crc_op(I2CBusOp* op) {
+  return ((op->buf == _crc_open) || (op->buf == _crc_page) || (op->buf == _crc_close));
+}
+
+
+/*******************************************************************************
+* CapSense diagnostics                                                         *
+*******************************************************************************/
+
+/*
+* Reads every channel's diagnostic registers in turn, until stopped. Samples go
+*   to the given monitor, which must already be started.
+*/
+int8_t SX8634Jig::startMonitor(CapMonitor* mon) {
+  if ((nullptr != _monitor) || (nullptr == mon)) return -1;
+  _monitor = mon;
+  if (!_jig_flag(SX8634_JIG_FLAG_MON_BUSY)) {
+    _mon_next();
+  }
+  return 0;
+}
+
+
+/*
+* A read that is in flight is let finish, and its result discarded.
+*/
+void SX8634Jig::stopMonitor() {
+  _monitor = nullptr;
+}
+
+
+/*
+* The chain of reads pauses while the SPM gateway is in use, or if the bus
+*   drops a transfer. This restarts it.
+*/
+void SX8634Jig::pollMonitor() {
+  if ((nullptr != _monitor) && !_jig_flag(SX8634_JIG_FLAG_MON_BUSY)) {
+    _mon_next();
+  }
+}
+
+
+int8_t SX8634Jig::_mon_next() {
+  if (deltaBusy() || _jig_flag(SX8634_JIG_FLAG_SPM_OPEN | SX8634_JIG_FLAG_CRC_BUSY)) {
+    return -1;
+  }
+  _mon_sel[0] = _monitor->nextChannel();
+  _jig_set_flag(SX8634_JIG_FLAG_MON_BUSY, true);
+  writeX(SX8634_JIG_REG_CAP_CHAN, 1, _mon_sel);
+  readX(SX8634_JIG_REG_CAP_USEFUL, 8, _mon_data);
+  return 0;
+}
+
+
+void SX8634Jig::printDelta(StringBuilder* output) {
+  output->concatf("SPM %s: %u bytes differed, %u pages written\n",
+    deltaBusy() ? "delta write underway" : (deltaFailed() ? "delta write FAILED" : "delta write"),
+    _delta_bytes, _delta_pages
+  );
+  output->concatf("\t%u transactions, %u bytes on the wire (all 16 pages is 48 and 272)\n", _delta_xfers, _delta_wire);
+  if (!deltaBusy()) {
+    output->concatf("\t%u ms", _delta_ms);
+    if (0 < _delta_waits) {
+      output->concatf(" (%u pages timed out waiting on INTB)", _delta_waits);
+    }
+    output->concat("\n");
+  }
+}
+
+
+/*******************************************************************************
+* Bus observation                                                              *
+*******************************************************************************/
+
+/*
+* The driver answers INTB by reading IrqSrc. That read starting is the first
+*   thing we can see of an IRQ being serviced.
+*/
+int8_t SX8634Jig::io_op_callahead(BusOp* _op) {
+  I2CBusOp* op = (I2CBusOp*) _op;
+  if ((BusOpcode::RX == op->get_opcode()) && (SX8634_JIG_REG_IRQ_SRC == op->sub_addr) && !_jig_flag(SX8634_JIG_FLAG_SPM_OPEN)) {
+    _lat.irq        = latency_irq_take();
+    _lat.read_start = edge_clock_us();
+    _lat.read_done  = 0;
+    _lat.raise      = 0;
+    _lat.recorded   = 0;
+    if (0 != _lat.irq) {
+      _observe(SX8634_JIG_OBS_INTB, _lat.irq);
+    }
+  }
+  return SX8634::io_op_callahead(_op);
+}
+
+
+/*
+* Every operation the driver queued comes back through here. We look at what
+*   crossed the wire, and then let the driver have it. Unless it was one of the
+*   delta writer's, which the driver didn't ask for.
+*/
+int8_t SX8634Jig::io_op_callback(BusOp* _op) {
+  I2CBusOp* op = (I2CBusOp*) _op;
+  if (nullptr != _trace) {
+    _trace->add(op, _trace_flags(op));
+  }
+  if (op->hasFault()) {
+    _nacks++;
+    _observe(SX8634_JIG_OBS_NACK);
+  }
+  else {
+    _acks++;
+    _observe(SX8634_JIG_OBS_ACK);
+    _last_ack_ms = millis();
+    if (0 <= op->sub_addr) {
+      const uint8_t reg = (uint8_t) op->sub_addr;
+      const bool spm_io = _jig_flag(SX8634_JIG_FLAG_SPM_OPEN) && (8 > reg);
+      switch (op->get_opcode()) {
+        case BusOpcode::TX:
+        case BusOpcode::TX_CMD:
+          if (spm_io) {
+            if (!_jig_flag(SX8634_JIG_FLAG_SPM_READ)) {
+              // The driver is writing a page. The mirror follows.
+              for (uint16_t i = 0; i < op->buf_len; i++) {
+                _spm_mirror[(_spm_base + reg + i) & 0x7F] = *(op->buf + i);
+              }
+            }
+          }
+          else {
+            for (uint16_t i = 0; i < op->buf_len; i++) {
+              _observe_write(reg + i, *(op->buf + i));
+            }
+          }
+          break;
+
+        case BusOpcode::RX:
+          if (spm_io) {
+            if (_jig_flag(SX8634_JIG_FLAG_SPM_READ) && !_is_crc_op(op)) {
+              for (uint16_t i = 0; i < op->buf_len; i++) {
+                _spm_mirror[(_spm_base + reg + i) & 0x7F] = *(op->buf + i);
+              }
+              _pages_seen |= (1 << (_spm_base >> 3));
+              if (0xFFFF == _pages_seen) {
+                _jig_set_flag(SX8634_JIG_FLAG_MIRROR_VALID, true);
+              }
+              if (0x78 == _spm_base) {
+                _observe(SX8634_JIG_OBS_SPM_READ);
+              }
+            }
+          }
+          else {
+            for (uint16_t i = 0; i < op->buf_len; i++) {
+              _observe_read(reg + i, *(op->buf + i));
+            }
+          }
+          break;
+
+        default:
+          break;
+      }
+    }
+  }
+
+  if ((op->buf == _mon_sel) || (op->buf == _mon_data)) {
+    if (op->hasFault() && (nullptr != _monitor)) {
+      _monitor->addFault();
+    }
+    if (op->buf == _mon_data) {
+      _jig_set_flag(SX8634_JIG_FLAG_MON_BUSY, false);
+      if (nullptr != _monitor) {
+        if (!op->hasFault()) {
+          _monitor->addSample(_mon_sel[0], _mon_data);
+        }
+        // The next channel goes to the back of the queue, behind anything
+        //   the driver has queued in the meantime.
+        _mon_next();
+      }
+    }
+    return BUSOP_CALLBACK_NOMINAL;
+  }
+  if (_is_crc_op(op)) {
+    if (op->hasFault() || (op->buf == _crc_close)) {
+      _jig_set_flag(SX8634_JIG_FLAG_CRC_BUSY, false);
+    }
+    else if (op->buf == _crc_page) {
+      _observe(SX8634_JIG_OBS_CRC_PAGE);
+    }
+    return BUSOP_CALLBACK_NOMINAL;
+  }
+  if (_is_delta_op(op)) {
+    _delta_xfers++;
+    _delta_wire += op->buf_len + 2;
+    if (op->hasFault()) {
+      _delta_finish(true);
+    }
+    else if (deltaBusy() && (op->buf == _delta_close)) {
+      _jig_set_flag(SX8634_JIG_FLAG_DELTA_WAIT, true);
+    }
+    return BUSOP_CALLBACK_NOMINAL;
+  }
+  if (BusOpcode::RX != op->get_opcode()) {
+    return SX8634::io_op_callback(_op);
+  }
+
+  // Any message the driver raises for this read is raised before it returns.
+  _lat.read_done = edge_clock_us();
+  const int8_t ret = SX8634::io_op_callback(_op);
+  _lat.raise = edge_clock_us();
+  return ret;
+}
+
+
+/*
+* A read of IrqSrc answers INTB if the callahead took an IRQ stamp for it.
+*/
+uint8_t SX8634Jig::_trace_flags(I2CBusOp* op) {
+  if ((op->buf == _mon_sel) || (op->buf == _mon_data) || _is_crc_op(op) || _is_delta_op(op)) {
+    return I2C_TRACE_FLAG_JIG;
+  }
+  if ((BusOpcode::RX == op->get_opcode()) && (SX8634_JIG_REG_IRQ_SRC == op->sub_addr)) {
+    if (!_jig_flag(SX8634_JIG_FLAG_SPM_OPEN) && (0 != _lat.irq) && (0 == _lat.read_done)) {
+      return I2C_TRACE_FLAG_IRQ;
+    }
+  }
+  return 0;
+}
+
+
+void SX8634Jig::_observe_write(uint8_t reg, uint8_t val) {
+  switch (reg) {
+    case SX8634_JIG_REG_SPM_CFG:
+      _jig_set_flag(SX8634_JIG_FLAG_SPM_OPEN, (0x10 == (val & 0x30)));
+      _jig_set_flag(SX8634_JIG_FLAG_SPM_READ, (0x08 == (val & 0x08)));
+      break;
+    case SX8634_JIG_REG_SPM_BASE:
+      _spm_base = val & 0x78;   // Also catches the burn key. That's harmless.
+      break;
+    default:
+      break;
+  }
+}
+
+
+/*
+* Sets an observation flag. The first time it is set after being cleared, the
+*   time is noted.
+*/
+void SX8634Jig::_observe(uint16_t f, uint64_t at) {
+  if (0 == (_obs & f)) {
+    _obs |= f;
+    for (uint8_t i = 0; i < SX8634_JIG_OBS_COUNT; i++) {
+      if (f & (1 << i)) {
+        _obs_at[i] = (0 != at) ? at : edge_clock_us();
+      }
+    }
+  }
+}
+
+
+/*
+* @return The edge-clock time (us) at which the given observation was made, or
+*   0 if it hasn't been.
+*/
+uint64_t SX8634Jig::observedAt(uint16_t f) {
+  for (uint8_t i = 0; i < SX8634_JIG_OBS_COUNT; i++) {
+    if (f & _obs & (1 << i)) {
+      return _obs_at[i];
+    }
+  }
+  return 0;
+}
+
+
+void SX8634Jig::_observe_read(uint8_t reg, uint8_t val) {
+  switch (reg) {
+    case SX8634_JIG_REG_IRQ_SRC:
+      if (0 != val) {
+        _observe(SX8634_JIG_OBS_IRQ);
+        if (val & SX8634_JIG_IRQ_SPM_WRITE) {
+          _observe(SX8634_JIG_OBS_SPM_WRITTEN);
+          if (_jig_flag(SX8634_JIG_FLAG_DELTA_WAIT)) {
+            _delta_next();   // The chip has the page. Send the next.
+          }
+        }
+        if (val & SX8634_JIG_IRQ_NVM_BURN)  _observe(SX8634_JIG_OBS_NVM_BURNED);
+      }
+      break;
+    case SX8634_JIG_REG_SPM_STAT:
+      _spm_stat = val;
+      _observe(SX8634_JIG_OBS_SPM_STAT);
+      break;
+    default:
+      break;
+  }
+}
+
+
+void SX8634Jig::printJig(StringBuilder* output) {
+  output->concatf("\tACK/NACK:      %u / %u\n", _acks, _nacks);
+  output->concatf("\tLast ACK:      %u ms\n", _last_ack_ms);
+  output->concatf("\tObservations:  0x%04x\n", _obs);
+  output->concatf("\tSPM gateway:   %s\n", _jig_flag(SX8634_JIG_FLAG_SPM_OPEN) ? (_jig_flag(SX8634_JIG_FLAG_SPM_READ) ? "read" : "write") : "closed");
+  output->concatf("\tSPM mirror:    %s (pages 0x%04x)\n", mirrorValid() ? "valid" : "incomplete", _pages_seen);
+  output->concatf("\tSpmStat:       0x%02x\n", _spm_stat);
+}
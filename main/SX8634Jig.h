@@ -0,0 +1,191 @@
+/*
+File:   SX8634Jig.h
+Author: J. Ian Lindsay
+Date:   2019.09.04
+
+The SX8634 driver, as seen from the provisioning jig.
+
+The driver does its work asynchronously through the I2C queue, and reports
+  most outcomes only by way of its own shadow registers. The jig needs to know
+  when things finish (a full SPM read, an SPM write, an NVM burn), so this class
+  watches every bus operation the driver completes and keeps track of what
+  crossed the wire. It does not alter the driver's behavior.
+
+It can also write the SPM by itself, one changed page at a time. The driver's
+  load_spm_from_buffer() rewrites all 16 pages, even when only a byte or two
+  differs from what the chip already holds. The delta writer diffs a blob
+  against the mirror (or the driver's shadow, if the mirror isn't complete), and
+  runs the datasheet's write sequence only for the pages that differ. The chip
+  must apply each page (and assert INTB) before the next can be written, so
+  pages are never merged into one transfer. But SpmCfg and SpmBaseAddr are
+  adjacent, so opening the gateway and setting the base is a single write.
+  Those operations are ours, and the driver never sees them. So its shadow goes
+  stale, and copySPM() should be used in place of copy_spm_to_buffer().
+*/
+
+#ifndef __SX8634_JIG_H__
+#define __SX8634_JIG_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include <Drivers/SX8634/SX8634.h>
+#include "LatencyProbe.h"
+#include "CapMonitor.h"
+#include "I2CTrace.h"
+
+/* I2C registers the jig cares about. */
+#define SX8634_JIG_REG_IRQ_SRC     0x00
+#define SX8634_JIG_REG_SPM_STAT    0x08
+#define SX8634_JIG_REG_SPM_CFG     0x0D
+#define SX8634_JIG_REG_SPM_BASE    0x0E
+#define SX8634_JIG_REG_CAP_CHAN    0x10    // CapSenseChanSelect
+#define SX8634_JIG_REG_CAP_USEFUL  0x11    // The first of 8 diagnostic bytes.
+
+/* IrqSrc bits. */
+#define SX8634_JIG_IRQ_COMPENSATION  0x02
+#define SX8634_JIG_IRQ_SPM_WRITE     0x20
+#define SX8634_JIG_IRQ_NVM_BURN      0x40
+
+/* Observation flags. These latch until clearObservations(). */
+#define SX8634_JIG_OBS_ACK           0x0001  // Some transfer was ACK'd.
+#define SX8634_JIG_OBS_NACK          0x0002  // Some transfer failed.
+#define SX8634_JIG_OBS_IRQ           0x0004  // IrqSrc was read non-zero.
+#define SX8634_JIG_OBS_SPM_READ      0x0008  // A read of the last SPM page finished.
+#define SX8634_JIG_OBS_SPM_WRITTEN   0x0010  // The chip flagged an SPM write.
+#define SX8634_JIG_OBS_NVM_BURNED    0x0020  // The chip flagged an NVM burn.
+#define SX8634_JIG_OBS_SPM_STAT      0x0040  // SpmStat was read.
+#define SX8634_JIG_OBS_DELTA_DONE    0x0080  // A delta write finished without error.
+#define SX8634_JIG_OBS_CRC_PAGE      0x0100  // Our read of the SPM page with SpmCrc finished.
+#define SX8634_JIG_OBS_INTB          0x0200  // An IrqSrc read had an INTB edge stamped ahead of it.
+#define SX8634_JIG_OBS_COUNT         10
+
+/* State flags. */
+#define SX8634_JIG_FLAG_SPM_OPEN     0x01    // The SPM gateway is open.
+#define SX8634_JIG_FLAG_SPM_READ     0x02    // ...for reading.
+#define SX8634_JIG_FLAG_MIRROR_VALID 0x04    // Every page of the mirror has been seen.
+#define SX8634_JIG_FLAG_DELTA_BUSY   0x08    // A delta write is underway.
+#define SX8634_JIG_FLAG_DELTA_WAIT   0x10    // ...and the chip is applying a page.
+#define SX8634_JIG_FLAG_DELTA_ERROR  0x20    // The last delta write failed.
+#define SX8634_JIG_FLAG_CRC_BUSY     0x40    // Reading the SPM page with SpmCrc.
+#define SX8634_JIG_FLAG_MON_BUSY     0x80    // A CapSense channel read is in flight.
+
+#define SX8634_JIG_SPM_CRC_PAGE      0x78    // The SPM page that ends with SpmCrc.
+
+/*
+* In Active and Doze, the chip asserts INTB when it has applied a page. In Sleep
+*   it doesn't, and the host is told to wait 30ms instead.
+*/
+#define SX8634_JIG_DELTA_PAGE_MS     40
+#define SX8634_JIG_DELTA_STALL_MS    250     // Our own transfers never came back.
+
+
+class SX8634Jig : public SX8634 {
+  public:
+    SX8634Jig(const SX8634Opts*);
+    ~SX8634Jig();
+
+    /* Overrides from BusOpCallback */
+    int8_t io_op_callahead(BusOp*);
+    int8_t io_op_callback(BusOp*);
+
+    inline bool observed(uint16_t f) {      return (_obs & f);   };
+    inline void clearObservations() {       _obs = 0;            };
+    inline void clearObservations(uint16_t f) {   _obs &= ~f;    };
+    uint64_t observedAt(uint16_t f);
+    inline uint8_t  spmStat() {             return _spm_stat;    };
+    inline uint32_t lastAck() {             return _last_ack_ms; };
+    inline bool     mirrorValid() {         return _jig_flag(SX8634_JIG_FLAG_MIRROR_VALID);  };
+    inline const uint8_t* spmMirror() {     return (const uint8_t*) _spm_mirror;  };
+    void invalidateMirror();
+    int8_t copySPM(uint8_t* buf);
+
+    /* Delta SPM writes */
+    int8_t loadSPMDelta(const uint8_t* blob, bool all_pages = false);
+    void   pollDelta(uint32_t now);
+    int8_t readCRCPage();
+    int8_t loadMirror(const uint8_t* spm);
+    inline const uint8_t* crcPage() {     return (const uint8_t*) _crc_page;  };
+
+    inline bool     deltaBusy() {         return _jig_flag(SX8634_JIG_FLAG_DELTA_BUSY);   };
+    inline bool     deltaFailed() {       return _jig_flag(SX8634_JIG_FLAG_DELTA_ERROR);  };
+    inline uint16_t deltaPages() {        return _delta_pages;   };
+    void printDelta(StringBuilder*);
+
+    /* CapSense diagnostics */
+    int8_t startMonitor(CapMonitor*);
+    void   stopMonitor();
+    void   pollMonitor();
+    inline bool monitoring() {   return (nullptr != _monitor);   };
+
+    /* Every transfer, as it completes. nullptr to stop. */
+    inline void traceTo(I2CTrace* t) {   _trace = t;   };
+    inline bool tracing() {     return (nullptr != _trace);   };
+
+    /* Stamps for the latest IRQ the driver serviced. */
+    inline LatencyStamps* latencyStamps() {   return &_lat;   };
+
+    void printJig(StringBuilder*);
+
+    static bool isApplicationAddr(uint8_t);
+    static int  compareApplicationBytes(const uint8_t*, const uint8_t*);
+    static uint8_t applicationCRC(const uint8_t*);
+
+
+  private:
+    uint16_t _obs         = 0;
+    uint64_t _obs_at[SX8634_JIG_OBS_COUNT];   // When each observation was made.
+    uint8_t  _jig_flags   = 0;
+    uint8_t  _spm_base    = 0;
+    uint8_t  _spm_stat    = 0;
+    uint16_t _pages_seen  = 0;   // Bitmask of SPM pages in the mirror.
+    uint32_t _last_ack_ms = 0;
+    uint32_t _acks        = 0;
+    uint32_t _nacks       = 0;
+    uint8_t  _spm_mirror[128];
+    LatencyStamps _lat;
+
+    /* Delta writer state and its record of the last run. */
+    uint16_t _delta_pending = 0;   // Bitmask of pages not yet written.
+    uint16_t _delta_pages   = 0;   // Pages written, or to be written.
+    uint16_t _delta_bytes   = 0;   // Application bytes that differed.
+    uint16_t _delta_xfers   = 0;   // I2C transactions.
+    uint16_t _delta_wire    = 0;   // Bytes on the wire, counting address and register.
+    uint16_t _delta_waits   = 0;   // Pages that ran out the clock instead of INTB.
+    uint32_t _delta_start   = 0;
+    uint32_t _delta_page_ms = 0;
+    uint32_t _delta_ms      = 0;
+    uint8_t  _delta_target[128];
+    uint8_t  _delta_open[2];       // SpmCfg and SpmBaseAddr.
+    uint8_t  _delta_page[8];
+    uint8_t  _delta_close[1];
+
+    /* Our own read of the last SPM page. */
+    uint8_t  _crc_open[2];
+    uint8_t  _crc_page[8];
+    uint8_t  _crc_close[1];
+
+    /* CapSense diagnostic reads, one channel at a time. */
+    CapMonitor* _monitor = nullptr;
+    uint8_t  _mon_sel[1];
+    uint8_t  _mon_data[8];
+
+    I2CTrace* _trace = nullptr;
+
+    void _observe_write(uint8_t reg, uint8_t val);
+    void _observe_read(uint8_t reg, uint8_t val);
+    void _observe(uint16_t f, uint64_t at = 0);
+    void _delta_next();
+    void _delta_finish(bool failed);
+    bool _is_delta_op(I2CBusOp*);
+    bool _is_crc_op(I2CBusOp*);
+    int8_t _mon_next();
+    uint8_t _trace_flags(I2CBusOp*);
+
+    inline bool _jig_flag(uint8_t f) {   return (_jig_flags & f);  };
+    inline void _jig_set_flag(uint8_t f, bool x) {
+      _jig_flags = (x) ? (_jig_flags | f) : (_jig_flags & ~f);
+    };
+};
+
+#endif  // __SX8634_JIG_H__
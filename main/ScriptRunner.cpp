@@ -0,0 +1,234 @@
+#include "ScriptRunner.h"
+#include "IoCore.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const WAIT_STR[] = {
+  "", "ping", "spm", "delta", "nvm", "irq", "ms"
+};
+
+
+ScriptRunner::ScriptRunner() {
+  memset(_table, 0, sizeof(_table));
+  _name[0] = 0;
+  _text[0] = 0;
+  _step[0] = 0;
+}
+
+
+const char* ScriptRunner::waitStr(ScriptWait w) {
+  return WAIT_STR[(uint8_t) w];
+}
+
+
+/*******************************************************************************
+* The stored scripts                                                           *
+*******************************************************************************/
+
+int8_t ScriptRunner::load(Storage* store) {
+  const int rlen = io_core_read(store, SCRIPT_STORAGE_KEY, (uint8_t*) _table, sizeof(_table), 0);
+  if ((int) sizeof(_table) != rlen) {
+    memset(_table, 0, sizeof(_table));
+    return -1;
+  }
+  for (uint8_t i = 0; i < SCRIPT_MAX_SCRIPTS; i++) {
+    _table[i].name[SCRIPT_NAME_LEN - 1] = 0;
+    _table[i].text[SCRIPT_TEXT_LEN - 1] = 0;
+  }
+  return 0;
+}
+
+
+/*
+* Saves a script, replacing any of the same name.
+*
+* @return 0 on success, -1 on a bad name or text, -2 if the table is full, or
+*   -3 if storage refused the write.
+*/
+int8_t ScriptRunner::put(Storage* store, const char* name, const char* text) {
+  const int name_len = strlen(name);
+  if ((0 == name_len) || (SCRIPT_NAME_LEN <= name_len) || (SCRIPT_TEXT_LEN <= strlen(text))) {
+    return -1;
+  }
+  int idx = _lookup(name);
+  if (0 > idx) {
+    idx = _lookup("");
+    if (0 > idx) return -2;
+  }
+  memset(&_table[idx], 0, sizeof(ScriptRecord));
+  strcpy(_table[idx].name, name);
+  strcpy(_table[idx].text, text);
+  return _write_table(store);
+}
+
+
+/*
+* @return 0 on success, -1 if there is no such script, or -3 if storage refused
+*   the write.
+*/
+int8_t ScriptRunner::drop(Storage* store, const char* name) {
+  const int idx = (0 < strlen(name)) ? _lookup(name) : -1;
+  if (0 > idx) return -1;
+  memset(&_table[idx], 0, sizeof(ScriptRecord));
+  return _write_table(store);
+}
+
+
+/* The table is only a couple of KB, so it is always written whole. */
+int8_t ScriptRunner::_write_table(Storage* store) {
+  const int wlen = io_core_write(store, SCRIPT_STORAGE_KEY, (uint8_t*) _table, sizeof(_table), 0);
+  return ((int) sizeof(_table) == wlen) ? 0 : -3;
+}
+
+
+const char* ScriptRunner::find(const char* name) {
+  const int idx = (0 < strlen(name)) ? _lookup(name) : -1;
+  return (0 > idx) ? nullptr : _table[idx].text;
+}
+
+
+/* Passing an empty name finds a free record. */
+int ScriptRunner::_lookup(const char* name) {
+  for (uint8_t i = 0; i < SCRIPT_MAX_SCRIPTS; i++) {
+    if (0 == strcmp(_table[i].name, name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+void ScriptRunner::printScripts(StringBuilder* output) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < SCRIPT_MAX_SCRIPTS; i++) {
+    if (0 != _table[i].name[0]) {
+      output->concatf("%-15s %s\n", _table[i].name, _table[i].text);
+      n++;
+    }
+  }
+  output->concatf("%u of %u scripts stored.\n", n, SCRIPT_MAX_SCRIPTS);
+}
+
+
+/*******************************************************************************
+* Running them                                                                 *
+*******************************************************************************/
+
+/*
+* The script is copied, so it can be changed or dropped while it runs.
+*/
+int8_t ScriptRunner::start(const char* name, uint32_t now) {
+  if (running()) return -1;
+  const char* text = find(name);
+  if (nullptr == text) return -2;
+  strcpy(_name, name);
+  strcpy(_text, text);
+  _pos          = 0;
+  _step_idx     = 0;
+  _step[0]      = 0;
+  _wait         = ScriptWait::NONE;
+  _script_start = now;
+  return 0;
+}
+
+
+void ScriptRunner::stop(StringBuilder* output, uint32_t now) {
+  if (running()) {
+    _finish(output, now, true);
+  }
+}
+
+
+/*
+* Moves to the next step. If there isn't one, the script is finished.
+*
+* @return true if there is a step to run.
+*/
+bool ScriptRunner::nextStep(StringBuilder* output, uint32_t now) {
+  if (!running()) return false;
+  _step[0] = 0;
+  while ((0 == _step[0]) && (0 != _text[_pos])) {
+    while ((' ' == _text[_pos]) || (';' == _text[_pos])) _pos++;
+    _step_may_fail = ('-' == _text[_pos]);
+    if (_step_may_fail) {
+      _pos++;
+      while (' ' == _text[_pos]) _pos++;
+    }
+    uint8_t len = 0;
+    while ((0 != _text[_pos]) && (';' != _text[_pos])) {
+      if ((SCRIPT_STEP_LEN - 1) > len) {
+        _step[len++] = _text[_pos];
+      }
+      _pos++;
+    }
+    while ((0 < len) && (' ' == _step[len - 1])) len--;
+    _step[len] = 0;
+  }
+  if (0 == _step[0]) {
+    _finish(output, now, false);
+    return false;
+  }
+  _step_idx++;
+  _step_start = now;
+  _parse_wait();
+  return true;
+}
+
+
+/*
+* Anything that starts with 'W' but isn't a wait we know is left as a command,
+*   which the console will refuse.
+*/
+void ScriptRunner::_parse_wait() {
+  _wait     = ScriptWait::NONE;
+  _wait_arg = 0;
+  if (('W' != _step[0]) || (' ' != _step[1])) return;
+  const char* kind = &_step[2];
+  while (' ' == *kind) kind++;
+  for (uint8_t i = (uint8_t) ScriptWait::PING; i <= (uint8_t) ScriptWait::DELAY; i++) {
+    const int len = strlen(WAIT_STR[i]);
+    if ((0 == strncmp(kind, WAIT_STR[i], len)) && ((' ' == kind[len]) || (0 == kind[len]))) {
+      _wait = (ScriptWait) i;
+      _wait_arg = strtoul(&kind[len], nullptr, 10);
+      if ((ScriptWait::DELAY != _wait) && (0 == _wait_arg)) {
+        _wait_arg = SCRIPT_WAIT_TIMEOUT_MS;
+      }
+      return;
+    }
+  }
+}
+
+
+/*
+* Reports on the step that just finished.
+*
+* @return true if the script should go on.
+*/
+bool ScriptRunner::stepDone(int8_t ret, StringBuilder* output, uint32_t now) {
+  output->concatf("  %2u: %-24s %4d  (%u ms)\n", _step_idx, _step, ret, now - _step_start);
+  _wait = ScriptWait::NONE;
+  if ((0 != ret) && !_step_may_fail) {
+    _finish(output, now, true);
+    return false;
+  }
+  return true;
+}
+
+
+void ScriptRunner::_finish(StringBuilder* output, uint32_t now, bool aborted) {
+  output->concatf("Script \"%s\" %s after %u steps (%u ms).\n",
+    _name, (aborted ? "ABORTED" : "finished"), _step_idx, now - _script_start
+  );
+  _name[0] = 0;
+  _wait = ScriptWait::NONE;
+}
+
+
+void ScriptRunner::printStatus(StringBuilder* output) {
+  if (running()) {
+    output->concatf("Script \"%s\" is on step %u: %s\n", _name, _step_idx, _step);
+  }
+  else {
+    output->concat("No script is running.\n");
+  }
+}
@@ -0,0 +1,111 @@
+/*
+File:   ScriptRunner.h
+Author: J. Ian Lindsay
+Date:   2019.09.13
+
+Named sequences of console commands, kept in platform storage and run back to
+  back without an operator.
+
+A script is a list of steps separated by ';'. A step is either a console
+  command, exactly as it would be typed, or a wait:
+
+  W ping [ms]    Until the board ACKs a transfer. Pings it while waiting.
+  W spm  [ms]    Until the driver has read the whole SPM.
+  W delta [ms]   Until an SPM delta write has finished. Fails if it failed.
+  W nvm  [ms]    Until the chip flags an NVM burn.
+  W irq  [ms]    Until the chip raises an IRQ.
+  W ms <ms>      A plain delay. For when nothing better is observable.
+
+  The optional argument is a timeout, and a wait that times out fails.
+
+Observations are cleared before each command, so a wait only sees what happened
+  after the command before it. The script is aborted by the first step that
+  fails (a command that returns non-zero, or a wait that times out), unless
+  that step is prefixed with '-'. Each step's result and wall time are reported
+  as it finishes.
+
+For example, to bring up a board and load a blob into it:
+  X; W spm; L myblob; W delta; i 3
+
+All scripts are held in one fixed table, stored under its own key. Saving or
+  dropping a script writes the whole table.
+*/
+
+#ifndef __SX8634_SCRIPT_RUNNER_H__
+#define __SX8634_SCRIPT_RUNNER_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define SCRIPT_STORAGE_KEY       "scripts"
+#define SCRIPT_MAX_SCRIPTS       8
+#define SCRIPT_NAME_LEN          16     // Including the terminator.
+#define SCRIPT_TEXT_LEN          240    // Including the terminator.
+#define SCRIPT_STEP_LEN          64     // Including the terminator.
+#define SCRIPT_WAIT_TIMEOUT_MS   2000   // For waits that don't give one.
+#define SCRIPT_PING_PERIOD_MS    50
+
+enum class ScriptWait : uint8_t {
+  NONE,    // The step is a command.
+  PING,
+  SPM,
+  DELTA,
+  NVM,
+  IRQ,
+  DELAY
+};
+
+typedef struct {
+  char name[SCRIPT_NAME_LEN];   // Empty if the record is free.
+  char text[SCRIPT_TEXT_LEN];
+} ScriptRecord;
+
+
+class ScriptRunner {
+  public:
+    ScriptRunner();
+
+    /* The stored scripts */
+    int8_t load(Storage*);
+    int8_t put(Storage*, const char* name, const char* text);
+    int8_t drop(Storage*, const char* name);
+    const char* find(const char* name);
+    void printScripts(StringBuilder*);
+
+    /* Running them */
+    int8_t start(const char* name, uint32_t now);
+    void   stop(StringBuilder*, uint32_t now);
+    bool   nextStep(StringBuilder*, uint32_t now);
+    bool   stepDone(int8_t ret, StringBuilder*, uint32_t now);
+    void   printStatus(StringBuilder*);
+
+    inline bool        running() {     return (0 != _name[0]);   };
+    inline const char* step() {        return _step;             };
+    inline ScriptWait  waitFor() {     return _wait;             };
+    inline uint32_t    waitArg() {     return _wait_arg;         };
+    inline uint32_t    stepStart() {   return _step_start;       };
+
+    static const char* waitStr(ScriptWait);
+
+
+  private:
+    ScriptRecord _table[SCRIPT_MAX_SCRIPTS];
+    char         _name[SCRIPT_NAME_LEN];  // The running script. Empty if none.
+    char         _text[SCRIPT_TEXT_LEN];  // ...and a copy of its steps.
+    char         _step[SCRIPT_STEP_LEN];
+    uint16_t     _pos          = 0;       // Where the next step starts in _text.
+    uint8_t      _step_idx     = 0;
+    bool         _step_may_fail = false;
+    ScriptWait   _wait         = ScriptWait::NONE;
+    uint32_t     _wait_arg     = 0;
+    uint32_t     _step_start   = 0;
+    uint32_t     _script_start = 0;
+
+    int    _lookup(const char* name);
+    void   _parse_wait();
+    void   _finish(StringBuilder*, uint32_t now, bool aborted);
+    int8_t _write_table(Storage*);
+};
+
+#endif  // __SX8634_SCRIPT_RUNNER_H__
@@ -0,0 +1,132 @@
+#include "SpmCache.h"
+#include "IoCore.h"
+#include "BlobDirectory.h"
+#include <string.h>
+
+#define SPM_CACHE_KEY_OFFSET  0x78   // The last page, which ends with SpmCrc.
+
+
+SpmCache::SpmCache() {
+  memset(_entries, 0, sizeof(_entries));
+}
+
+
+/*
+* Reads the whole table. Entries that fail their check are forgotten.
+*
+* @return 0 on success, or -1 if there is no cache in storage yet.
+*/
+int8_t SpmCache::load(Storage* store) {
+  _store = store;
+  _next  = 0;
+  const int rlen = io_core_read(store, SPM_CACHE_STORAGE_KEY, (uint8_t*) _entries, sizeof(_entries), 0);
+  if ((int) sizeof(_entries) != rlen) {
+    memset(_entries, 0, sizeof(_entries));
+    return -1;
+  }
+  for (uint8_t i = 0; i < SPM_CACHE_ENTRIES; i++) {
+    if (_entries[i].check != BlobDirectory::crc8(_entries[i].spm, 128)) {
+      _entries[i].flags = 0;
+    }
+  }
+  return 0;
+}
+
+
+/*
+* @param crc_page  The last 8 bytes of a board's SPM.
+* @return The cached image whose last page matches, or nullptr.
+*/
+const uint8_t* SpmCache::lookup(const uint8_t* crc_page) {
+  for (uint8_t i = 0; i < SPM_CACHE_ENTRIES; i++) {
+    SpmCacheEntry* e = &_entries[i];
+    if ((e->flags & SPM_CACHE_ENTRY_LIVE) && (0 == memcmp(&e->spm[SPM_CACHE_KEY_OFFSET], crc_page, 8))) {
+      return (const uint8_t*) e->spm;
+    }
+  }
+  return nullptr;
+}
+
+
+/*
+* Counts what the cache would have given for an image that was read in full,
+*   and then adds the image.
+*
+* @return As insert().
+*/
+int8_t SpmCache::record(const uint8_t* spm) {
+  const uint8_t* cached = lookup(&spm[SPM_CACHE_KEY_OFFSET]);
+  if (nullptr == cached) {
+    _misses++;
+  }
+  else if (0 == memcmp(cached, spm, 128)) {
+    _hits++;
+  }
+  else {
+    _false_hits++;
+  }
+  return insert(spm);
+}
+
+
+/*
+* Adds an image that was read in full. It replaces any entry with the same last
+*   page. Otherwise, it takes a free entry, and only evicts (round-robin) once
+*   there are none.
+*
+* @return 0 on success, -1 with no storage, or -2 if storage refused the write.
+*/
+int8_t SpmCache::insert(const uint8_t* spm) {
+  if (nullptr == _store) return -1;
+  uint8_t idx = SPM_CACHE_ENTRIES;
+  for (uint8_t i = 0; i < SPM_CACHE_ENTRIES; i++) {
+    if ((_entries[i].flags & SPM_CACHE_ENTRY_LIVE) && (0 == memcmp(&_entries[i].spm[SPM_CACHE_KEY_OFFSET], &spm[SPM_CACHE_KEY_OFFSET], 8))) {
+      if (0 == memcmp(_entries[i].spm, spm, 128)) {
+        return 0;   // Already have it.
+      }
+      idx = i;
+      break;
+    }
+  }
+  for (uint8_t i = 0; (SPM_CACHE_ENTRIES == idx) && (i < SPM_CACHE_ENTRIES); i++) {
+    if (0 == (_entries[i].flags & SPM_CACHE_ENTRY_LIVE)) {
+      idx = i;
+    }
+  }
+  if (SPM_CACHE_ENTRIES == idx) {
+    idx = _next;
+    _next = (_next + 1) % SPM_CACHE_ENTRIES;
+  }
+  memcpy(_entries[idx].spm, spm, 128);
+  _entries[idx].check = BlobDirectory::crc8(spm, 128);
+  _entries[idx].flags = SPM_CACHE_ENTRY_LIVE;
+  return _write_table();
+}
+
+
+int8_t SpmCache::clear() {
+  memset(_entries, 0, sizeof(_entries));
+  _next       = 0;
+  _hits       = 0;
+  _false_hits = 0;
+  _misses     = 0;
+  if (nullptr == _store) return -1;
+  return _write_table();
+}
+
+
+/* The table is only about 1 KB, so it is always written whole. */
+int8_t SpmCache::_write_table() {
+  const int wlen = io_core_write(_store, SPM_CACHE_STORAGE_KEY, (uint8_t*) _entries, sizeof(_entries), 0);
+  return ((int) sizeof(_entries) == wlen) ? 0 : -2;
+}
+
+
+void SpmCache::printCache(StringBuilder* output) {
+  output->concatf("SPM cache: %u hits, %u false hits, %u misses\n", _hits, _false_hits, _misses);
+  for (uint8_t i = 0; i < SPM_CACHE_ENTRIES; i++) {
+    if (_entries[i].flags & SPM_CACHE_ENTRY_LIVE) {
+      output->concatf("\t%u: SpmCrc 0x%02x, check 0x%02x\n", i, _entries[i].spm[0x7F], _entries[i].check);
+    }
+  }
+}
@@ -0,0 +1,73 @@
+/*
+File:   SpmCache.h
+Author: J. Ian Lindsay
+Date:   2019.09.16
+
+Whole SPM images that have been read from boards before, kept in platform
+  storage and keyed by the SpmCrc byte that the chip keeps at the end of its
+  SPM.
+
+Reading the whole SPM takes 16 trips through the gateway, and the chip doesn't
+  respond to touch while that is going on. Reading only the last page takes one
+  trip, and the last page (SpmCrc and seven bytes of config) would pick out an
+  image in the cache.
+
+But SpmCrc is only eight bits, and the datasheet doesn't give its algorithm. So
+  a hit can be wrong, and a delta write takes the reserved bytes of every page
+  it writes from the image it was diffed against. An image from the cache is
+  never burned into a board. Every board's SPM is still read in full, and each
+  full read is checked against the cache before it is added: a hit had the
+  same image, a false hit had the same last page and a different image. The
+  counts say whether the last page alone can be trusted on a given product.
+
+Each entry also carries a CRC of its own, so that one damaged in storage is
+  not used.
+*/
+
+#ifndef __SX8634_SPM_CACHE_H__
+#define __SX8634_SPM_CACHE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define SPM_CACHE_STORAGE_KEY   "spmcache"
+#define SPM_CACHE_ENTRIES       8
+
+/* Entry flags */
+#define SPM_CACHE_ENTRY_LIVE    0x01
+
+
+typedef struct {
+  uint8_t  spm[128];
+  uint8_t  check;          // CRC-8 of spm.
+  uint8_t  flags;
+  uint16_t reserved;
+} SpmCacheEntry;
+
+
+class SpmCache {
+  public:
+    SpmCache();
+
+    int8_t load(Storage*);
+    const uint8_t* lookup(const uint8_t* crc_page);
+    int8_t record(const uint8_t* spm);
+    int8_t insert(const uint8_t* spm);
+    int8_t clear();
+
+    void printCache(StringBuilder*);
+
+
+  private:
+    Storage*      _store      = nullptr;
+    uint8_t       _next       = 0;   // The entry that the next insert replaces.
+    uint32_t      _hits       = 0;
+    uint32_t      _false_hits = 0;
+    uint32_t      _misses     = 0;
+    SpmCacheEntry _entries[SPM_CACHE_ENTRIES];
+
+    int8_t _write_table();
+};
+
+#endif  // __SX8634_SPM_CACHE_H__
@@ -0,0 +1,101 @@
+/*
+File:   SpscQueue.h
+Author: J. Ian Lindsay
+Date:   2019.09.17
+
+A fixed-size ring for passing things from exactly one thread to exactly one
+  other, without locks. Neither side ever blocks, or touches the heap. Nothing
+  in the ring is ever overwritten before the consumer has released it.
+
+The producer may only call claim()/publish() and write(). The consumer may only
+  call peek()/release() and read(). count() and full() are safe from either
+  side, but are only a snapshot.
+
+Indices run freely, and are masked on use. So N must be a power of two.
+*/
+
+#ifndef __SX8634_SPSC_QUEUE_H__
+#define __SX8634_SPSC_QUEUE_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <atomic>
+
+template <class T, uint32_t N> class SpscQueue {
+  static_assert((0 < N) && (0 == (N & (N - 1))), "SpscQueue depth must be a power of two.");
+
+  public:
+    inline uint32_t depth() {   return N;   };
+    inline uint32_t count() {
+      return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire));
+    };
+    inline bool full() {    return (N <= count());   };
+    inline bool empty() {   return (0 == count());   };
+
+    /* Producer side */
+
+    /* The slot that the next publish() will hand over, or nullptr if full. */
+    inline T* claim() {
+      const uint32_t h = _head.load(std::memory_order_relaxed);
+      if (N <= (h - _tail.load(std::memory_order_acquire))) return nullptr;
+      return &_items[h & (N - 1)];
+    };
+    inline void publish() {
+      _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    };
+
+    /* Copies in as many of the given items as fit. Returns how many that was. */
+    uint32_t write(const T* src, uint32_t n) {
+      const uint32_t h    = _head.load(std::memory_order_relaxed);
+      const uint32_t room = N - (h - _tail.load(std::memory_order_acquire));
+      if (n > room) n = room;
+      for (uint32_t i = 0; i < n; i++) {
+        _items[(h + i) & (N - 1)] = src[i];
+      }
+      _head.store(h + n, std::memory_order_release);
+      return n;
+    };
+
+    /*
+    * Items the consumer hasn't released yet, oldest first, for the producer to
+    *   look over. The consumer may release them at any time, but can't change
+    *   them. Returns nullptr past the newest.
+    */
+    inline T* pending(uint32_t i) {
+      const uint32_t h = _head.load(std::memory_order_relaxed);
+      const uint32_t t = _tail.load(std::memory_order_acquire);
+      return (i < (h - t)) ? &_items[(t + i) & (N - 1)] : nullptr;
+    };
+
+    /* Consumer side */
+
+    /* The oldest item, or nullptr if empty. It stays valid until release(). */
+    inline T* peek() {
+      const uint32_t t = _tail.load(std::memory_order_relaxed);
+      if (t == _head.load(std::memory_order_acquire)) return nullptr;
+      return &_items[t & (N - 1)];
+    };
+    inline void release() {
+      _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    };
+
+    /* Copies out as many as max items. Returns how many that was. */
+    uint32_t read(T* dest, uint32_t max) {
+      const uint32_t t = _tail.load(std::memory_order_relaxed);
+      uint32_t n = _head.load(std::memory_order_acquire) - t;
+      if (n > max) n = max;
+      for (uint32_t i = 0; i < n; i++) {
+        dest[i] = _items[(t + i) & (N - 1)];
+      }
+      _tail.store(t + n, std::memory_order_release);
+      return n;
+    };
+
+
+  private:
+    std::atomic<uint32_t> _head{0};   // Only the producer stores this...
+    std::atomic<uint32_t> _tail{0};   // ...and only the consumer stores this.
+    T _items[N];
+};
+
+#endif  // __SX8634_SPSC_QUEUE_H__
@@ -0,0 +1,232 @@
+#include "YieldLog.h"
+#include "IoCore.h"
+#include <stdio.h>
+#include <string.h>
+
+YieldLog::YieldLog() {
+  memset(&_hdr, 0, sizeof(_hdr));
+  memset(_ring, 0, sizeof(_ring));
+  _reset_stats();
+}
+
+
+/* Key must have room for 16 bytes. */
+static void _record_key(char* key, uint16_t idx) {
+  snprintf(key, 16, YIELD_LOG_RECORD_KEY, idx);
+}
+
+
+void YieldLog::_reset_stats() {
+  _passed   = 0;
+  _failed   = 0;
+  _first_ts = 0;
+  _last_ts  = 0;
+  _busy_ms  = 0;
+  memset(_fail_counts, 0, sizeof(_fail_counts));
+  memset(_gpio_fails, 0, sizeof(_gpio_fails));
+  for (uint8_t i = 0; i < SX8634PROV_STAGES; i++) {
+    _stage_hist[i].reset();
+  }
+  _cycle_hist.reset();
+  _stale = false;
+}
+
+
+/*
+* Reads the header, and then every record in the ring. A record that can't be
+*   read is left zeroed, and is not counted in the report.
+*
+* @return 0 on success, -1 if there is no log yet, or -2 if the one in storage
+*   is unusable. In either failure case, a new log is started.
+*/
+int8_t YieldLog::load(Storage* store) {
+  YieldLogHeader hdr;
+  int rlen = io_core_read(store, YIELD_LOG_STORAGE_KEY, (uint8_t*) &hdr, sizeof(hdr), 0);
+  if ((int) sizeof(hdr) != rlen) {
+    clear(nullptr);
+    return -1;
+  }
+  if ((YIELD_LOG_MAGIC != hdr.magic) || (YIELD_LOG_VERSION != hdr.version) ||
+      (sizeof(YieldRecord) != hdr.record_size) || (YIELD_LOG_DEPTH <= hdr.head)) {
+    clear(nullptr);
+    return -2;
+  }
+  _hdr = hdr;
+  memset(_ring, 0, sizeof(_ring));
+  const uint16_t n = (YIELD_LOG_DEPTH < _hdr.total) ? YIELD_LOG_DEPTH : _hdr.total;
+  uint16_t idx = (YIELD_LOG_DEPTH + _hdr.head - n) % YIELD_LOG_DEPTH;
+  char key[16];
+  for (uint16_t i = 0; i < n; i++) {
+    _record_key(key, idx);
+    rlen = io_core_read(store, key, (uint8_t*) &_ring[idx], sizeof(YieldRecord), 0);
+    if ((int) sizeof(YieldRecord) != rlen) {
+      memset(&_ring[idx], 0, sizeof(YieldRecord));
+    }
+    idx = (idx + 1) % YIELD_LOG_DEPTH;
+  }
+  _rebuild_stats();
+  return 0;
+}
+
+
+/*
+* Logs the board that the slot just finished.
+*
+* @return 0 on success, or -1 if storage refused either write.
+*/
+int8_t YieldLog::add(Storage* store, ProvisionerSlot* slot, bool passed) {
+  YieldRecord* rec = &_ring[_hdr.head];
+  memset(rec, 0, sizeof(YieldRecord));
+  rec->timestamp   = epochTime();
+  rec->cycle_ms    = slot->lastCycleMs();
+  rec->slot        = slot->index();
+  rec->fail_stage  = passed ? 0 : slot->failStage();
+  rec->fail_detail = passed ? 0 : slot->failDetail();
+  rec->flags       = YIELD_LOG_REC_HELD | (passed ? YIELD_LOG_REC_PASSED : 0);
+  memcpy(rec->stage_ms, slot->stageMs(), sizeof(rec->stage_ms));
+
+  char key[16];
+  _record_key(key, _hdr.head);
+  const int wlen = io_core_write(store, key, (uint8_t*) rec, sizeof(YieldRecord), 0);
+  _hdr.head = (_hdr.head + 1) % YIELD_LOG_DEPTH;
+  _hdr.total++;
+  const int8_t ret = (((int) sizeof(YieldRecord) == wlen) && (0 == _write_header(store))) ? 0 : -1;
+
+  if (YIELD_LOG_DEPTH < _hdr.total) {
+    // The oldest record was overwritten. The histograms can't forget it, so
+    //   they will be rebuilt from the ring when they are next wanted.
+    _stale = true;
+  }
+  else if (!_stale) {
+    _tally(rec);
+  }
+  return ret;
+}
+
+
+/*
+* Forgets every board. With no storage, only the copy in memory is reset.
+*/
+int8_t YieldLog::clear(Storage* store) {
+  memset(&_hdr, 0, sizeof(_hdr));
+  _hdr.magic       = YIELD_LOG_MAGIC;
+  _hdr.version     = YIELD_LOG_VERSION;
+  _hdr.record_size = sizeof(YieldRecord);
+  memset(_ring, 0, sizeof(_ring));
+  _reset_stats();
+  return (nullptr == store) ? 0 : _write_header(store);
+}
+
+
+int8_t YieldLog::_write_header(Storage* store) {
+  const int wlen = io_core_write(store, YIELD_LOG_STORAGE_KEY, (uint8_t*) &_hdr, sizeof(_hdr), 0);
+  return ((int) sizeof(_hdr) == wlen) ? 0 : -1;
+}
+
+
+/*
+* Tallies the ring, oldest record first.
+*/
+void YieldLog::_rebuild_stats() {
+  _reset_stats();
+  const uint16_t n = (YIELD_LOG_DEPTH < _hdr.total) ? YIELD_LOG_DEPTH : _hdr.total;
+  uint16_t idx = (YIELD_LOG_DEPTH + _hdr.head - n) % YIELD_LOG_DEPTH;
+  for (uint16_t i = 0; i < n; i++) {
+    if (_ring[idx].flags & YIELD_LOG_REC_HELD) {
+      _tally(&_ring[idx]);
+    }
+    idx = (idx + 1) % YIELD_LOG_DEPTH;
+  }
+}
+
+
+/*
+* A stage counts for a board if it spent any time there. Every stage takes at
+*   least one service period.
+*/
+void YieldLog::_tally(const YieldRecord* rec) {
+  if (rec->flags & YIELD_LOG_REC_PASSED) {
+    _passed++;
+  }
+  else {
+    _failed++;
+    if (SX8634PROV_STAGES > rec->fail_stage) {
+      _fail_counts[rec->fail_stage]++;
+    }
+    if (((uint8_t) SlotState::GPIO_TEST == rec->fail_stage) && (8 > rec->fail_detail)) {
+      _gpio_fails[rec->fail_detail]++;
+    }
+  }
+  for (uint8_t i = 0; i < SX8634PROV_STAGES; i++) {
+    if (0 < rec->stage_ms[i]) {
+      _stage_hist[i].add(rec->stage_ms[i]);
+    }
+  }
+  _cycle_hist.add(rec->cycle_ms);
+  _busy_ms += rec->cycle_ms;
+  if ((0 == _first_ts) || (rec->timestamp < _first_ts)) _first_ts = rec->timestamp;
+  if (rec->timestamp > _last_ts) _last_ts = rec->timestamp;
+}
+
+
+void YieldLog::printReport(StringBuilder* output) {
+  if (_stale) {
+    _rebuild_stats();
+  }
+  const uint32_t boards = _passed + _failed;
+  output->concatf("Yield log: %u boards logged.", _hdr.total);
+  if (0 == boards) {
+    output->concat("\n");
+    return;
+  }
+  output->concatf(" Report on the last %u:\n", boards);
+  output->concatf("\tPassed/Failed:  %u / %u (%u%% yield)\n", _passed, _failed, (_passed * 100) / boards);
+  if (_last_ts > _first_ts) {
+    output->concatf("\tThroughput:     %u boards/hour\n", (uint32_t) (((uint64_t) boards * 3600) / (_last_ts - _first_ts)));
+  }
+  if (0 < _busy_ms) {
+    output->concatf("\tCycle time:     %u boards/hour per slot, not counting swaps\n", (uint32_t) (((uint64_t) boards * 3600000) / _busy_ms));
+  }
+
+  output->concat("\nStage (ms)      Count      p50      p90      p99      max\n");
+  for (uint8_t i = 0; i < SX8634PROV_STAGES; i++) {
+    LatencyHistogram* h = &_stage_hist[i];
+    if (0 == h->count()) continue;
+    output->concatf("%-12s %8u %8u %8u %8u %8u\n",
+      ProvisionerSlot::stateStr((SlotState) i), h->count(),
+      h->percentile(50), h->percentile(90), h->percentile(99), h->max()
+    );
+  }
+  output->concatf("%-12s %8u %8u %8u %8u %8u\n", "Whole cycle",
+    _cycle_hist.count(), _cycle_hist.percentile(50), _cycle_hist.percentile(90),
+    _cycle_hist.percentile(99), _cycle_hist.max()
+  );
+
+  if (0 == _failed) return;
+  output->concat("\nFailures by stage:\n");
+  bool listed[SX8634PROV_STAGES];
+  memset(listed, 0, sizeof(listed));
+  uint32_t cumulative = 0;
+  for (uint8_t n = 0; n < SX8634PROV_STAGES; n++) {
+    uint8_t worst = SX8634PROV_STAGES;
+    for (uint8_t i = 0; i < SX8634PROV_STAGES; i++) {
+      if (!listed[i] && (0 < _fail_counts[i]) && ((SX8634PROV_STAGES == worst) || (_fail_counts[i] > _fail_counts[worst]))) {
+        worst = i;
+      }
+    }
+    if (SX8634PROV_STAGES == worst) break;
+    listed[worst] = true;
+    cumulative += _fail_counts[worst];
+    output->concatf("\t%-12s %6u  %3u%%  (%3u%% cumulative)",
+      ProvisionerSlot::stateStr((SlotState) worst), _fail_counts[worst],
+      (_fail_counts[worst] * 100) / _failed, (cumulative * 100) / _failed
+    );
+    if ((uint8_t) SlotState::GPIO_TEST == worst) {
+      output->concat("  Pins:");
+      for (uint8_t p = 0; p < 8; p++) {
+        if (0 < _gpio_fails[p]) output->concatf(" GPIO%u x%u", p, _gpio_fails[p]);
+      }
+    }
+    output->concat("\n");
+  }
+}
@@ -0,0 +1,95 @@
+/*
+File:   YieldLog.h
+Author: J. Ian Lindsay
+Date:   2019.09.14
+
+The record of every board that went through a production run, kept in platform
+  storage so that it survives the jig being power-cycled.
+
+Each board gets one fixed-size record: when it finished, which slot it was in,
+  how long it spent in each stage of its cycle, and the stage it failed in (if
+  it did). Records go into a ring, so the log holds the last YIELD_LOG_DEPTH
+  boards. Each position in the ring has its own key (see io_core_write()), so
+  adding a board writes that record and the header, and nothing else.
+
+The ring is also kept in memory, and the report is built from that copy, so it
+  covers the same window: yield, throughput, the spread of time in each stage,
+  and which stages the failures came from, in order of how often. Once the ring
+  has wrapped, the histograms can't forget the board that was overwritten. So
+  they are rebuilt from memory when the report is next asked for, rather than
+  after every board.
+*/
+
+#ifndef __SX8634_YIELD_LOG_H__
+#define __SX8634_YIELD_LOG_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "ProvisionerSlot.h"
+#include "LatencyProbe.h"
+
+#define YIELD_LOG_STORAGE_KEY  "yieldlog"
+#define YIELD_LOG_RECORD_KEY   "yieldlog.%u"  // Record keys. At most 12 characters.
+#define YIELD_LOG_MAGIC        0x4C595853   // "SXYL", little-endian.
+#define YIELD_LOG_VERSION      2            // 1 kept the records at offsets under the header's key.
+#define YIELD_LOG_DEPTH        256
+
+/* Record flags */
+#define YIELD_LOG_REC_PASSED   0x01
+#define YIELD_LOG_REC_HELD     0x02         // Set in every record that was written.
+
+
+typedef struct {
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  record_size;
+  uint16_t head;           // Where the next record goes.
+  uint32_t total;          // Records ever added.
+} YieldLogHeader;
+
+typedef struct {
+  uint32_t timestamp;      // Epoch seconds when the board finished.
+  uint32_t cycle_ms;
+  uint16_t stage_ms[SX8634PROV_STAGES];
+  uint8_t  slot;
+  uint8_t  fail_stage;     // SlotState. Meaningless if the board passed.
+  uint8_t  fail_detail;
+  uint8_t  flags;
+} YieldRecord;
+
+
+class YieldLog {
+  public:
+    YieldLog();
+
+    int8_t load(Storage*);
+    int8_t add(Storage*, ProvisionerSlot*, bool passed);
+    int8_t clear(Storage*);
+
+    inline uint32_t total() {   return _hdr.total;   };
+
+    void printReport(StringBuilder*);
+
+
+  private:
+    YieldLogHeader   _hdr;
+    YieldRecord      _ring[YIELD_LOG_DEPTH];
+    bool             _stale = false;  // The stats no longer match the ring.
+    uint32_t         _passed = 0;
+    uint32_t         _failed = 0;
+    uint32_t         _first_ts = 0;   // The oldest record in the ring...
+    uint32_t         _last_ts  = 0;   // ...and the newest.
+    uint64_t         _busy_ms  = 0;   // Sum of the cycle times in the ring.
+    uint16_t         _fail_counts[SX8634PROV_STAGES];
+    uint16_t         _gpio_fails[8];  // GPIO_TEST failures, by pin.
+    LatencyHistogram _stage_hist[SX8634PROV_STAGES];   // In ms, not us.
+    LatencyHistogram _cycle_hist;
+
+    void   _reset_stats();
+    void   _rebuild_stats();
+    void   _tally(const YieldRecord*);
+    int8_t _write_header(Storage*);
+};
+
+#endif  // __SX8634_YIELD_LOG_H__
@@ -35,7 +35,7 @@
 * Pins
 * -------------
 * IO33   SX8634 reset pin via level-shifter
-* IO35   SX8634 IRQ pin via level-shifter with 3.3v pullup
+* IO35   SX8634 IRQ pin via level-shifter with 3.3v pullup (wakes the main loop)
 * IO32   SCL
 * IO25   SDA
 *
@@ -48,6 +48,28 @@
 * IO19   SX8634 GPIO5 via level-shifter
 * IO22   SX8634 GPIO6 via level-shifter
 * IO21   SX8634 GPIO7 via level-shifter
+*
+* Additional slots (no GPIO harness). Both share the second I2C bus, and so
+*   take turns.
+* -------------
+* IO4    SDA (I2C1)
+* IO16   SCL (I2C1)
+* IO2    Slot 1 regulator enable (10k pull-down)
+* IO5    Slot 1 SX8634 reset     (10k pull-up)
+* IO34   Slot 1 SX8634 IRQ       (owned by the driver, no loop wake)
+* IO12   Slot 2 regulator enable (10k pull-down)
+* IO15   Slot 2 SX8634 reset     (10k pull-up)
+* IO36   Slot 2 SX8634 IRQ       (owned by the driver, no loop wake)
+*
+* Every other output-capable pin is taken, so these four are strapping pins.
+*   Each is given the function (and the external pull) that agrees with the
+*   level it must have at reset:
+*   IO12  Must be low, or the flash is run at 1.8v and the jig won't boot.
+*   IO2   Must be low (or floating) to enter the serial bootloader.
+*   IO5, IO15  Are high by default.
+*   So the regulator enables are pulled down, which also leaves the slots
+*   unpowered until the firmware asks. The resets are pulled up, as they are
+*   active-low. Don't put a pull-up on IO12 or IO2.
 */
 
 #include <math.h>
@@ -57,6 +79,11 @@
 #include <XenoSession/Console/ManuvrConsole.h>
 #include <Drivers/SX8634/SX8634.h>
 #include "SX8634BitDiddler.h"
+#include "LoopWake.h"
+#include "SX8634Conf.h"
+#include "LatencyProbe.h"
+#include "LogRing.h"
+#include "IoCore.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -99,41 +126,56 @@ const I2CAdapterOptions i2c_opts(
   400000
 );
 
+const I2CAdapterOptions i2c1_opts(
+  1,   // Device number
+  4,   // sda
+  16,  // scl
+  0,   // No pullups.
+  400000
+);
+
 /*
 * If we care to setup the SX8634 differently than it comes shipped, we need to
 *   provide a binary blob containing the parameters we want. Since this setup
 *   takes time, and has implications for circuit safety, this blob ought to be
 *   provisioned into the NVM once it is finalized for a given application.
-* Only non-reserved values should be placed in the blob (97 bytes). Specifying
-*   reserved bytes will have undefined (possibly disasterous) results. Nor
-*   should the CRC value be supplied.
+* Only non-reserved values should be placed in the blob (97 bytes). The blob is
+*   built by the compiler from named fields, starting at the QSM defaults. The
+*   builder can't touch reserved bytes, and a bad field fails the build. See
+*   SX8634Conf.h.
 * If the NVM has already been written with the desired data, or the existing
 *   configuration is the desired one, then this blob, and its reference in the
 *   SX8634Opts, can be omitted and class will accept the existing config.
 */
-const uint8_t sx8634_conf[97] = {
-  0x2b, 0x02, 0x0E, 0x05, 0x01, 0xaa, 0xa5, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0x00, 0x30,
-  0x50, 0x50, 0x01, 0x0a, 0x00, 0x00, 0x00, 0x03, 0x01, 0x80, 0x50, 0x50, 0x01, 0x02,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xcd, 0x30, 0x00, 0x00, 0x3f, 0x02,
-
-  0x56, 0xA0, // GPIO mode
-  0x00, // pwrup state
-  0x00, // autolight
-  0x00, // polarity
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // GPIO intensity ON
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // GPIO intensity OFF
-  0x00, // GPIO fxn
-  0x00, // Increment factor
-  0x00, // Decrement factor
-  0x00, 0x00, 0x00, 0x00, // Increment time
-  0x44, 0x40, 0x00, 0x00, // Decrement time
-  0x00, 0x00, 0x00, 0x00, // Off delay
-  0x00, 0x00, // Pull resistors
-  0x01, 0x70, // Interrupt
-  0x00, // Debounce
-  0x74
-};
+constexpr SX8634Conf SX8634_CONF = SX8634Conf()
+  .dozeScanPeriod(0x0E)                        // 210ms
+  .passiveTimer(5)                             // Seconds
+  .mapAutoLight(3, 0xCD)
+  .mapAutoLight(2, 0x00)
+  .mapAutoLight(1, 0x00)
+  .mapAutoLight(0, 0x00)
+  .mapAutoLightGroup(0, 0x3000)
+  .mapAutoLightGroup(1, 0x003F)
+  .gpioMode(7, SX8634_GPIO_MODE_GPP)           // GPIO 7-5 are LEDs.
+  .gpioMode(6, SX8634_GPIO_MODE_GPP)
+  .gpioMode(5, SX8634_GPIO_MODE_GPP)
+  .gpioMode(4, SX8634_GPIO_MODE_GPI)           // GPIO 4-2 are inputs.
+  .gpioMode(3, SX8634_GPIO_MODE_GPI)
+  .gpioMode(2, SX8634_GPIO_MODE_GPI)
+  .gpioAutoLight(7, false).gpioAutoLight(6, false).gpioAutoLight(5, false).gpioAutoLight(4, false)
+  .gpioAutoLight(3, false).gpioAutoLight(2, false).gpioAutoLight(1, false).gpioAutoLight(0, false)
+  .gpioFade(7, 0, 4)                           // The LEDs fade out.
+  .gpioFade(6, 0, 4)
+  .gpioFade(5, 0, 4)
+  .gpioFade(4, 0, 0).gpioFade(3, 0, 0).gpioFade(2, 0, 0).gpioFade(1, 0, 0).gpioFade(0, 0, 0)
+  .gpioInterrupt(4, SX8634_GPIO_IRQ_RISING)
+  .gpioInterrupt(3, SX8634_GPIO_IRQ_RISING)
+  .gpioInterrupt(2, SX8634_GPIO_IRQ_BOTH)
+  .proximity(true);
+
+static_assert(0 == SX8634_CONF.faults(), "sx8634_conf has a bad field.");
+constexpr SX8634ConfBlob SX8634_CONF_BLOB = SX8634_CONF.blob();
+const uint8_t (&sx8634_conf)[SX8634_CONF_APP_BYTES] = SX8634_CONF_BLOB.bytes;
 
 
 /*
@@ -148,6 +190,37 @@ const SX8634Opts sx8634_opts(
   nullptr // sx8634_conf
 );
 
+/* The extra slots have their own reset and IRQ lines. */
+const SX8634Opts sx8634_opts_slot1(SX8634_DEFAULT_I2C_ADDR,  5, 34, nullptr);
+const SX8634Opts sx8634_opts_slot2(SX8634_DEFAULT_I2C_ADDR, 15, 36, nullptr);
+
+
+#if !defined(CONFIG_SX8634_PROV_FALLBACK_TICK_MS)
+  #define CONFIG_SX8634_PROV_FALLBACK_TICK_MS  10
+#endif
+#if !defined(CONFIG_SX8634_PROV_IRQ_WAKE_PIN)
+  #define CONFIG_SX8634_PROV_IRQ_WAKE_PIN      35   // As Kconfig.projbuild has it.
+#endif
+#if !defined(CONFIG_SX8634_PROV_IO_CORE)
+  #define CONFIG_SX8634_PROV_IO_CORE           0
+#endif
+#define SX8634_PROV_KERNEL_CORE  (1 - CONFIG_SX8634_PROV_IO_CORE)
+#if defined(CONFIG_SX8634_PROV_EVENT_DRIVEN)
+  #define SX8634_PROV_EVENT_DRIVEN  true
+#else
+  #define SX8634_PROV_EVENT_DRIVEN  false
+#endif
+
+
+/*
+* The driver services the IRQ itself. This only gets the main loop moving, and
+*   stamps the IRQ for the latency histograms.
+*/
+void sx8634_irq_wake_isr() {
+  latency_irq_isr();
+  loop_wake_isr();
+}
+
 
 /*******************************************************************************
 * Main thread                                                                  *
@@ -157,24 +230,64 @@ void manuvr_task(void* pvParameter) {
   Kernel* kernel = platform.kernel();
   unsigned long ms_0 = millis();
   unsigned long ms_1 = ms_0;
-  bool odd_even = false;
 
-  I2CAdapter i2c(&i2c_opts);
+  loop_wake_init(SX8634_PROV_EVENT_DRIVEN, CONFIG_SX8634_PROV_FALLBACK_TICK_MS);
+  if (0 <= CONFIG_SX8634_PROV_IRQ_WAKE_PIN) {
+    gpioDefine(CONFIG_SX8634_PROV_IRQ_WAKE_PIN, GPIOMode::INPUT);
+    setPinFxn(CONFIG_SX8634_PROV_IRQ_WAKE_PIN, FALLING, sx8634_irq_wake_isr);
+  }
+
+  /*
+  * These live as long as the task, but are far too big for its stack (the
+  *   provisioner's tables alone are over 30KB). So they are static, and built
+  *   here, once, after the platform is up.
+  */
+  static I2CAdapter i2c(&i2c_opts);
   kernel->subscribe(&i2c);
+  static I2CAdapter i2c1(&i2c1_opts);
+  kernel->subscribe(&i2c1);
 
-  SX8634BitDiddler provisioner(&i2c, 23, 13, 14, 27, 26, 18, 19, 22, 21, &sx8634_opts);
+  static SX8634BitDiddler provisioner(&i2c, 23, 13, 14, 27, 26, 18, 19, 22, 21, &sx8634_opts);
+  provisioner.addSlot(&i2c1,  2, nullptr, &sx8634_opts_slot1);
+  provisioner.addSlot(&i2c1, 12, nullptr, &sx8634_opts_slot2);
   kernel->subscribe(&provisioner);
 
-  while (1) {
-    kernel->procIdleFlags();
-    ms_1 = millis();
-    kernel->advanceScheduler(ms_1 - ms_0);
-    ms_0 = ms_1;
-    odd_even = !odd_even;
-    if (0 == kernel->procIdleFlags()) {
-      vTaskDelay(10 / portTICK_PERIOD_MS);
+  #if defined(CONFIG_SX8634_PROV_DUAL_CORE)
+    /*
+    * The I/O task reads the console, writes its output and the log ring, and
+    *   does the storage writes. This task only services the touch boards, and
+    *   runs the command lines that it is handed.
+    */
+    char line_buf[IO_CORE_LINE_MAX];
+    io_core_start(CONFIG_SX8634_PROV_IO_CORE);
+    while (1) {
+      ms_1 = millis();
+      kernel->advanceScheduler(ms_1 - ms_0);
+      ms_0 = ms_1;
+      if (0 == kernel->procIdleFlags()) {
+        if (0 < io_core_take_line(line_buf, sizeof(line_buf))) {
+          StringBuilder line(line_buf);
+          line.split(" ");
+          provisioner.consoleCmdProc(&line);
+        }
+        else {
+          loop_wake_wait();
+        }
+      }
     }
-  }
+  #else
+    while (1) {
+      ms_1 = millis();
+      kernel->advanceScheduler(ms_1 - ms_0);
+      ms_0 = ms_1;
+      if (0 == kernel->procIdleFlags()) {
+        // Deferred log lines go out when there is nothing else to do.
+        if (0 == log_ring_drain(LOG_RING_DRAIN_BATCH)) {
+          loop_wake_wait();
+        }
+      }
+    }
+  #endif
 }
 
 
@@ -191,7 +304,11 @@ void app_main() {
   platform.platformPreInit();
   platform.bootstrap();
 
-  xTaskCreate(manuvr_task, "_manuvr", 32768, NULL, (tskIDLE_PRIORITY + 2), NULL);
+  #if defined(CONFIG_SX8634_PROV_DUAL_CORE)
+    xTaskCreatePinnedToCore(manuvr_task, "_manuvr", 32768, NULL, (tskIDLE_PRIORITY + 2), NULL, SX8634_PROV_KERNEL_CORE);
+  #else
+    xTaskCreate(manuvr_task, "_manuvr", 32768, NULL, (tskIDLE_PRIORITY + 2), NULL);
+  #endif
 }
 
 #ifdef __cplusplus
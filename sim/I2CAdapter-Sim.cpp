@@ -0,0 +1,73 @@
+/*
+File:   I2CAdapter-Sim.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+The platform half of I2CAdapter for the host build. Instead of talking to
+  /dev/i2c-N, every bus operation is completed synchronously against the
+  simulated fabric in SimI2C.cpp.
+*/
+
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+#include "SimI2C.h"
+
+
+int8_t I2CAdapter::bus_init() {
+  busOnline(true);
+  return 0;
+}
+
+
+int8_t I2CAdapter::bus_deinit() {
+  busOnline(false);
+  return 0;
+}
+
+
+void I2CAdapter::printHardwareState(StringBuilder* output) {
+  output->concatf("-- I2C%d (simulated)\n", adapterNumber());
+  sim_i2c_print(output);
+}
+
+
+int8_t I2CAdapter::generateStart() {
+  return busOnline() ? 0 : -1;
+}
+
+
+int8_t I2CAdapter::generateStop() {
+  return busOnline() ? 0 : -1;
+}
+
+
+XferFault I2CBusOp::begin() {
+  if (nullptr == device) {
+    abort(XferFault::DEV_NOT_FOUND);
+    return XferFault::DEV_NOT_FOUND;
+  }
+
+  if ((nullptr != callback) && (0 != callback->io_op_callahead(this))) {
+    abort(XferFault::IO_RECALL);
+    return XferFault::IO_RECALL;
+  }
+
+  set_state(XferState::ADDR);
+  advance_operation(0, 0);
+  return getFault();
+}
+
+
+/*
+* The simulated bus never leaves a transfer half-done. By the time this returns,
+*   the operation has either completed or been aborted with a NACK.
+*/
+int8_t I2CBusOp::advance_operation(uint32_t status_reg, uint8_t data_reg) {
+  set_state(XferState::IO_WAIT);
+  if (0 == sim_i2c_transfer(device->adapterNumber(), this)) {
+    markComplete();
+  }
+  else {
+    abort(XferFault::DEV_NOT_FOUND);
+  }
+  return 0;
+}
@@ -0,0 +1,552 @@
+/*
+File:   SX8634Sim.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+A software model of the SX8634. See SX8634Sim.h.
+*/
+
+#include "SX8634Sim.h"
+#include "SimPins.h"
+#include "SX8634Conf.h"
+#include "LatencyProbe.h"
+#include <string.h>
+
+/* GPIO modes, as encoded in SPM GpioMode7_4 and GpioMode3_0. */
+#define SX8634SIM_GPIO_MODE_GPO   0
+#define SX8634SIM_GPIO_MODE_GPP   1
+#define SX8634SIM_GPIO_MODE_GPI   2
+
+
+/*
+* The datasheet doesn't document the algorithm behind SpmCrc. The model uses a
+*   CRC-8 (poly 0x07) over the first 127 bytes so that the value tracks content
+*   the way the real one does. Do not compare it against a real part.
+*/
+uint8_t SX8634Sim::spm_crc(const uint8_t* spm) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < 127; i++) {
+    crc ^= spm[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+/*******************************************************************************
+*   ___ _              ___      _ _              _      _
+*  / __| |__ _ ______ | _ ) ___(_) |___ _ _ _ __| |__ _| |_ ___
+* | (__| / _` (_-<_-< | _ \/ _ \ | / -_) '_| '_ \ / _` |  _/ -_)
+*  \___|_\__,_/__/__/ |___/\___/_|_\___|_| | .__/_\__,_|\__\___|
+*                                          |_|
+* Constructors/destructors, class initialization functions and so-forth...
+*******************************************************************************/
+
+SX8634Sim::SX8634Sim(uint8_t addr, uint8_t pwr_pin, uint8_t reset_pin, uint8_t irq_pin, const uint8_t* gpio_pins)
+    : _ADDR(addr), _PWR_PIN(pwr_pin), _RESET_PIN(reset_pin), _IRQ_PIN(irq_pin) {
+  for (uint8_t i = 0; i < 8; i++) {
+    _gpio_pins[i]     = (nullptr != gpio_pins) ? gpio_pins[i] : 255;
+    _intensity[i]     = 0;
+    _gpp_intensity[i] = 0;
+    _fade_step_at[i]  = 0;
+  }
+  memset(_cap_diag, 0, sizeof(_cap_diag));
+  memcpy(_spm, SX8634_CONF_QSM, 128);
+  memcpy(_nvm, SX8634_CONF_QSM, 128);
+  _spm[0x04] = _ADDR;
+  _nvm[0x04] = _ADDR;
+}
+
+
+SX8634Sim::~SX8634Sim() {
+}
+
+
+/*******************************************************************************
+* Bus-facing functions                                                         *
+*******************************************************************************/
+
+int8_t SX8634Sim::i2cWrite(uint8_t addr, int16_t reg, const uint8_t* buf, uint16_t len) {
+  if (!ready() || (addr != (_spm[0x04] & 0x7F)) || (0 > reg)) {
+    return -1;
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    uint8_t r = (uint8_t) (reg + i);
+    if (_sim_flag(SX8634SIM_FLAG_SPM_MODE) && (8 > r)) {
+      if (0 == (_spm_cfg & 0x08)) {
+        _spm[(_spm_base + r) & 0x7F] = buf[i];
+        _sim_set_flag(SX8634SIM_FLAG_SPM_DIRTY, true);
+      }
+    }
+    else {
+      _write_reg(r, buf[i]);
+    }
+  }
+  return 0;
+}
+
+
+int8_t SX8634Sim::i2cRead(uint8_t addr, int16_t reg, uint8_t* buf, uint16_t len) {
+  if (!ready() || (addr != (_spm[0x04] & 0x7F))) {
+    return -1;
+  }
+  if (0 > reg) reg = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    uint8_t r = (uint8_t) (reg + i);
+    if (_sim_flag(SX8634SIM_FLAG_SPM_MODE) && (8 > r)) {
+      buf[i] = (_spm_cfg & 0x08) ? _spm[(_spm_base + r) & 0x7F] : 0;
+    }
+    else {
+      buf[i] = _read_reg(r);
+    }
+  }
+  return 0;
+}
+
+
+int8_t SX8634Sim::_write_reg(uint8_t reg, uint8_t val) {
+  switch (reg) {
+    case SX8634SIM_REG_COMP_OP_MODE:
+      if (val & 0x04) {
+        _sim_set_flag(SX8634SIM_FLAG_COMPENSATING, true);
+        _comp_at = _now_us + SX8634SIM_COMP_US;
+      }
+      if ((val & 0x03) != _op_mode) {
+        _op_mode   = (val & 0x03);
+        _next_scan = _now_us;
+        _raise_irq(SX8634SIM_IRQ_MODE);
+      }
+      break;
+    case SX8634SIM_REG_GPO_CTRL:
+      _gpo_ctrl = val;
+      break;
+    case SX8634SIM_REG_GPP_PIN_ID:
+      _gpp_pin_id = val & 0x07;
+      break;
+    case SX8634SIM_REG_GPP_INTENSITY:
+      _gpp_intensity[_gpp_pin_id] = val;
+      break;
+    case SX8634SIM_REG_SPM_CFG:
+      _spm_cfg = val;
+      if (0x10 == (val & 0x30)) {
+        _sim_set_flag(SX8634SIM_FLAG_SPM_MODE, true);
+      }
+      else if (_sim_flag(SX8634SIM_FLAG_SPM_MODE)) {
+        _sim_set_flag(SX8634SIM_FLAG_SPM_MODE, false);
+        if (_sim_flag(SX8634SIM_FLAG_SPM_DIRTY)) {
+          _sim_set_flag(SX8634SIM_FLAG_SPM_DIRTY, false);
+          if (2 != _op_mode) {
+            _spm[0x7F] = spm_crc(_spm);   // CRC is only updated in Active/Doze.
+          }
+          _raise_irq(SX8634SIM_IRQ_SPM_WRITE);
+        }
+      }
+      _key_state = 0;
+      break;
+    case SX8634SIM_REG_SPM_BASE:
+      if ((2 == _key_state) && (0xA5 == val)) {
+        _key_state = 3;
+      }
+      else if ((3 == _key_state) && (0x5A == val)) {
+        _key_state = 0;
+        _sim_set_flag(SX8634SIM_FLAG_BURNING, true);
+        _burn_at = _now_us + SX8634SIM_BURN_US;
+      }
+      else {
+        _key_state = 0;
+        _spm_base  = val & 0xF8;
+      }
+      break;
+    case SX8634SIM_REG_SPM_KEY_MSB:
+      _key_state = (0x62 == val) ? 1 : 0;
+      break;
+    case SX8634SIM_REG_SPM_KEY_LSB:
+      _key_state = ((1 == _key_state) && (0x9D == val)) ? 2 : 0;
+      break;
+    case SX8634SIM_REG_CAP_CHAN_SEL:
+      _cap_sel = val;
+      _latch_cap_diag();
+      break;
+    case SX8634SIM_REG_SOFT_RESET:
+      if ((0xDE == _soft_reset) && (0x00 == val)) {
+        _begin_boot();
+      }
+      _soft_reset = val;
+      break;
+    default:   // Read-only or reserved.
+      return -1;
+  }
+  return 0;
+}
+
+
+uint8_t SX8634Sim::_read_reg(uint8_t reg) {
+  uint8_t ret = 0;
+  switch (reg) {
+    case SX8634SIM_REG_IRQ_SRC:
+      ret = _irq_src;
+      _irq_src = 0;
+      _update_irq_line();
+      break;
+    case SX8634SIM_REG_CAP_STAT_MSB:
+      ret = ((_cap_stat >> 8) & 0x0F) | (_sim_flag(SX8634SIM_FLAG_SLIDER_TOUCH) ? 0x10 : 0);
+      break;
+    case SX8634SIM_REG_CAP_STAT_LSB:   ret = _cap_stat & 0xFF;             break;
+    case SX8634SIM_REG_SLIDER_MSB:     ret = (_slider_pos >> 8) & 0xFF;    break;
+    case SX8634SIM_REG_SLIDER_LSB:     ret = _slider_pos & 0xFF;           break;
+    case SX8634SIM_REG_GPI_STAT:       ret = _gpi_stat;                    break;
+    case SX8634SIM_REG_SPM_STAT:
+      ret = (_nvm_valid ? 0x08 : 0x00) | ((_nvm_burns > 4) ? 4 : _nvm_burns);
+      break;
+    case SX8634SIM_REG_COMP_OP_MODE:
+      ret = _op_mode | (_sim_flag(SX8634SIM_FLAG_COMPENSATING) ? 0x04 : 0x00);
+      break;
+    case SX8634SIM_REG_GPO_CTRL:       ret = _gpo_ctrl;                    break;
+    case SX8634SIM_REG_GPP_PIN_ID:     ret = _gpp_pin_id;                  break;
+    case SX8634SIM_REG_GPP_INTENSITY:  ret = _gpp_intensity[_gpp_pin_id];  break;
+    case SX8634SIM_REG_SPM_CFG:        ret = _spm_cfg;                     break;
+    case SX8634SIM_REG_SPM_BASE:       ret = _spm_base;                    break;
+    case SX8634SIM_REG_CAP_CHAN_SEL:   ret = _cap_sel;                     break;
+    default:
+      if ((SX8634SIM_REG_CAP_USEFUL_MSB <= reg) && ((SX8634SIM_REG_CAP_USEFUL_MSB + 8) > reg)) {
+        ret = _cap_diag[reg - SX8634SIM_REG_CAP_USEFUL_MSB];
+      }
+      break;
+  }
+  return ret;
+}
+
+
+/*
+* Fills the diagnostic registers for the selected channel. AverageData sits at
+*   the channel's baseline, and UsefulData is that, plus a touch if there is
+*   one, plus a little noise.
+*/
+void SX8634Sim::_latch_cap_diag() {
+  memset(_cap_diag, 0, sizeof(_cap_diag));
+  if (12 <= _cap_sel) return;
+  _noise = (_noise * 1103515245) + 12345;
+  const int16_t noise  = (int16_t) ((_noise >> 16) % ((2 * SX8634SIM_CAP_NOISE) + 1)) - SX8634SIM_CAP_NOISE;
+  const uint16_t avg   = SX8634SIM_CAP_BASELINE + (_cap_sel * 16);
+  // Sensitivity is gain on the touch, not on the noise. Even channels are in the high nibble.
+  const uint8_t  sens  = ((_cap_sel & 1) ? _spm[0x0D + (_cap_sel >> 1)] : (_spm[0x0D + (_cap_sel >> 1)] >> 4)) & 0x07;
+  const uint16_t touch = ((_cap_touch >> _cap_sel) & 1) ? ((SX8634SIM_CAP_TOUCH_DELTA * (sens + 1)) / 8) : 0;
+  const uint16_t useful = (uint16_t) (avg + touch + noise);
+  const uint16_t diff   = (uint16_t) (useful - avg);
+  const uint16_t comp   = 0x0200 + _cap_sel;
+  _cap_diag[0] = (uint8_t) (useful >> 8);
+  _cap_diag[1] = (uint8_t) useful;
+  _cap_diag[2] = (uint8_t) (avg >> 8);
+  _cap_diag[3] = (uint8_t) avg;
+  _cap_diag[4] = (uint8_t) (diff >> 8);
+  _cap_diag[5] = (uint8_t) diff;
+  _cap_diag[6] = (uint8_t) (comp >> 8);
+  _cap_diag[7] = (uint8_t) comp;
+}
+
+
+/*******************************************************************************
+* Time and pins                                                                *
+*******************************************************************************/
+
+/*
+* Advance the model to the given time. Call this often. Output waveforms are
+*   only as good as the rate at which this is called.
+*/
+void SX8634Sim::poll(uint64_t now_us) {
+  _now_us = now_us;
+
+  bool pwr = (255 == _PWR_PIN) || (sim_pin_host_drives(_PWR_PIN) && sim_pin_host_level(_PWR_PIN));
+  if (pwr != powered()) {
+    _power(pwr);
+  }
+  if (!powered()) return;
+
+  bool rst = (255 != _RESET_PIN) && sim_pin_host_drives(_RESET_PIN) && !sim_pin_host_level(_RESET_PIN);
+  if (rst != _sim_flag(SX8634SIM_FLAG_IN_RESET)) {
+    _sim_set_flag(SX8634SIM_FLAG_IN_RESET, rst);
+    if (rst) {
+      _irq_src = 0;
+      _update_irq_line();
+    }
+    else {
+      _begin_boot();
+    }
+  }
+  if (rst) return;
+
+  if (_sim_flag(SX8634SIM_FLAG_BOOTING)) {
+    if (_now_us < _boot_at) return;
+    _finish_boot();
+  }
+
+  if (_sim_flag(SX8634SIM_FLAG_BURNING) && (_now_us >= _burn_at)) {
+    _sim_set_flag(SX8634SIM_FLAG_BURNING, false);
+    if (!_sim_flag(SX8634SIM_FLAG_RAIL_LOW)) {
+      memcpy(_nvm, _spm, 128);
+      _nvm[0x7F] = spm_crc(_nvm);
+      _nvm_burns++;
+      _nvm_valid = (SX8634SIM_MAX_NVM_BURNS >= _nvm_burns);
+    }
+    _raise_irq(SX8634SIM_IRQ_NVM_BURN);
+  }
+
+  if (_sim_flag(SX8634SIM_FLAG_COMPENSATING) && (_now_us >= _comp_at)) {
+    _sim_set_flag(SX8634SIM_FLAG_COMPENSATING, false);
+    _raise_irq(SX8634SIM_IRQ_COMPENSATION);
+  }
+
+  if ((2 != _op_mode) && (_now_us >= _next_scan)) {
+    uint8_t period = _spm[(1 == _op_mode) ? 0x06 : 0x05];
+    _next_scan = _now_us + (((period > 0) ? period : 1) * SX8634SIM_SCAN_UNIT_US);
+    _scan();
+  }
+  _update_gpio(now_us);
+}
+
+
+void SX8634Sim::_power(bool x) {
+  _sim_set_flag(SX8634SIM_FLAG_POWERED, x);
+  if (x) {
+    _begin_boot();
+  }
+  else {
+    _flags &= (SX8634SIM_FLAG_RAIL_LOW | SX8634SIM_FLAG_SLIDER_TOUCH);
+    _irq_src   = 0;
+    _spm_cfg   = 0;
+    _key_state = 0;
+    _cap_stat  = 0;
+    sim_pin_release(_IRQ_PIN);
+    for (uint8_t i = 0; i < 8; i++) {
+      _intensity[i] = 0;
+      sim_pin_release(_gpio_pins[i]);
+    }
+  }
+}
+
+
+void SX8634Sim::_begin_boot() {
+  _sim_set_flag(SX8634SIM_FLAG_BOOTING, true);
+  _sim_set_flag(SX8634SIM_FLAG_SPM_MODE | SX8634SIM_FLAG_BURNING | SX8634SIM_FLAG_COMPENSATING, false);
+  _boot_at   = _now_us + SX8634SIM_BOOT_US;
+  _irq_src   = 0;
+  _spm_cfg   = 0;
+  _key_state = 0;
+  _update_irq_line();
+}
+
+
+/*
+* The SPM is loaded from NVM (or QSM), outputs take their power-up states, and
+*   the part announces that it finished compensation.
+*/
+void SX8634Sim::_finish_boot() {
+  _sim_set_flag(SX8634SIM_FLAG_BOOTING, false);
+  memcpy(_spm, (_nvm_valid ? _nvm : SX8634_CONF_QSM), 128);
+  if (!_nvm_valid) {
+    _spm[0x04] = _ADDR;
+  }
+  _spm[0x7F] = spm_crc(_spm);
+  _op_mode   = 0;
+  _gpo_ctrl  = _spm[0x42];
+  _cap_stat  = 0;
+  _gpi_stat  = 0;
+  _next_scan = _now_us;
+  for (uint8_t i = 0; i < 8; i++) {
+    _gpp_intensity[i] = _spm[0x4D + i];
+    _intensity[i]     = _target_intensity(i);
+    _fade_step_at[i]  = _now_us;
+    if (SX8634SIM_GPIO_MODE_GPI == _gpio_mode(i)) {
+      sim_pin_release(_gpio_pins[i]);
+      _gpi_stat |= (readPin(_gpio_pins[i]) ? (1 << i) : 0);
+    }
+  }
+  _raise_irq(SX8634SIM_IRQ_COMPENSATION);
+}
+
+
+/*
+* The jig's wake line only fires on the falling edge, so only that is stamped.
+*/
+void SX8634Sim::_update_irq_line() {
+  if (powered() && (0 != _irq_src)) {
+    if (!_sim_flag(SX8634SIM_FLAG_IRQ_DRIVEN)) {
+      _sim_set_flag(SX8634SIM_FLAG_IRQ_DRIVEN, true);
+      latency_irq_isr();   // Stands in for the jig's wake line.
+      sim_pin_drive(_IRQ_PIN, false);
+    }
+  }
+  else {
+    _sim_set_flag(SX8634SIM_FLAG_IRQ_DRIVEN, false);
+    sim_pin_release(_IRQ_PIN);
+  }
+}
+
+
+void SX8634Sim::_raise_irq(uint8_t bits) {
+  _irq_src |= bits;
+  _update_irq_line();
+}
+
+
+/*
+* Touches are only noticed at scan boundaries, which is why doze costs latency.
+*/
+void SX8634Sim::_scan() {
+  if (_cap_touch != _cap_stat) {
+    _cap_stat = _cap_touch;
+    _raise_irq(SX8634SIM_IRQ_BUTTONS);
+  }
+  bool slider_touch = (0xFFFF != _slider_touch_pos);
+  if ((slider_touch != _sim_flag(SX8634SIM_FLAG_SLIDER_TOUCH)) || (slider_touch && (_slider_pos != _slider_touch_pos))) {
+    _sim_set_flag(SX8634SIM_FLAG_SLIDER_TOUCH, slider_touch);
+    if (slider_touch) {
+      _slider_pos = _slider_touch_pos;
+    }
+    _raise_irq(SX8634SIM_IRQ_SLIDER);
+  }
+}
+
+
+uint8_t SX8634Sim::_gpio_mode(uint8_t pin) {
+  uint8_t reg = _spm[(pin < 4) ? 0x41 : 0x40];
+  return ((reg >> ((pin & 0x03) << 1)) & 0x03);
+}
+
+
+/*
+* Where a pin's intensity is headed. Autolight is modelled as GPO pin i
+*   following CAP i.
+*/
+uint8_t SX8634Sim::_target_intensity(uint8_t pin) {
+  switch (_gpio_mode(pin)) {
+    case SX8634SIM_GPIO_MODE_GPO:
+      {
+        bool on = (_spm[0x43] & (1 << pin)) ? (_cap_stat & (1 << pin)) : (_gpo_ctrl & (1 << pin));
+        return _spm[(on ? 0x45 : 0x4D) + pin];
+      }
+    case SX8634SIM_GPIO_MODE_GPP:
+      return _gpp_intensity[pin];
+    default:
+      return 0;
+  }
+}
+
+
+/*
+* Walks each output toward its target intensity at the programmed fade rate,
+*   and renders the PWM onto the wire. Inputs are sampled for GPI edges.
+*/
+void SX8634Sim::_update_gpio(uint64_t now_us) {
+  for (uint8_t i = 0; i < 8; i++) {
+    if (255 == _gpio_pins[i]) continue;
+    if (SX8634SIM_GPIO_MODE_GPI == _gpio_mode(i)) {
+      uint8_t mask = (1 << i);
+      bool level   = readPin(_gpio_pins[i]);
+      if (level != (bool) (_gpi_stat & mask)) {
+        _gpi_stat = level ? (_gpi_stat | mask) : (_gpi_stat & ~mask);
+        uint8_t irq_cfg = (_spm[(i < 4) ? 0x68 : 0x67] >> ((i & 0x03) << 1)) & 0x03;
+        if ((irq_cfg & 0x01) && level)  _raise_irq(SX8634SIM_IRQ_GPI);
+        if ((irq_cfg & 0x02) && !level) _raise_irq(SX8634SIM_IRQ_GPI);
+      }
+      continue;
+    }
+
+    uint8_t target = _target_intensity(i);
+    if (target != _intensity[i]) {
+      uint8_t t_reg  = ((target > _intensity[i]) ? 0x59 : 0x5D) + (3 - (i >> 1));
+      uint8_t nibble = (i & 0x01) ? (_spm[t_reg] >> 4) : (_spm[t_reg] & 0x0F);
+      if (0 == nibble) {
+        _intensity[i] = target;
+      }
+      else {
+        uint64_t step_us = (nibble * SX8634SIM_FADE_UNIT_US) >> 8;
+        while ((target != _intensity[i]) && (now_us >= _fade_step_at[i] + step_us)) {
+          _intensity[i] += (target > _intensity[i]) ? 1 : -1;
+          _fade_step_at[i] += step_us;
+        }
+      }
+    }
+    if (target == _intensity[i]) {
+      _fade_step_at[i] = now_us;
+    }
+    sim_pin_drive(_gpio_pins[i], gpioLevel(i));
+  }
+}
+
+
+/*
+* The instantaneous level of an output pin, with PWM and polarity applied.
+*/
+uint8_t SX8634Sim::gpioLevel(uint8_t pin) {
+  uint32_t duty_us = ((uint32_t) _intensity[pin] * SX8634SIM_PWM_PERIOD_US) / 255;
+  bool level = ((_now_us % SX8634SIM_PWM_PERIOD_US) < duty_us);
+  if (_spm[0x44] & (1 << pin)) {
+    level = !level;
+  }
+  return (level ? 1 : 0);
+}
+
+
+/*******************************************************************************
+* Stimulus                                                                     *
+*******************************************************************************/
+
+void SX8634Sim::touchButton(uint8_t btn, bool touched) {
+  if (12 > btn) {
+    uint16_t mask = (1 << btn);
+    _cap_touch = touched ? (_cap_touch | mask) : (_cap_touch & ~mask);
+  }
+}
+
+
+void SX8634Sim::touchSlider(uint16_t pos) {
+  _slider_touch_pos = pos;
+}
+
+
+void SX8634Sim::releaseSlider() {
+  _slider_touch_pos = 0xFFFF;
+}
+
+
+void SX8634Sim::eraseNVM() {
+  memcpy(_nvm, SX8634_CONF_QSM, 128);
+  _nvm[0x04]  = _ADDR;
+  _nvm_burns  = 0;
+  _nvm_valid  = false;
+}
+
+
+/*
+* Stands in for taking the board off the jig and putting a blank one on. The
+*   new board comes up from power-on the next time it is polled, if the jig
+*   has its power switched on.
+*/
+void SX8634Sim::swap() {
+  eraseNVM();
+  if (powered()) {
+    _power(false);
+  }
+}
+
+
+void SX8634Sim::printDebug(StringBuilder* output) {
+  output->concatf("-- SX8634Sim (0x%02x)\n", _ADDR);
+  output->concatf("\tPowered:     %c\n", powered() ? 'y' : 'n');
+  output->concatf("\tIn reset:    %c\n", _sim_flag(SX8634SIM_FLAG_IN_RESET) ? 'y' : 'n');
+  output->concatf("\tBooting:     %c\n", _sim_flag(SX8634SIM_FLAG_BOOTING) ? 'y' : 'n');
+  output->concatf("\tRail low:    %c\n", _sim_flag(SX8634SIM_FLAG_RAIL_LOW) ? 'y' : 'n');
+  output->concatf("\tOp mode:     %u\n", _op_mode);
+  output->concatf("\tIrqSrc:      0x%02x\n", _irq_src);
+  output->concatf("\tNVM:         %s, %u burns\n", _nvm_valid ? "valid" : "QSM", _nvm_burns);
+  output->concatf("\tCap/Slider:  0x%03x / %u\n", _cap_stat, _slider_pos);
+  output->concat("\tGPIO intensity: ");
+  for (uint8_t i = 0; i < 8; i++) {
+    output->concatf("%3u ", _intensity[i]);
+  }
+  output->concat("\n\tSPM:\n");
+  StringBuilder::printBuffer(output, _spm, 128, "\t  ");
+}
@@ -0,0 +1,173 @@
+/*
+File:   SX8634Sim.h
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+A software model of the SX8634, as seen from the provisioning jig.
+
+This models the parts of the chip that the provisioner exercises:
+  - The I2C register file, including the SPM gateway and the NVM burn key.
+  - The SPM and NVM, with QSM fallback and the burn counter.
+  - Power (via the jig's regulator enable), the reset line, and soft reset.
+  - The INTB line, which is open-drain and active-low.
+  - GPO/GPP outputs (with PWM and fades), and GPI inputs with edge interrupts.
+  - Buttons and the slider, driven by a test harness.
+
+It is not a model of the capacitive front-end. Touches are injected directly
+  and reported at the next scan boundary.
+
+Timing constants below are chosen to be in the right neighborhood of the
+  datasheet, not to match any particular part.
+*/
+
+#ifndef __SX8634_SIM_MODEL_H__
+#define __SX8634_SIM_MODEL_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "SimI2C.h"
+
+#define SX8634SIM_BOOT_US          150000  // Power-up/reset until first IRQ.
+#define SX8634SIM_BURN_US          120000  // NVM burn duration.
+#define SX8634SIM_COMP_US           30000  // Compensation duration.
+#define SX8634SIM_PWM_PERIOD_US     10000  // GPP/GPO PWM period.
+#define SX8634SIM_FADE_UNIT_US      64000  // One step of GpioInc/DecTime.
+#define SX8634SIM_SCAN_UNIT_US      15000  // One step of Active/DozeScanPeriod.
+
+/* CapSense diagnostic model. Counts, as the registers report them. */
+#define SX8634SIM_CAP_BASELINE       4000   // Plus 16 per channel.
+#define SX8634SIM_CAP_TOUCH_DELTA     400   // At the highest sensitivity.
+#define SX8634SIM_CAP_NOISE             8   // Peak, either way.
+#define SX8634SIM_MAX_NVM_BURNS         3  // After this, the part reverts to QSM.
+
+/* I2C register addresses. */
+#define SX8634SIM_REG_IRQ_SRC        0x00
+#define SX8634SIM_REG_CAP_STAT_MSB   0x01
+#define SX8634SIM_REG_CAP_STAT_LSB   0x02
+#define SX8634SIM_REG_SLIDER_MSB     0x03
+#define SX8634SIM_REG_SLIDER_LSB     0x04
+#define SX8634SIM_REG_GPI_STAT       0x07
+#define SX8634SIM_REG_SPM_STAT       0x08
+#define SX8634SIM_REG_COMP_OP_MODE   0x09
+#define SX8634SIM_REG_GPO_CTRL       0x0A
+#define SX8634SIM_REG_GPP_PIN_ID     0x0B
+#define SX8634SIM_REG_GPP_INTENSITY  0x0C
+#define SX8634SIM_REG_SPM_CFG        0x0D
+#define SX8634SIM_REG_SPM_BASE       0x0E
+#define SX8634SIM_REG_CAP_CHAN_SEL   0x10
+#define SX8634SIM_REG_CAP_USEFUL_MSB 0x11   // ...through CapSenseCompLsb at 0x18.
+#define SX8634SIM_REG_SPM_KEY_MSB    0xAC
+#define SX8634SIM_REG_SPM_KEY_LSB    0xAD
+#define SX8634SIM_REG_SOFT_RESET     0xB1
+
+/* IrqSrc bits. */
+#define SX8634SIM_IRQ_MODE           0x01
+#define SX8634SIM_IRQ_COMPENSATION   0x02
+#define SX8634SIM_IRQ_BUTTONS        0x04
+#define SX8634SIM_IRQ_SLIDER         0x08
+#define SX8634SIM_IRQ_GPI            0x10
+#define SX8634SIM_IRQ_SPM_WRITE      0x20
+#define SX8634SIM_IRQ_NVM_BURN       0x40
+
+/* Model flags. */
+#define SX8634SIM_FLAG_POWERED       0x0001  // Regulator is on.
+#define SX8634SIM_FLAG_IN_RESET      0x0002  // Reset line is held low.
+#define SX8634SIM_FLAG_BOOTING       0x0004  // Between power/reset and ready.
+#define SX8634SIM_FLAG_SPM_MODE      0x0008  // SPM gateway is open.
+#define SX8634SIM_FLAG_SPM_DIRTY     0x0010  // SPM was written this session.
+#define SX8634SIM_FLAG_BURNING       0x0020  // An NVM burn is in progress.
+#define SX8634SIM_FLAG_RAIL_LOW      0x0040  // Supply is too low to burn NVM.
+#define SX8634SIM_FLAG_COMPENSATING  0x0080  // Compensation is running.
+#define SX8634SIM_FLAG_SLIDER_TOUCH  0x0100  // A finger is on the slider.
+#define SX8634SIM_FLAG_IRQ_DRIVEN    0x0200  // INTB is being held low.
+
+
+class SX8634Sim : public SimI2CTarget {
+  public:
+    SX8634Sim(uint8_t addr, uint8_t pwr_pin, uint8_t reset_pin, uint8_t irq_pin, const uint8_t* gpio_pins);
+    ~SX8634Sim();
+
+    /* Overrides from SimI2CTarget */
+    int8_t i2cWrite(uint8_t addr, int16_t reg, const uint8_t* buf, uint16_t len);
+    int8_t i2cRead(uint8_t addr, int16_t reg, uint8_t* buf, uint16_t len);
+
+    void poll(uint64_t now_us);
+
+    /* Stimulus from the harness. */
+    void touchButton(uint8_t, bool);
+    void touchSlider(uint16_t);
+    void releaseSlider();
+    inline void railLow(bool x) {   _sim_set_flag(SX8634SIM_FLAG_RAIL_LOW, x);   };
+    void eraseNVM();
+    void swap();
+
+    /* Inspection. */
+    inline bool    powered() {     return _sim_flag(SX8634SIM_FLAG_POWERED);    };
+    inline bool    ready() {       return (powered() && !_sim_flag(SX8634SIM_FLAG_IN_RESET | SX8634SIM_FLAG_BOOTING));  };
+    inline uint8_t nvmBurns() {    return _nvm_burns;  };
+    inline const uint8_t* spm() {  return (const uint8_t*) _spm;  };
+    inline const uint8_t* nvm() {  return (const uint8_t*) _nvm;  };
+    uint8_t gpioLevel(uint8_t pin);
+
+    void printDebug(StringBuilder*);
+
+    static uint8_t spm_crc(const uint8_t* spm);
+
+
+  private:
+    const uint8_t _ADDR;
+    const uint8_t _PWR_PIN;
+    const uint8_t _RESET_PIN;
+    const uint8_t _IRQ_PIN;
+    uint8_t  _gpio_pins[8];
+    uint16_t _flags       = 0;
+    uint8_t  _irq_src     = 0;
+    uint8_t  _op_mode     = 0;   // CompOpMode[1:0]
+    uint8_t  _spm_cfg     = 0;
+    uint8_t  _spm_base    = 0;
+    uint8_t  _key_state   = 0;   // Progress through the NVM unlock sequence.
+    uint8_t  _soft_reset  = 0;
+    uint8_t  _nvm_burns   = 0;
+    bool     _nvm_valid   = false;
+    uint8_t  _gpo_ctrl    = 0;
+    uint8_t  _gpp_pin_id  = 0;
+    uint8_t  _gpi_stat    = 0;
+    uint16_t _cap_stat    = 0;   // What the registers say.
+    uint16_t _cap_touch   = 0;   // What the harness says. Latched at scan.
+    uint8_t  _cap_sel     = 0;   // CapSenseChanSelect
+    uint8_t  _cap_diag[8];       // Its registers, as of the last select.
+    uint32_t _noise       = 1;
+    uint16_t _slider_pos  = 0;
+    uint16_t _slider_touch_pos = 0xFFFF;
+    uint64_t _now_us      = 0;
+    uint64_t _boot_at     = 0;   // Time at which boot completes.
+    uint64_t _burn_at     = 0;   // Time at which the NVM burn completes.
+    uint64_t _comp_at     = 0;   // Time at which compensation completes.
+    uint64_t _next_scan   = 0;
+    uint8_t  _intensity[8];      // Present output intensity, after fades.
+    uint8_t  _gpp_intensity[8];
+    uint64_t _fade_step_at[8];
+    uint8_t  _spm[128];
+    uint8_t  _nvm[128];
+
+    void _power(bool);
+    void _begin_boot();
+    void _finish_boot();
+    void _update_irq_line();
+    void _raise_irq(uint8_t);
+    void _scan();
+    void _update_gpio(uint64_t now_us);
+    uint8_t _gpio_mode(uint8_t pin);
+    uint8_t _target_intensity(uint8_t pin);
+    void    _latch_cap_diag();
+    int8_t  _write_reg(uint8_t reg, uint8_t val);
+    uint8_t _read_reg(uint8_t reg);
+
+    inline bool _sim_flag(uint16_t f) {   return (_flags & f);  };
+    inline void _sim_set_flag(uint16_t f, bool x) {
+      _flags = (x) ? (_flags | f) : (_flags & ~f);
+    };
+};
+
+#endif  // __SX8634_SIM_MODEL_H__
@@ -0,0 +1,98 @@
+/*
+File:   SimClock.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.22
+
+The clock for the host build. See SimClock.h.
+
+These definitions take the place of the Linux platform's millis() and
+  micros(). The sim Makefile links this object ahead of libmanuvr, so ours are
+  the ones used.
+*/
+
+#include "SimClock.h"
+#include <time.h>
+
+static bool     _virtual   = false;
+static uint64_t _offset_us = 0;     // Added to the wall clock in real time.
+static uint64_t _virt_us   = 0;     // The clock, in virtual time.
+static uint32_t _tick_us   = SIM_CLOCK_DEFAULT_TICK_US;
+static uint64_t _ticks     = 0;     // Idle ticks taken.
+static uint64_t _advanced  = 0;     // Microseconds added by sim_clock_advance().
+static uint64_t _wall_mark = 0;     // Wall clock when virtual time began...
+static uint64_t _virt_mark = 0;     // ...and the clock at that moment.
+
+
+static uint64_t _wall_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (((uint64_t) ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+uint64_t sim_micros64() {
+  return _virtual ? _virt_us : (_wall_us() + _offset_us);
+}
+
+unsigned long millis() {   return (unsigned long) (sim_micros64() / 1000);   }
+unsigned long micros() {   return (unsigned long) sim_micros64();            }
+
+
+void sim_clock_virtual(bool x) {
+  if (x == _virtual) return;
+  const uint64_t now = sim_micros64();
+  const uint64_t wall = _wall_us();
+  if (x) {
+    _virt_us   = now;
+    _wall_mark = wall;
+    _virt_mark = now;
+    _ticks     = 0;
+    _advanced  = 0;
+  }
+  else {
+    _offset_us = now - wall;
+  }
+  _virtual = x;
+}
+
+
+bool sim_clock_is_virtual() {   return _virtual;   }
+
+void sim_clock_tick(uint32_t us) {
+  _tick_us = (0 < us) ? us : SIM_CLOCK_DEFAULT_TICK_US;
+}
+
+
+/* Does nothing in real time, where the wall clock is already moving. */
+void sim_clock_advance(uint32_t us) {
+  if (_virtual) {
+    _virt_us  += us;
+    _advanced += us;
+  }
+}
+
+
+void sim_clock_idle() {
+  if (_virtual) {
+    _virt_us += _tick_us;
+    _ticks++;
+  }
+}
+
+
+void sim_clock_print(StringBuilder* output) {
+  output->concatf("-- Clock:    %s time\n", _virtual ? "virtual" : "real");
+  output->concatf("\tNow:       %" PRIu64 " us\n", sim_micros64());
+  if (_virtual) {
+    const uint64_t sim_us  = _virt_us - _virt_mark;
+    const uint64_t wall_us = _wall_us() - _wall_mark;
+    output->concatf("\tTick:      %u us\n", _tick_us);
+    output->concatf("\tSimulated: %" PRIu64 " ms (%" PRIu64 " idle ticks, %" PRIu64 " us on the wire)\n",
+      sim_us / 1000, _ticks, _advanced
+    );
+    output->concatf("\tWall:      %" PRIu64 " ms\n", wall_us / 1000);
+    if (0 < wall_us) {
+      output->concatf("\tSpeed:     %" PRIu64 "x real time\n", sim_us / wall_us);
+    }
+  }
+}
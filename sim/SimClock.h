@@ -0,0 +1,49 @@
+/*
+File:   SimClock.h
+Author: J. Ian Lindsay
+Date:   2019.09.22
+
+The clock for the host build of the provisioner.
+
+millis() and micros() are provided here in place of the Linux platform's, in
+  the same way as the GPIO functions in SimPins. So the scheduler, the
+  provisioner, and the SX8634 model all read the same clock, and it can be
+  taken away from the wall.
+
+In real time (the default), the clock follows CLOCK_MONOTONIC.
+
+In virtual time, the clock only moves when something moves it:
+  - The main loop calls sim_clock_idle() when the kernel has nothing to do,
+    in place of sleeping. That advances the clock by one tick (1ms unless
+    set otherwise), which is the scheduler's resolution.
+  - Each simulated I2C transfer advances it by its time on the wire.
+  So no pass of the loop ever waits, and a run of the loop is the same run
+  every time, for as long as nobody types at the console. A board cycle that
+  takes most of a second on the jig takes about a millisecond here.
+
+A longer tick runs faster, at the cost of timing resolution. Schedules shorter
+  than the tick will fire once per tick.
+
+Switching between modes never moves the clock backward.
+*/
+
+#ifndef __SX8634_SIM_CLOCK_H__
+#define __SX8634_SIM_CLOCK_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+
+#define SIM_CLOCK_DEFAULT_TICK_US   1000
+
+
+uint64_t sim_micros64();
+
+void     sim_clock_virtual(bool);
+bool     sim_clock_is_virtual();
+void     sim_clock_tick(uint32_t us);
+void     sim_clock_advance(uint32_t us);
+void     sim_clock_idle();
+void     sim_clock_print(StringBuilder*);
+
+#endif  // __SX8634_SIM_CLOCK_H__
@@ -0,0 +1,168 @@
+/*
+File:   SimHarness.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+The far side of the simulated jig. See SimHarness.h.
+*/
+
+#include "SimHarness.h"
+#include "SimPins.h"
+#include "SimI2C.h"
+
+
+SimHarness::SimHarness() : EventReceiver("SimHarness") {
+  for (uint8_t i = 0; i < SIM_HARNESS_MAX_CHIPS; i++) {
+    _chips[i] = nullptr;
+  }
+}
+
+
+SimHarness::~SimHarness() {
+}
+
+
+int8_t SimHarness::addChip(uint8_t adapter, SX8634Sim* sx) {
+  if (SIM_HARNESS_MAX_CHIPS > _chip_count) {
+    if (0 == sim_i2c_attach(adapter, sx)) {
+      _chips[_chip_count++] = sx;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+
+/*
+* Called from the main loop on every pass.
+*/
+void SimHarness::poll() {
+  uint64_t now = sim_micros64();
+  for (uint8_t i = 0; i < _chip_count; i++) {
+    _chips[i]->poll(now);
+  }
+}
+
+
+/*******************************************************************************
+* ######## ##     ## ######## ##    ## ########  ######
+* ##       ##     ## ##       ###   ##    ##    ##    ##
+* ##       ##     ## ##       ####  ##    ##    ##
+* ######   ##     ## ######   ## ## ##    ##     ######
+* ##        ##   ##  ##       ##  ####    ##          ##
+* ##         ## ##   ##       ##   ###    ##    ##    ##
+* ########    ###    ######## ##    ##    ##     ######
+*
+* These are overrides from EventReceiver interface...
+*******************************************************************************/
+
+int8_t SimHarness::attached() {
+  if (EventReceiver::attached()) {
+    return 1;
+  }
+  return 0;
+}
+
+
+int8_t SimHarness::callback_proc(ManuvrMsg* event) {
+  return (0 == event->refCount()) ? EVENT_CALLBACK_RETURN_REAP : EVENT_CALLBACK_RETURN_DROP;
+}
+
+
+int8_t SimHarness::notify(ManuvrMsg* active_event) {
+  return EventReceiver::notify(active_event);
+}
+
+
+void SimHarness::printDebug(StringBuilder* output) {
+  EventReceiver::printDebug(output);
+  for (uint8_t i = 0; i < _chip_count; i++) {
+    output->concatf("%c", (i == _selected) ? '*' : ' ');
+    _chips[i]->printDebug(output);
+  }
+  sim_i2c_print(output);
+  sim_pins_print(output);
+  sim_clock_print(output);
+}
+
+
+/*******************************************************************************
+* Console I/O
+*******************************************************************************/
+
+static const ConsoleCommand console_cmds[] = {
+  { "i",    "Simulation info" },
+  { "n",    "Select simulated chip" },
+  { "b",    "Touch (b <btn> 1) or release (b <btn> 0) a button" },
+  { "s",    "Touch the slider at a position, or release it if none given" },
+  { "r",    "Set (r 1) or clear (r 0) a low-supply fault for NVM burns" },
+  { "E",    "Erase the NVM of the selected chip back to QSM" },
+  { "c",    "Clock info, or run on virtual (c 1 [tick us]) or real (c 0) time" }
+};
+
+
+uint SimHarness::consoleGetCmds(ConsoleCommand** ptr) {
+  *ptr = (ConsoleCommand*) &console_cmds[0];
+  return sizeof(console_cmds) / sizeof(ConsoleCommand);
+}
+
+
+void SimHarness::consoleCmdProc(StringBuilder* input) {
+  const char* str = (char *) input->position(0);
+  char c          = *str;
+  int arg0        = (input->count() > 1) ? input->position_as_int(1) : -1;
+  int arg1        = (input->count() > 2) ? input->position_as_int(2) : -1;
+  SX8634Sim* sx   = chip(_selected);
+
+  if ((nullptr == sx) && ('i' != c) && ('c' != c)) {
+    local_log.concat("No simulated chips.\n");
+    flushLocalLog();
+    return;
+  }
+
+  switch (c) {
+    case 'i':
+      printDebug(&local_log);
+      break;
+    case 'n':
+      if ((0 <= arg0) && (arg0 < _chip_count)) {
+        _selected = arg0;
+      }
+      local_log.concatf("Selected chip %u.\n", _selected);
+      break;
+    case 'b':
+      if ((0 <= arg0) && (12 > arg0)) {
+        sx->touchButton(arg0, (0 != arg1));
+        local_log.concatf("Button %d %s.\n", arg0, (0 != arg1) ? "touched" : "released");
+      }
+      break;
+    case 's':
+      if (0 <= arg0) {
+        sx->touchSlider(arg0);
+        local_log.concatf("Slider touched at %d.\n", arg0);
+      }
+      else {
+        sx->releaseSlider();
+        local_log.concat("Slider released.\n");
+      }
+      break;
+    case 'r':
+      sx->railLow(1 == arg0);
+      local_log.concatf("Burn supply is %s.\n", (1 == arg0) ? "LOW" : "nominal");
+      break;
+    case 'E':
+      sx->eraseNVM();
+      local_log.concat("NVM erased.\n");
+      break;
+    case 'c':
+      if (0 <= arg0) {
+        sim_clock_tick((0 < arg1) ? arg1 : SIM_CLOCK_DEFAULT_TICK_US);
+        sim_clock_virtual(0 != arg0);
+      }
+      sim_clock_print(&local_log);
+      break;
+    default:
+      break;
+  }
+  flushLocalLog();
+}
@@ -0,0 +1,51 @@
+/*
+File:   SimHarness.h
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+The far side of the simulated jig. Owns the SX8634 models, keeps them ticking,
+  and gives the console a way to poke at them (touches, supply faults, NVM
+  erasure) while the provisioner runs against them.
+*/
+
+#ifndef __SX8634_SIM_HARNESS_H__
+#define __SX8634_SIM_HARNESS_H__
+
+#include <Platform/Platform.h>
+#include <XenoSession/Console/ManuvrConsole.h>
+#include "SX8634Sim.h"
+
+#define SIM_HARNESS_MAX_CHIPS   4
+
+
+class SimHarness : public EventReceiver, public ConsoleInterface {
+  public:
+    SimHarness();
+    ~SimHarness();
+
+    int8_t addChip(uint8_t adapter, SX8634Sim*);
+    void   poll();
+    inline SX8634Sim* chip(uint8_t i) {  return (i < _chip_count) ? _chips[i] : nullptr;  };
+
+    /* Overrides from EventReceiver */
+    int8_t notify(ManuvrMsg*);
+    int8_t callback_proc(ManuvrMsg*);
+    void printDebug(StringBuilder*);
+
+    /* Overrides from ConsoleInterface */
+    uint consoleGetCmds(ConsoleCommand**);
+    inline const char* consoleName() { return "SimHarness";  };
+    void consoleCmdProc(StringBuilder* input);
+
+
+  protected:
+    int8_t attached();
+
+
+  private:
+    SX8634Sim* _chips[SIM_HARNESS_MAX_CHIPS];
+    uint8_t    _chip_count = 0;
+    uint8_t    _selected   = 0;
+};
+
+#endif  // __SX8634_SIM_HARNESS_H__
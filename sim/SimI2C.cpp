@@ -0,0 +1,110 @@
+/*
+File:   SimI2C.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+The simulated I2C fabric for the host build. See SimI2C.h.
+*/
+
+#include "SimI2C.h"
+#include "SimClock.h"
+
+static SimI2CTarget* sim_targets[SIM_I2C_MAX_ADAPTERS][SIM_I2C_MAX_TARGETS];
+static SimI2CStats   sim_stats[SIM_I2C_MAX_ADAPTERS];
+
+
+/*
+* Time on the wire for a transfer, in microseconds. Each byte is nine clocks
+*   with the ACK, plus one clock each for START and STOP. Register-addressed
+*   reads pay for a second address byte and a repeated START.
+*/
+static uint32_t _sim_i2c_wire_us(I2CBusOp* op) {
+  uint32_t clocks = 2 + 9;   // START/STOP + address.
+  if (0 <= op->sub_addr) {
+    clocks += 9;
+    if (BusOpcode::RX == op->get_opcode()) {
+      clocks += 1 + 9;       // Repeated START + address.
+    }
+  }
+  clocks += 9 * op->buf_len;
+  return ((clocks * 1000000) / SIM_I2C_BUS_FREQ);
+}
+
+
+int8_t sim_i2c_attach(uint8_t adapter, SimI2CTarget* target) {
+  if (SIM_I2C_MAX_ADAPTERS > adapter) {
+    for (uint8_t i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+      if (nullptr == sim_targets[adapter][i]) {
+        sim_targets[adapter][i] = target;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+
+int8_t sim_i2c_detach(uint8_t adapter, SimI2CTarget* target) {
+  if (SIM_I2C_MAX_ADAPTERS > adapter) {
+    for (uint8_t i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+      if (target == sim_targets[adapter][i]) {
+        sim_targets[adapter][i] = nullptr;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+
+/*
+* Called by the sim's I2CBusOp::advance_operation().
+*
+* @return 0 if some target ACK'd the transfer, -1 otherwise.
+*/
+int8_t sim_i2c_transfer(uint8_t adapter, I2CBusOp* op) {
+  if (SIM_I2C_MAX_ADAPTERS <= adapter) return -1;
+  SimI2CStats* s = &sim_stats[adapter];
+  const uint32_t wire_us = _sim_i2c_wire_us(op);
+  s->xfers++;
+  s->bus_us += wire_us;
+  sim_clock_advance(wire_us);   // Only in virtual time.
+  for (uint8_t i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+    SimI2CTarget* t = sim_targets[adapter][i];
+    if (nullptr != t) {
+      int8_t ret = -1;
+      switch (op->get_opcode()) {
+        case BusOpcode::RX:
+          ret = t->i2cRead(op->dev_addr, op->sub_addr, op->buf, op->buf_len);
+          break;
+        case BusOpcode::TX:
+        case BusOpcode::TX_CMD:
+          ret = t->i2cWrite(op->dev_addr, op->sub_addr, op->buf, op->buf_len);
+          break;
+        default:
+          break;
+      }
+      if (0 == ret) {
+        s->bytes += op->buf_len;
+        return 0;
+      }
+    }
+  }
+  s->nacks++;
+  return -1;
+}
+
+
+SimI2CStats* sim_i2c_stats(uint8_t adapter) {
+  return (SIM_I2C_MAX_ADAPTERS > adapter) ? &sim_stats[adapter] : nullptr;
+}
+
+
+void sim_i2c_print(StringBuilder* output) {
+  for (uint8_t a = 0; a < SIM_I2C_MAX_ADAPTERS; a++) {
+    SimI2CStats* s = &sim_stats[a];
+    output->concatf("Sim I2C%u: %u xfers, %u NACK, %u bytes, %u us on the wire\n",
+      a, s->xfers, s->nacks, s->bytes, (uint32_t) s->bus_us
+    );
+  }
+}
@@ -0,0 +1,53 @@
+/*
+File:   SimI2C.h
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+The simulated I2C fabric for the host build.
+
+I2CAdapter-Sim.cpp supplies the platform half of ManuvrOS's I2CAdapter, and
+  hands each bus operation to sim_i2c_transfer(). That function offers the
+  transfer to every target attached to the adapter until one of them ACKs.
+  Several targets may share an address, so long as no more than one of them is
+  powered at a time.
+*/
+
+#ifndef __SX8634_SIM_I2C_H__
+#define __SX8634_SIM_I2C_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+
+#define SIM_I2C_MAX_ADAPTERS   2   // The ESP32 has two I2C controllers.
+#define SIM_I2C_MAX_TARGETS    4   // Targets per adapter.
+#define SIM_I2C_BUS_FREQ       400000
+
+
+/*
+* Anything that wants to sit on a simulated bus implements this.
+* A negative return is a NACK. Zero is an ACK.
+*/
+class SimI2CTarget {
+  public:
+    virtual int8_t i2cWrite(uint8_t addr, int16_t reg, const uint8_t* buf, uint16_t len) = 0;
+    virtual int8_t i2cRead(uint8_t addr, int16_t reg, uint8_t* buf, uint16_t len)        = 0;
+};
+
+
+/* Per-adapter accounting. */
+typedef struct {
+  uint32_t xfers;       // Transfers offered to the bus.
+  uint32_t nacks;       // Transfers nobody answered.
+  uint32_t bytes;       // Payload bytes moved.
+  uint64_t bus_us;      // Time the bus would have spent on the wire.
+} SimI2CStats;
+
+
+int8_t   sim_i2c_attach(uint8_t adapter, SimI2CTarget*);
+int8_t   sim_i2c_detach(uint8_t adapter, SimI2CTarget*);
+int8_t   sim_i2c_transfer(uint8_t adapter, I2CBusOp*);
+SimI2CStats* sim_i2c_stats(uint8_t adapter);
+void     sim_i2c_print(StringBuilder*);
+
+#endif  // __SX8634_SIM_I2C_H__
@@ -0,0 +1,189 @@
+/*
+File:   SimPins.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+Simulated platform GPIO for the host build. See SimPins.h.
+
+These definitions take the place of the Linux platform's GPIO functions. The
+  sim Makefile links this object ahead of libmanuvr, so ours are the ones used.
+*/
+
+#include "SimPins.h"
+#include "LoopWake.h"
+
+
+typedef struct {
+  GPIOMode   mode;
+  uint8_t    drivers;     // Bitmask of SIM_PIN_DRIVER_*
+  bool       host_level;
+  bool       far_level;
+  bool       level;       // The resolved level of the wire.
+  uint8_t    condition;   // IRQ condition, if fxn is set.
+  FxnPointer fxn;
+} SimPin;
+
+static SimPin sim_pins[SIM_PIN_COUNT];
+
+
+/*
+* Resolves the level of a wire, and fires any ISR attached to it.
+* An undriven wire floats to whatever its pull resistor says. Absent a pull, we
+*   call it high, since every line on the jig has a pullup on the SX8634 side.
+* Contention (both sides driving opposite levels) resolves low, as it would
+*   with the open-drain IRQ line.
+*/
+static void _sim_pin_resolve(uint8_t pin) {
+  SimPin* p = &sim_pins[pin];
+  bool nu_level = (GPIOMode::INPUT_PULLDOWN != p->mode);
+  switch (p->drivers) {
+    case SIM_PIN_DRIVER_HOST:   nu_level = p->host_level;                    break;
+    case SIM_PIN_DRIVER_FAR:    nu_level = p->far_level;                     break;
+    case (SIM_PIN_DRIVER_HOST | SIM_PIN_DRIVER_FAR):
+      nu_level = (p->host_level && p->far_level);
+      break;
+    default:
+      break;
+  }
+
+  if (nu_level != p->level) {
+    p->level = nu_level;
+    if (nullptr != p->fxn) {
+      bool fire = false;
+      switch (p->condition) {
+        case RISING:    fire = nu_level;     break;
+        case FALLING:   fire = !nu_level;    break;
+        default:        fire = true;         break;   // CHANGE, CHANGE_PULL_UP
+      }
+      if (fire) {
+        p->fxn();
+        loop_wake_isr();   // The jig routes IRQ to a wake pin. Here, any edge will do.
+      }
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Platform GPIO API                                                            *
+*******************************************************************************/
+
+int8_t gpioDefine(uint8_t pin, GPIOMode mode) {
+  if (SIM_PIN_COUNT <= pin) return -1;
+  SimPin* p = &sim_pins[pin];
+  p->mode = mode;
+  switch (mode) {
+    case GPIOMode::OUTPUT:
+    case GPIOMode::OUTPUT_OD:
+      p->drivers |= SIM_PIN_DRIVER_HOST;
+      break;
+    default:
+      p->drivers &= ~SIM_PIN_DRIVER_HOST;
+      break;
+  }
+  _sim_pin_resolve(pin);
+  return 0;
+}
+
+
+void unsetPinIRQ(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return;
+  sim_pins[pin].fxn = nullptr;
+}
+
+
+int8_t setPinFxn(uint8_t pin, uint8_t condition, FxnPointer fxn) {
+  if (SIM_PIN_COUNT <= pin) return -1;
+  sim_pins[pin].condition = condition;
+  sim_pins[pin].fxn       = fxn;
+  return 0;
+}
+
+
+int8_t setPin(uint8_t pin, bool high) {
+  if (SIM_PIN_COUNT <= pin) return -1;
+  sim_pins[pin].host_level = high;
+  _sim_pin_resolve(pin);
+  return 0;
+}
+
+
+int8_t readPin(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return -1;
+  return (sim_pins[pin].level ? 1 : 0);
+}
+
+
+/*******************************************************************************
+* Far-side API                                                                 *
+*******************************************************************************/
+
+void sim_pin_drive(uint8_t pin, bool level) {
+  if (SIM_PIN_COUNT <= pin) return;
+  sim_pins[pin].drivers  |= SIM_PIN_DRIVER_FAR;
+  sim_pins[pin].far_level = level;
+  _sim_pin_resolve(pin);
+}
+
+
+void sim_pin_release(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return;
+  sim_pins[pin].drivers &= ~SIM_PIN_DRIVER_FAR;
+  _sim_pin_resolve(pin);
+}
+
+
+/*
+* What the host is trying to put on the wire. Only meaningful if the host has
+*   the pin defined as an output.
+*/
+bool sim_pin_host_level(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return false;
+  return sim_pins[pin].host_level;
+}
+
+
+bool sim_pin_host_drives(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return false;
+  return (sim_pins[pin].drivers & SIM_PIN_DRIVER_HOST);
+}
+
+
+GPIOMode sim_pin_mode(uint8_t pin) {
+  if (SIM_PIN_COUNT <= pin) return GPIOMode::UNINIT;
+  return sim_pins[pin].mode;
+}
+
+
+void sim_pins_reset() {
+  for (uint8_t i = 0; i < SIM_PIN_COUNT; i++) {
+    sim_pins[i].mode       = GPIOMode::UNINIT;
+    sim_pins[i].drivers    = SIM_PIN_DRIVER_NONE;
+    sim_pins[i].host_level = false;
+    sim_pins[i].far_level  = false;
+    sim_pins[i].level      = true;
+    sim_pins[i].condition  = 0;
+    sim_pins[i].fxn        = nullptr;
+  }
+}
+
+
+void sim_pins_print(StringBuilder* output) {
+  output->concat("Sim pin bank\n  Pin  Mode            Drv  Host  Far  Level  ISR\n");
+  for (uint8_t i = 0; i < SIM_PIN_COUNT; i++) {
+    SimPin* p = &sim_pins[i];
+    if ((GPIOMode::UNINIT != p->mode) || (SIM_PIN_DRIVER_NONE != p->drivers)) {
+      output->concatf("  %3u  %-14s  %c%c   %u     %u    %u      %c\n",
+        i,
+        Platform::getPinModeStr(p->mode),
+        (p->drivers & SIM_PIN_DRIVER_HOST) ? 'H' : '-',
+        (p->drivers & SIM_PIN_DRIVER_FAR)  ? 'F' : '-',
+        p->host_level ? 1 : 0,
+        p->far_level ? 1 : 0,
+        p->level ? 1 : 0,
+        (nullptr != p->fxn) ? 'y' : 'n'
+      );
+    }
+  }
+}
+
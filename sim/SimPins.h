@@ -0,0 +1,41 @@
+/*
+File:   SimPins.h
+Author: J. Ian Lindsay
+Date:   2019.09.02
+
+A simulated bank of platform GPIO pins for the host build of the provisioner.
+
+The platform GPIO API (gpioDefine(), setPin(), readPin(), setPinFxn(),
+  unsetPinIRQ()) is provided here in place of the Linux platform's, so that
+  SX8634BitDiddler can be linked unmodified. Each pin is a wire with two
+  possible drivers: the host (the provisioner, via setPin()) and the far side
+  (the simulated SX8634 or a test harness, via sim_pin_drive()). The resolved
+  level of the wire is what readPin() returns, and what edge ISRs see.
+*/
+
+#ifndef __SX8634_SIM_PINS_H__
+#define __SX8634_SIM_PINS_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <Platform/Platform.h>
+#include "SimClock.h"
+
+#define SIM_PIN_COUNT           40     // Matches the ESP32's pin space.
+
+/* Who is driving a given pin? */
+#define SIM_PIN_DRIVER_NONE     0x00
+#define SIM_PIN_DRIVER_HOST     0x01   // Set by the provisioner via setPin().
+#define SIM_PIN_DRIVER_FAR      0x02   // Set by the model via sim_pin_drive().
+
+
+/* Far-side (model) access to the pin bank. */
+void    sim_pin_drive(uint8_t pin, bool level);
+void    sim_pin_release(uint8_t pin);
+bool    sim_pin_host_level(uint8_t pin);
+bool    sim_pin_host_drives(uint8_t pin);
+GPIOMode sim_pin_mode(uint8_t pin);
+void    sim_pins_reset();
+void    sim_pins_print(StringBuilder*);
+
+#endif  // __SX8634_SIM_PINS_H__
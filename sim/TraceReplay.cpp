@@ -0,0 +1,146 @@
+/*
+File:   TraceReplay.cpp
+Author: J. Ian Lindsay
+Date:   2019.09.20
+
+Answers the driver from an I2C trace. See TraceReplay.h.
+*/
+
+#include "TraceReplay.h"
+#include "SimPins.h"
+#include <string.h>
+
+
+TraceReplay::TraceReplay(uint8_t irq_pin, bool realtime) : _IRQ_PIN(irq_pin), _REALTIME(realtime) {
+  memset(&_rec, 0, sizeof(_rec));
+}
+
+
+/*
+* The buffer is not copied, and must outlive the replay.
+*
+* @return 0 on success, -1 if it isn't a trace we understand, -2 if it is empty.
+*/
+int8_t TraceReplay::load(const uint8_t* buf, uint32_t len) {
+  if (0 != I2CTrace::checkHeader(buf, len)) return -1;
+  _buf     = buf;
+  _len     = len;
+  _records = (uint32_t) buf[8] | ((uint32_t) buf[9] << 8) | ((uint32_t) buf[10] << 16) | ((uint32_t) buf[11] << 24);
+  _after   = I2C_TRACE_HEADER_LEN;
+  _index   = 0;
+  _rec_us  = 0;
+  _advance();
+  if (finished()) return -2;
+  _first_addr = _rec.addr;
+  return 0;
+}
+
+
+/*
+* Moves _rec to the next of the driver's records.
+*/
+void TraceReplay::_advance() {
+  while (true) {
+    const int32_t r = I2CTrace::readRecord(_buf, _len, _after, &_rec);
+    if (0 >= r) {
+      if (0 > r) {
+        _notes.concatf("The trace is cut short in record %u.\n", _index);
+      }
+      _next = 0;
+      return;
+    }
+    _next    = _after;
+    _after   = (uint32_t) r;
+    _rec_us += _rec.dt_us;
+    _index++;
+    if (0 == (_rec.flags & I2C_TRACE_FLAG_JIG)) {
+      return;
+    }
+    _skipped++;
+  }
+}
+
+
+/*
+* Call this often. It is what asserts INTB.
+*/
+void TraceReplay::poll(uint64_t now_us) {
+  if (0 == _t_start) _t_start = now_us;
+  if (!_irq && !finished() && (_rec.flags & I2C_TRACE_FLAG_IRQ)) {
+    if (!_REALTIME || ((now_us - _t_start) >= _rec_us)) {
+      sim_pin_drive(_IRQ_PIN, false);
+      _irq = true;
+      _irqs++;
+    }
+  }
+}
+
+
+int8_t TraceReplay::_serve(uint8_t addr, int16_t reg, uint16_t len, uint8_t* rbuf, const uint8_t* wbuf) {
+  const uint64_t now = sim_micros64();
+  if (0 == _t_first) _t_first = now;
+  _t_last = now;
+  if (finished()) {
+    _extra++;
+    return -1;
+  }
+  const bool rx = (nullptr != rbuf);
+  bool match = (rx == (0 != (_rec.flags & I2C_TRACE_FLAG_RX))) && (addr == _rec.addr) && (len == _rec.len);
+  if (0 > reg) {
+    match &= (0 == (_rec.flags & I2C_TRACE_FLAG_REG));
+  }
+  else {
+    match &= (0 != (_rec.flags & I2C_TRACE_FLAG_REG)) && ((uint8_t) reg == _rec.reg);
+  }
+  if (match && !rx && (nullptr != _rec.payload)) {
+    match = (0 == memcmp(wbuf, _rec.payload, len));
+  }
+  if (!match) {
+    if (TRACE_REPLAY_DESCRIBED > _mismatch) {
+      _notes.concatf("Record %u: the trace has a %u-byte %s of 0x%02x:0x%02x, but the driver %s %u bytes at 0x%02x:0x%02x.\n",
+        _index - 1, _rec.len, ((_rec.flags & I2C_TRACE_FLAG_RX) ? "read" : "write"), _rec.addr, _rec.reg,
+        (rx ? "read" : "wrote"), len, addr, (uint8_t) reg
+      );
+    }
+    _mismatch++;
+  }
+  const int8_t ret = (_rec.flags & I2C_TRACE_FLAG_FAULT) ? -1 : 0;
+  if (rx && (0 == ret) && (nullptr != _rec.payload)) {
+    memcpy(rbuf, _rec.payload, (len < _rec.len) ? len : _rec.len);
+  }
+  if (_irq && (_rec.flags & I2C_TRACE_FLAG_IRQ)) {
+    sim_pin_release(_IRQ_PIN);
+    _irq = false;
+  }
+  _served++;
+  _trace_us = _rec_us;
+  _advance();
+  return ret;
+}
+
+
+int8_t TraceReplay::i2cWrite(uint8_t addr, int16_t reg, const uint8_t* buf, uint16_t len) {
+  return _serve(addr, reg, len, nullptr, buf);
+}
+
+
+int8_t TraceReplay::i2cRead(uint8_t addr, int16_t reg, uint8_t* buf, uint16_t len) {
+  return _serve(addr, reg, len, buf, nullptr);
+}
+
+
+void TraceReplay::printResults(StringBuilder* output) {
+  output->concatf("Replayed %u of %u records (%u were the jig's own, and passed over). %s\n",
+    _served, _records, _skipped, (finished() ? "Done." : "The driver stopped short.")
+  );
+  output->concatf("\t%u mismatched, %u transfers past the end, %u IRQs asserted.\n", _mismatch, _extra, _irqs);
+  output->concatf("\tThe trace spans %u us to the last record served. The replay took %u us, first transfer to last.\n",
+    (uint32_t) _trace_us, (uint32_t) (_t_last - _t_first)
+  );
+  if (0 < _notes.length()) {
+    output->concat(&_notes);
+    if (TRACE_REPLAY_DESCRIBED < _mismatch) {
+      output->concatf("...and %u more mismatches.\n", _mismatch - TRACE_REPLAY_DESCRIBED);
+    }
+  }
+}
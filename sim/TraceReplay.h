@@ -0,0 +1,78 @@
+/*
+File:   TraceReplay.h
+Author: J. Ian Lindsay
+Date:   2019.09.20
+
+Stands in for an SX8634 on the simulated bus, answering from an I2C trace
+  taken on the jig (see main/I2CTrace.h).
+
+Each transfer the driver makes is matched against the next of the driver's
+  records in the trace. Records that the jig made on its own are passed over.
+  A read is answered with what the board sent back, and a transfer that failed
+  on the jig fails here too. Writes are compared byte for byte. Anything that
+  doesn't match is counted (the first few are described), and the replay
+  carries on in lockstep, so one difference doesn't throw off the rest.
+
+When the next record is a read of IrqSrc that answered INTB, the IRQ pin is
+  asserted, and it is released once that read is served. In real time, the
+  pin is asserted when the trace says it was. Otherwise, as soon as the driver
+  has caught up to it. The second is for benchmarking driver changes.
+*/
+
+#ifndef __SX8634_TRACE_REPLAY_H__
+#define __SX8634_TRACE_REPLAY_H__
+
+#include <inttypes.h>
+#include <stdint.h>
+#include "SimI2C.h"
+#include "I2CTrace.h"
+
+#define TRACE_REPLAY_DESCRIBED   8   // Mismatches that are described in full.
+
+
+class TraceReplay : public SimI2CTarget {
+  public:
+    TraceReplay(uint8_t irq_pin, bool realtime);
+
+    int8_t load(const uint8_t* buf, uint32_t len);
+    void   poll(uint64_t now_us);
+    inline bool    finished() {     return (0 == _next);   };
+    inline uint8_t address() {      return _first_addr;    };
+    inline uint32_t served() {      return _served;        };
+
+    /* Overrides from SimI2CTarget */
+    int8_t i2cWrite(uint8_t addr, int16_t reg, const uint8_t* buf, uint16_t len);
+    int8_t i2cRead(uint8_t addr, int16_t reg, uint8_t* buf, uint16_t len);
+
+    void printResults(StringBuilder*);
+
+
+  private:
+    const uint8_t* _buf     = nullptr;
+    uint32_t       _len     = 0;
+    uint32_t       _next    = 0;       // Offset of the next driver record (in _rec). Zero at the end.
+    uint32_t       _after   = 0;       // Offset of the record after it.
+    uint32_t       _index   = 0;       // Records read so far.
+    uint32_t       _records = 0;       // ...of this many, as the header has it.
+    uint64_t       _rec_us  = 0;       // Trace time of _rec.
+    I2CTraceRecord _rec;
+    const uint8_t  _IRQ_PIN;
+    const bool     _REALTIME;
+    bool           _irq     = false;   // We are asserting INTB.
+    uint8_t        _first_addr = 0;
+    uint32_t       _served     = 0;    // Transfers answered from the trace.
+    uint32_t       _mismatch   = 0;
+    uint32_t       _extra      = 0;    // Transfers after the trace ran out.
+    uint32_t       _skipped    = 0;    // The jig's own records.
+    uint32_t       _irqs       = 0;
+    uint64_t       _trace_us   = 0;    // Trace time, up to the last record served.
+    uint64_t       _t_start    = 0;
+    uint64_t       _t_first    = 0;    // Host time of the first and last transfers.
+    uint64_t       _t_last     = 0;
+    StringBuilder  _notes;
+
+    void   _advance();
+    int8_t _serve(uint8_t addr, int16_t reg, uint16_t len, uint8_t* rbuf, const uint8_t* wbuf);
+};
+
+#endif  // __SX8634_TRACE_REPLAY_H__
@@ -0,0 +1,208 @@
+/**
+* SX8634 provisioner benchmarks, host build
+*
+* Runs SX8634BitDiddler::runBenchmarks() (the same suite as the 'Z' command)
+*   against the simulated SX8634 and bus, with storage held in RAM, so that the
+*   numbers are for our code and not for the host's disk.
+*
+*   sx8634-bench [calls]
+*
+* Heap allocations are counted by wrapping malloc(), calloc() and realloc() at
+*   link time (see the Makefile), and by routing operator new through them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <Platform/Platform.h>
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+#include <Drivers/SX8634/SX8634.h>
+#include "../main/SX8634BitDiddler.h"
+#include "SX8634Sim.h"
+#include "SimHarness.h"
+#include "SimPins.h"
+#include "LoopWake.h"
+#include "Bench.h"
+
+#define BENCH_BOOT_MS         1000   // For the simulated board to come up.
+#define BENCH_PUMP_QUIET_MS     50   // The pump stops after this long without work.
+#define RAM_STORAGE_KEYS        32
+#define RAM_STORAGE_BYTES    65536   // For any one key.
+
+
+/*******************************************************************************
+* Counting allocations                                                         *
+*******************************************************************************/
+static uint32_t _allocs = 0;
+
+extern "C" {
+  void* __real_malloc(size_t);
+  void* __real_calloc(size_t, size_t);
+  void* __real_realloc(void*, size_t);
+
+  void* __wrap_malloc(size_t n) {              _allocs++;   return __real_malloc(n);      }
+  void* __wrap_calloc(size_t n, size_t s) {    _allocs++;   return __real_calloc(n, s);   }
+  void* __wrap_realloc(void* p, size_t n) {    _allocs++;   return __real_realloc(p, n);  }
+}
+
+void* operator new(size_t n) {      return malloc(n);   }
+void* operator new[](size_t n) {    return malloc(n);   }
+void  operator delete(void* p) noexcept {     free(p);   }
+void  operator delete[](void* p) noexcept {   free(p);   }
+
+static uint32_t _alloc_count() {   return _allocs;   }
+
+
+/*******************************************************************************
+* Storage in RAM                                                               *
+*******************************************************************************/
+class RamStorage : public Storage {
+  public:
+    RamStorage() {
+      memset(_keys, 0, sizeof(_keys));
+      memset(_lens, 0, sizeof(_lens));
+    };
+
+    long freeSpace() {   return (long) (RAM_STORAGE_KEYS - _count) * RAM_STORAGE_BYTES;   };
+
+    int persistentWrite(const char* key, uint8_t* buf, unsigned int len, uint16_t offset) {
+      uint8_t* d = _find(key, true);
+      if ((nullptr == d) || (RAM_STORAGE_BYTES < (offset + len))) return -1;
+      memcpy(d + offset, buf, len);
+      uint32_t* l = &_lens[(d - _data[0]) / RAM_STORAGE_BYTES];
+      if (*l < (offset + len)) *l = offset + len;
+      return (int) len;
+    };
+
+    int persistentRead(const char* key, uint8_t* buf, unsigned int len, uint16_t offset) {
+      uint8_t* d = _find(key, false);
+      if (nullptr == d) return -1;
+      const uint32_t have = _lens[(d - _data[0]) / RAM_STORAGE_BYTES];
+      if (have <= offset) return 0;
+      const uint32_t n = ((have - offset) < len) ? (have - offset) : len;
+      memcpy(buf, d + offset, n);
+      return (int) n;
+    };
+
+
+  private:
+    uint32_t _count = 0;
+    char     _keys[RAM_STORAGE_KEYS][16];
+    uint32_t _lens[RAM_STORAGE_KEYS];
+    uint8_t  _data[RAM_STORAGE_KEYS][RAM_STORAGE_BYTES];
+
+    uint8_t* _find(const char* key, bool create) {
+      for (uint32_t i = 0; i < _count; i++) {
+        if (0 == strncmp(_keys[i], key, 15)) return _data[i];
+      }
+      if (!create || (RAM_STORAGE_KEYS <= _count)) return nullptr;
+      strncpy(_keys[_count], key, 15);
+      return _data[_count++];
+    };
+};
+
+
+/*******************************************************************************
+* The simulated jig                                                            *
+*******************************************************************************/
+const I2CAdapterOptions i2c_opts(
+  0,   // Device number
+  25,  // sda
+  32,  // scl
+  0,   // No pullups.
+  400000
+);
+
+const SX8634Opts sx8634_opts(
+  SX8634_DEFAULT_I2C_ADDR,   // i2c addr
+  33,     // Reset pin
+  17,     // IRQ pin
+  nullptr // sx8634_conf
+);
+
+const uint8_t sx_gpio_pins[8] = { 13, 14, 27, 26, 18, 19, 22, 21 };
+
+static Kernel*     kernel  = nullptr;
+static SimHarness* harness = nullptr;
+
+
+/*
+* One pass of the main loop, as main-sim.cpp has it.
+* @return true if the kernel had anything to do.
+*/
+static bool _loop_pass() {
+  static unsigned long ms_0 = millis();
+  harness->poll();
+  const unsigned long ms_1 = millis();
+  kernel->advanceScheduler(ms_1 - ms_0);
+  ms_0 = ms_1;
+  return (0 != kernel->procIdleFlags());
+}
+
+
+static void _run_for(unsigned long ms) {
+  const unsigned long start = millis();
+  while ((millis() - start) < ms) {
+    if (!_loop_pass()) loop_wake_wait();
+  }
+}
+
+
+/* Runs the loop until it has had nothing to do for a while. */
+static void _pump() {
+  unsigned long quiet_since = millis();
+  while ((millis() - quiet_since) < BENCH_PUMP_QUIET_MS) {
+    if (_loop_pass()) {
+      quiet_since = millis();
+    }
+    else {
+      loop_wake_wait();
+    }
+  }
+}
+
+
+static void _command(SX8634BitDiddler* p, const char* cmd) {
+  StringBuilder line(cmd);
+  line.split(" ");
+  p->consoleCmdProc(&line);
+}
+
+
+/*******************************************************************************
+* Main function                                                                *
+*******************************************************************************/
+int main(int argc, const char* argv[]) {
+  const uint32_t calls = (1 < argc) ? (uint32_t) atoi(argv[1]) : BENCH_ITERATIONS;
+  static RamStorage ram;
+
+  sim_pins_reset();
+  platform.platformPreInit();
+  kernel = platform.kernel();
+  platform.bootstrap();
+
+  SX8634Sim sx(SX8634_DEFAULT_I2C_ADDR, 23, 33, 17, sx_gpio_pins);
+  SimHarness sim;
+  harness = &sim;
+  sim.addChip(0, &sx);
+  kernel->subscribe(&sim);
+
+  I2CAdapter i2c(&i2c_opts);
+  kernel->subscribe(&i2c);
+
+  SX8634BitDiddler provisioner(&i2c, 23, 13, 14, 27, 26, 18, 19, 22, 21, &sx8634_opts);
+  provisioner.useStorage(&ram);
+  kernel->subscribe(&provisioner);
+
+  loop_wake_init(true, 1);
+  _command(&provisioner, "X");
+  _run_for(BENCH_BOOT_MS);
+
+  bench_set_pump(_pump);
+  bench_set_alloc_counter(_alloc_count);
+  StringBuilder output;
+  provisioner.runBenchmarks(&output, ((0 < calls) ? calls : BENCH_ITERATIONS), true);
+  printf("%s", (const char*) output.string());
+  return 0;
+}
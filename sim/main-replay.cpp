@@ -0,0 +1,159 @@
+/**
+* SX8634 I2C trace replay, host build
+*
+* Plays an I2C trace taken on the jig (with the provisioner's 'j' command) back
+*   to a bare SX8634 driver, and reports where the driver's traffic differs
+*   from what the board saw. Also reports how long the driver took to get
+*   through it, for benchmarking driver changes against real traffic.
+*
+*   sx8634-replay <trace file> [-r]
+*
+* The file may be a trace as saved to storage, or a console log that holds the
+*   output of 'J' (only lines with the trace tag are read). With -r, INTB is
+*   asserted when the trace says it was, rather than as soon as the driver is
+*   ready for it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Platform/Platform.h>
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+#include <Drivers/SX8634/SX8634.h>
+#include "I2CTrace.h"
+#include "TraceReplay.h"
+#include "SimI2C.h"
+#include "SimPins.h"
+
+#define REPLAY_RESET_PIN   33
+#define REPLAY_IRQ_PIN     17
+#define REPLAY_IDLE_MS   2000   // With no transfer in this long, the driver is done.
+
+const I2CAdapterOptions i2c_opts(
+  0,   // Device number
+  25,  // sda
+  32,  // scl
+  0,   // No pullups.
+  400000
+);
+
+
+static int _hex_val(char c) {
+  if (('0' <= c) && ('9' >= c)) return c - '0';
+  if (('a' <= c) && ('f' >= c)) return c - 'a' + 10;
+  if (('A' <= c) && ('F' >= c)) return c - 'A' + 10;
+  return -1;
+}
+
+
+/*
+* Takes the hex from every line with the trace tag, in place.
+*
+* @return The number of bytes decoded.
+*/
+static uint32_t _decode_console(uint8_t* buf, uint32_t len) {
+  const uint32_t tag_len = strlen(I2C_TRACE_LINE_TAG);
+  uint32_t out = 0;
+  uint32_t i   = 0;
+  while (i < len) {
+    uint32_t eol = i;
+    while ((eol < len) && ('\n' != buf[eol])) eol++;
+    for (uint32_t n = i; (n + tag_len) <= eol; n++) {
+      if (0 == memcmp(&buf[n], I2C_TRACE_LINE_TAG, tag_len)) {
+        uint32_t h = n + tag_len;
+        while (((h + 1) < eol) && (0 <= _hex_val(buf[h])) && (0 <= _hex_val(buf[h + 1]))) {
+          buf[out++] = (uint8_t) ((_hex_val(buf[h]) << 4) | _hex_val(buf[h + 1]));
+          h += 2;
+        }
+        break;
+      }
+    }
+    i = eol + 1;
+  }
+  return out;
+}
+
+
+static uint8_t* _read_file(const char* path, uint32_t* len) {
+  FILE* f = fopen(path, "rb");
+  if (nullptr == f) return nullptr;
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t* buf = (0 < size) ? (uint8_t*) malloc(size) : nullptr;
+  if (nullptr != buf) {
+    *len = (uint32_t) fread(buf, 1, size, f);
+  }
+  fclose(f);
+  return buf;
+}
+
+
+/*******************************************************************************
+* Main function                                                                *
+*******************************************************************************/
+int main(int argc, const char* argv[]) {
+  if (2 > argc) {
+    printf("Usage: %s <trace file> [-r]\n", argv[0]);
+    return 1;
+  }
+  const bool realtime = (2 < argc) && (0 == strcmp(argv[2], "-r"));
+  uint32_t len = 0;
+  uint8_t* buf = _read_file(argv[1], &len);
+  if (nullptr == buf) {
+    printf("Couldn't read %s.\n", argv[1]);
+    return 1;
+  }
+  if (0 != I2CTrace::checkHeader(buf, len)) {
+    len = _decode_console(buf, len);
+  }
+
+  TraceReplay replay(REPLAY_IRQ_PIN, realtime);
+  switch (replay.load(buf, len)) {
+    case 0:
+      break;
+    case -2:
+      printf("The trace holds nothing for the driver.\n");
+      return 1;
+    default:
+      printf("%s doesn't hold an I2C trace.\n", argv[1]);
+      return 1;
+  }
+
+  sim_pins_reset();
+  platform.platformPreInit();
+  Kernel* kernel = platform.kernel();
+  platform.bootstrap();
+
+  sim_i2c_attach(0, &replay);
+  I2CAdapter i2c(&i2c_opts);
+  kernel->subscribe(&i2c);
+
+  const SX8634Opts opts(replay.address(), REPLAY_RESET_PIN, REPLAY_IRQ_PIN, nullptr);
+  SX8634 touch(&opts);
+  i2c.addSlaveDevice((I2CDevice*) &touch);
+  touch.init();
+
+  unsigned long ms_0    = millis();
+  unsigned long ms_1    = ms_0;
+  unsigned long idle_ms = ms_0;
+  uint32_t served = 0;
+  while (!replay.finished() && ((ms_1 - idle_ms) < REPLAY_IDLE_MS)) {
+    replay.poll(sim_micros64());
+    ms_1 = millis();
+    kernel->advanceScheduler(ms_1 - ms_0);
+    ms_0 = ms_1;
+    kernel->procIdleFlags();
+    if (served != replay.served()) {
+      served  = replay.served();
+      idle_ms = ms_1;
+    }
+  }
+
+  StringBuilder output;
+  replay.printResults(&output);
+  sim_i2c_print(&output);
+  printf("%s", (const char*) output.string());
+  free(buf);
+  return 0;
+}
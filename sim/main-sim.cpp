@@ -0,0 +1,220 @@
+/**
+* SX8634 provisioner, host build
+*
+* This runs the same SX8634BitDiddler that the ESP32 build does, but against a
+*   simulated SX8634 and a simulated jig. The pin numbers below are the same as
+*   the ones in main/main.cpp, so that console sessions transfer directly.
+*
+* The console has two modules: SX8634BitDiddler (the provisioner, as usual) and
+*   SimHarness (to touch buttons, brown out the burn rail, and so on).
+*
+*   sx8634-provisioner-sim [-v [tick us]] [-x "<command>"]... [-s <boards>]
+*
+*   -v  Run on virtual time (see SimClock.h), with an optional tick.
+*   -x  A provisioner console command, run before the loop starts. May be
+*       given more than once. The commands are run in order.
+*   -s  Soak. Implies -v. Each board is swapped for a blank one as it
+*       finishes, and the program exits after this many boards with a report
+*       of the run, the clock, and the kernel (which includes the event pool).
+*       Start a run with -x for this to do anything. For example:
+*         sx8634-provisioner-sim -s 20000 -x "M myblob 20"
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Platform/Platform.h>
+#include <Platform/Peripherals/I2C/I2CAdapter.h>
+#include <XenoSession/Console/ManuvrConsole.h>
+#include <Transports/StandardIO/StandardIO.h>
+#include <Drivers/SX8634/SX8634.h>
+#include "../main/SX8634BitDiddler.h"
+#include "SX8634Sim.h"
+#include "SimHarness.h"
+#include "SimPins.h"
+#include "LoopWake.h"
+#include "LogRing.h"
+
+
+const I2CAdapterOptions i2c_opts(
+  0,   // Device number
+  25,  // sda
+  32,  // scl
+  0,   // No pullups.
+  400000
+);
+
+const I2CAdapterOptions i2c1_opts(
+  1,   // Device number
+  4,   // sda
+  16,  // scl
+  0,   // No pullups.
+  400000
+);
+
+const SX8634Opts sx8634_opts(
+  SX8634_DEFAULT_I2C_ADDR,   // i2c addr
+  33,     // Reset pin
+  17,     // IRQ pin
+  nullptr // sx8634_conf
+);
+
+const SX8634Opts sx8634_opts_slot1(SX8634_DEFAULT_I2C_ADDR,  5, 34, nullptr);
+const SX8634Opts sx8634_opts_slot2(SX8634_DEFAULT_I2C_ADDR, 15, 36, nullptr);
+
+const uint8_t sx_gpio_pins[8] = { 13, 14, 27, 26, 18, 19, 22, 21 };
+
+#define SOAK_STALL_MS   10000   // A soak with no board finished in this long has hung.
+#define SIM_MAX_CMDS       16   // Commands given with -x.
+
+static SX8634Sim* _chips[3];
+
+
+/*
+* Swaps in a blank board for each one that has finished since the last call.
+*   Slot i is fed by chip i.
+*
+* @return The number of boards finished, over all slots.
+*/
+static uint32_t _soak_swap(SX8634BitDiddler* p, uint32_t* done) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < p->slotCount(); i++) {
+    ProvisionerSlot* s = p->slot(i);
+    const uint32_t n = s->passed() + s->failed();
+    if (n != done[i]) {
+      done[i] = n;
+      _chips[i]->swap();
+    }
+    total += n;
+  }
+  return total;
+}
+
+
+/*******************************************************************************
+* Main function                                                                *
+*******************************************************************************/
+int main(int argc, const char* argv[]) {
+  const char* cmds[SIM_MAX_CMDS];
+  uint8_t  cmd_count  = 0;
+  uint32_t soak       = 0;
+  bool     virt       = false;
+  uint32_t tick_us    = SIM_CLOCK_DEFAULT_TICK_US;
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp(argv[i], "-v")) {
+      virt = true;
+      if (((i + 1) < argc) && ('-' != *argv[i + 1])) {
+        tick_us = (uint32_t) atoi(argv[++i]);
+      }
+    }
+    else if ((0 == strcmp(argv[i], "-x")) && ((i + 1) < argc) && (SIM_MAX_CMDS > cmd_count)) {
+      cmds[cmd_count++] = argv[++i];
+    }
+    else if ((0 == strcmp(argv[i], "-s")) && ((i + 1) < argc)) {
+      soak = (uint32_t) atoi(argv[++i]);
+      virt = (0 < soak) || virt;
+    }
+    else {
+      printf("Usage: %s [-v [tick us]] [-x \"<command>\"]... [-s <boards>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  sim_pins_reset();
+  platform.platformPreInit();
+  Kernel* kernel = platform.kernel();
+
+  StandardIO* _console_xport = new StandardIO();
+  ManuvrConsole* _console = new ManuvrConsole((BufferPipe*) _console_xport);
+  kernel->subscribe((EventReceiver*) _console);
+  kernel->subscribe((EventReceiver*) _console_xport);
+  platform.bootstrap();
+
+  SX8634Sim sx(SX8634_DEFAULT_I2C_ADDR, 23, 33, 17, sx_gpio_pins);
+  SX8634Sim sx_slot1(SX8634_DEFAULT_I2C_ADDR,  2,  5, 34, nullptr);
+  SX8634Sim sx_slot2(SX8634_DEFAULT_I2C_ADDR, 12, 15, 36, nullptr);
+  SimHarness harness;
+  harness.addChip(0, &sx);
+  harness.addChip(1, &sx_slot1);
+  harness.addChip(1, &sx_slot2);
+  _chips[0] = &sx;
+  _chips[1] = &sx_slot1;
+  _chips[2] = &sx_slot2;
+  kernel->subscribe(&harness);
+
+  I2CAdapter i2c(&i2c_opts);
+  kernel->subscribe(&i2c);
+  I2CAdapter i2c1(&i2c1_opts);
+  kernel->subscribe(&i2c1);
+
+  SX8634BitDiddler provisioner(&i2c, 23, 13, 14, 27, 26, 18, 19, 22, 21, &sx8634_opts);
+  provisioner.addSlot(&i2c1,  2, nullptr, &sx8634_opts_slot1);
+  provisioner.addSlot(&i2c1, 12, nullptr, &sx8634_opts_slot2);
+  kernel->subscribe(&provisioner);
+
+  /*
+  * The model only advances when it is polled. So the fallback tick here is
+  *   also the resolution of simulated time, and is kept short.
+  */
+  loop_wake_init(true, 1);
+  sim_clock_tick(tick_us);
+  sim_clock_virtual(virt);
+
+  for (uint8_t i = 0; i < cmd_count; i++) {
+    StringBuilder line(cmds[i]);
+    line.split(" ");
+    provisioner.consoleCmdProc(&line);
+  }
+
+  uint32_t done[3]  = { 0, 0, 0 };
+  uint32_t finished = 0;
+  unsigned long ms_0 = millis();
+  unsigned long ms_1 = ms_0;
+  unsigned long progress_ms = ms_0;
+  while ((0 == soak) || (finished < soak)) {
+    harness.poll();
+    ms_1 = millis();
+    kernel->advanceScheduler(ms_1 - ms_0);
+    ms_0 = ms_1;
+    if (0 == kernel->procIdleFlags()) {
+      // Deferred log lines go out when there is nothing else to do.
+      if (0 == log_ring_drain(LOG_RING_DRAIN_BATCH)) {
+        if (sim_clock_is_virtual()) {
+          sim_clock_idle();
+        }
+        else {
+          loop_wake_wait();
+        }
+      }
+    }
+    if (0 < soak) {
+      const uint32_t n = _soak_swap(&provisioner, done);
+      if (n != finished) {
+        finished    = n;
+        progress_ms = ms_1;
+      }
+      else if ((ms_1 - progress_ms) >= SOAK_STALL_MS) {
+        break;
+      }
+    }
+  }
+
+  // Only a soak ends.
+  while (0 < log_ring_drain(LOG_RING_DRAIN_BATCH)) {}
+  StringBuilder output;
+  output.concatf("Soak: %u of %u boards finished.\n", finished, soak);
+  if (finished < soak) {
+    output.concatf("STALLED: No board finished in %u simulated ms.\n", SOAK_STALL_MS);
+  }
+  provisioner.printSlots(&output);
+  sim_clock_print(&output);
+  kernel->printDebug(&output);
+  printf("%s", (const char*) output.string());
+
+  uint32_t failed = 0;
+  for (uint8_t i = 0; i < provisioner.slotCount(); i++) {
+    failed += provisioner.slot(i)->failed();
+  }
+  return ((finished < soak) || (0 < failed)) ? 1 : 0;
+}
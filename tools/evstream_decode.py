@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#
+# Decodes a touch event stream captured from the provisioner's console.
+# Author: J. Ian Lindsay
+#
+# With the `b 1` console command, SX8634BitDiddler sends touch events as
+#   batches of CBOR (see main/EventStream.h). Log text can be mixed in with
+#   them. Capture the serial port to a file, and then:
+#
+#   tools/evstream_decode.py capture.bin > events.csv
+#
+# The CapSense monitor (`a` and `A 1`) sends windows of per-channel statistics
+#   the same way (see main/CapMonitor.h). To get those instead of events:
+#
+#   tools/evstream_decode.py --cap capture.bin > capsense.csv
+#
+# Each batch starts with the self-described CBOR tag (0xD9 0xD9 0xF7). Anything
+#   between batches is skipped. Output is CSV, with absolute times in us.
+
+import sys
+
+MARKER = b"\xd9\xd9\xf7"
+TYPES  = ["press", "release", "slider", "gpi", "long_press", "double_tap", "chord", "swipe"]
+BREAK  = object()
+
+
+class Truncated(Exception):
+    pass
+
+
+def read_item(buf, pos):
+    """Returns (item, next position). Only the parts of CBOR that the stream uses."""
+    if pos >= len(buf):
+        raise Truncated()
+    ib    = buf[pos]
+    major = ib >> 5
+    info  = ib & 0x1F
+    pos  += 1
+    if 0xFF == ib:
+        return BREAK, pos
+    if 24 > info:
+        val = info
+    elif 28 > info:
+        n = 1 << (info - 24)
+        if pos + n > len(buf):
+            raise Truncated()
+        val = int.from_bytes(buf[pos:pos + n], "big")
+        pos += n
+    elif 31 == info:
+        val = None
+    else:
+        raise ValueError("bad additional info 0x%02x" % ib)
+
+    if 0 == major:
+        return val, pos
+    if 1 == major:
+        return -1 - val, pos
+    if 4 == major:
+        items = []
+        while (val is None) or (len(items) < val):
+            item, pos = read_item(buf, pos)
+            if item is BREAK:
+                if val is None:
+                    break
+                raise ValueError("unexpected break")
+            items.append(item)
+        return items, pos
+    if 6 == major:
+        return read_item(buf, pos)
+    raise ValueError("unexpected major type %d" % major)
+
+
+def batches(buf):
+    pos = buf.find(MARKER)
+    while 0 <= pos:
+        try:
+            batch, end = read_item(buf, pos)
+        except Truncated:
+            return
+        except ValueError as e:
+            sys.stderr.write("Skipping bad batch at offset %d: %s\n" % (pos, e))
+            end = pos + len(MARKER)
+        else:
+            yield batch
+        pos = buf.find(MARKER, end)
+
+
+def is_cap_frame(batch):
+    """Monitor frames hold plain numbers where event batches hold events."""
+    return (4 == len(batch)) and not isinstance(batch[1], list) and isinstance(batch[3], list)
+
+
+def print_cap(buf):
+    print("t_us,slot,sweeps,chan,diff_mean,diff_var,diff_min,diff_max,useful_mean,avg_mean")
+    count = 0
+    for batch in batches(buf):
+        if not is_cap_frame(batch):
+            continue
+        t, slot, sweeps, chans = batch
+        for (i, stats) in enumerate(chans):
+            print("%d,%d,%d,%d,%s" % (t, slot, sweeps, i, ",".join(str(x) for x in stats)))
+        count += 1
+    sys.stderr.write("%d windows\n" % count)
+
+
+def main():
+    args = sys.argv[1:]
+    cap  = "--cap" in args
+    args = [a for a in args if "--cap" != a]
+    path = args[0] if args else None
+    buf  = open(path, "rb").read() if path else sys.stdin.buffer.read()
+    if cap:
+        print_cap(buf)
+        return
+    print("t_us,type,slot,arg,value")
+    count = 0
+    for batch in batches(buf):
+        if is_cap_frame(batch):
+            continue
+        t = batch[0]
+        for (dt, kind, slot, arg, value) in batch[1:]:
+            t += dt
+            name = TYPES[kind] if kind < len(TYPES) else str(kind)
+            print("%d,%s,%d,%d,%d" % (t, name, slot, arg, value))
+            count += 1
+    sys.stderr.write("%d events\n" % count)
+
+
+if __name__ == "__main__":
+    main()